@@ -0,0 +1,506 @@
+#pragma once
+
+#include "model_loader.h"
+#include "import_memory.h"
+#include "mesh_convert.h"
+#include "mesh_optimize.h"
+#include "light_clusters.h"
+#include "material_luts.h"
+#include "mesh_clusters.h"
+#include "obj_parser.h"
+#include "parallel.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Offline measurement modes selected from the command line. None of these
+// open a window or touch GL.
+namespace Benchmarks {
+
+inline double median(std::vector<double> samples) {
+    if (samples.empty()) return 0.0;
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+struct ConvertRun {
+    double ms = 0.0;
+    size_t bytesReserved = 0;
+};
+
+template <typename ConvertFn>
+ConvertRun timeConversion(const aiScene* scene, ConvertFn convert, std::vector<Vertex>* keepVertices = nullptr,
+                          std::vector<unsigned int>* keepIndices = nullptr) {
+    ConvertRun run;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int m = 0; m < scene->mNumMeshes; ++m) {
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        convert(scene->mMeshes[m], vertices, indices);
+        run.bytesReserved += vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int);
+        if (keepVertices) keepVertices->insert(keepVertices->end(), vertices.begin(), vertices.end());
+        if (keepIndices) keepIndices->insert(keepIndices->end(), indices.begin(), indices.end());
+    }
+    run.ms = millisecondsSince(start);
+    return run;
+}
+
+// Compares the original push_back conversion against MeshConvert::convertMesh
+// on already-imported scenes, so Assimp parse time is excluded from both.
+inline int runConvertBenchmark(const std::vector<std::string>& paths, int iterations) {
+    std::cout << "🏁 processMesh conversion benchmark (" << iterations << " iterations, median)" << std::endl;
+    printf("%-28s %10s %10s %10s %10s %8s %10s %10s\n", "model", "vertices", "indices",
+           "ref ms", "fast ms", "speedup", "ref MB", "fast MB");
+
+    bool allMatch = true;
+    for (const std::string& path : paths) {
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+        if (!scene || !scene->mRootNode) {
+            std::cout << "⚠️ Skipping " << path << ": " << importer.GetErrorString() << std::endl;
+            continue;
+        }
+
+        std::vector<Vertex> refVertices, fastVertices;
+        std::vector<unsigned int> refIndices, fastIndices;
+        timeConversion(scene, MeshConvert::convertMeshReference, &refVertices, &refIndices);
+        timeConversion(scene, MeshConvert::convertMesh, &fastVertices, &fastIndices);
+
+        bool match = refIndices == fastIndices && refVertices.size() == fastVertices.size() &&
+                     memcmp(refVertices.data(), fastVertices.data(), refVertices.size() * sizeof(Vertex)) == 0;
+        allMatch = allMatch && match;
+
+        std::vector<double> refTimes, fastTimes;
+        ConvertRun refRun, fastRun;
+        for (int i = 0; i < iterations; ++i) {
+            refRun = timeConversion(scene, MeshConvert::convertMeshReference);
+            fastRun = timeConversion(scene, MeshConvert::convertMesh);
+            refTimes.push_back(refRun.ms);
+            fastTimes.push_back(fastRun.ms);
+        }
+
+        double refMs = median(refTimes);
+        double fastMs = median(fastTimes);
+        printf("%-28s %10zu %10zu %10.2f %10.2f %7.2fx %10.1f %10.1f%s\n", path.c_str(), fastVertices.size(),
+               fastIndices.size(), refMs, fastMs, fastMs > 0.0 ? refMs / fastMs : 0.0,
+               refRun.bytesReserved / (1024.0 * 1024.0), fastRun.bytesReserved / (1024.0 * 1024.0),
+               match ? "" : "  ❌ MISMATCH");
+    }
+
+    return allMatch ? 0 : 1;
+}
+
+struct ParseRun {
+    bool ok = false;
+    double ms = 0.0;
+    size_t peakBytes = 0;
+    size_t vertices = 0;
+    size_t triangles = 0;
+};
+
+template <typename ImportFn>
+ParseRun timeImport(ImportFn importFn) {
+    ParseRun run;
+    ImportMemory::resetPeakRss();
+    size_t baseline = ImportMemory::readRss().current;
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<LoadedMesh> meshes;
+        run.ok = importFn(meshes);
+        run.ms = millisecondsSince(start);
+        size_t peak = ImportMemory::readRss().peak;
+        run.peakBytes = peak - std::min(baseline, peak);
+        for (const LoadedMesh& mesh : meshes) {
+            run.vertices += mesh.vertices.size();
+            run.triangles += mesh.indices.size() / 3;
+        }
+    }
+    return run;
+}
+
+// Source file to Vertex/index arrays: Assimp ReadFile plus processNode against
+// ObjParser::load. Peak RSS is measured above the RSS before each run, and
+// includes the file pages mapped in while parsing. Assimp emits one vertex
+// per face corner for OBJ, ObjParser one per distinct v/vt/vn tuple, so only
+// the triangle counts have to agree.
+inline int runObjParseBenchmark(const std::vector<std::string>& paths, int iterations) {
+    std::cout << "🏁 OBJ parse benchmark (" << iterations << " iterations, median; " << workerCount()
+              << " threads)" << std::endl;
+    printf("%-28s %8s %10s %10s %10s %11s %11s %10s %10s %10s\n", "model", "MB", "triangles", "assimp ms",
+           "native ms", "assimp MB/s", "native MB/s", "assimp RSS", "native RSS", "native vtx");
+
+    bool allMatch = true;
+    for (const std::string& path : paths) {
+        std::error_code ec;
+        uintmax_t fileBytes = std::filesystem::file_size(path, ec);
+        if (ec) {
+            std::cout << "⚠️ Skipping " << path << ": " << ec.message() << std::endl;
+            continue;
+        }
+
+        auto assimpImport = [&](std::vector<LoadedMesh>& meshes) {
+            Assimp::Importer importer;
+            const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+            if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) return false;
+            processNode(scene->mRootNode, scene, meshes);
+            return true;
+        };
+        std::string nativeError;
+        auto nativeImport = [&](std::vector<LoadedMesh>& meshes) {
+            std::vector<ObjParser::MeshData> parsed;
+            if (!ObjParser::load(path, parsed, nativeError)) return false;
+            for (ObjParser::MeshData& data : parsed) {
+                LoadedMesh mesh;
+                mesh.vertices.swap(data.vertices);
+                mesh.indices.swap(data.indices);
+                meshes.push_back(std::move(mesh));
+            }
+            return true;
+        };
+
+        std::vector<double> assimpTimes, nativeTimes;
+        ParseRun assimpRun, nativeRun;
+        size_t assimpPeak = 0, nativePeak = 0;
+        for (int i = 0; i < iterations; ++i) {
+            assimpRun = timeImport(assimpImport);
+            nativeRun = timeImport(nativeImport);
+            if (!assimpRun.ok || !nativeRun.ok) break;
+            assimpTimes.push_back(assimpRun.ms);
+            nativeTimes.push_back(nativeRun.ms);
+            assimpPeak = std::max(assimpPeak, assimpRun.peakBytes);
+            nativePeak = std::max(nativePeak, nativeRun.peakBytes);
+        }
+        if (!nativeRun.ok) {
+            std::cout << "⚠️ " << path << ": native parser failed: " << nativeError << std::endl;
+            allMatch = false;
+            continue;
+        }
+        if (!assimpRun.ok) {
+            std::cout << "⚠️ Skipping " << path << ": Assimp could not import it" << std::endl;
+            continue;
+        }
+
+        bool match = assimpRun.triangles == nativeRun.triangles;
+        allMatch = allMatch && match;
+        double megabytes = double(fileBytes) / (1024.0 * 1024.0);
+        double assimpMs = median(assimpTimes);
+        double nativeMs = median(nativeTimes);
+        printf("%-28s %8.1f %10zu %10.1f %10.1f %11.1f %11.1f %9.0fM %9.0fM %10zu%s\n", path.c_str(), megabytes,
+               nativeRun.triangles, assimpMs, nativeMs, assimpMs > 0.0 ? megabytes * 1000.0 / assimpMs : 0.0,
+               nativeMs > 0.0 ? megabytes * 1000.0 / nativeMs : 0.0, assimpPeak / (1024.0 * 1024.0),
+               nativePeak / (1024.0 * 1024.0), nativeRun.vertices, match ? "" : "  ❌ TRIANGLE MISMATCH");
+    }
+
+    return allMatch ? 0 : 1;
+}
+
+struct OrbitModel {
+    std::string name;
+    std::string path;
+    glm::mat4 model;
+    glm::vec3 target;
+    float distance;
+};
+
+// Loads each model the way the demo does (mesh cache, native OBJ, optimize,
+// LODs, clusters) and steps the camera around the autoRotate orbit: 2 units
+// above the target at the model's viewing distance. Per angle it reports how
+// many LOD 0 clusters the frustum and normal cones reject and the triangles
+// that saves, plus the median culling time.
+inline int runClusterBenchmark(const std::vector<OrbitModel>& orbitModels, const glm::mat4& projection,
+                               int iterations, int angles = 12) {
+    std::cout << "🧩 Cluster culling over the auto-rotate orbit (" << angles << " angles, " << iterations
+              << " iterations, median; " << workerCount() << " threads)" << std::endl;
+
+    for (const OrbitModel& orbit : orbitModels) {
+        LoaderSettings settings;
+        ModelLoadResult result;
+        {
+            ModelLoader loader(settings);
+            loader.enqueue(orbit.path);
+            while (!loader.poll(result)) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (!result.success) {
+            std::cout << "⚠️ Skipping " << orbit.path << ": " << result.error << std::endl;
+            continue;
+        }
+
+        size_t clusteredMeshes = 0, clusterCount = 0;
+        for (const LoadedMesh& mesh : result.meshes) {
+            if (mesh.clusters.empty()) continue;
+            clusteredMeshes++;
+            clusterCount += mesh.clusters.size();
+        }
+        std::cout << "\n" << orbit.name << " (" << orbit.path << "): " << clusteredMeshes << "/" << result.meshes.size()
+                  << " meshes clustered, " << clusterCount << " clusters" << (result.fromCache ? " (cached)" : "")
+                  << std::endl;
+        if (clusterCount == 0) continue;
+        printf("%8s %8s %10s %10s %10s %12s %12s %8s %8s %8s\n", "angle", "orbit s", "frustum", "backface", "visible",
+               "triangles", "drawn", "saved", "ranges", "ms");
+
+        MeshClusters::Culler culler;
+        double savedSum = 0.0;
+        for (int step = 0; step < angles; ++step) {
+            float angle = 2.0f * 3.14159265f * float(step) / float(angles);
+            glm::vec3 camera = orbit.target + glm::vec3(std::sin(angle) * orbit.distance, 2.0f,
+                                                        std::cos(angle) * orbit.distance);
+            glm::mat4 view = glm::lookAt(camera, orbit.target, glm::vec3(0, 1, 0));
+            Frustum frustum = Frustum::fromViewProjection(projection * view);
+            MeshClusters::View clusterView = MeshClusters::objectSpaceView(frustum, camera, orbit.model);
+
+            std::vector<double> times;
+            for (int i = 0; i < iterations; ++i) {
+                culler.begin();
+                for (const LoadedMesh& mesh : result.meshes) {
+                    if (!mesh.clusters.empty()) culler.add(mesh.clusters, clusterView);
+                }
+                culler.run();
+                times.push_back(culler.stats().ms);
+            }
+
+            const MeshClusters::Stats& s = culler.stats();
+            size_t visible = s.tested - s.frustumCulled - s.backfaceCulled;
+            double saved = s.trianglesTested ? 100.0 * double(s.trianglesCulled) / double(s.trianglesTested) : 0.0;
+            savedSum += saved;
+            // autoRotate advances the angle by 0.3 radians per second
+            printf("%7.0f° %8.1f %10zu %10zu %10zu %12zu %12zu %7.1f%% %8zu %8.3f\n", glm::degrees(angle),
+                   angle / 0.3f, s.frustumCulled, s.backfaceCulled, visible, s.trianglesTested,
+                   s.trianglesTested - s.trianglesCulled, saved, s.ranges, median(times));
+        }
+        printf("%-8s %8s %10s %10s %10s %12s %12s %7.1f%%\n", "mean", "", "", "", "", "", "", savedSum / angles);
+    }
+    return 0;
+}
+
+struct NamedMeshes {
+    std::string name;
+    std::vector<LoadedMesh> meshes;
+};
+
+inline bool importMeshes(const std::string& path, std::vector<LoadedMesh>& out) {
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        std::cout << "⚠️ Skipping " << path << ": " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+    processNode(scene->mRootNode, scene, out);
+    return true;
+}
+
+// ACMR (cache misses per triangle) and ATVR (misses per vertex, 1.0 is ideal)
+// for a 16-entry FIFO before and after MeshOptimize::reorderMesh. Both columns
+// are measured on the welded mesh so they isolate the reordering; the optimize
+// time covers welding and reordering.
+inline int runMeshStats(std::vector<NamedMeshes>& sets) {
+    std::cout << "📐 Vertex cache statistics (FIFO " << MeshOptimize::CACHE_SIZE << ")" << std::endl;
+    printf("%-20s %8s %10s %10s %10s %10s %10s %12s\n", "model", "meshes", "triangles",
+           "ACMR old", "ACMR new", "ATVR old", "ATVR new", "optimize ms");
+
+    for (NamedMeshes& set : sets) {
+        MeshOptimize::CacheStats before, after;
+        auto start = std::chrono::steady_clock::now();
+        double optimizeMs = 0.0;
+
+        for (LoadedMesh& mesh : set.meshes) {
+            start = std::chrono::steady_clock::now();
+            MeshOptimize::weldVertices(mesh.vertices, mesh.indices);
+            optimizeMs += millisecondsSince(start);
+
+            before.add(MeshOptimize::analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size()));
+
+            start = std::chrono::steady_clock::now();
+            MeshOptimize::reorderMesh(mesh.vertices, mesh.indices);
+            optimizeMs += millisecondsSince(start);
+
+            after.add(MeshOptimize::analyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size()));
+        }
+
+        printf("%-20s %8zu %10zu %10.3f %10.3f %10.3f %10.3f %12.1f\n", set.name.c_str(), set.meshes.size(),
+               before.triangles, before.acmr, after.acmr, before.atvr, after.atvr, optimizeMs);
+    }
+    return 0;
+}
+
+// Sweeps the light count from 4 to maxLights for a fixed Sponza view. Reports
+// binning time single- and multi-threaded and how many lights a fragment
+// evaluates on average (light refs per lit cluster) against the brute-force N.
+inline int runLightBenchmark(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane,
+                             size_t maxLights, int iterations) {
+    std::cout << "💡 Clustered light binning benchmark (" << LightGrid::TILES_X << "x" << LightGrid::TILES_Y << "x"
+              << LightGrid::SLICES << " clusters, " << iterations << " iterations, median)" << std::endl;
+    printf("%8s %10s %10s %8s %12s %10s %10s\n", "lights", "1T ms", "MT ms", "speedup", "lit clusters",
+           "avg/frag", "max/frag");
+
+    LightGrid grid;
+    grid.configure(projection, nearPlane, farPlane);
+    std::vector<PointLight> lights;
+    for (size_t count = 4; count <= maxLights; count *= 2) {
+        animateLights(lights, count, 0.0f);
+
+        std::vector<double> serialTimes, parallelTimes;
+        for (int i = 0; i < iterations; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            grid.build(lights, view, false);
+            serialTimes.push_back(millisecondsSince(start));
+
+            start = std::chrono::steady_clock::now();
+            grid.build(lights, view, true);
+            parallelTimes.push_back(millisecondsSince(start));
+        }
+
+        double serialMs = median(serialTimes);
+        double parallelMs = median(parallelTimes);
+        size_t lit = grid.occupiedClusterCount();
+        double average = lit > 0 ? double(grid.lightIndices().size()) / lit : 0.0;
+        printf("%8zu %10.3f %10.3f %7.2fx %12zu %10.1f %10u\n", count, serialMs, parallelMs,
+               parallelMs > 0.0 ? serialMs / parallelMs : 0.0, lit, average, grid.maxLightsPerCluster());
+    }
+    return 0;
+}
+
+// CPU copies of calculateDisneySSS / calculateEnhancedSSS (analytic) and
+// lutDisneySSS / lutEnhancedSSS (tables) from the forward shader, per unit
+// light colour
+struct ShadingSample {
+    glm::vec3 N, L, V;
+};
+
+inline glm::vec3 analyticShading(const UniformBlocks::Material& m, const ShadingSample& s) {
+    const float pi = 3.14159265f;
+    glm::vec3 albedo(0.8f, 0.6f, 0.5f);
+    float NdotL = std::max(glm::dot(s.N, s.L), 0.0f);
+    float NdotV = std::max(glm::dot(s.N, s.V), 0.0f);
+
+    glm::vec3 disney(0.0f);
+    if (NdotL > 0.0f && NdotV > 0.0f) {
+        float HdotL = std::max(glm::dot(glm::normalize(s.L + s.V), s.L), 0.0f);
+        float sqrtAlpha = std::sqrt(m.internalColor.w * m.internalColor.w);
+        float fl = std::pow(1.0f - NdotL, 5.0f), fv = std::pow(1.0f - NdotV, 5.0f);
+        float FD90 = 0.5f + 2.0f * sqrtAlpha * HdotL * HdotL;
+        float fd = (1.0f + (FD90 - 1.0f) * fl) * (1.0f + (FD90 - 1.0f) * fv);
+        float FSS90 = sqrtAlpha * HdotL * HdotL;
+        float FSS = (1.0f + (FSS90 - 1.0f) * fl) * (1.0f + (FSS90 - 1.0f) * fv);
+        float fss = (1.0f / (NdotL * NdotV) - 0.5f) * FSS + 0.5f;
+        float kss = m.params.x;
+        disney = NdotL * NdotV * (albedo / pi) * ((1.0f - kss) * fd + 1.25f * kss * fss);
+    }
+
+    MaterialLuts::MaterialTint t = MaterialLuts::tintFor(m);
+    float wrap = m.scattering.w;
+    glm::vec3 H = glm::normalize(s.L + s.N * wrap);
+    float VdotH = std::max(0.0f, glm::dot(-s.V, H));
+    float transmission = std::pow(VdotH, 3.0f) * m.absorption.w * t.multiplier;
+    glm::vec3 enhanced = (glm::vec3(m.scattering) * MaterialLuts::wrappedDiffuse(glm::dot(s.N, s.L), wrap) * t.tint +
+                          glm::vec3(m.internalColor) * transmission * t.tint) * MaterialLuts::absorptionTerm(m);
+    return disney * 0.06f + enhanced * 0.94f;
+}
+
+inline glm::vec3 lutShading(const UniformBlocks::Material& m, const std::vector<glm::vec4>& scatter,
+                            const std::vector<glm::vec4>& schlick, const ShadingSample& s, float curvature) {
+    const float pi = 3.14159265f;
+    glm::vec3 albedo(0.8f, 0.6f, 0.5f);
+    float NdotL = std::max(glm::dot(s.N, s.L), 0.0f);
+    float NdotV = std::max(glm::dot(s.N, s.V), 0.0f);
+
+    glm::vec3 disney(0.0f);
+    if (NdotL > 0.0f && NdotV > 0.0f) {
+        float HdotL = std::max(glm::dot(glm::normalize(s.L + s.V), s.L), 0.0f);
+        glm::vec4 w = MaterialLuts::sample(schlick, MaterialLuts::SCHLICK_SIZE, NdotL, NdotV);
+        float roughness = m.internalColor.w;
+        float kd = 2.0f * roughness * HdotL * HdotL - 0.5f;
+        float ks = roughness * HdotL * HdotL - 1.0f;
+        float fd = 1.0f + kd * w.x + kd * kd * w.y;
+        float FSS = 1.0f + ks * w.x + ks * ks * w.y;
+        float nn = NdotL * NdotV;
+        float kss = m.params.x;
+        disney = (albedo / pi) * ((1.0f - kss) * nn * fd + 1.25f * kss * ((1.0f - 0.5f * nn) * FSS + 0.5f * nn));
+    }
+
+    glm::vec3 scattered = glm::vec3(MaterialLuts::sample(scatter, MaterialLuts::SCATTER_SIZE,
+                                                         glm::dot(s.N, s.L) * 0.5f + 0.5f, curvature));
+    glm::vec3 H = glm::normalize(s.L + s.N * m.scattering.w);
+    float VdotH = std::max(0.0f, glm::dot(-s.V, H));
+    glm::vec3 enhanced = scattered + MaterialLuts::transmissionColor(m) * (VdotH * VdotH * VdotH);
+    return disney * 0.06f + enhanced * 0.94f;
+}
+
+// Builds each preset's tables serially and in parallel, checks the cache
+// round-trip, and compares the table path against the analytic path on random
+// flat-surface samples (curvature 0, where both should agree up to filtering).
+// The last column is how far the max-curvature row moves away from flat.
+inline int runMaterialLutComparison(int iterations, size_t samples = 100000) {
+    std::cout << "🧮 Material LUT comparison (" << MaterialLuts::SCATTER_SIZE << "x" << MaterialLuts::SCATTER_SIZE
+              << " scatter, " << MaterialLuts::SCHLICK_SIZE << "x" << MaterialLuts::SCHLICK_SIZE << " Schlick, "
+              << samples << " samples, " << iterations << " iterations, median)" << std::endl;
+    printf("%-10s %8s %8s %8s %6s %10s %10s %10s %10s\n", "material", "1T ms", "MT ms", "load ms", "cache",
+           "max err", "mean err", "rel err", "curv dev");
+
+    const char* names[UniformBlocks::MATERIAL_COUNT] = {"Skin", "Marble", "Wax", "Jade"};
+    std::vector<glm::vec4> schlick;
+    MaterialLuts::buildSchlickLut(schlick);
+
+    for (int preset = 0; preset < UniformBlocks::MATERIAL_COUNT; ++preset) {
+        const UniformBlocks::Material& m = UniformBlocks::MATERIAL_PRESETS[preset];
+        std::vector<glm::vec4> scatter, reloaded;
+        std::vector<double> serialTimes, parallelTimes;
+        for (int i = 0; i < iterations; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            MaterialLuts::buildScatterLut(m, scatter, false);
+            serialTimes.push_back(millisecondsSince(start));
+
+            start = std::chrono::steady_clock::now();
+            MaterialLuts::buildScatterLut(m, scatter, true);
+            parallelTimes.push_back(millisecondsSince(start));
+        }
+
+        std::string path = MaterialLuts::cachePathFor(m);
+        MaterialLuts::writeScatterLut(path, m, scatter);
+        auto start = std::chrono::steady_clock::now();
+        bool cacheOk = MaterialLuts::readScatterLut(path, m, reloaded) && reloaded == scatter;
+        double loadMs = millisecondsSince(start);
+
+        std::mt19937 rng(1234u + preset);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        auto randomDirection = [&]() {
+            glm::vec3 v;
+            do v = glm::vec3(unit(rng), unit(rng), unit(rng));
+            while (glm::dot(v, v) > 1.0f || glm::dot(v, v) < 1e-4f);
+            return glm::normalize(v);
+        };
+
+        double maxError = 0.0, sumError = 0.0, sumReference = 0.0;
+        for (size_t i = 0; i < samples; ++i) {
+            ShadingSample s = {randomDirection(), randomDirection(), randomDirection()};
+            glm::vec3 reference = analyticShading(m, s);
+            glm::vec3 error = glm::abs(lutShading(m, scatter, schlick, s, 0.0f) - reference);
+            double channelMax = std::max(error.x, std::max(error.y, error.z));
+            maxError = std::max(maxError, channelMax);
+            sumError += (error.x + error.y + error.z) / 3.0;
+            sumReference += (reference.x + reference.y + reference.z) / 3.0;
+        }
+
+        double curvatureDeviation = 0.0;
+        for (int x = 0; x < MaterialLuts::SCATTER_SIZE; ++x) {
+            glm::vec4 flat = scatter[x];
+            glm::vec4 curved = scatter[(MaterialLuts::SCATTER_SIZE - 1) * MaterialLuts::SCATTER_SIZE + x];
+            glm::vec3 delta = glm::abs(glm::vec3(curved - flat));
+            curvatureDeviation = std::max<double>(curvatureDeviation, std::max(delta.x, std::max(delta.y, delta.z)));
+        }
+
+        printf("%-10s %8.2f %8.2f %8.3f %6s %10.2e %10.2e %9.3f%% %10.3f\n", names[preset], median(serialTimes),
+               median(parallelTimes), loadMs, cacheOk ? "ok" : "FAIL", maxError, sumError / samples,
+               sumReference > 0.0 ? 100.0 * sumError / sumReference : 0.0, curvatureDeviation);
+        if (!cacheOk) return 1;
+    }
+    return 0;
+}
+
+}
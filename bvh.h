@@ -0,0 +1,261 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+struct Aabb {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    Aabb() = default;
+    Aabb(const glm::vec3& lo, const glm::vec3& hi) : min(lo), max(hi) {}
+
+    void grow(const glm::vec3& p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void grow(const Aabb& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    bool empty() const { return min.x > max.x; }
+    glm::vec3 center() const { return 0.5f * (min + max); }
+
+    float surfaceArea() const {
+        if (empty()) return 0.0f;
+        glm::vec3 e = max - min;
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+};
+
+// Bounds of a transformed box, from the transformed centre and the absolute
+// value of the matrix applied to the half extents (Arvo).
+inline Aabb transformAabb(const Aabb& box, const glm::mat4& m) {
+    glm::vec3 center = glm::vec3(m * glm::vec4(box.center(), 1.0f));
+    glm::vec3 half = 0.5f * (box.max - box.min);
+    glm::vec3 extent = glm::abs(glm::vec3(m[0])) * half.x + glm::abs(glm::vec3(m[1])) * half.y +
+                       glm::abs(glm::vec3(m[2])) * half.z;
+    return Aabb(center - extent, center + extent);
+}
+
+struct Frustum {
+    enum Result { Outside, Intersecting, Inside };
+
+    glm::vec4 planes[6];
+
+    // Gribb/Hartmann plane extraction; normals point into the frustum
+    static Frustum fromViewProjection(const glm::mat4& vp) {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; ++i) {
+            rows[i] = glm::vec4(vp[0][i], vp[1][i], vp[2][i], vp[3][i]);
+        }
+
+        Frustum f;
+        for (int i = 0; i < 3; ++i) {
+            f.planes[i * 2 + 0] = rows[3] + rows[i];
+            f.planes[i * 2 + 1] = rows[3] - rows[i];
+        }
+        for (glm::vec4& p : f.planes) {
+            p /= glm::length(glm::vec3(p));
+        }
+        return f;
+    }
+
+    Result classify(const Aabb& box) const {
+        glm::vec3 center = box.center();
+        glm::vec3 half = 0.5f * (box.max - box.min);
+        Result result = Inside;
+        for (const glm::vec4& p : planes) {
+            glm::vec3 n = glm::vec3(p);
+            float distance = glm::dot(n, center) + p.w;
+            float radius = glm::dot(glm::abs(n), half);
+            if (distance + radius < 0.0f) return Outside;
+            if (distance - radius < 0.0f) result = Intersecting;
+        }
+        return result;
+    }
+};
+
+struct CullStats {
+    size_t nodesVisited = 0;
+    size_t itemsTested = 0;
+    size_t itemsVisible = 0;
+};
+
+// Binned-SAH bounding volume hierarchy over a flat list of boxes. Nodes are
+// 32 bytes in one array with siblings adjacent, and each leaf owns a
+// contiguous run of the item permutation.
+class Bvh {
+public:
+    struct Node {
+        glm::vec3 boundsMin;
+        uint32_t leftFirst;    // first child for inner nodes, first item for leaves
+        glm::vec3 boundsMax;
+        uint32_t count;        // 0 for inner nodes
+    };
+    static_assert(sizeof(Node) == 32, "BVH nodes should pack two per cache line");
+
+    static const uint32_t MAX_LEAF_ITEMS = 4;
+    static const int BIN_COUNT = 8;
+    static const int MAX_DEPTH = 48;
+
+    void build(const std::vector<Aabb>& bounds) {
+        itemBounds = bounds;
+        items.resize(bounds.size());
+        for (uint32_t i = 0; i < items.size(); ++i) items[i] = i;
+
+        nodes.clear();
+        if (bounds.empty()) return;
+        nodes.reserve(bounds.size() * 2);
+        nodes.push_back(Node{glm::vec3(0.0f), 0, glm::vec3(0.0f), uint32_t(bounds.size())});
+        updateBounds(0);
+        subdivide(0, 0);
+    }
+
+    size_t itemCount() const { return items.size(); }
+    size_t nodeCount() const { return nodes.size(); }
+
+    // Calls visit(item) for every item whose box touches the frustum. Subtrees
+    // entirely inside are emitted without further plane tests.
+    template <typename Visit>
+    void cull(const Frustum& frustum, CullStats& stats, Visit visit) const {
+        if (nodes.empty()) return;
+
+        struct Entry {
+            uint32_t node;
+            bool inside;
+        };
+        Entry stack[MAX_DEPTH + 2];
+        int top = 0;
+        stack[top++] = {0, false};
+
+        while (top > 0) {
+            Entry entry = stack[--top];
+            const Node& node = nodes[entry.node];
+            bool inside = entry.inside;
+
+            if (!inside) {
+                stats.nodesVisited++;
+                Frustum::Result result = frustum.classify(Aabb(node.boundsMin, node.boundsMax));
+                if (result == Frustum::Outside) continue;
+                inside = result == Frustum::Inside;
+            }
+
+            if (node.count == 0) {
+                stack[top++] = {node.leftFirst + 1, inside};
+                stack[top++] = {node.leftFirst, inside};
+                continue;
+            }
+
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                uint32_t item = items[i];
+                if (!inside) {
+                    stats.itemsTested++;
+                    if (frustum.classify(itemBounds[item]) == Frustum::Outside) continue;
+                }
+                stats.itemsVisible++;
+                visit(item);
+            }
+        }
+    }
+
+private:
+    std::vector<Node> nodes;
+    std::vector<uint32_t> items;
+    std::vector<Aabb> itemBounds;
+
+    void updateBounds(uint32_t nodeIndex) {
+        Node& node = nodes[nodeIndex];
+        Aabb box;
+        for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+            box.grow(itemBounds[items[i]]);
+        }
+        node.boundsMin = box.min;
+        node.boundsMax = box.max;
+    }
+
+    // Returns the split position on the centroid axis, or false for a leaf
+    bool findSplit(const Node& node, int& axis, float& split) const {
+        Aabb centroids;
+        for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+            centroids.grow(itemBounds[items[i]].center());
+        }
+
+        float bestCost = std::numeric_limits<float>::max();
+        for (int a = 0; a < 3; ++a) {
+            float lo = centroids.min[a], hi = centroids.max[a];
+            if (hi <= lo) continue;
+
+            Aabb binBounds[BIN_COUNT];
+            uint32_t binCounts[BIN_COUNT] = {};
+            float scale = BIN_COUNT / (hi - lo);
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                const Aabb& box = itemBounds[items[i]];
+                int bin = std::min(BIN_COUNT - 1, int((box.center()[a] - lo) * scale));
+                binCounts[bin]++;
+                binBounds[bin].grow(box);
+            }
+
+            // Sweep from both ends to price every plane between bins
+            float leftArea[BIN_COUNT - 1], rightArea[BIN_COUNT - 1];
+            uint32_t leftCount[BIN_COUNT - 1], rightCount[BIN_COUNT - 1];
+            Aabb leftBox, rightBox;
+            uint32_t leftSum = 0, rightSum = 0;
+            for (int i = 0; i < BIN_COUNT - 1; ++i) {
+                leftSum += binCounts[i];
+                leftBox.grow(binBounds[i]);
+                leftCount[i] = leftSum;
+                leftArea[i] = leftBox.surfaceArea();
+
+                rightSum += binCounts[BIN_COUNT - 1 - i];
+                rightBox.grow(binBounds[BIN_COUNT - 1 - i]);
+                rightCount[BIN_COUNT - 2 - i] = rightSum;
+                rightArea[BIN_COUNT - 2 - i] = rightBox.surfaceArea();
+            }
+
+            for (int i = 0; i < BIN_COUNT - 1; ++i) {
+                float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+                if (leftCount[i] > 0 && rightCount[i] > 0 && cost < bestCost) {
+                    bestCost = cost;
+                    axis = a;
+                    split = lo + (i + 1) / scale;
+                }
+            }
+        }
+
+        float leafCost = node.count * Aabb(node.boundsMin, node.boundsMax).surfaceArea();
+        return bestCost < std::numeric_limits<float>::max() && (bestCost < leafCost || node.count > MAX_LEAF_ITEMS * 4);
+    }
+
+    void subdivide(uint32_t nodeIndex, int depth) {
+        if (nodes[nodeIndex].count <= MAX_LEAF_ITEMS || depth >= MAX_DEPTH) return;
+
+        int axis = 0;
+        float split = 0.0f;
+        if (!findSplit(nodes[nodeIndex], axis, split)) return;
+
+        Node& node = nodes[nodeIndex];
+        uint32_t first = node.leftFirst;
+        uint32_t* mid = std::partition(items.data() + first, items.data() + first + node.count,
+                                       [&](uint32_t item) { return itemBounds[item].center()[axis] < split; });
+        uint32_t leftCount = uint32_t(mid - (items.data() + first));
+        if (leftCount == 0 || leftCount == node.count) return;
+
+        uint32_t leftIndex = uint32_t(nodes.size());
+        uint32_t count = node.count;
+        nodes.push_back(Node{glm::vec3(0.0f), first, glm::vec3(0.0f), leftCount});
+        nodes.push_back(Node{glm::vec3(0.0f), first + leftCount, glm::vec3(0.0f), count - leftCount});
+        nodes[nodeIndex].leftFirst = leftIndex;
+        nodes[nodeIndex].count = 0;
+
+        updateBounds(leftIndex);
+        updateBounds(leftIndex + 1);
+        subdivide(leftIndex, depth + 1);
+        subdivide(leftIndex + 1, depth + 1);
+    }
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "gl_counter.h"
+#include "geometry_pool.h"
+#include "shader_cache.h"
+#include "uniform_blocks.h"
+#include <GL/glew.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace DepthPrepassShaders {
+
+// Must transform positions exactly like sexyVertexShader (same expression
+// order, same variant defines, invariant gl_Position) or GL_EQUAL will reject
+// shaded fragments.
+const char* const vertex = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in uint aDrawId;
+
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 camPosTime;
+    vec4 clusterScale;
+    vec4 clusterDims;
+    mat4 previousViewProjection;
+    vec4 temporal;
+};
+
+uniform samplerBuffer drawData;
+uniform int drawIdBase;
+
+invariant gl_Position;
+
+mat4 fetchMatrix(int texel) {
+    return mat4(texelFetch(drawData, texel), texelFetch(drawData, texel + 1),
+                texelFetch(drawData, texel + 2), texelFetch(drawData, texel + 3));
+}
+
+void main() {
+    int drawId = int(aDrawId) + drawIdBase;
+    mat4 model = fetchMatrix(drawId * 11);
+    mat4 positionDecode = fetchMatrix(drawId * 11 + 4);
+
+    vec3 worldPos = vec3(model * (positionDecode * vec4(aPos, 1.0)));
+#ifdef PER_VERTEX_NORMAL_MATRIX
+    gl_Position = projection * view * vec4(worldPos, 1.0);
+#else
+    gl_Position = viewProjection * vec4(worldPos, 1.0);
+#endif
+}
+)";
+
+}
+
+// Depth-only pass drawn before the shading pass. The shading pass then runs
+// with GL_EQUAL and depth writes off, so the SSS fragment shader executes at
+// most once per visible sample regardless of draw order.
+class DepthPrepass {
+public:
+    // defines must match the shading program's vertex shader variant
+    bool create(const std::vector<std::string>& defines = {}) {
+        program = linkProgram(DepthPrepassShaders::vertex, nullptr, {}, defines);
+        if (!program) return false;
+
+        drawIdBase = glGetUniformLocation(program, "drawIdBase");
+        UniformBlocks::bindBlock(program, "FrameData", UniformBlocks::FRAME_BINDING);
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "drawData"), DrawBatcher::DRAW_DATA_UNIT);
+        glUseProgram(0);
+        return true;
+    }
+
+    // Binds the depth program with color writes masked off
+    void begin() {
+        GL_COUNT(glUseProgram(program));
+        GL_COUNT(glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE));
+    }
+
+    // Restores color writes and switches to equal-depth testing for shading
+    void beginShading() {
+        GL_COUNT(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+        GL_COUNT(glDepthFunc(GL_EQUAL));
+        GL_COUNT(glDepthMask(GL_FALSE));
+    }
+
+    // Back to default state; also ends a depth-only pass with no shading after it
+    void end() {
+        GL_COUNT(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+        GL_COUNT(glDepthFunc(GL_LESS));
+        GL_COUNT(glDepthMask(GL_TRUE));
+    }
+
+    GLint drawIdBaseLocation() const { return drawIdBase; }
+
+private:
+    GLuint program = 0;
+    GLint drawIdBase = -1;
+};
+
+// GL_SAMPLES_PASSED queries around the shading draws, read back a few frames
+// late so the CPU never waits on them. A frame may count several segments
+// (e.g. both Hi-Z phases) so passes in between are left out of the total.
+class SampleCounter {
+public:
+    static const int RING = 4;
+    static const int MAX_SEGMENTS = 2;
+
+    void create() {
+        glGenQueries(RING * MAX_SEGMENTS, &queries[0][0]);
+    }
+
+    void begin() {
+        GL_COUNT(glBeginQuery(GL_SAMPLES_PASSED, queries[head][segments[head]]));
+    }
+
+    void end() {
+        GL_COUNT(glEndQuery(GL_SAMPLES_PASSED));
+        segments[head]++;
+    }
+
+    void endFrame() {
+        if (segments[head] == 0) return;
+        head = (head + 1) % RING;
+        segments[head] = 0;
+        if (pending < RING - 1) pending++;
+    }
+
+    // Returns true and the oldest finished frame's total if one is available
+    bool poll(uint64_t& samples) {
+        if (pending == 0) return false;
+        int oldest = (head + RING - pending) % RING;
+        for (int s = 0; s < segments[oldest]; ++s) {
+            GLuint available = 0;
+            GL_COUNT(glGetQueryObjectuiv(queries[oldest][s], GL_QUERY_RESULT_AVAILABLE, &available));
+            if (!available) return false;
+        }
+        samples = 0;
+        for (int s = 0; s < segments[oldest]; ++s) {
+            GLuint64 result = 0;
+            GL_COUNT(glGetQueryObjectui64v(queries[oldest][s], GL_QUERY_RESULT, &result));
+            samples += result;
+        }
+        pending--;
+        return true;
+    }
+
+    // Drops in-flight results, e.g. after switching modes
+    void reset() {
+        pending = 0;
+        segments[head] = 0;
+    }
+
+private:
+    GLuint queries[RING][MAX_SEGMENTS] = {};
+    int segments[RING] = {};
+    int head = 0;
+    int pending = 0;
+};
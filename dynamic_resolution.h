@@ -0,0 +1,239 @@
+#pragma once
+
+#include "gl_counter.h"
+#include "render_target.h"
+#include "shader_cache.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+// Real frame deltas for animation and input. Deltas are clamped so a stall
+// (loading, a debugger, window drag) doesn't teleport the camera.
+class FrameClock {
+public:
+    static constexpr float MAX_DELTA = 0.1f;
+
+    // Call once per frame; returns seconds since the previous call
+    float tick() {
+        auto now = std::chrono::steady_clock::now();
+        float seconds = started ? std::chrono::duration<float>(now - last).count() : 1.0f / 60.0f;
+        last = now;
+        started = true;
+        delta = std::min(seconds, MAX_DELTA);
+        smoothedMs = smoothedMs > 0.0 ? 0.95 * smoothedMs + 0.05 * seconds * 1000.0 : seconds * 1000.0;
+        return delta;
+    }
+
+    float getDelta() const { return delta; }
+    double getSmoothedMs() const { return smoothedMs; }
+
+private:
+    std::chrono::steady_clock::time_point last;
+    bool started = false;
+    float delta = 1.0f / 60.0f;
+    double smoothedMs = 0.0;
+};
+
+// Chooses the scene render scale from measured GPU time of the scene pass.
+// GPU time is read from GL_TIMESTAMP pairs a few frames late, so it never
+// blocks and doesn't collide with other timer queries. Scales are quantized
+// and changes are spaced out, since each change reallocates the SceneTarget.
+class ResolutionController {
+public:
+    static constexpr float MIN_SCALE = 0.5f;
+    static constexpr float MAX_SCALE = 1.0f;
+    static constexpr float STEP = 0.05f;
+    static const int COOLDOWN_FRAMES = 20;
+    static const int RING = 3;
+
+    void create() {
+        glGenQueries(RING * 2, &queries[0][0]);
+    }
+
+    void setAdaptive(bool on) {
+        adaptive = on;
+        cooldown = COOLDOWN_FRAMES;
+    }
+
+    void setBudgetMs(double ms) { budgetMs = std::max(1.0, ms); }
+    void setScale(float s) { scale = quantize(s); }
+
+    bool isAdaptive() const { return adaptive; }
+    double getBudgetMs() const { return budgetMs; }
+    float getScale() const { return scale; }
+    double getGpuMs() const { return gpuMs; }
+
+    void beginFrame() {
+        poll();
+        GL_COUNT(glQueryCounter(queries[head][0], GL_TIMESTAMP));
+    }
+
+    void endFrame() {
+        GL_COUNT(glQueryCounter(queries[head][1], GL_TIMESTAMP));
+        issued[head] = true;
+        head = (head + 1) % RING;
+    }
+
+private:
+    GLuint queries[RING][2] = {};
+    bool issued[RING] = {};
+    int head = 0;
+    bool adaptive = false;
+    double budgetMs = 16.0;
+    double gpuMs = 0.0;
+    float scale = MAX_SCALE;
+    int cooldown = 0;
+
+    static float quantize(float s) {
+        return std::clamp(std::floor(s / STEP + 0.5f) * STEP, MIN_SCALE, MAX_SCALE);
+    }
+
+    // Reads finished frames oldest first and updates the scale. After endFrame()
+    // head is the oldest slot, which beginFrame() is about to reuse.
+    void poll() {
+        for (int k = 0; k < RING; ++k) {
+            int slot = (head + k) % RING;
+            if (!issued[slot]) continue;
+            GLuint available = 0;
+            GL_COUNT(glGetQueryObjectuiv(queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available));
+            if (!available) break;
+
+            GLuint64 begin = 0, end = 0;
+            GL_COUNT(glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &begin));
+            GL_COUNT(glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &end));
+            issued[slot] = false;
+            double ms = double(end - begin) * 1e-6;
+            gpuMs = gpuMs > 0.0 ? 0.9 * gpuMs + 0.1 * ms : ms;
+            adjust();
+        }
+    }
+
+    // Cost scales with pixel count, i.e. scale squared, so the scale that
+    // would just meet the budget is scale * sqrt(budget / measured). Step down
+    // as far as needed, but only up by one step and only with 20% headroom.
+    void adjust() {
+        if (!adaptive || gpuMs <= 0.0) return;
+        if (cooldown > 0) {
+            cooldown--;
+            return;
+        }
+
+        float ideal = scale * float(std::sqrt(budgetMs / gpuMs));
+        float next = scale;
+        if (gpuMs > budgetMs) {
+            next = std::min(quantize(ideal), scale - STEP);
+        } else if (gpuMs < 0.8 * budgetMs && ideal >= scale + STEP) {
+            next = scale + STEP;
+        }
+        next = quantize(next);
+        if (next == scale) return;
+
+        gpuMs *= double(next * next) / double(scale * scale);
+        scale = next;
+        cooldown = COOLDOWN_FRAMES;
+    }
+};
+
+namespace UpscaleShaders {
+
+// Bilinear upscale plus a contrast-limited sharpen: the centre is pushed
+// away from its 4-neighbour average and clamped to the neighbourhood's range
+// so edges don't ring.
+const char* const fragment = R"(
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D source;
+uniform vec2 outputSize;
+uniform float sharpness;
+
+void main() {
+    vec2 uv = gl_FragCoord.xy / outputSize;
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+    vec3 c = texture(source, uv).rgb;
+    vec3 n = texture(source, uv + vec2(0.0, texel.y)).rgb;
+    vec3 s = texture(source, uv - vec2(0.0, texel.y)).rgb;
+    vec3 e = texture(source, uv + vec2(texel.x, 0.0)).rgb;
+    vec3 w = texture(source, uv - vec2(texel.x, 0.0)).rgb;
+
+    vec3 lo = min(c, min(min(n, s), min(e, w)));
+    vec3 hi = max(c, max(max(n, s), max(e, w)));
+    vec3 sharpened = c + sharpness * (c - 0.25 * (n + s + e + w));
+    FragColor = vec4(clamp(sharpened, lo, hi), 1.0);
+}
+)";
+
+}
+
+// Presents the scene target to the window. At native size that's the usual
+// MSAA resolve blit; below it the target is resolved into a texture and
+// drawn to the window through the upscale/sharpen shader.
+class UpscalePass {
+public:
+    static const GLuint SOURCE_UNIT = 0;
+
+    bool create() {
+        program = linkProgram(fullscreenTriangleVertex, UpscaleShaders::fragment);
+        if (!program) return false;
+        outputSizeLocation = glGetUniformLocation(program, "outputSize");
+        sharpnessLocation = glGetUniformLocation(program, "sharpness");
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "source"), SOURCE_UNIT);
+        glUseProgram(0);
+        glGenVertexArrays(1, &emptyVao);
+        return true;
+    }
+
+    void present(SceneTarget& target, int windowWidth, int windowHeight, float sharpness) {
+        if (!program || (target.getWidth() == windowWidth && target.getHeight() == windowHeight)) {
+            target.resolveToScreen();
+            return;
+        }
+
+        resize(target.getWidth(), target.getHeight());
+        target.resolveColor(fbo);
+
+        GL_COUNT(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+        GL_COUNT(glViewport(0, 0, windowWidth, windowHeight));
+        GL_COUNT(glDisable(GL_DEPTH_TEST));
+        GL_COUNT(glUseProgram(program));
+        GL_COUNT(glUniform2f(outputSizeLocation, float(windowWidth), float(windowHeight)));
+        GL_COUNT(glUniform1f(sharpnessLocation, sharpness));
+        GL_COUNT(glActiveTexture(GL_TEXTURE0 + SOURCE_UNIT));
+        GL_COUNT(glBindTexture(GL_TEXTURE_2D, texture));
+        GL_COUNT(glBindVertexArray(emptyVao));
+        GL_COUNT(glDrawArrays(GL_TRIANGLES, 0, 3));
+        GL_COUNT(glBindVertexArray(0));
+        GL_COUNT(glEnable(GL_DEPTH_TEST));
+    }
+
+private:
+    GLuint program = 0;
+    GLint outputSizeLocation = -1;
+    GLint sharpnessLocation = -1;
+    GLuint emptyVao = 0;
+    GLuint fbo = 0;
+    GLuint texture = 0;
+    int width = 0;
+    int height = 0;
+
+    void resize(int newWidth, int newHeight) {
+        if (newWidth == width && newHeight == height && fbo) return;
+        width = newWidth;
+        height = newHeight;
+        if (!fbo) {
+            glGenFramebuffers(1, &fbo);
+            glGenTextures(1, &texture);
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    }
+};
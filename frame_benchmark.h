@@ -0,0 +1,247 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Scripted, reproducible frame-time measurement: every shot (one model with
+// one material) replays the same camera path and light clock. CPU time covers
+// frame submission, GPU time comes from GL_TIME_ELAPSED queries read back
+// after the shot, so timing never stalls the pipeline mid-shot.
+namespace FrameBenchmark {
+
+struct Settings {
+    int warmupFrames = 10;
+    int frames = 120;
+    std::string outputPrefix = "benchmark";
+    std::string baselinePath;
+    // A percentile regresses if it exceeds baseline * (1 + tolerance) + NOISE_FLOOR_MS
+    double tolerance = 0.10;
+};
+
+const double NOISE_FLOOR_MS = 0.05;
+
+struct Percentiles {
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+// Nearest-rank percentiles
+inline Percentiles summarize(std::vector<double> samples) {
+    Percentiles p;
+    if (samples.empty()) return p;
+    std::sort(samples.begin(), samples.end());
+    auto rank = [&](double q) {
+        size_t index = size_t(std::ceil(q * samples.size()));
+        return samples[std::min(samples.size(), std::max<size_t>(index, 1)) - 1];
+    };
+    double sum = 0.0;
+    for (double s : samples) sum += s;
+    p.mean = sum / samples.size();
+    p.p50 = rank(0.50);
+    p.p90 = rank(0.90);
+    p.p95 = rank(0.95);
+    p.p99 = rank(0.99);
+    p.max = samples.back();
+    return p;
+}
+
+struct Shot {
+    std::string name;
+    std::vector<double> cpuMs;
+    std::vector<double> gpuMs;
+    Percentiles cpu;
+    Percentiles gpu;
+};
+
+// One full orbit per shot with a slow dolly in and out, so LOD selection and
+// culling see the same sequence of distances every run. Light time advances
+// at a fixed 60 Hz.
+struct CameraPose {
+    float angle;
+    float distanceScale;
+    float time;
+};
+
+inline CameraPose poseAt(int frame, int frames) {
+    float t = float(frame) / float(std::max(frames, 1));
+    const float twoPi = 6.28318530718f;
+    return {twoPi * t, 1.0f + 0.35f * std::sin(twoPi * t), float(frame) / 60.0f};
+}
+
+// One GL_TIME_ELAPSED query per frame of a shot
+class GpuTimer {
+public:
+    ~GpuTimer() {
+        if (!queries.empty()) glDeleteQueries(GLsizei(queries.size()), queries.data());
+    }
+
+    void create(int frames) {
+        queries.resize(size_t(frames));
+        glGenQueries(GLsizei(frames), queries.data());
+    }
+
+    void begin(int frame) { glBeginQuery(GL_TIME_ELAPSED, queries[size_t(frame)]); }
+    void end() { glEndQuery(GL_TIME_ELAPSED); }
+
+    // Blocks until every query of the shot has a result
+    void read(std::vector<double>& ms) {
+        ms.resize(queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &ns);
+            ms[i] = double(ns) * 1e-6;
+        }
+    }
+
+private:
+    std::vector<GLuint> queries;
+};
+
+inline bool writeCsv(const std::string& path, const std::vector<Shot>& shots) {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << "shot,frame,cpu_ms,gpu_ms\n";
+    for (const Shot& shot : shots) {
+        for (size_t i = 0; i < shot.cpuMs.size(); ++i) {
+            out << '"' << shot.name << "\"," << i << ',' << shot.cpuMs[i] << ','
+                << (i < shot.gpuMs.size() ? shot.gpuMs[i] : 0.0) << '\n';
+        }
+    }
+    return bool(out);
+}
+
+inline void writePercentiles(std::ostream& out, const char* key, const Percentiles& p) {
+    out << "\"" << key << "\": {\"mean\": " << p.mean << ", \"p50\": " << p.p50 << ", \"p90\": " << p.p90
+        << ", \"p95\": " << p.p95 << ", \"p99\": " << p.p99 << ", \"max\": " << p.max << "}";
+}
+
+// config is a list of already-quoted "key": value pairs
+inline bool writeJson(const std::string& path, const std::vector<Shot>& shots,
+                      const std::vector<std::string>& config) {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << "{\n  \"config\": {";
+    for (size_t i = 0; i < config.size(); ++i) {
+        out << (i ? ", " : "") << config[i];
+    }
+    out << "},\n  \"shots\": [\n";
+    for (size_t i = 0; i < shots.size(); ++i) {
+        const Shot& shot = shots[i];
+        out << "    {\"name\": \"" << shot.name << "\", \"frames\": " << shot.cpuMs.size() << ", ";
+        writePercentiles(out, "cpu_ms", shot.cpu);
+        out << ", ";
+        writePercentiles(out, "gpu_ms", shot.gpu);
+        out << "}" << (i + 1 < shots.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return bool(out);
+}
+
+// Reads back what writeJson produced: shots in order, each with a "name"
+// followed by its cpu_ms and gpu_ms objects. Not a general JSON parser.
+struct BaselineShot {
+    std::string name;
+    Percentiles cpu;
+    Percentiles gpu;
+};
+
+inline bool readNumber(const std::string& text, size_t from, size_t to, const char* key, double& value) {
+    size_t pos = text.find(std::string("\"") + key + "\"", from);
+    if (pos == std::string::npos || pos >= to) return false;
+    pos = text.find(':', pos);
+    if (pos == std::string::npos || pos >= to) return false;
+    value = strtod(text.c_str() + pos + 1, nullptr);
+    return true;
+}
+
+inline bool readPercentiles(const std::string& text, size_t from, size_t to, const char* key, Percentiles& p) {
+    size_t pos = text.find(std::string("\"") + key + "\"", from);
+    if (pos == std::string::npos || pos >= to) return false;
+    size_t close = text.find('}', pos);
+    if (close == std::string::npos || close > to) return false;
+    return readNumber(text, pos, close, "mean", p.mean) && readNumber(text, pos, close, "p50", p.p50) &&
+           readNumber(text, pos, close, "p90", p.p90) && readNumber(text, pos, close, "p95", p.p95) &&
+           readNumber(text, pos, close, "p99", p.p99) && readNumber(text, pos, close, "max", p.max);
+}
+
+inline bool readBaseline(const std::string& path, std::vector<BaselineShot>& shots) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string text = buffer.str();
+
+    const std::string nameKey = "\"name\": \"";
+    size_t pos = text.find(nameKey);
+    while (pos != std::string::npos) {
+        size_t nameStart = pos + nameKey.size();
+        size_t nameEnd = text.find('"', nameStart);
+        if (nameEnd == std::string::npos) return false;
+        size_t next = text.find(nameKey, nameEnd);
+        size_t end = next == std::string::npos ? text.size() : next;
+
+        BaselineShot shot;
+        shot.name = text.substr(nameStart, nameEnd - nameStart);
+        if (!readPercentiles(text, nameEnd, end, "cpu_ms", shot.cpu) ||
+            !readPercentiles(text, nameEnd, end, "gpu_ms", shot.gpu)) {
+            return false;
+        }
+        shots.push_back(shot);
+        pos = next;
+    }
+    return !shots.empty();
+}
+
+// Compares p50 and p95 of both timers per shot. Returns the number of
+// regressions, or -1 if the baseline couldn't be read.
+inline int compareToBaseline(const std::string& path, const std::vector<Shot>& shots, double tolerance) {
+    std::vector<BaselineShot> baseline;
+    if (!readBaseline(path, baseline)) {
+        std::cerr << "❌ Could not read benchmark baseline " << path << std::endl;
+        return -1;
+    }
+
+    std::cout << "📏 Regression check against " << path << " (tolerance " << tolerance * 100.0 << "% + "
+              << NOISE_FLOOR_MS << " ms)" << std::endl;
+    printf("%-36s %-8s %10s %10s %9s  %s\n", "shot", "metric", "baseline", "current", "change", "");
+
+    int regressions = 0;
+    for (const Shot& shot : shots) {
+        auto it = std::find_if(baseline.begin(), baseline.end(),
+                               [&](const BaselineShot& b) { return b.name == shot.name; });
+        if (it == baseline.end()) {
+            printf("%-36s %-8s %10s %10s %9s  %s\n", shot.name.c_str(), "-", "-", "-", "-", "not in baseline");
+            continue;
+        }
+
+        struct Metric {
+            const char* name;
+            double base;
+            double current;
+        };
+        const Metric metrics[] = {{"cpu p50", it->cpu.p50, shot.cpu.p50}, {"cpu p95", it->cpu.p95, shot.cpu.p95},
+                                  {"gpu p50", it->gpu.p50, shot.gpu.p50}, {"gpu p95", it->gpu.p95, shot.gpu.p95}};
+        for (const Metric& m : metrics) {
+            bool regressed = m.current > m.base * (1.0 + tolerance) + NOISE_FLOOR_MS;
+            double change = m.base > 0.0 ? 100.0 * (m.current - m.base) / m.base : 0.0;
+            printf("%-36s %-8s %10.3f %10.3f %8.1f%%  %s\n", shot.name.c_str(), m.name, m.base, m.current, change,
+                   regressed ? "REGRESSED" : "ok");
+            if (regressed) regressions++;
+        }
+    }
+    return regressions;
+}
+
+}
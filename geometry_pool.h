@@ -0,0 +1,479 @@
+#pragma once
+
+#include "gl_counter.h"
+#include "mesh.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+// Scene-wide geometry storage. Every mesh is a range of one shared vertex
+// buffer plus a range of either the 16-bit or the 32-bit index buffer, so a
+// pass binds at most two VAOs no matter how many meshes were loaded. Positions
+// are also copied into a tightly packed stream for depth-only passes.
+class GeometryPool {
+public:
+    // Highest draw ID a batch can address; sized so the per-draw texture
+    // buffer (11 texels per draw) stays within GL 3.3's guaranteed 65536 texels.
+    static const size_t MAX_DRAWS = 65536 / 11;
+    static const GLuint DRAW_ID_ATTRIBUTE = 3;
+
+    void create(VertexFormat vertexFormat) {
+        format = vertexFormat;
+        vertexSize = format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+        positionSize = format == VertexFormat::Packed ? sizeof(PackedVertex::Position) : sizeof(Vertex::Position);
+
+        // Identity table read through an instanced attribute: with baseInstance
+        // set to the draw's index, aDrawId comes out as that index.
+        std::vector<uint32_t> drawIds(MAX_DRAWS);
+        std::iota(drawIds.begin(), drawIds.end(), 0u);
+        glGenBuffers(1, &drawIdBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+        glBufferData(GL_ARRAY_BUFFER, drawIds.size() * sizeof(uint32_t), drawIds.data(), GL_STATIC_DRAW);
+
+        for (IndexStream& stream : streams) {
+            glGenVertexArrays(1, &stream.vao);
+            glGenVertexArrays(1, &stream.depthVao);
+        }
+    }
+
+    // Copies one mesh into the pool and records where it landed. Buffers grow
+    // by doubling; growth copies on the GPU with glCopyBufferSubData.
+    void add(Mesh& mesh, const void* vertexData, size_t vertexCount, const void* indexData, size_t indexCount,
+             GLenum indexType) {
+        IndexStream& stream = streamFor(indexType);
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+
+        bool verticesMoved = reserve(vertices, (vertexCount + vertexUsed) * vertexSize);
+        verticesMoved = reserve(positions, (vertexCount + vertexUsed) * positionSize) || verticesMoved;
+        bool indicesMoved = reserve(stream.indices, (indexCount + stream.used) * indexSize);
+        if (verticesMoved) {
+            for (IndexStream& s : streams) s.dirty = true;
+        }
+        stream.dirty = stream.dirty || indicesMoved;
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vertices.id);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, vertexUsed * vertexSize, vertexCount * vertexSize, vertexData);
+
+        // Position is the first member of both layouts
+        positionScratch.resize(vertexCount * positionSize);
+        const uint8_t* src = static_cast<const uint8_t*>(vertexData);
+        for (size_t v = 0; v < vertexCount; ++v) {
+            memcpy(&positionScratch[v * positionSize], src + v * vertexSize, positionSize);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, positions.id);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, vertexUsed * positionSize, positionScratch.size(), positionScratch.data());
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, stream.indices.id);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, stream.used * indexSize, indexCount * indexSize, indexData);
+
+        mesh.format = format;
+        mesh.indexType = indexType;
+        mesh.indexCount = GLsizei(indexCount);
+        mesh.baseVertex = GLint(vertexUsed);
+        mesh.firstIndex = GLuint(stream.used);
+        mesh.gpuBytes = vertexCount * vertexSize + indexCount * indexSize;
+
+        vertexUsed += vertexCount;
+        stream.used += indexCount;
+    }
+
+    // Binds the VAO for an index type, re-pointing attributes first if a
+    // buffer was reallocated since the last bind. The depth-only VAO reads
+    // the position stream and draw ID and nothing else.
+    bool bind(GLenum indexType, bool depthOnly = false) {
+        IndexStream& stream = streamFor(indexType);
+        if (stream.indices.id == 0 || vertices.id == 0) return false;
+        if (stream.dirty) {
+            setupVertexArray(stream);
+            stream.dirty = false;
+        }
+        GL_COUNT(glBindVertexArray(depthOnly ? stream.depthVao : stream.vao));
+        return true;
+    }
+
+    size_t bytesUsed() const {
+        return vertexUsed * (vertexSize + positionSize) + streams[0].used * sizeof(uint16_t) +
+               streams[1].used * sizeof(uint32_t);
+    }
+
+private:
+    struct GrowableBuffer {
+        GLuint id = 0;
+        size_t capacity = 0;
+    };
+
+    struct IndexStream {
+        GLuint vao = 0;
+        GLuint depthVao = 0;
+        GrowableBuffer indices;
+        size_t used = 0;
+        bool dirty = true;
+    };
+
+    VertexFormat format = VertexFormat::Float;
+    size_t vertexSize = sizeof(Vertex);
+    size_t positionSize = sizeof(Vertex::Position);
+    GrowableBuffer vertices;
+    GrowableBuffer positions;
+    std::vector<uint8_t> positionScratch;
+    size_t vertexUsed = 0;
+    IndexStream streams[2];
+    GLuint drawIdBuffer = 0;
+
+    IndexStream& streamFor(GLenum indexType) {
+        return indexType == GL_UNSIGNED_SHORT ? streams[0] : streams[1];
+    }
+
+    // Returns true if the buffer object was replaced
+    static bool reserve(GrowableBuffer& buffer, size_t bytes) {
+        if (bytes <= buffer.capacity) return false;
+
+        size_t capacity = std::max<size_t>(buffer.capacity * 2, 1 << 20);
+        while (capacity < bytes) capacity *= 2;
+
+        GLuint grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STATIC_DRAW);
+        if (buffer.id) {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer.id);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, buffer.capacity);
+            glDeleteBuffers(1, &buffer.id);
+        }
+        buffer.id = grown;
+        buffer.capacity = capacity;
+        return true;
+    }
+
+    void setupVertexArray(IndexStream& stream) {
+        glBindVertexArray(stream.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vertices.id);
+
+        if (format == VertexFormat::Packed) {
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+        } else {
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+        glEnableVertexAttribArray(DRAW_ID_ATTRIBUTE);
+        glVertexAttribIPointer(DRAW_ID_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void*)0);
+        glVertexAttribDivisor(DRAW_ID_ATTRIBUTE, 1);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, stream.indices.id);
+
+        // Same position format as above so both passes produce identical depth
+        glBindVertexArray(stream.depthVao);
+        glBindBuffer(GL_ARRAY_BUFFER, positions.id);
+        glEnableVertexAttribArray(0);
+        if (format == VertexFormat::Packed) {
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, GLsizei(positionSize), (void*)0);
+        } else {
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, GLsizei(positionSize), (void*)0);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+        glEnableVertexAttribArray(DRAW_ID_ATTRIBUTE);
+        glVertexAttribIPointer(DRAW_ID_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void*)0);
+        glVertexAttribDivisor(DRAW_ID_ATTRIBUTE, 1);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, stream.indices.id);
+        glBindVertexArray(0);
+    }
+};
+
+// Collects one frame's draws and submits them as at most one multi-draw per
+// index type. Per-draw model, decode and normal matrices go to a texture
+// buffer the vertex shader indexes by draw ID. A command may cover several
+// consecutive draw IDs as instances of one mesh, or several commands may share
+// one draw ID when an instance is drawn as a set of cluster ranges.
+class DrawBatcher {
+public:
+    static const GLuint DRAW_DATA_UNIT = 0;
+    static const uint32_t INVALID_DRAW = ~0u;
+
+    // Matches DrawElementsIndirectCommand
+    struct IndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // 11 texels per draw; the normal matrix is a mat3 stored as three vec4 columns
+    struct DrawData {
+        glm::mat4 model;
+        glm::mat4 positionDecode;
+        glm::vec4 normalMatrix[3];
+    };
+    static_assert(sizeof(DrawData) == 11 * sizeof(glm::vec4), "vertex shaders index draw data as drawId * 11");
+
+    // Consecutive commands of one index type that share a surface; first
+    // counts from the start of that type's commands
+    struct DrawRun {
+        GLenum indexType;
+        uint32_t surface;
+        size_t first;
+        size_t count;
+    };
+
+    // Binds a surface's textures and state before its run is drawn; returning
+    // false skips the run
+    using SurfaceBinder = std::function<bool(uint32_t surface)>;
+
+    void create() {
+        // aDrawId comes from each command's baseInstance, which is reserved (must be
+        // zero) without GL 4.2 or ARB_base_instance
+        multiDrawIndirect = (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect) &&
+                            (GLEW_VERSION_4_2 || GLEW_ARB_base_instance);
+        glGenBuffers(1, &indirectBuffer);
+        glGenBuffers(1, &drawDataBuffer);
+        glGenTextures(1, &drawDataTexture);
+        std::cout << (multiDrawIndirect ? "🧱 Geometry pool: glMultiDrawElementsIndirect"
+                                        : "🧱 Geometry pool: no multi-draw indirect, one draw per mesh from a shared VAO")
+                  << std::endl;
+    }
+
+    void begin() {
+        drawData.clear();
+        for (int t = 0; t < 2; ++t) {
+            commands[t].clear();
+            surfaces[t].clear();
+        }
+        runs.clear();
+    }
+
+    void add(const Mesh& mesh, int lod, const glm::mat4& model, const glm::mat3& normalMatrix) {
+        uint32_t drawId = addDrawData(mesh, model, normalMatrix);
+        if (drawId != INVALID_DRAW) addCommand(mesh, lod, drawId);
+    }
+
+    // Registers a draw's matrices without queueing a command, for passes that
+    // build their own commands on the GPU. Returns the draw ID.
+    uint32_t addDrawData(const Mesh& mesh, const glm::mat4& model, const glm::mat3& normalMatrix) {
+        if (drawData.size() >= GeometryPool::MAX_DRAWS) {
+            if (!warnedOverflow) std::cout << "⚠️ More than " << GeometryPool::MAX_DRAWS << " draws in one batch, extra draws skipped" << std::endl;
+            warnedOverflow = true;
+            return INVALID_DRAW;
+        }
+        drawData.push_back({model, mesh.positionDecode,
+                            {glm::vec4(normalMatrix[0], 0.0f), glm::vec4(normalMatrix[1], 0.0f),
+                             glm::vec4(normalMatrix[2], 0.0f)}});
+        return uint32_t(drawData.size() - 1);
+    }
+
+    // instanceCount consecutive draw IDs from firstDrawId, one command
+    void addCommand(const Mesh& mesh, int lod, uint32_t firstDrawId, uint32_t instanceCount = 1) {
+        int t = mesh.indexType == GL_UNSIGNED_SHORT ? 0 : 1;
+        commands[t].push_back(makeCommand(mesh, lod, firstDrawId, instanceCount));
+        surfaces[t].push_back(mesh.surface);
+    }
+
+    // Part of a mesh's index list; firstIndex is relative to the mesh
+    void addRange(const Mesh& mesh, uint32_t firstIndex, uint32_t indexCount, uint32_t drawId) {
+        IndirectCommand cmd;
+        cmd.count = indexCount;
+        cmd.instanceCount = 1;
+        cmd.firstIndex = mesh.firstIndex + firstIndex;
+        cmd.baseVertex = mesh.baseVertex;
+        cmd.baseInstance = drawId;
+        int t = mesh.indexType == GL_UNSIGNED_SHORT ? 0 : 1;
+        commands[t].push_back(cmd);
+        surfaces[t].push_back(mesh.surface);
+    }
+
+    static IndirectCommand makeCommand(const Mesh& mesh, int lod, uint32_t drawId, uint32_t instanceCount = 1) {
+        const MeshLod& range = mesh.lods[lod];
+        IndirectCommand cmd;
+        cmd.count = range.indexCount;
+        cmd.instanceCount = instanceCount;
+        cmd.firstIndex = mesh.firstIndex + range.firstIndex;
+        cmd.baseVertex = mesh.baseVertex;
+        cmd.baseInstance = drawId;
+        return cmd;
+    }
+
+    bool hasMultiDrawIndirect() const { return multiDrawIndirect; }
+
+    size_t drawCount() const { return drawData.size(); }
+
+    // Returns the number of GL draw calls issued
+    size_t submit(GeometryPool& pool, GLint drawIdBaseLocation) {
+        upload();
+        return draw(pool, drawIdBaseLocation);
+    }
+
+    // Splits [0, count) of one index type's commands into runs of equal surface
+    static void appendRuns(GLenum indexType, const uint32_t* surfaceList, size_t count, std::vector<DrawRun>& out) {
+        for (size_t k = 0; k < count; ++k) {
+            if (k == 0 || surfaceList[k] != surfaceList[k - 1]) {
+                out.push_back({indexType, surfaceList[k], k, 0});
+            }
+            out.back().count++;
+        }
+    }
+
+    // Uploads the frame's draw data and indirect commands and binds the draw
+    // data texture. draw() can then be issued once per pass. Commands are
+    // grouped by surface first (stable, so front-to-back order holds within a
+    // surface) so each surface's textures are bound once per pass.
+    void upload() {
+        if (drawData.empty()) return;
+
+        for (int t = 0; t < 2; ++t) {
+            std::vector<uint32_t>& list = surfaces[t];
+            if (!std::is_sorted(list.begin(), list.end())) {
+                order.resize(list.size());
+                std::iota(order.begin(), order.end(), size_t(0));
+                std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return list[a] < list[b]; });
+                sortedCommands.clear();
+                sortedSurfaces.clear();
+                for (size_t k : order) {
+                    sortedCommands.push_back(commands[t][k]);
+                    sortedSurfaces.push_back(list[k]);
+                }
+                commands[t].swap(sortedCommands);
+                list.swap(sortedSurfaces);
+            }
+            appendRuns(t == 0 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, list.data(), list.size(), runs);
+        }
+
+        size_t drawBytes = drawData.size() * sizeof(DrawData);
+        GL_COUNT(glBindBuffer(GL_TEXTURE_BUFFER, drawDataBuffer));
+        if (drawBytes > drawDataCapacity) {
+            drawDataCapacity = std::max(drawBytes, drawDataCapacity * 2);
+            GL_COUNT(glBufferData(GL_TEXTURE_BUFFER, drawDataCapacity, nullptr, GL_STREAM_DRAW));
+            GL_COUNT(glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture));
+            GL_COUNT(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataBuffer));
+        } else {
+            GL_COUNT(glBufferData(GL_TEXTURE_BUFFER, drawDataCapacity, nullptr, GL_STREAM_DRAW));
+        }
+        GL_COUNT(glBufferSubData(GL_TEXTURE_BUFFER, 0, drawBytes, drawData.data()));
+        GL_COUNT(glActiveTexture(GL_TEXTURE0 + DRAW_DATA_UNIT));
+        GL_COUNT(glBindTexture(GL_TEXTURE_BUFFER, drawDataTexture));
+
+        if (multiDrawIndirect) {
+            std::vector<IndirectCommand>& all = commands[2];
+            all.assign(commands[0].begin(), commands[0].end());
+            all.insert(all.end(), commands[1].begin(), commands[1].end());
+
+            GL_COUNT(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer));
+            GL_COUNT(glBufferData(GL_DRAW_INDIRECT_BUFFER, all.size() * sizeof(IndirectCommand), all.data(), GL_STREAM_DRAW));
+        }
+    }
+
+    // Issues the uploaded commands with whatever program is bound; depthOnly
+    // draws from the pool's position-only VAOs. Without a binder each index
+    // type goes out as one multi-draw regardless of surface.
+    size_t draw(GeometryPool& pool, GLint drawIdBaseLocation, bool depthOnly = false,
+                const SurfaceBinder& bindSurface = nullptr) {
+        if (drawData.empty()) return 0;
+
+        size_t drawCalls = 0;
+        if (multiDrawIndirect) {
+            GL_COUNT(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer));
+            GL_COUNT(glUniform1i(drawIdBaseLocation, 0));
+
+            size_t typeOffset[2] = {0, commands[0].size()};
+            for (int t = 0; t < 2; ++t) {
+                GLenum type = t == 0 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+                if (commands[t].empty() || !pool.bind(type, depthOnly)) continue;
+                if (!bindSurface) {
+                    GL_COUNT(glMultiDrawElementsIndirect(GL_TRIANGLES, type, (void*)(typeOffset[t] * sizeof(IndirectCommand)),
+                                                         GLsizei(commands[t].size()), 0));
+                    drawCalls++;
+                    continue;
+                }
+                for (const DrawRun& run : runs) {
+                    if (run.indexType != type || !bindSurface(run.surface)) continue;
+                    size_t offset = typeOffset[t] + run.first;
+                    GL_COUNT(glMultiDrawElementsIndirect(GL_TRIANGLES, type, (void*)(offset * sizeof(IndirectCommand)),
+                                                         GLsizei(run.count), 0));
+                    drawCalls++;
+                }
+            }
+        } else {
+            // No base instance here, so aDrawId reads the instance index and the
+            // uniform supplies the first ID. Consecutive single-instance commands
+            // with the same draw ID (cluster ranges) share one multi-draw.
+            for (const DrawRun& group : runs) {
+                GLenum type = group.indexType;
+                size_t indexSize = type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+                const std::vector<IndirectCommand>& list = commands[type == GL_UNSIGNED_SHORT ? 0 : 1];
+                if (bindSurface && !bindSurface(group.surface)) continue;
+                if (!pool.bind(type, depthOnly)) continue;
+                size_t end = group.first + group.count;
+                for (size_t k = group.first; k < end;) {
+                    const IndirectCommand& cmd = list[k];
+                    GL_COUNT(glUniform1i(drawIdBaseLocation, GLint(cmd.baseInstance)));
+                    size_t run = k + 1;
+                    while (cmd.instanceCount == 1 && run < end && list[run].instanceCount == 1 &&
+                           list[run].baseInstance == cmd.baseInstance) {
+                        run++;
+                    }
+
+                    if (run - k > 1) {
+                        multiCounts.clear();
+                        multiOffsets.clear();
+                        multiBaseVertices.clear();
+                        for (size_t r = k; r < run; ++r) {
+                            multiCounts.push_back(GLsizei(list[r].count));
+                            multiOffsets.push_back((void*)(size_t(list[r].firstIndex) * indexSize));
+                            multiBaseVertices.push_back(list[r].baseVertex);
+                        }
+                        GL_COUNT(glMultiDrawElementsBaseVertex(GL_TRIANGLES, multiCounts.data(), type,
+                                                               multiOffsets.data(), GLsizei(multiCounts.size()),
+                                                               multiBaseVertices.data()));
+                    } else if (cmd.instanceCount == 1) {
+                        GL_COUNT(glDrawElementsBaseVertex(GL_TRIANGLES, GLsizei(cmd.count), type,
+                                                          (void*)(size_t(cmd.firstIndex) * indexSize), cmd.baseVertex));
+                    } else {
+                        GL_COUNT(glDrawElementsInstancedBaseVertex(GL_TRIANGLES, GLsizei(cmd.count), type,
+                                                                   (void*)(size_t(cmd.firstIndex) * indexSize),
+                                                                   GLsizei(cmd.instanceCount), cmd.baseVertex));
+                    }
+                    drawCalls++;
+                    k = run;
+                }
+            }
+        }
+
+        GL_COUNT(glBindVertexArray(0));
+        return drawCalls;
+    }
+
+private:
+    bool multiDrawIndirect = false;
+    bool warnedOverflow = false;
+    GLuint indirectBuffer = 0;
+    GLuint drawDataBuffer = 0;
+    GLuint drawDataTexture = 0;
+    size_t drawDataCapacity = 0;
+    std::vector<DrawData> drawData;
+    std::vector<IndirectCommand> commands[3];
+    std::vector<uint32_t> surfaces[2];
+    std::vector<DrawRun> runs;
+    std::vector<size_t> order;
+    std::vector<IndirectCommand> sortedCommands;
+    std::vector<uint32_t> sortedSurfaces;
+    std::vector<GLsizei> multiCounts;
+    std::vector<void*> multiOffsets;
+    std::vector<GLint> multiBaseVertices;
+};
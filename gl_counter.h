@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+
+// Counts GL entry points issued on the render path. Wrap a call in GL_COUNT
+// and read/reset GLCounter::calls once per frame to compare renderer changes.
+namespace GLCounter {
+inline size_t calls = 0;
+}
+
+#define GL_COUNT(call) (++GLCounter::calls, call)
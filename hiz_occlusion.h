@@ -0,0 +1,384 @@
+#pragma once
+
+#include "gl_counter.h"
+#include "geometry_pool.h"
+#include "shader_cache.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace HiZShaders {
+
+// Max of every source texel the destination texel overlaps. The source's base
+// level is pinned to the level being read, so lod 0 is always that level.
+// Built with MULTISAMPLE, level 0 reads the scene's multisampled depth and
+// takes the max over every sample, so a silhouette pixel keeps the depth of
+// whatever shows through its farthest sample.
+const char* const reduceFragment = R"(
+#version 330 core
+uniform vec2 scale;
+out float reduced;
+
+#ifdef MULTISAMPLE
+uniform sampler2DMS source;
+uniform int sampleCount;
+
+ivec2 sourceSize() { return textureSize(source); }
+
+float farthestAt(ivec2 p) {
+    float farthest = 0.0;
+    for (int s = 0; s < sampleCount; ++s) farthest = max(farthest, texelFetch(source, p, s).r);
+    return farthest;
+}
+#else
+uniform sampler2D source;
+
+ivec2 sourceSize() { return textureSize(source, 0); }
+
+float farthestAt(ivec2 p) { return texelFetch(source, p, 0).r; }
+#endif
+
+void main() {
+    ivec2 size = sourceSize();
+    ivec2 dst = ivec2(gl_FragCoord.xy);
+    ivec2 lo = ivec2(floor(vec2(dst) * scale));
+    ivec2 hi = min(ivec2(ceil(vec2(dst + 1) * scale)) - 1, size - 1);
+
+    float farthest = 0.0;
+    for (int y = lo.y; y <= hi.y; ++y) {
+        for (int x = lo.x; x <= hi.x; ++x) {
+            farthest = max(farthest, farthestAt(ivec2(x, y)));
+        }
+    }
+    reduced = farthest;
+}
+)";
+
+// One point per candidate; writes a DrawElementsIndirectCommand (plus the
+// visibility bit) through transform feedback, 32 bytes per record.
+const char* const testVertex = R"(
+#version 330 core
+layout (location = 0) in vec3 boundsMin;
+layout (location = 1) in uint indexCount;
+layout (location = 2) in vec3 boundsMax;
+layout (location = 3) in uint firstIndex;
+layout (location = 4) in int baseVertex;
+layout (location = 5) in uint drawId;
+layout (location = 6) in uint drawnEarly;
+
+uniform mat4 viewProjection;
+uniform sampler2D hiZ;
+uniform int hiZLevels;
+
+flat out uvec4 commandHead;
+flat out uvec4 commandTail;
+
+bool isVisible() {
+    vec3 ndcMin = vec3(1.0);
+    vec3 ndcMax = vec3(-1.0);
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = vec3((i & 1) != 0 ? boundsMax.x : boundsMin.x,
+                           (i & 2) != 0 ? boundsMax.y : boundsMin.y,
+                           (i & 4) != 0 ? boundsMax.z : boundsMin.z);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+        if (clip.w <= 1e-4) return true;
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+
+    vec2 uvMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0);
+    vec2 uvMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0);
+    float nearest = ndcMin.z * 0.5 + 0.5;
+
+    // Pick the level where the rectangle covers at most 2x2 texels
+    vec2 extent = (uvMax - uvMin) * vec2(textureSize(hiZ, 0));
+    int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, hiZLevels - 1);
+    ivec2 size = textureSize(hiZ, level);
+    ivec2 lo = clamp(ivec2(uvMin * vec2(size)), ivec2(0), size - 1);
+    ivec2 hi = clamp(ivec2(uvMax * vec2(size)), ivec2(0), size - 1);
+
+    float farthest = max(max(texelFetch(hiZ, lo, level).r, texelFetch(hiZ, ivec2(hi.x, lo.y), level).r),
+                         max(texelFetch(hiZ, ivec2(lo.x, hi.y), level).r, texelFetch(hiZ, hi, level).r));
+    return nearest <= farthest;
+}
+
+void main() {
+    bool visible = isVisible();
+    commandHead = uvec4(indexCount, (visible && drawnEarly == 0u) ? 1u : 0u, firstIndex, uint(baseVertex));
+    commandTail = uvec4(drawId, visible ? 1u : 0u, 0u, 0u);
+}
+)";
+
+}
+
+// Two-phase occlusion culling against a hierarchical depth buffer. The caller
+// draws last frame's visible set, then buildPyramid() max-reduces that depth
+// and test() checks every frustum-visible candidate on the GPU. Survivors that
+// weren't drawn in phase one are drawn straight from the generated commands,
+// and the per-candidate visibility is read back a frame later without stalling.
+class HiZOcclusion {
+public:
+    static const GLuint HIZ_UNIT = 1;
+    static const size_t RECORD_SIZE = 32;
+
+    struct Candidate {
+        glm::vec3 boundsMin;
+        uint32_t indexCount;
+        glm::vec3 boundsMax;
+        uint32_t firstIndex;
+        int32_t baseVertex;
+        uint32_t drawId;
+        uint32_t drawnEarly;
+        uint32_t pad;
+    };
+    static_assert(sizeof(Candidate) == 48, "Candidate layout is read as vertex attributes");
+
+    struct Result {
+        uint32_t indexCount;
+        uint32_t drawnLate;
+        uint32_t visible;
+    };
+
+    bool create() {
+        reduceProgram = linkProgram(fullscreenTriangleVertex, HiZShaders::reduceFragment);
+        reduceMultisampleProgram = linkProgram(fullscreenTriangleVertex, HiZShaders::reduceFragment, {}, {"MULTISAMPLE"});
+        testProgram = linkProgram(HiZShaders::testVertex, nullptr, {"commandHead", "commandTail"});
+        if (!reduceProgram || !reduceMultisampleProgram || !testProgram) return false;
+
+        reduceScale = glGetUniformLocation(reduceProgram, "scale");
+        reduceMultisampleScale = glGetUniformLocation(reduceMultisampleProgram, "scale");
+        reduceSampleCount = glGetUniformLocation(reduceMultisampleProgram, "sampleCount");
+        testViewProjection = glGetUniformLocation(testProgram, "viewProjection");
+        testLevels = glGetUniformLocation(testProgram, "hiZLevels");
+        glUseProgram(testProgram);
+        glUniform1i(glGetUniformLocation(testProgram, "hiZ"), HIZ_UNIT);
+        glUseProgram(reduceProgram);
+        glUniform1i(glGetUniformLocation(reduceProgram, "source"), HIZ_UNIT);
+        glUseProgram(reduceMultisampleProgram);
+        glUniform1i(glGetUniformLocation(reduceMultisampleProgram, "source"), HIZ_UNIT);
+        glUseProgram(0);
+
+        glGenVertexArrays(1, &emptyVao);
+        glGenFramebuffers(1, &fbo);
+        glGenBuffers(1, &candidateBuffer);
+        glGenBuffers(1, &commandBuffer);
+
+        glGenVertexArrays(1, &candidateVao);
+        glBindVertexArray(candidateVao);
+        glBindBuffer(GL_ARRAY_BUFFER, candidateBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Candidate), (void*)offsetof(Candidate, boundsMin));
+        glEnableVertexAttribArray(1);
+        glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(Candidate), (void*)offsetof(Candidate, indexCount));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Candidate), (void*)offsetof(Candidate, boundsMax));
+        glEnableVertexAttribArray(3);
+        glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(Candidate), (void*)offsetof(Candidate, firstIndex));
+        glEnableVertexAttribArray(4);
+        glVertexAttribIPointer(4, 1, GL_INT, sizeof(Candidate), (void*)offsetof(Candidate, baseVertex));
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(Candidate), (void*)offsetof(Candidate, drawId));
+        glEnableVertexAttribArray(6);
+        glVertexAttribIPointer(6, 1, GL_UNSIGNED_INT, sizeof(Candidate), (void*)offsetof(Candidate, drawnEarly));
+        glBindVertexArray(0);
+        return true;
+    }
+
+    // Max-reduces the scene depth into a power-of-two pyramid that covers
+    // every sample: with depthSamples > 1, depthTexture is a multisample
+    // texture and level 0 takes the farthest of all its samples. The depth
+    // texture must not be attached to the bound draw framebuffer. The caller
+    // rebinds its framebuffer and viewport afterwards.
+    void buildPyramid(GLuint depthTexture, int depthSamples, int depthWidth, int depthHeight) {
+        allocatePyramid(depthWidth, depthHeight);
+        bool multisample = depthSamples > 1;
+
+        GL_COUNT(glDisable(GL_DEPTH_TEST));
+        GL_COUNT(glBindVertexArray(emptyVao));
+        GL_COUNT(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+        GL_COUNT(glActiveTexture(GL_TEXTURE0 + HIZ_UNIT));
+
+        int srcWidth = depthWidth, srcHeight = depthHeight;
+        for (int level = 0; level < levels; ++level) {
+            int dstWidth = std::max(1, baseWidth >> level);
+            int dstHeight = std::max(1, baseHeight >> level);
+
+            GLint scaleLocation = reduceScale;
+            if (level == 0 && multisample) {
+                GL_COUNT(glUseProgram(reduceMultisampleProgram));
+                GL_COUNT(glUniform1i(reduceSampleCount, depthSamples));
+                GL_COUNT(glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, depthTexture));
+                scaleLocation = reduceMultisampleScale;
+            } else if (level == 0) {
+                GL_COUNT(glUseProgram(reduceProgram));
+                GL_COUNT(glBindTexture(GL_TEXTURE_2D, depthTexture));
+            } else {
+                if (level == 1 && multisample) GL_COUNT(glUseProgram(reduceProgram));
+                GL_COUNT(glBindTexture(GL_TEXTURE_2D, pyramid));
+                GL_COUNT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1));
+                GL_COUNT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1));
+            }
+            GL_COUNT(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid, level));
+            GL_COUNT(glViewport(0, 0, dstWidth, dstHeight));
+            GL_COUNT(glUniform2f(scaleLocation, float(srcWidth) / dstWidth, float(srcHeight) / dstHeight));
+            GL_COUNT(glDrawArrays(GL_TRIANGLES, 0, 3));
+
+            srcWidth = dstWidth;
+            srcHeight = dstHeight;
+        }
+
+        GL_COUNT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0));
+        GL_COUNT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1));
+        if (multisample) GL_COUNT(glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0));
+        GL_COUNT(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+        GL_COUNT(glEnable(GL_DEPTH_TEST));
+    }
+
+    // Tests every candidate and writes its indirect command. Candidates must be
+    // ordered with all 16-bit-index meshes first.
+    void test(const std::vector<Candidate>& candidates, const glm::mat4& viewProjection) {
+        candidateCount = candidates.size();
+        if (candidates.empty()) return;
+
+        size_t commandBytes = candidates.size() * RECORD_SIZE;
+        if (commandBytes > commandCapacity) {
+            commandCapacity = std::max(commandBytes, commandCapacity * 2);
+            GL_COUNT(glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, commandBuffer));
+            GL_COUNT(glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, commandCapacity, nullptr, GL_DYNAMIC_COPY));
+        }
+
+        GL_COUNT(glBindBuffer(GL_ARRAY_BUFFER, candidateBuffer));
+        GL_COUNT(glBufferData(GL_ARRAY_BUFFER, candidates.size() * sizeof(Candidate), candidates.data(), GL_STREAM_DRAW));
+
+        GL_COUNT(glUseProgram(testProgram));
+        GL_COUNT(glUniformMatrix4fv(testViewProjection, 1, GL_FALSE, glm::value_ptr(viewProjection)));
+        GL_COUNT(glUniform1i(testLevels, levels));
+        GL_COUNT(glActiveTexture(GL_TEXTURE0 + HIZ_UNIT));
+        GL_COUNT(glBindTexture(GL_TEXTURE_2D, pyramid));
+        GL_COUNT(glBindVertexArray(candidateVao));
+
+        GL_COUNT(glEnable(GL_RASTERIZER_DISCARD));
+        GL_COUNT(glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, commandBuffer));
+        GL_COUNT(glBeginTransformFeedback(GL_POINTS));
+        GL_COUNT(glDrawArrays(GL_POINTS, 0, GLsizei(candidates.size())));
+        GL_COUNT(glEndTransformFeedback());
+        GL_COUNT(glDisable(GL_RASTERIZER_DISCARD));
+        GL_COUNT(glBindVertexArray(0));
+    }
+
+    // Draws the generated commands; the scene (or depth) program and draw
+    // data must be bound. Candidates are 16-bit index meshes first, and runs
+    // splits each type into surfaces (DrawBatcher::appendRuns) for bindSurface.
+    size_t drawSurvivors(GeometryPool& pool, size_t shortIndexCandidates, const std::vector<DrawBatcher::DrawRun>& runs,
+                         bool depthOnly = false, const DrawBatcher::SurfaceBinder& bindSurface = nullptr) {
+        if (candidateCount == 0) return 0;
+
+        GL_COUNT(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer));
+        size_t drawCalls = 0;
+        size_t ranges[2][2] = {{0, shortIndexCandidates}, {shortIndexCandidates, candidateCount}};
+        for (int t = 0; t < 2; ++t) {
+            GLenum type = t == 0 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+            size_t count = ranges[t][1] - ranges[t][0];
+            if (count == 0 || !pool.bind(type, depthOnly)) continue;
+            if (!bindSurface) {
+                GL_COUNT(glMultiDrawElementsIndirect(GL_TRIANGLES, type, (void*)(ranges[t][0] * RECORD_SIZE),
+                                                     GLsizei(count), GLsizei(RECORD_SIZE)));
+                drawCalls++;
+                continue;
+            }
+            for (const DrawBatcher::DrawRun& run : runs) {
+                if (run.indexType != type || !bindSurface(run.surface)) continue;
+                GL_COUNT(glMultiDrawElementsIndirect(GL_TRIANGLES, type, (void*)((ranges[t][0] + run.first) * RECORD_SIZE),
+                                                     GLsizei(run.count), GLsizei(RECORD_SIZE)));
+                drawCalls++;
+            }
+        }
+        GL_COUNT(glBindVertexArray(0));
+
+        if (fence) glDeleteSync(fence);
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        resultCount = candidateCount;
+        return drawCalls;
+    }
+
+    // Fetches the previous test's results if the GPU has finished with them.
+    // Must run before the next test() overwrites the command buffer.
+    bool readResults(std::vector<Result>& out) {
+        if (!fence || resultCount == 0) return false;
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return false;
+        glDeleteSync(fence);
+        fence = nullptr;
+
+        std::vector<uint32_t> raw(resultCount * RECORD_SIZE / sizeof(uint32_t));
+        GL_COUNT(glBindBuffer(GL_COPY_READ_BUFFER, commandBuffer));
+        GL_COUNT(glGetBufferSubData(GL_COPY_READ_BUFFER, 0, raw.size() * sizeof(uint32_t), raw.data()));
+
+        out.resize(resultCount);
+        for (size_t i = 0; i < resultCount; ++i) {
+            const uint32_t* record = &raw[i * RECORD_SIZE / sizeof(uint32_t)];
+            out[i] = {record[0], record[1], record[5]};
+        }
+        resultCount = 0;
+        return true;
+    }
+
+private:
+    GLuint reduceProgram = 0;
+    GLuint reduceMultisampleProgram = 0;
+    GLuint testProgram = 0;
+    GLint reduceScale = -1;
+    GLint reduceMultisampleScale = -1;
+    GLint reduceSampleCount = -1;
+    GLint testViewProjection = -1;
+    GLint testLevels = -1;
+    GLuint emptyVao = 0;
+    GLuint fbo = 0;
+    GLuint pyramid = 0;
+    int baseWidth = 0;
+    int baseHeight = 0;
+    int levels = 0;
+
+    GLuint candidateVao = 0;
+    GLuint candidateBuffer = 0;
+    GLuint commandBuffer = 0;
+    size_t commandCapacity = 0;
+    size_t candidateCount = 0;
+    size_t resultCount = 0;
+    GLsync fence = nullptr;
+
+    static int previousPowerOfTwo(int v) {
+        int p = 1;
+        while (p * 2 <= v) p *= 2;
+        return p;
+    }
+
+    void allocatePyramid(int depthWidth, int depthHeight) {
+        int width = previousPowerOfTwo(depthWidth);
+        int height = previousPowerOfTwo(depthHeight);
+        if (pyramid && width == baseWidth && height == baseHeight) return;
+
+        if (pyramid) glDeleteTextures(1, &pyramid);
+        baseWidth = width;
+        baseHeight = height;
+        levels = 1;
+        while ((std::max(baseWidth, baseHeight) >> levels) > 0) levels++;
+
+        glGenTextures(1, &pyramid);
+        glBindTexture(GL_TEXTURE_2D, pyramid);
+        for (int level = 0; level < levels; ++level) {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, std::max(1, baseWidth >> level), std::max(1, baseHeight >> level),
+                         0, GL_RED, GL_FLOAT, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    }
+};
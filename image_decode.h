@@ -0,0 +1,373 @@
+#pragma once
+
+#include "mesh_cache.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Decodes the texture formats model files reference (PNG and TGA) into RGBA8
+// with the first row at the top of the image. Only the texture transcoder
+// uses this; decoded images never reach the GPU, the block-compressed cache
+// does. JPEG isn't supported: such textures are skipped with an error and
+// their material keeps its flat color.
+namespace ImageDecode {
+
+struct Image {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Channels in the source file: 1 gray, 2 gray + alpha, 3 RGB, 4 RGBA
+    int channels = 0;
+    std::vector<uint8_t> rgba;
+};
+
+inline uint32_t readBigEndian32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return uint8_t(a);
+    return uint8_t(pb <= pc ? b : c);
+}
+
+// Reverses the per-row filters of one (sub)image in place. rows holds
+// height rows of 1 filter byte + rowBytes data.
+inline bool unfilter(uint8_t* rows, size_t rowBytes, uint32_t height, size_t pixelBytes) {
+    const uint8_t* previous = nullptr;
+    for (uint32_t y = 0; y < height; ++y) {
+        uint8_t* row = rows + y * (rowBytes + 1);
+        uint8_t filter = row[0];
+        uint8_t* line = row + 1;
+        for (size_t i = 0; i < rowBytes; ++i) {
+            int a = i >= pixelBytes ? line[i - pixelBytes] : 0;
+            int b = previous ? previous[i] : 0;
+            int c = previous && i >= pixelBytes ? previous[i - pixelBytes] : 0;
+            switch (filter) {
+            case 0: break;
+            case 1: line[i] = uint8_t(line[i] + a); break;
+            case 2: line[i] = uint8_t(line[i] + b); break;
+            case 3: line[i] = uint8_t(line[i] + ((a + b) >> 1)); break;
+            case 4: line[i] = uint8_t(line[i] + paeth(a, b, c)); break;
+            default: return false;
+            }
+        }
+        previous = line;
+    }
+    return true;
+}
+
+struct PngHeader {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    int bitDepth = 0;
+    int colorType = 0;
+    int interlace = 0;
+    std::vector<uint8_t> palette;
+    std::vector<uint8_t> paletteAlpha;
+    // tRNS key color for gray/RGB images, at the image's bit depth
+    bool hasKey = false;
+    uint16_t key[3] = {};
+};
+
+inline int pngSamples(int colorType) {
+    switch (colorType) {
+    case 0: return 1;
+    case 2: return 3;
+    case 3: return 1;
+    case 4: return 2;
+    case 6: return 4;
+    default: return 0;
+    }
+}
+
+// Converts one unfiltered row to RGBA8 at out, stepping outStride pixels
+// between written pixels (1 except for Adam7 passes)
+inline void expandRow(const PngHeader& h, const uint8_t* line, uint32_t count, uint8_t* out, size_t outStride) {
+    int samples = pngSamples(h.colorType);
+    for (uint32_t x = 0; x < count; ++x) {
+        uint16_t s[4] = {0, 0, 0, 0};
+        if (h.bitDepth < 8) {
+            size_t bit = size_t(x) * h.bitDepth;
+            int shift = 8 - h.bitDepth - int(bit & 7);
+            s[0] = uint16_t((line[bit >> 3] >> shift) & ((1 << h.bitDepth) - 1));
+        } else {
+            for (int c = 0; c < samples; ++c) {
+                s[c] = h.bitDepth == 16 ? uint16_t((line[(x * samples + c) * 2] << 8) | line[(x * samples + c) * 2 + 1])
+                                        : line[x * samples + c];
+            }
+        }
+
+        uint8_t* px = out + x * outStride * 4;
+        auto to8 = [&](uint16_t v) -> uint8_t {
+            if (h.bitDepth == 16) return uint8_t(v >> 8);
+            return uint8_t(v * 255 / ((1 << h.bitDepth) - 1));
+        };
+        switch (h.colorType) {
+        case 0:
+            px[0] = px[1] = px[2] = to8(s[0]);
+            px[3] = h.hasKey && s[0] == h.key[0] ? 0 : 255;
+            break;
+        case 2:
+            px[0] = to8(s[0]);
+            px[1] = to8(s[1]);
+            px[2] = to8(s[2]);
+            px[3] = h.hasKey && s[0] == h.key[0] && s[1] == h.key[1] && s[2] == h.key[2] ? 0 : 255;
+            break;
+        case 3: {
+            size_t index = s[0];
+            bool valid = index * 3 + 2 < h.palette.size();
+            px[0] = valid ? h.palette[index * 3] : 0;
+            px[1] = valid ? h.palette[index * 3 + 1] : 0;
+            px[2] = valid ? h.palette[index * 3 + 2] : 0;
+            px[3] = index < h.paletteAlpha.size() ? h.paletteAlpha[index] : 255;
+            break;
+        }
+        case 4:
+            px[0] = px[1] = px[2] = to8(s[0]);
+            px[3] = to8(s[1]);
+            break;
+        case 6:
+            px[0] = to8(s[0]);
+            px[1] = to8(s[1]);
+            px[2] = to8(s[2]);
+            px[3] = to8(s[3]);
+            break;
+        }
+    }
+}
+
+inline bool decodePng(const uint8_t* data, size_t size, Image& image, std::string& error) {
+    static const uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (size < 8 || memcmp(data, SIGNATURE, 8) != 0) {
+        error = "not a PNG file";
+        return false;
+    }
+
+    PngHeader h;
+    std::vector<uint8_t> compressed;
+    bool sawHeader = false;
+    size_t cursor = 8;
+    while (cursor + 12 <= size) {
+        uint32_t length = readBigEndian32(data + cursor);
+        const uint8_t* type = data + cursor + 4;
+        const uint8_t* body = data + cursor + 8;
+        if (length > size - cursor - 12) {
+            error = "truncated PNG chunk";
+            return false;
+        }
+        if (memcmp(type, "IHDR", 4) == 0 && length >= 13) {
+            h.width = readBigEndian32(body);
+            h.height = readBigEndian32(body + 4);
+            h.bitDepth = body[8];
+            h.colorType = body[9];
+            h.interlace = body[12];
+            sawHeader = true;
+        } else if (memcmp(type, "PLTE", 4) == 0) {
+            h.palette.assign(body, body + length);
+        } else if (memcmp(type, "tRNS", 4) == 0) {
+            if (h.colorType == 3) {
+                h.paletteAlpha.assign(body, body + length);
+            } else if (h.colorType == 0 && length >= 2) {
+                h.hasKey = true;
+                h.key[0] = uint16_t((body[0] << 8) | body[1]);
+            } else if (h.colorType == 2 && length >= 6) {
+                h.hasKey = true;
+                for (int c = 0; c < 3; ++c) h.key[c] = uint16_t((body[c * 2] << 8) | body[c * 2 + 1]);
+            }
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            compressed.insert(compressed.end(), body, body + length);
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            break;
+        }
+        cursor += 12 + size_t(length);
+    }
+
+    int samples = pngSamples(h.colorType);
+    bool depthOk = h.bitDepth == 8 || h.bitDepth == 16 ||
+                   ((h.colorType == 0 || h.colorType == 3) && (h.bitDepth == 1 || h.bitDepth == 2 || h.bitDepth == 4));
+    if (!sawHeader || samples == 0 || !depthOk || h.width == 0 || h.height == 0 || h.interlace > 1) {
+        error = "unsupported PNG header";
+        return false;
+    }
+    if (h.width > 16384 || h.height > 16384) {
+        error = "PNG larger than 16384 pixels";
+        return false;
+    }
+
+    size_t bitsPerPixel = size_t(samples) * h.bitDepth;
+    size_t pixelBytes = std::max<size_t>(1, bitsPerPixel / 8);
+    auto rowBytes = [&](uint32_t width) { return (size_t(width) * bitsPerPixel + 7) / 8; };
+
+    // Adam7 passes: start x/y and step x/y; a non-interlaced image is one pass
+    static const uint32_t ADAM7[7][4] = {{0, 0, 8, 8}, {4, 0, 8, 8}, {0, 4, 4, 8}, {2, 0, 4, 4},
+                                         {0, 2, 2, 4}, {1, 0, 2, 2}, {0, 1, 1, 2}};
+    static const uint32_t SINGLE[1][4] = {{0, 0, 1, 1}};
+    const uint32_t(*passes)[4] = h.interlace ? ADAM7 : SINGLE;
+    int passCount = h.interlace ? 7 : 1;
+
+    size_t rawSize = 0;
+    for (int p = 0; p < passCount; ++p) {
+        uint32_t w = (h.width + passes[p][2] - 1 - passes[p][0]) / passes[p][2];
+        uint32_t hgt = (h.height + passes[p][3] - 1 - passes[p][1]) / passes[p][3];
+        if (w && hgt) rawSize += size_t(hgt) * (rowBytes(w) + 1);
+    }
+
+    std::vector<uint8_t> raw(rawSize);
+    uLongf rawLength = uLongf(rawSize);
+    if (uncompress(raw.data(), &rawLength, compressed.data(), uLong(compressed.size())) != Z_OK || rawLength != rawSize) {
+        error = "corrupt PNG image data";
+        return false;
+    }
+    std::vector<uint8_t>().swap(compressed);
+
+    image.width = h.width;
+    image.height = h.height;
+    image.channels = h.colorType == 3 ? (h.paletteAlpha.empty() ? 3 : 4)
+                                      : samples + ((h.colorType == 0 || h.colorType == 2) && h.hasKey ? 1 : 0);
+    image.rgba.assign(size_t(h.width) * h.height * 4, 0);
+
+    uint8_t* rows = raw.data();
+    for (int p = 0; p < passCount; ++p) {
+        uint32_t w = (h.width + passes[p][2] - 1 - passes[p][0]) / passes[p][2];
+        uint32_t hgt = (h.height + passes[p][3] - 1 - passes[p][1]) / passes[p][3];
+        if (!w || !hgt) continue;
+        size_t bytes = rowBytes(w);
+        if (!unfilter(rows, bytes, hgt, pixelBytes)) {
+            error = "bad PNG row filter";
+            return false;
+        }
+        for (uint32_t y = 0; y < hgt; ++y) {
+            size_t outY = passes[p][1] + size_t(y) * passes[p][3];
+            uint8_t* out = image.rgba.data() + (outY * h.width + passes[p][0]) * 4;
+            expandRow(h, rows + y * (bytes + 1) + 1, w, out, passes[p][2]);
+        }
+        rows += size_t(hgt) * (bytes + 1);
+    }
+    return true;
+}
+
+// Uncompressed and RLE true-color (16/24/32-bit) and grayscale (8-bit) TGA
+inline bool decodeTga(const uint8_t* data, size_t size, Image& image, std::string& error) {
+    if (size < 18) {
+        error = "truncated TGA header";
+        return false;
+    }
+    int idLength = data[0];
+    int colorMapType = data[1];
+    int imageType = data[2];
+    uint32_t width = uint32_t(data[12] | (data[13] << 8));
+    uint32_t height = uint32_t(data[14] | (data[15] << 8));
+    int depth = data[16];
+    int descriptor = data[17];
+
+    bool rle = imageType == 10 || imageType == 11;
+    bool gray = imageType == 3 || imageType == 11;
+    bool supported = colorMapType == 0 && (imageType == 2 || imageType == 3 || rle) &&
+                     (gray ? depth == 8 : (depth == 16 || depth == 24 || depth == 32));
+    if (!supported || width == 0 || height == 0) {
+        error = "unsupported TGA type";
+        return false;
+    }
+
+    size_t pixelBytes = size_t(depth) / 8;
+    size_t cursor = 18 + size_t(idLength);
+    size_t pixelCount = size_t(width) * height;
+    std::vector<uint8_t> pixels(pixelCount * pixelBytes);
+    if (!rle) {
+        if (cursor + pixels.size() > size) {
+            error = "truncated TGA image data";
+            return false;
+        }
+        memcpy(pixels.data(), data + cursor, pixels.size());
+    } else {
+        size_t written = 0;
+        while (written < pixelCount) {
+            if (cursor >= size) {
+                error = "truncated TGA RLE data";
+                return false;
+            }
+            uint8_t packet = data[cursor++];
+            size_t run = std::min<size_t>((packet & 0x7F) + 1, pixelCount - written);
+            if (packet & 0x80) {
+                if (cursor + pixelBytes > size) break;
+                for (size_t i = 0; i < run; ++i) {
+                    memcpy(&pixels[(written + i) * pixelBytes], data + cursor, pixelBytes);
+                }
+                cursor += pixelBytes;
+            } else {
+                if (cursor + run * pixelBytes > size) break;
+                memcpy(&pixels[written * pixelBytes], data + cursor, run * pixelBytes);
+                cursor += run * pixelBytes;
+            }
+            written += run;
+        }
+        if (written < pixelCount) {
+            error = "truncated TGA RLE data";
+            return false;
+        }
+    }
+
+    image.width = width;
+    image.height = height;
+    image.channels = gray ? 1 : depth == 32 ? 4 : 3;
+    image.rgba.resize(pixelCount * 4);
+    bool topDown = (descriptor & 0x20) != 0;
+    bool rightToLeft = (descriptor & 0x10) != 0;
+    for (uint32_t y = 0; y < height; ++y) {
+        uint32_t srcY = topDown ? y : height - 1 - y;
+        for (uint32_t x = 0; x < width; ++x) {
+            uint32_t srcX = rightToLeft ? width - 1 - x : x;
+            const uint8_t* s = &pixels[(size_t(srcY) * width + srcX) * pixelBytes];
+            uint8_t* d = &image.rgba[(size_t(y) * width + x) * 4];
+            if (gray) {
+                d[0] = d[1] = d[2] = s[0];
+                d[3] = 255;
+            } else if (depth == 16) {
+                uint16_t v = uint16_t(s[0] | (s[1] << 8));
+                d[0] = uint8_t(((v >> 10) & 31) * 255 / 31);
+                d[1] = uint8_t(((v >> 5) & 31) * 255 / 31);
+                d[2] = uint8_t((v & 31) * 255 / 31);
+                d[3] = 255;
+            } else {
+                d[0] = s[2];
+                d[1] = s[1];
+                d[2] = s[0];
+                d[3] = depth == 32 ? s[3] : 255;
+            }
+        }
+    }
+    return true;
+}
+
+inline bool hasExtension(const std::string& path, const char* extension) {
+    size_t length = strlen(extension);
+    if (path.size() < length) return false;
+    for (size_t i = 0; i < length; ++i) {
+        if (std::tolower(static_cast<unsigned char>(path[path.size() - length + i])) != extension[i]) return false;
+    }
+    return true;
+}
+
+inline bool load(const std::string& path, Image& image, std::string& error) {
+    MappedFile file;
+    if (!file.open(path)) {
+        error = "could not open " + path;
+        return false;
+    }
+    if (file.size() >= 8 && file.data()[0] == 0x89 && file.data()[1] == 'P') {
+        return decodePng(file.data(), file.size(), image, error);
+    }
+    if (hasExtension(path, ".tga")) {
+        return decodeTga(file.data(), file.size(), image, error);
+    }
+    error = "unsupported image format (PNG and TGA only)";
+    return false;
+}
+
+}
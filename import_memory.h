@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <sys/mman.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Memory used while importing models: a monotonic arena for each model's
+// upload-ready streams, process RSS from /proc, and heap allocation counts
+// fed by the operator new replacement in main.cpp.
+namespace ImportMemory {
+
+// Bump allocator over anonymous mappings. Nothing is freed individually;
+// reset() unmaps every block, so a model's staged geometry goes back to the
+// OS in one step instead of lingering as free space in the malloc heap.
+// allocate() is safe to call from several threads.
+class Arena {
+public:
+    static const size_t BLOCK_BYTES = size_t(4) << 20;
+
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() { reset(); }
+
+    template <typename T>
+    T* allocate(size_t count) {
+        return static_cast<T*>(allocateBytes(count * sizeof(T), alignof(T)));
+    }
+
+    template <typename T>
+    T* copy(const T* data, size_t count) {
+        T* out = allocate<T>(count);
+        if (count > 0) std::memcpy(out, data, count * sizeof(T));
+        return out;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const Block& block : blocks) {
+            munmap(block.base, block.size);
+        }
+        blocks.clear();
+        used = 0;
+        mapped = 0;
+    }
+
+    size_t bytesUsed() const { return used; }
+    size_t bytesMapped() const { return mapped; }
+
+private:
+    struct Block {
+        uint8_t* base;
+        size_t size;
+        size_t offset;
+    };
+
+    // The last block is the one being filled; oversized requests get their
+    // own block in front of it so its free tail stays usable
+    std::vector<Block> blocks;
+    std::mutex mutex;
+    size_t used = 0;
+    size_t mapped = 0;
+
+    void* allocateBytes(size_t bytes, size_t align) {
+        if (bytes == 0) return nullptr;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!blocks.empty()) {
+            Block& current = blocks.back();
+            size_t offset = (current.offset + align - 1) & ~(align - 1);
+            if (offset + bytes <= current.size) {
+                current.offset = offset + bytes;
+                used += bytes;
+                return current.base + offset;
+            }
+        }
+
+        bool dedicated = bytes > BLOCK_BYTES / 4;
+        size_t size = dedicated ? (bytes + 4095) & ~size_t(4095) : BLOCK_BYTES;
+        void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) throw std::bad_alloc();
+        Block block = {static_cast<uint8_t*>(base), size, bytes};
+        if (dedicated && !blocks.empty()) {
+            blocks.insert(blocks.end() - 1, block);
+        } else {
+            blocks.push_back(block);
+        }
+        used += bytes;
+        mapped += size;
+        return base;
+    }
+};
+
+// Bumped by the global operator new/delete. Constant-initialized, so counting
+// works for allocations made before main().
+struct HeapCounters {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> frees{0};
+    std::atomic<uint64_t> bytes{0};
+};
+
+inline HeapCounters heapCounters;
+
+// Resident set sizes from /proc/self/status in bytes. resetPeakRss() makes
+// VmHWM start over from the current RSS (Linux 4.0+), so each run reports its
+// own peak.
+struct RssSample {
+    size_t current = 0;
+    size_t peak = 0;
+};
+
+inline RssSample readRss() {
+    RssSample sample;
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f) return sample;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long kb = 0;
+        if (sscanf(line, "VmRSS: %llu kB", &kb) == 1) sample.current = size_t(kb) * 1024;
+        if (sscanf(line, "VmHWM: %llu kB", &kb) == 1) sample.peak = size_t(kb) * 1024;
+    }
+    fclose(f);
+    return sample;
+}
+
+inline void resetPeakRss() {
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (!f) return;
+    fputs("5", f);
+    fclose(f);
+}
+
+// Hands free pages at the top of the heap and in its holes back to the OS
+inline void trimHeap() {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+struct Snapshot {
+    RssSample rss;
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t bytes = 0;
+};
+
+inline Snapshot snapshot() {
+    Snapshot s;
+    s.rss = readRss();
+    s.allocations = heapCounters.allocations.load(std::memory_order_relaxed);
+    s.frees = heapCounters.frees.load(std::memory_order_relaxed);
+    s.bytes = heapCounters.bytes.load(std::memory_order_relaxed);
+    return s;
+}
+
+// RSS now and at peak against what the GPU holds, plus the heap traffic
+// since start. cpuMeshBytes is what the renderer keeps per mesh (LOD ranges,
+// clusters).
+inline void printReport(const Snapshot& start, size_t gpuBytes, size_t cpuMeshBytes) {
+    Snapshot now = snapshot();
+    const double mb = 1024.0 * 1024.0;
+    printf("🧠 Memory after loading: RSS %.1f MB (peak %.1f MB, %.1f MB before loading) | GPU geometry %.1f MB | "
+           "CPU mesh data %.1f MB\n",
+           now.rss.current / mb, now.rss.peak / mb, start.rss.current / mb, gpuBytes / mb, cpuMeshBytes / mb);
+    uint64_t allocations = now.allocations - start.allocations;
+    uint64_t frees = now.frees - start.frees;
+    printf("   🧮 %llu heap allocations (%.1f MB requested), %llu frees, %lld still live from loading\n",
+           (unsigned long long)allocations, (now.bytes - start.bytes) / mb, (unsigned long long)frees,
+           (long long)allocations - (long long)frees);
+    fflush(stdout);
+}
+
+}
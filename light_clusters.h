@@ -0,0 +1,282 @@
+#pragma once
+
+#include "gl_counter.h"
+#include "parallel.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Point light as stored in the light texture buffer: two RGBA32F texels.
+// radius is where the windowed falloff reaches zero.
+struct PointLight {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+    float pad = 0.0f;
+};
+static_assert(sizeof(PointLight) == 32, "PointLight is read as two RGBA32F texels");
+
+// Lights below this radiance are cut off; sets each light's culling radius
+// from the shader's 1 / (d^2 + 1) attenuation.
+const float LIGHT_CUTOFF = 0.02f;
+
+inline float lightRadius(const glm::vec3& color) {
+    float peak = std::max(color.x, std::max(color.y, color.z));
+    return std::sqrt(std::max(peak / LIGHT_CUTOFF - 1.0f, 0.0f));
+}
+
+// The demo's lights at a given time: the original four animated lights, then
+// count - 4 smaller lights scattered through a Sponza-sized volume from a
+// fixed hash, each bobbing on its own phase.
+inline void animateLights(std::vector<PointLight>& lights, size_t count, float time) {
+    lights.resize(count);
+    const glm::vec3 classicColors[4] = {glm::vec3(5.0f, 4.0f, 3.5f), glm::vec3(3.5f, 4.0f, 5.0f),
+                                        glm::vec3(4.0f, 5.0f, 4.0f), glm::vec3(4.5f, 4.5f, 4.5f)};
+    const glm::vec3 classicPositions[4] = {
+        glm::vec3(std::sin(time * 0.3f) * 12.0f, 6.0f, std::cos(time * 0.3f) * 12.0f),
+        glm::vec3(-std::sin(time * 0.5f) * 8.0f, 4.0f, -std::cos(time * 0.5f) * 8.0f),
+        glm::vec3(6.0f, 3.0f, 6.0f), glm::vec3(-6.0f, 3.0f, -6.0f)};
+
+    for (size_t i = 0; i < count; ++i) {
+        PointLight& light = lights[i];
+        if (i < 4) {
+            light.position = classicPositions[i];
+            light.color = classicColors[i];
+        } else {
+            uint32_t h = uint32_t(i) * 2654435761u;
+            auto unit = [&h]() {
+                h ^= h >> 15;
+                h *= 2246822519u;
+                h ^= h >> 13;
+                return float(h & 0xffffu) / 65535.0f;
+            };
+            glm::vec3 base(unit() * 24.0f - 12.0f, unit() * 7.0f - 1.5f, unit() * 10.0f - 5.0f);
+            float phase = unit() * 6.2831853f;
+            light.position = base + glm::vec3(0.0f, 0.5f * std::sin(time + phase), 0.0f);
+            light.color = glm::vec3(0.4f + unit(), 0.4f + unit(), 0.4f + unit());
+        }
+        light.radius = lightRadius(light.color);
+    }
+}
+
+// View-space froxel grid: screen tiles in x/y, exponential depth slices in z.
+// build() bins every light into the clusters its bounding sphere touches, one
+// worker per group of slices, and flattens the result into a per-cluster
+// (offset, count) table plus one shared light index list. No GL here so the
+// benchmark can drive it headless.
+class LightGrid {
+public:
+    static const int TILES_X = 16;
+    static const int TILES_Y = 9;
+    static const int SLICES = 24;
+    static const int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    // Below this many lights the binning runs on the calling thread
+    static const size_t PARALLEL_LIGHTS = 128;
+
+    void configure(const glm::mat4& projection, float nearPlane, float farPlane) {
+        proj = projection;
+        zNear = nearPlane;
+        zFar = farPlane;
+        float logRatio = std::log(zFar / zNear);
+        sliceScale = SLICES / logRatio;
+        sliceBias = -SLICES * std::log(zNear) / logRatio;
+    }
+
+    void build(const std::vector<PointLight>& lights, const glm::mat4& view, bool parallel = true) {
+        extents.resize(lights.size());
+        for (size_t i = 0; i < lights.size(); ++i) {
+            extents[i] = lightExtent(lights[i], view);
+        }
+
+        ranges.assign(CLUSTER_COUNT * 2, 0);
+        sliceIndices.resize(SLICES);
+        size_t minChunk = parallel && lights.size() >= PARALLEL_LIGHTS ? 1 : SLICES;
+        parallelFor(SLICES, minChunk, [&](size_t begin, size_t end, unsigned) {
+            for (size_t s = begin; s < end; ++s) binSlice(int(s));
+        });
+
+        // Slice-local offsets become global once the slices are concatenated
+        indices.clear();
+        maxPerCluster = 0;
+        occupiedClusters = 0;
+        for (int s = 0; s < SLICES; ++s) {
+            uint32_t base = uint32_t(indices.size());
+            for (int c = s * TILES_X * TILES_Y; c < (s + 1) * TILES_X * TILES_Y; ++c) {
+                ranges[c * 2] += base;
+                maxPerCluster = std::max(maxPerCluster, ranges[c * 2 + 1]);
+                if (ranges[c * 2 + 1] > 0) occupiedClusters++;
+            }
+            indices.insert(indices.end(), sliceIndices[s].begin(), sliceIndices[s].end());
+        }
+    }
+
+    // x/y: tiles per pixel, z/w: scale and bias from log(view depth) to slice
+    glm::vec4 shaderScale(int viewportWidth, int viewportHeight) const {
+        return glm::vec4(float(TILES_X) / viewportWidth, float(TILES_Y) / viewportHeight, sliceScale, sliceBias);
+    }
+
+    static glm::vec4 shaderDims() { return glm::vec4(TILES_X, TILES_Y, SLICES, 0.0f); }
+
+    const std::vector<uint32_t>& clusterRanges() const { return ranges; }
+    const std::vector<uint32_t>& lightIndices() const { return indices; }
+    uint32_t maxLightsPerCluster() const { return maxPerCluster; }
+    size_t occupiedClusterCount() const { return occupiedClusters; }
+
+private:
+    struct Extent {
+        int x0, x1, y0, y1, z0, z1;
+        bool empty() const { return z0 > z1; }
+    };
+
+    glm::mat4 proj = glm::mat4(1.0f);
+    float zNear = 0.1f;
+    float zFar = 100.0f;
+    float sliceScale = 1.0f;
+    float sliceBias = 0.0f;
+    std::vector<Extent> extents;
+    std::vector<uint32_t> ranges;
+    std::vector<std::vector<uint32_t>> sliceIndices;
+    std::vector<uint32_t> indices;
+    uint32_t maxPerCluster = 0;
+    size_t occupiedClusters = 0;
+
+    int sliceFor(float depth) const {
+        return std::clamp(int(std::floor(std::log(std::max(depth, zNear)) * sliceScale + sliceBias)), 0, SLICES - 1);
+    }
+
+    // Conservative NDC range of one axis of the sphere's view-space box: a
+    // negative edge projects widest at the nearest depth, a positive one too.
+    static void projectAxis(float center, float radius, float scale, float nearDepth, float farDepth,
+                            float& lo, float& hi) {
+        float a = center - radius, b = center + radius;
+        lo = scale * a / (a < 0.0f ? nearDepth : farDepth);
+        hi = scale * b / (b > 0.0f ? nearDepth : farDepth);
+    }
+
+    static int tileFor(float ndc, int tiles) {
+        return std::clamp(int(std::floor((ndc * 0.5f + 0.5f) * tiles)), 0, tiles - 1);
+    }
+
+    Extent lightExtent(const PointLight& light, const glm::mat4& view) const {
+        Extent e = {0, -1, 0, -1, 0, -1};
+        glm::vec3 c = glm::vec3(view * glm::vec4(light.position, 1.0f));
+        float depth = -c.z;
+        float nearDepth = std::max(depth - light.radius, zNear);
+        float farDepth = depth + light.radius;
+        if (farDepth < zNear || nearDepth > zFar) return e;
+
+        float x0, x1, y0, y1;
+        projectAxis(c.x, light.radius, proj[0][0], nearDepth, farDepth, x0, x1);
+        projectAxis(c.y, light.radius, proj[1][1], nearDepth, farDepth, y0, y1);
+        if (x1 < -1.0f || x0 > 1.0f || y1 < -1.0f || y0 > 1.0f) return e;
+
+        e.x0 = tileFor(x0, TILES_X);
+        e.x1 = tileFor(x1, TILES_X);
+        e.y0 = tileFor(y0, TILES_Y);
+        e.y1 = tileFor(y1, TILES_Y);
+        e.z0 = sliceFor(nearDepth);
+        e.z1 = sliceFor(std::min(farDepth, zFar));
+        return e;
+    }
+
+    // Counts, then fills, every cluster of one slice; only touches that
+    // slice's ranges and index list so slices can run concurrently.
+    void binSlice(int s) {
+        uint32_t* sliceRanges = &ranges[size_t(s) * TILES_X * TILES_Y * 2];
+        for (const Extent& e : extents) {
+            if (e.empty() || s < e.z0 || s > e.z1) continue;
+            for (int y = e.y0; y <= e.y1; ++y) {
+                for (int x = e.x0; x <= e.x1; ++x) sliceRanges[(y * TILES_X + x) * 2 + 1]++;
+            }
+        }
+
+        uint32_t offset = 0;
+        for (int c = 0; c < TILES_X * TILES_Y; ++c) {
+            sliceRanges[c * 2] = offset;
+            offset += sliceRanges[c * 2 + 1];
+            sliceRanges[c * 2 + 1] = 0;
+        }
+
+        std::vector<uint32_t>& out = sliceIndices[s];
+        out.resize(offset);
+        for (uint32_t i = 0; i < extents.size(); ++i) {
+            const Extent& e = extents[i];
+            if (e.empty() || s < e.z0 || s > e.z1) continue;
+            for (int y = e.y0; y <= e.y1; ++y) {
+                for (int x = e.x0; x <= e.x1; ++x) {
+                    uint32_t* range = &sliceRanges[(y * TILES_X + x) * 2];
+                    out[range[0] + range[1]++] = i;
+                }
+            }
+        }
+    }
+};
+
+// Texture buffers the fragment shader reads: light data, per-cluster
+// (offset, count) and the flattened light index list.
+class ClusterBuffers {
+public:
+    static const GLuint LIGHT_DATA_UNIT = 2;
+    static const GLuint CLUSTER_RANGE_UNIT = 3;
+    static const GLuint CLUSTER_INDEX_UNIT = 4;
+
+    void create() {
+        lightData.create(GL_RGBA32F);
+        clusterRanges.create(GL_RG32UI);
+        clusterIndices.create(GL_R32UI);
+    }
+
+    void upload(const std::vector<PointLight>& lights, const LightGrid& grid) {
+        lightData.upload(lights.data(), lights.size() * sizeof(PointLight), LIGHT_DATA_UNIT);
+        clusterRanges.upload(grid.clusterRanges().data(), grid.clusterRanges().size() * sizeof(uint32_t),
+                             CLUSTER_RANGE_UNIT);
+        clusterIndices.upload(grid.lightIndices().data(), grid.lightIndices().size() * sizeof(uint32_t),
+                              CLUSTER_INDEX_UNIT);
+    }
+
+    // Points the program's samplers at the units above
+    static void bindSamplers(GLuint program) {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "lightData"), LIGHT_DATA_UNIT);
+        glUniform1i(glGetUniformLocation(program, "clusterRanges"), CLUSTER_RANGE_UNIT);
+        glUniform1i(glGetUniformLocation(program, "clusterLights"), CLUSTER_INDEX_UNIT);
+    }
+
+private:
+    struct TextureBuffer {
+        GLuint buffer = 0;
+        GLuint texture = 0;
+        GLenum format = GL_R32UI;
+        size_t capacity = 0;
+
+        void create(GLenum internalFormat) {
+            format = internalFormat;
+            glGenBuffers(1, &buffer);
+            glGenTextures(1, &texture);
+        }
+
+        // Orphans and refills; an empty list still gets a minimal buffer so
+        // the texture is always complete.
+        void upload(const void* data, size_t bytes, GLuint unit) {
+            GL_COUNT(glBindBuffer(GL_TEXTURE_BUFFER, buffer));
+            if (bytes > capacity || capacity == 0) {
+                capacity = std::max<size_t>(std::max(bytes, capacity * 2), 256);
+                GL_COUNT(glBufferData(GL_TEXTURE_BUFFER, capacity, nullptr, GL_STREAM_DRAW));
+                GL_COUNT(glBindTexture(GL_TEXTURE_BUFFER, texture));
+                GL_COUNT(glTexBuffer(GL_TEXTURE_BUFFER, format, buffer));
+            } else {
+                GL_COUNT(glBufferData(GL_TEXTURE_BUFFER, capacity, nullptr, GL_STREAM_DRAW));
+            }
+            if (bytes > 0) GL_COUNT(glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data));
+            GL_COUNT(glActiveTexture(GL_TEXTURE0 + unit));
+            GL_COUNT(glBindTexture(GL_TEXTURE_BUFFER, texture));
+        }
+    };
+
+    TextureBuffer lightData;
+    TextureBuffer clusterRanges;
+    TextureBuffer clusterIndices;
+};
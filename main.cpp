@@ -3,64 +3,123 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
+#include "mesh.h"
+#include "model_loader.h"
+#include "import_memory.h"
+#include "benchmarks.h"
+#include "uniform_blocks.h"
+#include "geometry_pool.h"
+#include "bvh.h"
+#include "mesh_clusters.h"
+#include "shader_cache.h"
+#include "render_target.h"
+#include "hiz_occlusion.h"
+#include "depth_prepass.h"
+#include "light_clusters.h"
+#include "sss_blur.h"
+#include "material_luts.h"
+#include "frame_benchmark.h"
+#include "profiler.h"
+#include "text_overlay.h"
+#include "dynamic_resolution.h"
+#include "procedural_geometry.h"
+#include "texture_streamer.h"
+#include "temporal_reprojection.h"
 #include <iostream>
 #include <vector>
 #include <chrono>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <deque>
+#include <algorithm>
+#include <memory>
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include <cstdlib>
+#include <new>
+
+// Counts heap traffic for the memory report printed after loading. Array and
+// sized forms fall through to these.
+void* operator new(size_t size) {
+    ImportMemory::heapCounters.allocations.fetch_add(1, std::memory_order_relaxed);
+    ImportMemory::heapCounters.bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
 
-const float PI = 3.14159265359f;
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    ImportMemory::heapCounters.frees.fetch_add(1, std::memory_order_relaxed);
+    std::free(p);
+}
 
-struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+const float PI = 3.14159265359f;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+const size_t MAX_SCENE_LIGHTS = 1024;
+const glm::vec3 BACKGROUND_COLOR = glm::vec3(0.02f, 0.02f, 0.05f);
+
+struct DemoOptions {
+    bool useMeshCache = true;
+    bool nativeObj = true;
+    bool optimizeMeshes = true;
+    bool buildLods = true;
+    bool clusterCulling = true;
+    float lodPixelError = 1.0f;
+    float lodHysteresis = 0.25f;
+    double uploadBudgetMs = 4.0;
+    int sceneCopies = 1;
+    bool depthPrepass = false;
+    size_t lightCount = 4;
+    bool screenSpaceSss = false;
+    bool temporal = false;
+    // Temporal mode runs the light loop on one in every temporalRate 8x8 tiles
+    // each frame: 1, 2 or 4
+    int temporalRate = 2;
+    bool materialLuts = true;
+    // Old vertex path: normal matrix inverted per vertex, projection * view per vertex
+    bool perVertexNormalMatrix = false;
+    bool instancing = true;
+    // Triangles per shape in the "Procedural Shapes" model; 0 leaves it out
+    size_t proceduralTriangles = 0;
+    bool shaderCache = true;
+    bool textures = true;
+    size_t textureBudgetMb = 256;
+    std::string tracePath;
+    // 0 keeps the render scale fixed; otherwise the GPU frame-time target
+    double frameBudgetMs = 0.0;
+    float renderScale = 1.0f;
+    float sharpness = 0.3f;
+    bool headless = false;
+    int windowWidth = 1400;
+    int windowHeight = 900;
+    VertexFormat vertexFormat = VertexFormat::Float;
 };
 
-struct ModelInfo {
-    std::string name;
-    std::vector<size_t> meshIndices;
-    glm::vec3 idealScale;
-    glm::vec3 idealPosition;
+struct ModelSource {
+    const char* path;
+    const char* name;
+    const char* description;
+    glm::vec3 scale;
+    glm::vec3 position;
     glm::vec3 cameraDistance;
-    std::string description;
 };
 
-struct Mesh {
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    GLuint VAO, VBO, EBO;
-
-    void setupMesh() {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-
-        glBindVertexArray(0);
-    }
-
-    void Draw() {
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-    }
+const ModelSource modelSources[] = {
+    {"models/bunny.obj", "Stanford Bunny", "Classic test model with complex geometry",
+     glm::vec3(0.1f), glm::vec3(0, 0, 0), glm::vec3(0, 0, 6)},
+    {"models/lucy.obj", "Stanford Lucy", "High-detail scan perfect for SSS",
+     glm::vec3(0.005f), glm::vec3(3, 0, 0), glm::vec3(0, 0, 10)},
+    {"models/dragon.obj", "Stanford Dragon", "Complex surface details showcase",
+     glm::vec3(0.008f), glm::vec3(-3, 0, 0), glm::vec3(0, 0, 8)},
+    {"models/sponza/sponza.obj", "Intel Sponza", "Architectural test scene",
+     glm::vec3(0.01f), glm::vec3(0, -2, 0), glm::vec3(0, 5, 15)},
 };
 
 const char* sexyVertexShader = R"(
@@ -68,48 +127,146 @@ const char* sexyVertexShader = R"(
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in uint aDrawId;
+
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 camPosTime;
+    vec4 clusterScale;
+    vec4 clusterDims;
+    mat4 previousViewProjection;
+    vec4 temporal;
+};
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Per-draw model, position decode and normal matrices, 11 texels per draw.
+// PER_VERTEX_NORMAL_MATRIX selects the old path that inverts the model
+// matrix and multiplies projection * view for every vertex.
+uniform samplerBuffer drawData;
+uniform int drawIdBase;
+uniform bool octNormals;
 
 out vec3 WorldPos;
 out vec3 Normal;
 out vec2 TexCoord;
 out vec3 ViewPos;
 
+// Matches the depth pre-pass so GL_EQUAL sees bit-identical depth
+invariant gl_Position;
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+mat4 fetchMatrix(int texel) {
+    return mat4(texelFetch(drawData, texel), texelFetch(drawData, texel + 1),
+                texelFetch(drawData, texel + 2), texelFetch(drawData, texel + 3));
+}
+
 void main() {
-    WorldPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    int drawId = int(aDrawId) + drawIdBase;
+    mat4 model = fetchMatrix(drawId * 11);
+    mat4 positionDecode = fetchMatrix(drawId * 11 + 4);
+
+    vec3 normal = octNormals ? octDecode(aNormal.xy) : aNormal;
+    WorldPos = vec3(model * (positionDecode * vec4(aPos, 1.0)));
+#ifdef PER_VERTEX_NORMAL_MATRIX
+    Normal = mat3(transpose(inverse(model))) * normal;
+#else
+    mat3 normalMatrix = mat3(texelFetch(drawData, drawId * 11 + 8).xyz, texelFetch(drawData, drawId * 11 + 9).xyz,
+                             texelFetch(drawData, drawId * 11 + 10).xyz);
+    Normal = normalMatrix * normal;
+#endif
     TexCoord = aTexCoord;
     ViewPos = vec3(view * vec4(WorldPos, 1.0));
 
+#ifdef PER_VERTEX_NORMAL_MATRIX
     gl_Position = projection * view * vec4(WorldPos, 1.0);
+#else
+    gl_Position = viewProjection * vec4(WorldPos, 1.0);
+#endif
 }
 )";
 
 const char* sexyFragmentShader = R"(
 #version 330 core
+#ifdef TEMPORAL_SHADING
+// Split for TemporalReprojection: the ambient term with view depth, the light
+// loop (alpha 1 where it ran this frame) and motion
+layout (location = 0) out vec4 Ambient;
+layout (location = 1) out vec4 Lighting;
+layout (location = 2) out vec4 Motion;
+#else
 out vec4 FragColor;
+#endif
 
 in vec3 WorldPos;
 in vec3 Normal;
 in vec2 TexCoord;
 in vec3 ViewPos;
 
-uniform vec3 scatteringCoeff;
-uniform vec3 absorptionCoeff;
-uniform float scatteringDistance;
-uniform vec3 internalColor;
-uniform float thickness;
-uniform float roughness;
-uniform float subsurfaceMix;
-uniform float materialType;
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 camPosTime;
+    vec4 clusterScale;
+    vec4 clusterDims;
+    mat4 previousViewProjection;
+    vec4 temporal;
+};
+
+struct Material {
+    vec4 scattering;
+    vec4 absorption;
+    vec4 internalColor;
+    vec4 params;
+};
+
+layout (std140) uniform Materials {
+    Material materials[4];
+};
 
-uniform vec3 lightPositions[4];
-uniform vec3 lightColors[4];
-uniform vec3 camPos;
-uniform float time;
+uniform int materialIndex;
+
+// Surface material from the model file: colour, albedo map (alpha-tested when
+// alphaMask is set) and a BC5 normal map. Off for meshes without one, which
+// keep the fixed demo albedo.
+uniform bool surfaceMaterial;
+uniform vec3 surfaceColor;
+uniform bool hasAlbedoMap;
+uniform bool hasNormalMap;
+uniform bool alphaMask;
+uniform sampler2D albedoMap;
+uniform sampler2D normalMap;
+
+// Clustered lights: two texels per light (position + radius, color), an
+// (offset, count) pair per cluster and the flattened per-cluster light lists
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterLights;
+
+// Precomputed material tables (material_luts.h); off means the analytic path
+uniform bool materialLuts;
+uniform sampler2D scatterLut;
+uniform sampler2D schlickLut;
+uniform float maxCurvature;
+uniform vec3 transmissionColor;
+
+// Unpacked from materials[materialIndex] at the top of main()
+vec3 scatteringCoeff;
+vec3 absorptionCoeff;
+float scatteringDistance;
+vec3 internalColor;
+float thickness;
+float roughness;
+float subsurfaceMix;
+float materialType;
 
 const float PI = 3.14159265359;
 
@@ -172,6 +329,43 @@ vec3 calculateEnhancedSSS(vec3 L, vec3 N, vec3 V, vec3 lightColor) {
     return (scatteredLight + transmittedLight) * attenuation;
 }
 
+// Tables hold coordinate i / (size - 1) in texel i; shift onto texel centres
+vec2 lutCoord(vec2 t, sampler2D lut) {
+    vec2 size = vec2(textureSize(lut, 0));
+    return (t * (size - 1.0) + 0.5) / size;
+}
+
+// Same terms as calculateDisneySSS with the Schlick weights read from a table:
+// (1 + k FL)(1 + k FV) = 1 + k (FL + FV) + k^2 FL FV, and the fss term
+// multiplied through by NdotL * NdotV so it needs no division.
+vec3 lutDisneySSS(vec3 L, vec3 N, vec3 V, vec3 lightColor, vec3 albedo) {
+    float NdotL = max(dot(N, L), 0.0);
+    float NdotV = max(dot(N, V), 0.0);
+    if (NdotL <= 0.0 || NdotV <= 0.0) return vec3(0.0);
+
+    float HdotL = max(dot(normalize(L + V), L), 0.0);
+    vec2 schlick = texture(schlickLut, lutCoord(vec2(NdotL, NdotV), schlickLut)).rg;
+
+    float kd = 2.0 * roughness * HdotL * HdotL - 0.5;
+    float kss = roughness * HdotL * HdotL - 1.0;
+    float fd = 1.0 + kd * schlick.x + kd * kd * schlick.y;
+    float FSS = 1.0 + kss * schlick.x + kss * kss * schlick.y;
+
+    float nn = NdotL * NdotV;
+    vec3 fdiff = (albedo / PI) * ((1.0 - subsurfaceMix) * nn * fd + 1.25 * subsurfaceMix * ((1.0 - 0.5 * nn) * FSS + 0.5 * nn));
+    return fdiff * lightColor;
+}
+
+// Scattered term from the pre-integrated table; the transmitted term's
+// material factors are folded into transmissionColor on the CPU
+vec3 lutEnhancedSSS(vec3 L, vec3 N, vec3 V, vec3 lightColor, float curvature) {
+    vec3 scattered = texture(scatterLut, lutCoord(vec2(dot(N, L) * 0.5 + 0.5, curvature), scatterLut)).rgb;
+
+    vec3 H = normalize(L + N * scatteringDistance);
+    float VdotH = max(0.0, dot(-V, H));
+    return lightColor * (scattered + transmissionColor * (VdotH * VdotH * VdotH));
+}
+
 vec3 calculateRimLighting(vec3 N, vec3 V, vec3 lightColor) {
     float rimPower = 2.0;
     float rimIntensity = 0.5;
@@ -180,6 +374,38 @@ vec3 calculateRimLighting(vec3 N, vec3 V, vec3 lightColor) {
     return lightColor * rim * vec3(0.8, 0.9, 1.0);
 }
 
+// Tangent frame from screen-space derivatives, since meshes carry no tangents.
+// The map stores X and Y (Y up the image) and Z is rebuilt; flipped UVs run
+// t down the image, hence the negated bitangent.
+vec3 perturbNormal(vec3 N, vec3 P, vec2 uv) {
+    vec3 dp1 = dFdx(P);
+    vec3 dp2 = dFdy(P);
+    vec2 duv1 = dFdx(uv);
+    vec2 duv2 = dFdy(uv);
+    vec3 dp2perp = cross(dp2, N);
+    vec3 dp1perp = cross(N, dp1);
+    vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+    float scale = inversesqrt(max(max(dot(T, T), dot(B, B)), 1e-20));
+    vec2 xy = texture(normalMap, uv).rg * 2.0 - 1.0;
+    vec3 n = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+    return normalize(mat3(T * scale, -B * scale, N) * n);
+}
+
+#ifdef TEMPORAL_SHADING
+// One screen tile in temporal.w runs the light loop each frame: a checkerboard
+// of tiles for 2, one tile of every 2x2 block for 4. Whole tiles, not single
+// pixels, so every quad and warp either runs the loop or skips it.
+bool shadedThisFrame() {
+    ivec2 tile = ivec2(gl_FragCoord.xy) / TEMPORAL_TILE_SIZE;
+    int phase = int(temporal.z);
+    int rate = int(temporal.w);
+    if (rate == 2) return ((tile.x + tile.y + phase) & 1) == 0;
+    if (rate == 4) return (tile.x & 1) + 2 * (tile.y & 1) == (phase & 3);
+    return true;
+}
+#endif
+
 vec3 calculateSceneGI(vec3 worldPos, vec3 normal) {
     vec3 ambient = vec3(0.08, 0.08, 0.12);
 
@@ -193,28 +419,79 @@ vec3 calculateSceneGI(vec3 worldPos, vec3 normal) {
 }
 
 void main() {
+    Material m = materials[materialIndex];
+    scatteringCoeff = m.scattering.xyz;
+    scatteringDistance = m.scattering.w;
+    absorptionCoeff = m.absorption.xyz;
+    thickness = m.absorption.w;
+    internalColor = m.internalColor.xyz;
+    roughness = m.internalColor.w;
+    subsurfaceMix = m.params.x;
+    materialType = m.params.y;
+
+    vec4 surfaceTexel = hasAlbedoMap ? texture(albedoMap, TexCoord) : vec4(1.0);
+    if (alphaMask && surfaceTexel.a < 0.5) discard;
+
     vec3 N = normalize(Normal);
-    vec3 V = normalize(camPos - WorldPos);
+    if (hasNormalMap) N = perturbNormal(N, WorldPos, TexCoord);
+    vec3 V = normalize(camPosTime.xyz - WorldPos);
+
+    vec3 albedo = surfaceMaterial ? surfaceColor * surfaceTexel.rgb : vec3(0.8, 0.6, 0.5);
+    // The scattering model's own colour comes from the SSS material; surface
+    // albedo tints it
+    vec3 surfaceTint = surfaceMaterial ? albedo : vec3(1.0);
+    vec3 globalIllum = calculateSceneGI(WorldPos, N) * surfaceTint;
 
-    vec3 globalIllum = calculateSceneGI(WorldPos, N);
-    vec3 albedo = vec3(0.8, 0.6, 0.5);
+    // Screen-space curvature estimate, normalized to the scatter table's range
+    float curvature = clamp(length(fwidth(N)) / max(length(fwidth(WorldPos)), 1e-6) / maxCurvature, 0.0, 1.0);
 
     vec3 totalLighting = vec3(0.0);
     vec3 totalRim = vec3(0.0);
 
-    for(int i = 0; i < 4; ++i) {
-        vec3 L = normalize(lightPositions[i] - WorldPos);
-        float distance = length(lightPositions[i] - WorldPos);
-        float attenuation = 1.0 / (distance * distance + 1.0);
-        vec3 radiance = lightColors[i] * attenuation;
-
-        vec3 disneySSS = calculateDisneySSS(L, N, V, radiance, albedo);
-        vec3 enhancedSSS = calculateEnhancedSSS(L, N, V, radiance);
+    ivec3 dims = ivec3(clusterDims.xyz);
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy * clusterScale.xy),
+                          int(floor(log(max(-ViewPos.z, 1e-4)) * clusterScale.z + clusterScale.w)));
+    cluster = clamp(cluster, ivec3(0), dims - 1);
+    uvec2 range = texelFetch(clusterRanges, (cluster.z * dims.y + cluster.y) * dims.x + cluster.x).xy;
+#ifdef TEMPORAL_SHADING
+    bool shaded = shadedThisFrame();
+    if (!shaded) range.y = 0u;
+#endif
+
+    for (uint k = 0u; k < range.y; ++k) {
+        int light = int(texelFetch(clusterLights, int(range.x + k)).r);
+        vec4 positionRadius = texelFetch(lightData, light * 2);
+        vec3 lightColor = texelFetch(lightData, light * 2 + 1).xyz;
+
+        vec3 L = normalize(positionRadius.xyz - WorldPos);
+        float distance = length(positionRadius.xyz - WorldPos);
+        // Windowed so the light fades to exactly zero at its cluster radius
+        float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (distance * distance + 1.0);
+        vec3 radiance = lightColor * attenuation;
+
+        vec3 disneySSS, enhancedSSS;
+        if (materialLuts) {
+            disneySSS = lutDisneySSS(L, N, V, radiance, albedo);
+            enhancedSSS = lutEnhancedSSS(L, N, V, radiance, curvature);
+        } else {
+            disneySSS = calculateDisneySSS(L, N, V, radiance, albedo);
+            enhancedSSS = calculateEnhancedSSS(L, N, V, radiance);
+        }
 
-        totalLighting += disneySSS * 0.06 + enhancedSSS * 0.94;
+        totalLighting += disneySSS * 0.06 + enhancedSSS * 0.94 * surfaceTint;
         totalRim += calculateRimLighting(N, V, radiance);
     }
 
+#ifdef TEMPORAL_SHADING
+    // Jitter taken out so a still camera has zero motion
+    vec4 current = viewProjection * vec4(WorldPos, 1.0);
+    vec4 previous = previousViewProjection * vec4(WorldPos, 1.0);
+    vec2 velocity = (current.xy / current.w - temporal.xy - previous.xy / previous.w) * 0.5;
+    Ambient = vec4(globalIllum * 0.2, -ViewPos.z);
+    Lighting = vec4(totalLighting + totalRim * 0.3, shaded ? 1.0 : 0.0);
+    Motion = vec4(velocity, previous.w, 0.0);
+#else
     vec3 finalColor = globalIllum * 0.2 + totalLighting + totalRim * 0.3;
 
     finalColor = finalColor * 1.2;
@@ -224,15 +501,57 @@ void main() {
 
     finalColor = pow(finalColor, vec3(1.0/2.2));
     FragColor = vec4(finalColor, 1.0);
+#endif
 }
 )";
 
+LoadedMesh toLoadedMesh(Procedural::Geometry& geometry) {
+    LoadedMesh loaded;
+    loaded.vertices.swap(geometry.vertices);
+    loaded.indices.swap(geometry.indices);
+    loaded.useOwnedData();
+    return loaded;
+}
+
+LoadedMesh buildSphereMesh(glm::vec3 center, float radius) {
+    Procedural::Geometry sphere;
+    Procedural::appendUvSphere(sphere, center, radius, 20, 40);
+    return toLoadedMesh(sphere);
+}
+
+// Per-channel difference between two RGBA8 images of the same size
+struct ImageDifference {
+    double squared = 0.0;
+    int max = 0;
+    size_t channels = 0;
+
+    void add(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+        for (size_t i = 0; i + 3 < a.size() && i + 3 < b.size(); i += 4) {
+            for (size_t c = 0; c < 3; ++c) {
+                int difference = std::abs(int(a[i + c]) - int(b[i + c]));
+                squared += double(difference) * difference;
+                max = std::max(max, difference);
+                channels++;
+            }
+        }
+    }
+
+    double rmse() const { return channels > 0 ? std::sqrt(squared / channels) : 0.0; }
+    double psnr() const { return rmse() > 0.0 ? 20.0 * std::log10(255.0 / rmse()) : 99.0; }
+};
+
 class SexySSDemo {
 private:
     GLFWwindow* window;
-    GLuint shaderProgram;
-    std::vector<Mesh> meshes;
+    DemoOptions options;
+    std::unique_ptr<ModelLoader> modelLoader;
+    std::deque<ModelLoadResult> pendingUploads;
+    size_t pendingMeshCursor = 0;
+    std::chrono::steady_clock::time_point startupTime;
+    // A deque so growing it never moves meshes that are already placed
+    std::deque<Mesh> meshes;
     std::vector<ModelInfo> models;
+    ImportMemory::Snapshot loadStartMemory;
     int currentModel = 0;
     bool showAllModels = false;
 
@@ -245,156 +564,263 @@ private:
     int currentMaterial = 0;
     const char* materialNames[4] = {"Skin", "Marble", "Wax", "Jade"};
 
-    GLuint compileShader(const char* source, GLenum shaderType) {
-        GLuint shader = glCreateShader(shaderType);
-        glShaderSource(shader, 1, &source, nullptr);
-        glCompileShader(shader);
-
-        GLint success;
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-        if (!success) {
-            char infoLog[512];
-            glGetShaderInfoLog(shader, 512, nullptr, infoLog);
-            std::cerr << "Shader compilation failed: " << infoLog << std::endl;
-        }
-        return shader;
-    }
-
-    void generateSphere(glm::vec3 center, float radius) {
-        std::vector<Vertex> vertices;
-        std::vector<unsigned int> indices;
-
-        const int latSegments = 20;
-        const int lonSegments = 40;
-
-        for (int lat = 0; lat <= latSegments; ++lat) {
-            float theta = lat * PI / latSegments;
-            float sinTheta = sin(theta);
-            float cosTheta = cos(theta);
-
-            for (int lon = 0; lon <= lonSegments; ++lon) {
-                float phi = lon * 2 * PI / lonSegments;
-                float sinPhi = sin(phi);
-                float cosPhi = cos(phi);
-
-                Vertex vertex;
-                vertex.Position = center + radius * glm::vec3(sinTheta * cosPhi, cosTheta, sinTheta * sinPhi);
-                vertex.Normal = glm::normalize(vertex.Position - center);
-                vertex.TexCoords = glm::vec2(float(lon) / lonSegments, float(lat) / latSegments);
-
-                vertices.push_back(vertex);
-            }
-        }
-
-        for (int lat = 0; lat < latSegments; ++lat) {
-            for (int lon = 0; lon < lonSegments; ++lon) {
-                int current = lat * (lonSegments + 1) + lon;
-                int next = current + lonSegments + 1;
-
-                indices.push_back(current);
-                indices.push_back(next);
-                indices.push_back(current + 1);
-
-                indices.push_back(current + 1);
-                indices.push_back(next);
-                indices.push_back(next + 1);
+    struct FrameStats {
+        size_t bvhNodesVisited = 0;
+        size_t meshesTested = 0;
+        size_t meshesCulled = 0;
+        size_t meshDraws = 0;
+        size_t drawCalls = 0;
+        size_t triangles = 0;
+        size_t trianglesCulled = 0;
+        MeshClusters::Stats clusters;
+        size_t glCalls = 0;
+        double lightBinMs = 0.0;
+        float renderScale = 1.0f;
+    };
+    FrameStats frameStats;
+
+    // A scene shading program. Locations are resolved once after linking;
+    // -1 means the uniform was optimized out.
+    struct ShadingProgram {
+        GLuint program = 0;
+        GLint drawIdBase = -1;
+        GLint octNormals = -1;
+        GLint materialIndex = -1;
+        GLint materialLuts = -1;
+        GLint transmissionColor = -1;
+        GLint surfaceMaterial = -1;
+        GLint surfaceColor = -1;
+        GLint hasAlbedoMap = -1;
+        GLint hasNormalMap = -1;
+        GLint alphaMask = -1;
+        int boundMaterial = -1;
+        int boundLuts = -1;
+    };
+    ShadingProgram forwardShading;
+    ShadingProgram sssShading;
+    ShadingProgram temporalShading;
+    // Requested in createShaders(), resolved in finishShaders() once the
+    // other passes have set up, so the driver compiles them meanwhile
+    ShaderCache::Handle forwardShadingRequest = 0;
+    ShaderCache::Handle sssShadingRequest = 0;
+    ShaderCache::Handle temporalShadingRequest = 0;
+    // Whichever of the three the current frame draws with
+    ShadingProgram* shading = &forwardShading;
+    GeometryPool geometry;
+    DrawBatcher drawBatcher;
+    UniformBlocks::UniformBuffer frameBuffer;
+    UniformBlocks::UniformBuffer materialBuffer;
+
+    bool lodEnabled = true;
+    glm::mat4 currentProjection = glm::mat4(1.0f);
+
+    // One entry per mesh per placed model; lod is last frame's pick, for hysteresis
+    struct MeshInstance {
+        size_t meshIdx;
+        uint32_t model;
+        glm::mat4 modelMatrix;
+        glm::mat3 normalMatrix;
+        Aabb worldBounds;
+        uint8_t lod;
+    };
+    std::vector<MeshInstance> instances;
+    size_t instanceBaseTriangles = 0;
+    Bvh sceneBvh;
+    double bvhBuildMs = 0.0;
+    bool instancesDirty = true;
+    bool cullingEnabled = true;
+    std::vector<uint32_t> visibleInstances;
+    MeshClusters::Culler clusterCuller;
+    bool clusterCullingEnabled = true;
+    // Instances handed to clusterCuller this frame, in job order
+    std::vector<uint32_t> clusterInstances;
+
+    // Visible instances sharing a mesh and LOD, drawn as one instanced command
+    struct InstanceGroup {
+        size_t meshIdx;
+        int lod;
+        std::vector<uint32_t> members;
+    };
+    std::vector<InstanceGroup> instanceGroups;
+    size_t instanceGroupCount = 0;
+    std::unordered_map<uint64_t, size_t> instanceGroupLookup;
+
+    SceneTarget sceneTarget;
+    HiZOcclusion occlusion;
+    bool occlusionAvailable = false;
+    bool occlusionEnabled = false;
+    // Per instance: survived last frame's Hi-Z test, so it is drawn in phase one
+    std::vector<uint8_t> wasVisible;
+    std::vector<uint32_t> candidateInstances;
+    std::vector<uint32_t> lastCandidateInstances;
+    std::vector<HiZOcclusion::Candidate> occlusionCandidates;
+    std::vector<HiZOcclusion::Result> occlusionResults;
+    // Surface per candidate, and the runs of equal surface drawSurvivors binds
+    std::vector<uint32_t> candidateSurfaces;
+    std::vector<DrawBatcher::DrawRun> candidateRuns;
+
+    struct OcclusionStats {
+        size_t tested = 0;
+        size_t drawnEarly = 0;
+        size_t drawnLate = 0;
+        size_t rejected = 0;
+        size_t lateTriangles = 0;
+    };
+    OcclusionStats occlusionStats;
+
+    DepthPrepass depthPrepass;
+    bool depthPrepassEnabled = false;
+    SampleCounter shadedSamples;
+    // Last read-back shading-pass sample count per mode (0 forward, 1 pre-pass)
+    // and the target's sample count at that time, for an overdraw ratio
+    uint64_t shadedSamplesByMode[2] = {0, 0};
+    uint64_t targetSamplesByMode[2] = {0, 0};
+    std::vector<std::pair<float, uint32_t>> drawOrder;
+
+    std::vector<PointLight> lights;
+    size_t lightCount = 4;
+    LightGrid lightGrid;
+    ClusterBuffers clusterBuffers;
+
+    ScreenSpaceSss screenSpaceSss;
+    bool screenSpaceSssAvailable = false;
+    bool screenSpaceSssEnabled = false;
+    bool compareRequested = false;
+
+    TemporalReprojection temporalReprojection;
+    bool temporalAvailable = false;
+    bool temporalEnabled = false;
+    bool temporalCompareRequested = false;
+
+    MaterialLutTextures materialLutTextures;
+    bool materialLutsEnabled = true;
+
+    // Material surfaces of the loaded models, indexed by Mesh::surface; entry 0
+    // is the untextured default every mesh without a material draws with
+    struct Surface {
+        bool material = false;
+        glm::vec3 color = glm::vec3(1.0f);
+        uint32_t albedo = TextureStreamer::NO_TEXTURE;
+        uint32_t normal = TextureStreamer::NO_TEXTURE;
+        bool alphaMap = false;
+    };
+    std::vector<Surface> surfaces{Surface()};
+    // Surface index per material of the model being uploaded
+    std::vector<uint32_t> pendingSurfaces;
+    TextureStreamer textures;
+    // Shading-pass surface state; reset by beginSurfaces()
+    uint32_t boundSurface = 0;
+    bool surfaceStateValid = false;
+    bool surfacesOverPrepass = false;
+    bool maskedDepthState = false;
+    const DrawBatcher::SurfaceBinder depthSurfaces = [this](uint32_t surface) { return !surfaceMasked(surface); };
+    const DrawBatcher::SurfaceBinder shadingSurfaces = [this](uint32_t surface) { return bindSurface(surface); };
+
+    Profiler profiler;
+    TextOverlay overlay;
+    bool overlayAvailable = false;
+    bool overlayVisible = false;
+    // Per model, this frame: meshes submitted and their triangles
+    struct ModelDrawCounts {
+        size_t meshDraws = 0;
+        size_t triangles = 0;
+    };
+    std::vector<ModelDrawCounts> modelDrawCounts;
+    // What the overlay shows, refreshed a few times a second so it stays readable
+    std::vector<Profiler::Pass> overlayPasses;
+    std::vector<ModelDrawCounts> overlayModelCounts;
+    std::chrono::steady_clock::time_point overlayRefresh;
+    int traceCaptures = 0;
+
+    FrameClock frameClock;
+    float animationTime = 0.0f;
+    ResolutionController resolution;
+    UpscalePass upscaler;
+    // Window framebuffer size, kept current by the resize callback
+    int framebufferWidth = 0;
+    int framebufferHeight = 0;
+
+    // Registers CPU-generated meshes as one model. Optimization, LODs and
+    // packing run for all meshes in parallel; only the upload is serial.
+    void addGeneratedModel(ModelInfo model, std::vector<LoadedMesh>& generated) {
+        ImportMemory::Arena arena;
+        parallelFor(generated.size(), 1, [&](size_t begin, size_t end, unsigned) {
+            for (size_t i = begin; i < end; ++i) {
+                LoadedMesh& loaded = generated[i];
+                if (options.optimizeMeshes) {
+                    MeshOptimize::optimizeMesh(loaded.vertices, loaded.indices);
+                    loaded.useOwnedData();
+                }
+                if (options.buildLods) {
+                    buildMeshLods(loaded, options.optimizeMeshes);
+                }
+                buildMeshClusters(loaded);
+                loaded.prepareForUpload(options.vertexFormat, arena);
             }
+        });
+
+        size_t gpuBytes = 0, floatBytes = 0;
+        for (LoadedMesh& loaded : generated) {
+            floatBytes += floatLayoutBytes(loaded);
+            Mesh mesh = uploadLoadedMesh(loaded);
+            gpuBytes += mesh.gpuBytes;
+            model.meshIndices.push_back(meshes.size());
+            meshes.push_back(std::move(mesh));
         }
 
-        Mesh mesh;
-        mesh.vertices = vertices;
-        mesh.indices = indices;
-        mesh.setupMesh();
-        meshes.push_back(mesh);
+        models.push_back(model);
+        std::cout << "✅ " << model.name << ": " << generated.size() << " meshes" << std::endl;
+        logGeometryBytes(gpuBytes, floatBytes);
     }
 
-    bool loadModel(const std::string& path) {
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, 
-            aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | 
-            aiProcess_GenNormals | aiProcess_PreTransformVertices);
-
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-            std::cout << "❌ Failed to load model: " << path << std::endl;
-            std::cout << "   Error: " << importer.GetErrorString() << std::endl;
-            return false;
+    Mesh uploadLoadedMesh(LoadedMesh& loaded) {
+        Mesh mesh;
+        geometry.add(mesh, loaded.gpuVertices, loaded.vertexCount, loaded.gpuIndices, loaded.indexCount,
+                     loaded.gpuIndexType);
+        mesh.boundsMin = loaded.boundsMin;
+        mesh.boundsMax = loaded.boundsMax;
+        if (loaded.format == VertexFormat::Packed) {
+            mesh.positionDecode = VertexPacking::decodeMatrix(loaded.boundsMin, loaded.boundsMax);
         }
-
-        std::cout << "✅ Loading model: " << path << std::endl;
-        std::cout << "   Meshes: " << scene->mNumMeshes << std::endl;
-
-        size_t startMeshCount = meshes.size();
-        processNode(scene->mRootNode, scene);
-        size_t endMeshCount = meshes.size();
-
-        std::cout << "   Added " << (endMeshCount - startMeshCount) << " mesh objects" << std::endl;
-        return true;
-    }
-
-    void processNode(aiNode* node, const aiScene* scene) {
-        for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            processMesh(mesh, scene);
-        }
-
-        for (unsigned int i = 0; i < node->mNumChildren; i++) {
-            processNode(node->mChildren[i], scene);
+        mesh.boundsCenter = 0.5f * (loaded.boundsMin + loaded.boundsMax);
+        mesh.boundsRadius = 0.5f * glm::length(loaded.boundsMax - loaded.boundsMin);
+        mesh.lods = std::move(loaded.lods);
+        if (mesh.lods.empty()) {
+            mesh.lods.push_back(MeshLod{0, uint32_t(loaded.indexCount), 0.0f});
         }
+        mesh.clusters = std::move(loaded.clusters);
+        return mesh;
     }
 
-    void processMesh(aiMesh* mesh, const aiScene* scene) {
-        std::vector<Vertex> vertices;
-        std::vector<unsigned int> indices;
-
-        for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-            Vertex vertex;
-
-            vertex.Position.x = mesh->mVertices[i].x;
-            vertex.Position.y = mesh->mVertices[i].y;
-            vertex.Position.z = mesh->mVertices[i].z;
-
-            if (mesh->HasNormals()) {
-                vertex.Normal.x = mesh->mNormals[i].x;
-                vertex.Normal.y = mesh->mNormals[i].y;
-                vertex.Normal.z = mesh->mNormals[i].z;
-            } else {
-                vertex.Normal = glm::vec3(0.0f, 1.0f, 0.0f);
-            }
-
-            if (mesh->mTextureCoords[0]) {
-                vertex.TexCoords.x = mesh->mTextureCoords[0][i].x;
-                vertex.TexCoords.y = mesh->mTextureCoords[0][i].y;
-            } else {
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-            }
-
-            vertices.push_back(vertex);
-        }
-
-        for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-            aiFace face = mesh->mFaces[i];
-            for (unsigned int j = 0; j < face.mNumIndices; j++) {
-                indices.push_back(face.mIndices[j]);
-            }
-        }
+    static size_t floatLayoutBytes(const LoadedMesh& loaded) {
+        return loaded.vertexCount * sizeof(Vertex) + loaded.indexCount * sizeof(unsigned int);
+    }
 
-        Mesh meshObj;
-        meshObj.vertices = vertices;
-        meshObj.indices = indices;
-        meshObj.setupMesh();
-        meshes.push_back(meshObj);
+    static void logGeometryBytes(size_t gpuBytes, size_t floatBytes) {
+        double saved = floatBytes > 0 ? 100.0 * (1.0 - double(gpuBytes) / double(floatBytes)) : 0.0;
+        std::cout << "   📦 GPU geometry " << gpuBytes / 1024 << " KB (float layout " << floatBytes / 1024
+                  << " KB, saved " << (floatBytes - gpuBytes) / 1024 << " KB / " << saved << "%)" << std::endl;
     }
 
 public:
-    bool initialize() {
+    bool initialize(const DemoOptions& demoOptions) {
+        options = demoOptions;
+        lodEnabled = options.buildLods;
+        clusterCullingEnabled = options.clusterCulling;
+        startupTime = std::chrono::steady_clock::now();
+#ifdef GLFW_PLATFORM_NULL
+        // GLFW 3.4+: no display server needed; the context comes from EGL or OSMesa
+        if (options.headless) glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
         if (!glfwInit()) return false;
 
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
         glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-        glfwWindowHint(GLFW_SAMPLES, 4);
 
-        window = glfwCreateWindow(1400, 900, "🔥 Sexy Subsurface Scattering Demo 🔥", nullptr, nullptr);
+        window = options.headless ? createHeadlessWindow()
+                                  : glfwCreateWindow(options.windowWidth, options.windowHeight,
+                                                     "🔥 Sexy Subsurface Scattering Demo 🔥", nullptr, nullptr);
         if (!window) {
             glfwTerminate();
             return false;
@@ -403,57 +829,283 @@ public:
         glfwMakeContextCurrent(window);
         glfwSetWindowUserPointer(window, this);
         glfwSetKeyCallback(window, keyCallback);
+        glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+
+        GLenum glewStatus = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+        // GLX-built GLEW still loads core entry points on EGL/OSMesa contexts
+        if (options.headless && glewStatus == GLEW_ERROR_NO_GLX_DISPLAY) glewStatus = GLEW_OK;
+#endif
+        if (glewStatus != GLEW_OK) return false;
+        if (options.headless) {
+            std::cout << "🖥️ Headless " << glGetString(GL_RENDERER) << " (" << glGetString(GL_VERSION) << ")"
+                      << std::endl;
+        }
 
-        if (glewInit() != GLEW_OK) return false;
-
+        ShaderCache::global().create(options.shaderCache);
         createShaders();
+        geometry.create(options.vertexFormat);
+        drawBatcher.create();
+        if (options.textures) textures.create(options.textureBudgetMb);
+        occlusionAvailable = drawBatcher.hasMultiDrawIndirect() && occlusion.create();
+        depthPrepassEnabled = depthPrepass.create(vertexDefines()) && options.depthPrepass;
+        clusterBuffers.create();
+        lightCount = options.lightCount;
+        materialLutTextures.create();
+        materialLutsEnabled = options.materialLuts;
+        profiler.create();
+        overlayAvailable = overlay.create();
+        resolution.create();
+        resolution.setScale(options.renderScale);
+        if (options.frameBudgetMs > 0.0) resolution.setBudgetMs(options.frameBudgetMs);
+        resolution.setAdaptive(options.frameBudgetMs > 0.0);
+        upscaler.create();
+        finishShaders();
+        screenSpaceSssEnabled = screenSpaceSssAvailable && options.screenSpaceSss;
+        temporalEnabled = temporalAvailable && options.temporal;
+        temporalReprojection.setRate(options.temporalRate);
+        if (!options.tracePath.empty()) startTrace();
+        shadedSamples.create();
         loadAllModels();
 
         glEnable(GL_DEPTH_TEST);
         glEnable(GL_MULTISAMPLE);
-        glClearColor(0.02f, 0.02f, 0.05f, 1.0f);
+        glClearColor(BACKGROUND_COLOR.x, BACKGROUND_COLOR.y, BACKGROUND_COLOR.z, 1.0f);
 
-        printControls();
+        if (!options.headless) printControls();
         return true;
     }
 
+    // Invisible window whose only purpose is the context: EGL first (Mesa's
+    // surfaceless/llvmpipe paths), then OSMesa, then whatever the platform has.
+    // All rendering goes to the offscreen SceneTarget anyway.
+    GLFWwindow* createHeadlessWindow() {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        const int contextApis[] = {GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API, GLFW_NATIVE_CONTEXT_API};
+        for (int api : contextApis) {
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, api);
+            GLFWwindow* created = glfwCreateWindow(options.windowWidth, options.windowHeight, "sss_demo benchmark",
+                                                   nullptr, nullptr);
+            if (created) return created;
+        }
+        return nullptr;
+    }
+
     void createShaders() {
-        GLuint vertexShader = compileShader(sexyVertexShader, GL_VERTEX_SHADER);
-        GLuint fragmentShader = compileShader(sexyFragmentShader, GL_FRAGMENT_SHADER);
+        frameBuffer.create(UniformBlocks::FRAME_BINDING, sizeof(UniformBlocks::FrameData), nullptr, GL_STREAM_DRAW);
+        materialBuffer.create(UniformBlocks::MATERIAL_BINDING, sizeof(UniformBlocks::MATERIAL_PRESETS),
+                              UniformBlocks::MATERIAL_PRESETS, GL_STATIC_DRAW);
+
+        ShaderCache& cache = ShaderCache::global();
+        forwardShadingRequest = cache.request(sexyVertexShader, sexyFragmentShader, {}, vertexDefines());
+        sssShadingRequest = cache.request(sexyVertexShader, SssShaders::irradianceFragment, {}, vertexDefines());
+        std::vector<std::string> temporalDefines = vertexDefines();
+        temporalDefines.push_back("TEMPORAL_SHADING");
+        temporalDefines.push_back("TEMPORAL_TILE_SIZE " + std::to_string(TemporalReprojection::TILE_SIZE));
+        temporalShadingRequest = cache.request(sexyVertexShader, sexyFragmentShader, {}, temporalDefines);
+    }
 
-        shaderProgram = glCreateProgram();
-        glAttachShader(shaderProgram, vertexShader);
-        glAttachShader(shaderProgram, fragmentShader);
-        glLinkProgram(shaderProgram);
+    void finishShaders() {
+        ShaderCache& cache = ShaderCache::global();
+        linkShading(forwardShading, cache.resolve(forwardShadingRequest));
+        linkShading(sssShading, cache.resolve(sssShadingRequest));
+        screenSpaceSssAvailable = sssShading.program && screenSpaceSss.create();
+        linkShading(temporalShading, cache.resolve(temporalShadingRequest));
+        temporalAvailable = temporalShading.program && temporalReprojection.create();
+
+        const ShaderCache::Stats& stats = cache.stats();
+        const char* state = !cache.hasBinaries() ? "no binary cache"
+                            : stats.binaryHits == stats.programs ? "warm cache"
+                            : stats.binaryHits == 0 ? "cold cache"
+                                                    : "partly cached";
+        std::cout << "🧊 Shaders: " << stats.programs << " programs, " << stats.binaryHits << " from binaries, "
+                  << stats.compiled << " compiled" << (cache.hasParallelCompile() ? " in parallel" : "") << ", "
+                  << stats.ms << " ms blocked (" << state << "); renderer ready "
+                  << millisecondsSince(startupTime) << " ms after startup" << std::endl;
+        if (stats.failed > 0) std::cout << "   ⚠️ " << stats.failed << " program(s) failed to build" << std::endl;
+    }
 
-        GLint success;
-        glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-        if (!success) {
-            char infoLog[512];
-            glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
-            std::cerr << "Shader linking failed: " << infoLog << std::endl;
+    // Vertex shader variant shared by the shading programs and the depth pre-pass
+    std::vector<std::string> vertexDefines() const {
+        std::vector<std::string> defines;
+        if (options.perVertexNormalMatrix) defines.push_back("PER_VERTEX_NORMAL_MATRIX");
+        return defines;
+    }
+
+    void linkShading(ShadingProgram& target, GLuint program) {
+        target = ShadingProgram();
+        target.program = program;
+        if (!target.program) return;
+
+        target.drawIdBase = glGetUniformLocation(target.program, "drawIdBase");
+        target.octNormals = glGetUniformLocation(target.program, "octNormals");
+        target.materialIndex = glGetUniformLocation(target.program, "materialIndex");
+        target.materialLuts = glGetUniformLocation(target.program, "materialLuts");
+        target.transmissionColor = glGetUniformLocation(target.program, "transmissionColor");
+        target.surfaceMaterial = glGetUniformLocation(target.program, "surfaceMaterial");
+        target.surfaceColor = glGetUniformLocation(target.program, "surfaceColor");
+        target.hasAlbedoMap = glGetUniformLocation(target.program, "hasAlbedoMap");
+        target.hasNormalMap = glGetUniformLocation(target.program, "hasNormalMap");
+        target.alphaMask = glGetUniformLocation(target.program, "alphaMask");
+
+        UniformBlocks::bindBlock(target.program, "FrameData", UniformBlocks::FRAME_BINDING);
+        if (target.materialIndex >= 0) {
+            UniformBlocks::bindBlock(target.program, "Materials", UniformBlocks::MATERIAL_BINDING);
         }
 
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
+        glUseProgram(target.program);
+        glUniform1i(glGetUniformLocation(target.program, "drawData"), DrawBatcher::DRAW_DATA_UNIT);
+        glUniform1i(target.octNormals, options.vertexFormat == VertexFormat::Packed);
+        ClusterBuffers::bindSamplers(target.program);
+        MaterialLutTextures::bindSamplers(target.program);
+        TextureStreamer::bindSamplers(target.program);
     }
 
     void loadAllModels() {
+        loadStartMemory = ImportMemory::snapshot();
+        auto sphereStart = std::chrono::steady_clock::now();
         generateTestSpheres();
+        std::cout << "⏱️ Test spheres ready in " << millisecondsSince(sphereStart) << " ms" << std::endl;
+        if (options.proceduralTriangles > 0) generateProceduralShapes();
+
+        LoaderSettings loaderSettings;
+        loaderSettings.useMeshCache = options.useMeshCache;
+        loaderSettings.nativeObj = options.nativeObj;
+        loaderSettings.optimizeMeshes = options.optimizeMeshes;
+        loaderSettings.buildLods = options.buildLods;
+        loaderSettings.vertexFormat = options.vertexFormat;
+        modelLoader = std::make_unique<ModelLoader>(loaderSettings);
+
+        for (const ModelSource& source : modelSources) {
+            loadModelWithInfo(source.path, source.name, source.description,
+                              source.scale, source.position, source.cameraDistance);
+        }
+
+        std::cout << "🚚 Streaming " << (models.size() - 1) << " models in the background" << std::endl;
+    }
+
+    // GL-thread stage: uploads finished meshes until the per-frame budget is
+    // spent. At least one mesh goes up per frame so large scans still progress.
+    void uploadLoadedMeshes() {
+        if (!modelLoader) return;
+
+        ModelLoadResult result;
+        while (modelLoader->poll(result)) {
+            pendingUploads.push_back(std::move(result));
+        }
+
+        auto frameStart = std::chrono::steady_clock::now();
+        bool uploadedThisFrame = false;
+
+        while (!pendingUploads.empty()) {
+            ModelLoadResult& current = pendingUploads.front();
+            auto modelIt = std::find_if(models.begin(), models.end(),
+                                        [&](const ModelInfo& m) { return m.sourcePath == current.path; });
+
+            if (!current.success || modelIt == models.end()) {
+                std::cout << "❌ Failed to load model: " << current.path << std::endl;
+                std::cout << "   Error: " << current.error << std::endl;
+                if (modelIt != models.end()) removeModel(size_t(modelIt - models.begin()));
+                pendingUploads.pop_front();
+                continue;
+            }
+
+            if (pendingMeshCursor == 0) {
+                if (uploadedThisFrame && millisecondsSince(frameStart) >= options.uploadBudgetMs) return;
+                current.timings.queuedMs = millisecondsSince(current.finishedAt);
+                addSurfaces(current.materials);
+            }
+
+            auto sliceStart = std::chrono::steady_clock::now();
+            while (pendingMeshCursor < current.meshes.size()) {
+                if (uploadedThisFrame && millisecondsSince(frameStart) >= options.uploadBudgetMs) {
+                    current.timings.uploadMs += millisecondsSince(sliceStart);
+                    current.timings.uploadFrames++;
+                    return;
+                }
+
+                LoadedMesh& loaded = current.meshes[pendingMeshCursor++];
+                Mesh mesh = uploadLoadedMesh(loaded);
+                if (loaded.material < pendingSurfaces.size()) mesh.surface = pendingSurfaces[loaded.material];
+                current.gpuBytes += mesh.gpuBytes;
+                current.floatBytes += floatLayoutBytes(loaded);
+                loaded = LoadedMesh();
+
+                modelIt->meshIndices.push_back(meshes.size());
+                meshes.push_back(std::move(mesh));
+                instancesDirty = true;
+                uploadedThisFrame = true;
+            }
+
+            current.timings.uploadMs += millisecondsSince(sliceStart);
+            current.timings.uploadFrames++;
+            logModelTimings(*modelIt, current);
+
+            pendingUploads.pop_front();
+            pendingMeshCursor = 0;
+        }
 
-        loadModelWithInfo("models/bunny.obj", "Stanford Bunny", "Classic test model with complex geometry", 
-                         glm::vec3(0.1f), glm::vec3(0, 0, 0), glm::vec3(0, 0, 6));
+        if (modelLoader->idle()) {
+            modelLoader.reset();
+            std::cout << "🎨 Loaded " << models.size() << " model groups with " << meshes.size()
+                      << " total meshes, " << millisecondsSince(startupTime) << " ms after startup" << std::endl;
+            reportLoadMemory();
+        }
+    }
 
-        loadModelWithInfo("models/lucy.obj", "Stanford Lucy", "High-detail scan perfect for SSS", 
-                         glm::vec3(0.005f), glm::vec3(3, 0, 0), glm::vec3(0, 0, 10));
+    // Maps a model's materials to new surfaces and queues their textures. The
+    // material colour stands in until the albedo map is resident.
+    void addSurfaces(const std::vector<MaterialSource>& materials) {
+        pendingSurfaces.clear();
+        for (const MaterialSource& material : materials) {
+            Surface surface;
+            surface.material = true;
+            surface.color = material.diffuseColor;
+            surface.albedo = textures.request(material.diffuseMap, material.alphaMap, TextureCompress::Kind::Color);
+            surface.normal = textures.request(material.normalMap, "", TextureCompress::Kind::Normal);
+            surface.alphaMap = surface.albedo != TextureStreamer::NO_TEXTURE && !material.alphaMap.empty();
+            pendingSurfaces.push_back(uint32_t(surfaces.size()));
+            surfaces.push_back(surface);
+        }
+    }
 
-        loadModelWithInfo("models/dragon.obj", "Stanford Dragon", "Complex surface details showcase", 
-                         glm::vec3(0.008f), glm::vec3(-3, 0, 0), glm::vec3(0, 0, 8));
+    // Loading streams in the background, so this runs once the last model is
+    // uploaded rather than when loadAllModels() returns
+    void reportLoadMemory() {
+        ImportMemory::trimHeap();
+        size_t gpuBytes = 0, cpuBytes = 0;
+        for (const Mesh& mesh : meshes) {
+            gpuBytes += mesh.gpuBytes;
+            cpuBytes += sizeof(Mesh) + mesh.cpuBytes();
+        }
+        ImportMemory::printReport(loadStartMemory, gpuBytes, cpuBytes);
+    }
 
-        loadModelWithInfo("models/sponza/sponza.obj", "Intel Sponza", "Architectural test scene", 
-                         glm::vec3(0.01f), glm::vec3(0, -2, 0), glm::vec3(0, 5, 15));
+    void logModelTimings(const ModelInfo& model, const ModelLoadResult& result) {
+        const LoadTimings& t = result.timings;
+        std::cout << (result.fromCache ? "⚡ " : "✅ ") << model.name << " (" << result.path << "): "
+                  << result.meshes.size() << " meshes" << std::endl;
+        std::cout << "   ⏱️ cache " << t.cacheMs << " ms | import" << (result.nativeImport ? " (native OBJ) " : " ")
+                  << t.importMs << " ms | convert "
+                  << t.convertMs << " ms | optimize " << t.optimizeMs << " ms | LOD " << t.lodMs << " ms | clusters "
+                  << t.clusterMs << " ms | cache write " << t.cacheWriteMs << " ms | pack " << t.packMs
+                  << " ms | queued " << t.queuedMs << " ms | upload " << t.uploadMs << " ms over "
+                  << t.uploadFrames << " frame(s)" << std::endl;
+        logGeometryBytes(result.gpuBytes, result.floatBytes);
+        if (!result.error.empty()) {
+            std::cout << "   ⚠️ " << result.error << std::endl;
+        }
+    }
+
+    void removeModel(size_t index) {
+        bool wasCurrent = currentModel == int(index);
+        models.erase(models.begin() + index);
+        instancesDirty = true;
 
-        std::cout << "🎨 Loaded " << models.size() << " model groups with " << meshes.size() << " total meshes" << std::endl;
+        if (currentModel > int(index)) currentModel--;
+        if (currentModel >= int(models.size())) currentModel = 0;
+        if (wasCurrent) updateCameraForCurrentModel();
     }
 
     void generateTestSpheres() {
@@ -464,41 +1116,93 @@ public:
         sphereModel.idealPosition = glm::vec3(0, 0, 0);
         sphereModel.cameraDistance = glm::vec3(0, 2, 8);
 
-        size_t startIdx = meshes.size();
+        std::vector<LoadedMesh> spheres;
+        spheres.push_back(buildSphereMesh(glm::vec3(0, 0, 0), 1.0f));
+        spheres.push_back(buildSphereMesh(glm::vec3(-2.5f, 0, 0), 0.8f));
+        spheres.push_back(buildSphereMesh(glm::vec3(2.5f, 0, 0), 1.2f));
+        spheres.push_back(buildSphereMesh(glm::vec3(0, 2.0f, 0), 0.6f));
+        addGeneratedModel(sphereModel, spheres);
+    }
 
-        generateSphere(glm::vec3(0, 0, 0), 1.0f);
-        generateSphere(glm::vec3(-2.5f, 0, 0), 0.8f);
-        generateSphere(glm::vec3(2.5f, 0, 0), 1.2f);
-        generateSphere(glm::vec3(0, 2.0f, 0), 0.6f);
+    // One mesh per procedural shape at --procedural triangles each: smooth and
+    // geodesic spheres, a torus, a noise-displaced sphere for curvature
+    // variation and two slabs of different thickness for transmission.
+    void generateProceduralShapes() {
+        ModelInfo shapesModel;
+        shapesModel.name = "Procedural Shapes";
+        shapesModel.description = "Dense generated surfaces for SSS stress tests";
+        shapesModel.idealScale = glm::vec3(1.0f);
+        shapesModel.idealPosition = glm::vec3(0, 0, 0);
+        shapesModel.cameraDistance = glm::vec3(0, 2, 10);
+
+        const size_t triangles = std::min(options.proceduralTriangles, Procedural::MAX_TRIANGLES);
+        struct ShapeSpec {
+            Procedural::Shape shape;
+            glm::vec3 center;
+        };
+        const ShapeSpec specs[] = {
+            {Procedural::Shape::UvSphere, glm::vec3(-3.0f, 0, 0)},
+            {Procedural::Shape::Icosphere, glm::vec3(0, 0, 0)},
+            {Procedural::Shape::Torus, glm::vec3(3.0f, 0, 0)},
+            {Procedural::Shape::NoiseSphere, glm::vec3(-1.5f, 2.5f, 0)},
+            {Procedural::Shape::Slab, glm::vec3(1.5f, 2.5f, 0)},
+        };
 
-        for (size_t i = startIdx; i < meshes.size(); ++i) {
-            sphereModel.meshIndices.push_back(i);
+        std::vector<LoadedMesh> generated;
+        auto start = std::chrono::steady_clock::now();
+        for (const ShapeSpec& spec : specs) {
+            auto shapeStart = std::chrono::steady_clock::now();
+            Procedural::Geometry geometry;
+            switch (spec.shape) {
+                case Procedural::Shape::UvSphere:
+                    Procedural::appendUvSphere(geometry, spec.center, 1.0f, triangles);
+                    break;
+                case Procedural::Shape::Icosphere:
+                    Procedural::appendIcosphere(geometry, spec.center, 1.0f, triangles);
+                    break;
+                case Procedural::Shape::Torus:
+                    Procedural::appendTorus(geometry, spec.center, 0.9f, 0.35f, triangles);
+                    break;
+                case Procedural::Shape::NoiseSphere:
+                    Procedural::appendNoiseSphere(geometry, spec.center, 1.0f, triangles);
+                    break;
+                case Procedural::Shape::Slab:
+                    // Half the budget each: a 2 cm and a 10 cm sheet side by side
+                    Procedural::appendSlab(geometry, spec.center - glm::vec3(0.6f, 0, 0), glm::vec3(1.0f, 1.6f, 0.02f),
+                                           triangles / 2);
+                    Procedural::appendSlab(geometry, spec.center + glm::vec3(0.6f, 0, 0), glm::vec3(1.0f, 1.6f, 0.1f),
+                                           triangles / 2);
+                    break;
+            }
+            std::cout << "   🔷 " << Procedural::shapeName(spec.shape) << ": " << geometry.triangleCount()
+                      << " triangles in " << millisecondsSince(shapeStart) << " ms" << std::endl;
+            generated.push_back(toLoadedMesh(geometry));
         }
+        double generateMs = millisecondsSince(start);
 
-        models.push_back(sphereModel);
+        addGeneratedModel(shapesModel, generated);
+        std::cout << "⏱️ Procedural shapes generated in " << generateMs << " ms, ready in " << millisecondsSince(start)
+                  << " ms" << std::endl;
     }
 
-    bool loadModelWithInfo(const std::string& path, const std::string& name, 
+    void loadModelWithInfo(const std::string& path, const std::string& name, 
                           const std::string& desc, glm::vec3 scale, glm::vec3 pos, glm::vec3 camDist) {
-        size_t startIdx = meshes.size();
-
-        if (!loadModel(path)) {
-            return false;
-        }
-
         ModelInfo modelInfo;
         modelInfo.name = name;
+        modelInfo.sourcePath = path;
         modelInfo.description = desc;
         modelInfo.idealScale = scale;
         modelInfo.idealPosition = pos;
         modelInfo.cameraDistance = camDist;
 
-        for (size_t i = startIdx; i < meshes.size(); ++i) {
-            modelInfo.meshIndices.push_back(i);
-        }
-
         models.push_back(modelInfo);
-        return true;
+        modelLoader->enqueue(path);
+    }
+
+    static void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
+        SexySSDemo* demo = static_cast<SexySSDemo*>(glfwGetWindowUserPointer(window));
+        demo->framebufferWidth = width;
+        demo->framebufferHeight = height;
     }
 
     static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
@@ -512,13 +1216,16 @@ public:
         switch (key) {
             case GLFW_KEY_SPACE:
                 currentModel = (currentModel + 1) % models.size();
+                instancesDirty = true;
                 updateCameraForCurrentModel();
                 std::cout << "🎯 Now showing: " << models[currentModel].name 
-                         << " - " << models[currentModel].description << std::endl;
+                         << " - " << models[currentModel].description
+                         << (models[currentModel].meshIndices.empty() ? " (still loading)" : "") << std::endl;
                 break;
 
             case GLFW_KEY_TAB:
                 showAllModels = !showAllModels;
+                instancesDirty = true;
                 std::cout << (showAllModels ? "🌟 Showing all models" : "🎯 Single model mode") << std::endl;
                 break;
 
@@ -532,6 +1239,170 @@ public:
                 std::cout << (autoRotate ? "🔄 Auto-rotation ON" : "⏸️ Auto-rotation OFF") << std::endl;
                 break;
 
+            case GLFW_KEY_L:
+                lodEnabled = !lodEnabled;
+                std::cout << (lodEnabled ? "🔻 LOD selection ON" : "🔺 LOD selection OFF (full detail)")
+                          << " - last frame drew " << frameStats.triangles << " triangles" << std::endl;
+                break;
+
+            case GLFW_KEY_LEFT_BRACKET:
+            case GLFW_KEY_RIGHT_BRACKET:
+                options.lodPixelError = glm::clamp(options.lodPixelError * (key == GLFW_KEY_RIGHT_BRACKET ? 2.0f : 0.5f),
+                                                   0.125f, 64.0f);
+                std::cout << "🔍 LOD screen-space error: " << options.lodPixelError << " px" << std::endl;
+                break;
+
+            case GLFW_KEY_O:
+                if (!occlusionAvailable) {
+                    std::cout << "⚠️ Hi-Z occlusion culling needs GL 4.3 or ARB_multi_draw_indirect" << std::endl;
+                    break;
+                }
+                occlusionEnabled = !occlusionEnabled;
+                std::fill(wasVisible.begin(), wasVisible.end(), 0);
+                lastCandidateInstances.clear();
+                std::cout << (occlusionEnabled ? "🧱 Hi-Z occlusion culling ON" : "🧱 Hi-Z occlusion culling OFF") << std::endl;
+                break;
+
+            case GLFW_KEY_P:
+                depthPrepassEnabled = !depthPrepassEnabled;
+                shadedSamples.reset();
+                std::cout << (depthPrepassEnabled ? "🎭 Depth pre-pass ON" : "🎭 Depth pre-pass OFF") << std::endl;
+                break;
+
+            case GLFW_KEY_MINUS:
+            case GLFW_KEY_EQUAL:
+                lightCount = key == GLFW_KEY_EQUAL ? std::min<size_t>(lightCount * 2, MAX_SCENE_LIGHTS)
+                                                   : std::max<size_t>(lightCount / 2, 4);
+                std::cout << "💡 " << lightCount << " point lights" << std::endl;
+                break;
+
+            case GLFW_KEY_B:
+                if (!screenSpaceSssAvailable) {
+                    std::cout << "⚠️ Screen-space SSS shaders failed to build" << std::endl;
+                    break;
+                }
+                screenSpaceSssEnabled = !screenSpaceSssEnabled;
+                std::cout << (screenSpaceSssEnabled ? "🌫️ Shading: screen-space diffusion blur"
+                                                    : "🌫️ Shading: per-light forward SSS") << std::endl;
+                break;
+
+            case GLFW_KEY_K:
+                if (screenSpaceSssAvailable) compareRequested = true;
+                break;
+
+            case GLFW_KEY_J:
+                if (!temporalAvailable) {
+                    std::cout << "⚠️ Temporal shading shaders failed to build" << std::endl;
+                    break;
+                }
+                temporalEnabled = !temporalEnabled;
+                if (temporalEnabled) {
+                    std::cout << "⏳ Temporal mode ON: 1 in " << temporalReprojection.getRate()
+                              << " pixels lit per frame, TAA instead of MSAA"
+                              << (screenSpaceSssEnabled ? " (forward SSS only, press B)" : "") << std::endl;
+                } else {
+                    std::cout << "⏳ Temporal mode OFF: full-rate shading with MSAA" << std::endl;
+                }
+                break;
+
+            case GLFW_KEY_U:
+                if (temporalAvailable) temporalCompareRequested = true;
+                break;
+
+            case GLFW_KEY_T:
+                materialLutsEnabled = !materialLutsEnabled;
+                std::cout << (materialLutsEnabled ? "🧮 Material terms: precomputed LUTs"
+                                                  : "🧮 Material terms: analytic") << std::endl;
+                break;
+
+            case GLFW_KEY_C:
+                cullingEnabled = !cullingEnabled;
+                std::cout << (cullingEnabled ? "✂️ Frustum culling ON" : "✂️ Frustum culling OFF") << std::endl;
+                break;
+
+            case GLFW_KEY_N:
+                clusterCullingEnabled = !clusterCullingEnabled;
+                std::cout << (clusterCullingEnabled ? "🧩 Cluster culling ON" : "🧩 Cluster culling OFF (whole meshes)")
+                          << std::endl;
+                break;
+
+            case GLFW_KEY_G:
+                std::cout << "📊 Last frame: " << frameStats.meshDraws << " meshes in " << frameStats.drawCalls
+                          << " draw calls, " << frameStats.triangles
+                          << " triangles, " << frameStats.glCalls << " GL calls" << std::endl;
+                std::cout << "   ✂️ " << instances.size() << " instances, BVH " << sceneBvh.nodeCount() << " nodes built in "
+                          << bvhBuildMs << " ms | visited " << frameStats.bvhNodesVisited << " nodes, tested "
+                          << frameStats.meshesTested << " meshes | culled " << frameStats.meshesCulled << " meshes / "
+                          << frameStats.trianglesCulled << " triangles" << std::endl;
+                if (clusterCullingEnabled && occlusionEnabled) {
+                    std::cout << "   🧩 Cluster culling is skipped while Hi-Z occlusion culling is on" << std::endl;
+                } else if (clusterCullingEnabled) {
+                    const MeshClusters::Stats& c = frameStats.clusters;
+                    std::cout << "   🧩 " << c.instances << " clustered instances, " << c.tested << " clusters tested in "
+                              << c.ms << " ms | culled " << c.frustumCulled << " outside frustum, " << c.backfaceCulled
+                              << " backfacing (" << c.trianglesCulled << " of " << c.trianglesTested
+                              << " triangles) | " << c.ranges << " index ranges drawn" << std::endl;
+                }
+                std::cout << "   💡 " << lightCount << " lights binned in " << frameStats.lightBinMs << " ms | "
+                          << lightGrid.occupiedClusterCount() << "/" << LightGrid::CLUSTER_COUNT
+                          << " clusters lit, " << lightGrid.lightIndices().size() << " light refs, max "
+                          << lightGrid.maxLightsPerCluster() << " per cluster" << std::endl;
+                std::cout << "   📐 Render scale " << frameStats.renderScale << " (" << sceneTarget.getWidth() << "x"
+                          << sceneTarget.getHeight() << " for " << framebufferWidth << "x" << framebufferHeight
+                          << "), scene GPU " << resolution.getGpuMs() << " ms, frame " << frameClock.getSmoothedMs()
+                          << " ms, budget " << resolution.getBudgetMs() << " ms"
+                          << (resolution.isAdaptive() ? " (adaptive)" : " (fixed scale)") << std::endl;
+                for (int mode = 0; mode < 2; ++mode) {
+                    if (targetSamplesByMode[mode] == 0) continue;
+                    std::cout << (mode == 0 ? "   🎭 Forward: " : "   🎭 Depth pre-pass: ") << shadedSamplesByMode[mode]
+                              << " shaded samples (" << double(shadedSamplesByMode[mode]) / targetSamplesByMode[mode]
+                              << "x the " << targetSamplesByMode[mode] << " target samples)" << std::endl;
+                }
+                if (occlusionEnabled) {
+                    std::cout << "   🧱 Hi-Z: tested " << occlusionStats.tested << ", phase 1 drew " << occlusionStats.drawnEarly
+                              << ", phase 2 drew " << occlusionStats.drawnLate << " (" << occlusionStats.lateTriangles
+                              << " triangles), rejected " << occlusionStats.rejected << " meshes" << std::endl;
+                }
+                if (temporalEnabled && !screenSpaceSssEnabled) {
+                    std::cout << "   ⏳ Temporal: 1 in " << temporalReprojection.getRate()
+                              << " pixels lit per frame, 1 sample per pixel with " << TemporalReprojection::JITTER_PHASES
+                              << "-phase jitter" << std::endl;
+                }
+                if (textures.isAvailable()) {
+                    const TextureStreamer::Stats& t = textures.getStats();
+                    std::cout << "   🖼️ " << surfaces.size() - 1 << " surfaces, " << t.textures << " textures ("
+                              << t.pending << " transcoding, " << t.failed << " failed) | resident "
+                              << t.residentBytes / 1024 << " of " << t.fullBytes / 1024 << " KB, "
+                              << t.levelsStreamed << " levels streamed, " << t.levelsEvicted << " evicted" << std::endl;
+                }
+                break;
+
+            case GLFW_KEY_I:
+                if (!overlayAvailable) {
+                    std::cout << "⚠️ Profiler overlay shaders failed to build" << std::endl;
+                    break;
+                }
+                overlayVisible = !overlayVisible;
+                overlayPasses.clear();
+                updateProfilerEnabled();
+                std::cout << (overlayVisible ? "⏱️ Profiler overlay ON" : "⏱️ Profiler overlay OFF") << std::endl;
+                break;
+
+            case GLFW_KEY_F:
+                resolution.setAdaptive(!resolution.isAdaptive());
+                if (!resolution.isAdaptive()) resolution.setScale(options.renderScale);
+                std::cout << "📐 Dynamic resolution " << (resolution.isAdaptive() ? "ON" : "OFF") << " (GPU budget "
+                          << resolution.getBudgetMs() << " ms, scale " << resolution.getScale() << ")" << std::endl;
+                break;
+
+            case GLFW_KEY_Y:
+                if (profiler.isTracing()) {
+                    stopTrace();
+                } else {
+                    startTrace();
+                }
+                break;
+
             case GLFW_KEY_H:
                 printControls();
                 break;
@@ -547,6 +1418,8 @@ public:
             cameraTarget = models[currentModel].idealPosition;
             cameraDistance = glm::length(models[currentModel].cameraDistance);
         }
+        // The camera jumps, so nothing in the history reprojects usefully
+        temporalReprojection.reset();
     }
 
     void printControls() {
@@ -555,6 +1428,22 @@ public:
         std::cout << "TAB      - Toggle single/all models" << std::endl;
         std::cout << "M        - Cycle material types (Skin/Marble/Wax/Jade)" << std::endl;
         std::cout << "R        - Toggle auto-rotation" << std::endl;
+        std::cout << "L        - Toggle LOD selection" << std::endl;
+        std::cout << "C        - Toggle frustum culling" << std::endl;
+        std::cout << "N        - Toggle per-cluster frustum/backface culling" << std::endl;
+        std::cout << "O        - Toggle Hi-Z occlusion culling" << std::endl;
+        std::cout << "P        - Toggle depth pre-pass" << std::endl;
+        std::cout << "- / =    - Halve/double point light count" << std::endl;
+        std::cout << "B        - Toggle screen-space SSS blur / forward SSS shading" << std::endl;
+        std::cout << "K        - Compare both shading paths (frame time, image difference)" << std::endl;
+        std::cout << "J        - Toggle temporal mode (amortized lighting, TAA instead of MSAA)" << std::endl;
+        std::cout << "U        - Compare temporal mode with full-rate shading (frame time, image difference)" << std::endl;
+        std::cout << "T        - Toggle precomputed material LUTs / analytic material terms" << std::endl;
+        std::cout << "G        - Print draw/triangle/GL call and culling counts" << std::endl;
+        std::cout << "I        - Toggle per-pass CPU/GPU timing overlay" << std::endl;
+        std::cout << "Y        - Start/stop a Chrome trace-event capture" << std::endl;
+        std::cout << "F        - Toggle dynamic resolution" << std::endl;
+        std::cout << "[ / ]    - Halve/double LOD pixel error" << std::endl;
         std::cout << "WASD     - Manual camera control" << std::endl;
         std::cout << "H        - Show this help" << std::endl;
         std::cout << "ESC      - Exit" << std::endl;
@@ -562,8 +1451,7 @@ public:
     }
 
     void processInput() {
-        float deltaTime = 0.016f;
-        float speed = 3.0f * deltaTime;
+        float speed = 3.0f * frameClock.getDelta();
 
         if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) cameraDistance -= speed * 2.0f;
         if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) cameraDistance += speed * 2.0f;
@@ -573,55 +1461,63 @@ public:
         cameraDistance = glm::clamp(cameraDistance, 2.0f, 50.0f);
     }
 
-    void setMaterialUniforms() {
-        switch (currentMaterial) {
-            case 0: // Skin
-                glUniform3f(glGetUniformLocation(shaderProgram, "scatteringCoeff"), 0.9f, 0.7f, 0.5f);
-                glUniform3f(glGetUniformLocation(shaderProgram, "absorptionCoeff"), 0.1f, 0.3f, 0.6f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "scatteringDistance"), 0.4f);
-                glUniform3f(glGetUniformLocation(shaderProgram, "internalColor"), 1.0f, 0.6f, 0.4f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "thickness"), 0.5f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "roughness"), 0.4f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "subsurfaceMix"), 0.9f);
-                break;
-            case 1: // Marble
-                glUniform3f(glGetUniformLocation(shaderProgram, "scatteringCoeff"), 0.8f, 0.8f, 0.9f);
-                glUniform3f(glGetUniformLocation(shaderProgram, "absorptionCoeff"), 0.05f, 0.05f, 0.1f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "scatteringDistance"), 0.6f);
-                glUniform3f(glGetUniformLocation(shaderProgram, "internalColor"), 0.9f, 0.9f, 1.0f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "thickness"), 0.3f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "roughness"), 0.2f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "subsurfaceMix"), 0.7f);
-                break;
-            case 2: // Wax
-                glUniform3f(glGetUniformLocation(shaderProgram, "scatteringCoeff"), 1.0f, 0.9f, 0.7f);
-                glUniform3f(glGetUniformLocation(shaderProgram, "absorptionCoeff"), 0.2f, 0.4f, 0.8f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "scatteringDistance"), 0.8f);
-                glUniform3f(glGetUniformLocation(shaderProgram, "internalColor"), 1.0f, 0.8f, 0.6f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "thickness"), 0.7f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "roughness"), 0.6f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "subsurfaceMix"), 0.95f);
-                break;
-            case 3: // Jade
-                glUniform3f(glGetUniformLocation(shaderProgram, "scatteringCoeff"), 0.6f, 0.9f, 0.7f);
-                glUniform3f(glGetUniformLocation(shaderProgram, "absorptionCoeff"), 0.3f, 0.1f, 0.2f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "scatteringDistance"), 0.3f);
-                glUniform3f(glGetUniformLocation(shaderProgram, "internalColor"), 0.7f, 1.0f, 0.8f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "thickness"), 0.4f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "roughness"), 0.3f);
-                glUniform1f(glGetUniformLocation(shaderProgram, "subsurfaceMix"), 0.8f);
-                break;
+    void render() {
+        float delta = frameClock.getDelta();
+        if (autoRotate) {
+            cameraAngle += 0.3f * delta;
         }
+        animationTime += delta;
+        drawFrame(animationTime);
     }
 
-    void render() {
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glUseProgram(shaderProgram);
-
-        float time = glfwGetTime();
-
-        if (autoRotate) {
-            cameraAngle += 0.3f * 0.016f;
+    void drawFrame(float time) {
+        frameStats = FrameStats();
+        GLCounter::calls = 0;
+        modelDrawCounts.assign(models.size(), ModelDrawCounts());
+        int textureScope = profiler.begin("texture stream");
+        textures.update();
+        profiler.end(textureScope);
+        int clearScope = profiler.begin("clear");
+
+        // Temporal mode replaces forward shading only; the blur path keeps its own
+        bool temporal = temporalEnabled && !screenSpaceSssEnabled;
+        shading = screenSpaceSssEnabled ? &sssShading : temporal ? &temporalShading : &forwardShading;
+        if (screenSpaceSssEnabled) sceneTarget.requestSplitOutputs();
+        if (temporal) {
+            sceneTarget.requestSplitOutputs(3);
+        } else {
+            temporalReprojection.reset();
+        }
+        sceneTarget.setMultisample(!temporal);
+
+        resolution.beginFrame();
+        frameStats.renderScale = resolution.getScale();
+        int renderWidth = std::max(1, int(std::lround(framebufferWidth * frameStats.renderScale)));
+        int renderHeight = std::max(1, int(std::lround(framebufferHeight * frameStats.renderScale)));
+        if (framebufferWidth <= 0 || framebufferHeight <= 0 || !sceneTarget.resize(renderWidth, renderHeight)) {
+            resolution.endFrame();
+            profiler.end(clearScope);
+            return;
+        }
+        sceneTarget.bind();
+        int splitOutputs = screenSpaceSssEnabled ? 2 : temporal ? 3 : 0;
+        sceneTarget.selectOutputs(splitOutputs);
+        if (splitOutputs > 0) {
+            // Alpha 0 (no view depth) marks background for the blur, composite and resolve
+            static const GLfloat zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (int i = 0; i < splitOutputs; ++i) GL_COUNT(glClearBufferfv(GL_COLOR, i, zero));
+            GL_COUNT(glClear(GL_DEPTH_BUFFER_BIT));
+        } else {
+            GL_COUNT(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+        }
+        GL_COUNT(glUseProgram(shading->program));
+        profiler.end(clearScope);
+
+        uint64_t samples = 0;
+        while (shadedSamples.poll(samples)) {
+            int mode = depthPrepassEnabled ? 1 : 0;
+            shadedSamplesByMode[mode] = samples;
+            targetSamplesByMode[mode] = uint64_t(sceneTarget.getWidth()) * sceneTarget.getHeight() * sceneTarget.getSamples();
         }
 
         cameraPos = cameraTarget + glm::vec3(
@@ -631,94 +1527,970 @@ public:
         );
 
         glm::mat4 view = glm::lookAt(cameraPos, cameraTarget, glm::vec3(0, 1, 0));
-        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1400.0f / 900.0f, 0.1f, 100.0f);
+        float aspect = float(framebufferWidth) / float(framebufferHeight);
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), aspect, NEAR_PLANE, FAR_PLANE);
+        currentProjection = projection;
+        // Temporal mode rasterizes with a sub-pixel jitter; culling, LOD and
+        // motion vectors use the unjittered projection
+        glm::mat4 rasterProjection = projection;
+        glm::vec4 temporalParams(0.0f);
+        if (temporal) {
+            glm::vec2 jitter = temporalReprojection.jitter(sceneTarget.getWidth(), sceneTarget.getHeight());
+            rasterProjection = glm::translate(glm::mat4(1.0f), glm::vec3(jitter, 0.0f)) * projection;
+            temporalParams = temporalReprojection.frameParams(jitter);
+        }
 
-        glm::vec3 lightPositions[] = {
-            glm::vec3(sin(time * 0.3f) * 12.0f, 6.0f, cos(time * 0.3f) * 12.0f),
-            glm::vec3(-sin(time * 0.5f) * 8.0f, 4.0f, -cos(time * 0.5f) * 8.0f),
-            glm::vec3(6.0f, 3.0f, 6.0f),
-            glm::vec3(-6.0f, 3.0f, -6.0f)
-        };
-        glm::vec3 lightColors[] = {
-            glm::vec3(5.0f, 4.0f, 3.5f),
-            glm::vec3(3.5f, 4.0f, 5.0f),
-            glm::vec3(4.0f, 5.0f, 4.0f),
-            glm::vec3(4.5f, 4.5f, 4.5f)
-        };
+        // The slice scale and bias in FrameData come from this frame's projection
+        lightGrid.configure(projection, NEAR_PLANE, FAR_PLANE);
+
+        int uniformScope = profiler.begin("uniforms");
+        UniformBlocks::FrameData frame;
+        frame.view = view;
+        frame.projection = rasterProjection;
+        frame.viewProjection = rasterProjection * view;
+        frame.camPosTime = glm::vec4(cameraPos, time);
+        frame.clusterScale = lightGrid.shaderScale(sceneTarget.getWidth(), sceneTarget.getHeight());
+        frame.clusterDims = LightGrid::shaderDims();
+        frame.previousViewProjection = temporalReprojection.previousViewProjection(projection * view);
+        frame.temporal = temporalParams;
+        frameBuffer.update(&frame);
+        profiler.end(uniformScope);
+
+        int lightScope = profiler.begin("lights");
+        auto binStart = std::chrono::steady_clock::now();
+        animateLights(lights, lightCount, time);
+        lightGrid.build(lights, view);
+        frameStats.lightBinMs = millisecondsSince(binStart);
+        clusterBuffers.upload(lights, lightGrid);
+        profiler.end(lightScope);
+
+        int materialScope = profiler.begin("material");
+        if (materialLutsEnabled) materialLutTextures.select(currentMaterial);
+        if (shading->boundMaterial != currentMaterial) {
+            glm::vec3 transmission = MaterialLuts::transmissionColor(UniformBlocks::MATERIAL_PRESETS[currentMaterial]);
+            GL_COUNT(glUniform1i(shading->materialIndex, currentMaterial));
+            GL_COUNT(glUniform3fv(shading->transmissionColor, 1, glm::value_ptr(transmission)));
+            shading->boundMaterial = currentMaterial;
+        }
+        if (shading->boundLuts != int(materialLutsEnabled)) {
+            GL_COUNT(glUniform1i(shading->materialLuts, materialLutsEnabled));
+            shading->boundLuts = int(materialLutsEnabled);
+        }
+        profiler.end(materialScope);
 
-        setMaterialUniforms();
+        int cullScope = profiler.begin("cull");
+        if (instancesDirty) {
+            rebuildInstances();
+        }
 
-        glUniform3fv(glGetUniformLocation(shaderProgram, "lightPositions"), 4, glm::value_ptr(lightPositions[0]));
-        glUniform3fv(glGetUniformLocation(shaderProgram, "lightColors"), 4, glm::value_ptr(lightColors[0]));
-        glUniform3fv(glGetUniformLocation(shaderProgram, "camPos"), 1, glm::value_ptr(cameraPos));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-        glUniform1f(glGetUniformLocation(shaderProgram, "time"), time);
-        glUniform1f(glGetUniformLocation(shaderProgram, "materialType"), float(currentMaterial));
+        CullStats cull;
+        visibleInstances.clear();
+        Frustum frustum = Frustum::fromViewProjection(projection * view);
+        if (cullingEnabled) {
+            sceneBvh.cull(frustum, cull, [&](uint32_t i) { visibleInstances.push_back(i); });
+        } else {
+            for (uint32_t i = 0; i < instances.size(); ++i) visibleInstances.push_back(i);
+        }
 
-        if (showAllModels) {
-            renderAllModels();
+        size_t visibleBaseTriangles = 0;
+        for (uint32_t i : visibleInstances) {
+            visibleBaseTriangles += meshes[instances[i].meshIdx].lods[0].indexCount / 3;
+        }
+        sortFrontToBack(view);
+        frameStats.bvhNodesVisited = cull.nodesVisited;
+        frameStats.meshesTested = cull.itemsTested;
+        frameStats.meshesCulled = instances.size() - visibleInstances.size();
+        frameStats.trianglesCulled = instanceBaseTriangles - visibleBaseTriangles;
+        profiler.end(cullScope);
+
+        int drawScope = profiler.begin("draw");
+        if (occlusionEnabled) {
+            drawWithOcclusion(projection * view);
         } else {
-            renderSingleModel(currentModel);
+            drawBatcher.begin();
+            if (clusterCullingEnabled) {
+                int clusterScope = profiler.begin("cluster cull");
+                addClusterDraws(frustum);
+                profiler.end(clusterScope);
+            }
+            if (options.instancing) {
+                addInstancedDraws();
+            } else {
+                for (uint32_t i : visibleInstances) {
+                    MeshInstance& instance = instances[i];
+                    const Mesh& mesh = meshes[instance.meshIdx];
+                    int lod = selectLod(instance);
+                    drawBatcher.add(mesh, lod, instance.modelMatrix, instance.normalMatrix);
+                    countModelDraw(instance, mesh.lods[lod].indexCount / 3);
+                }
+            }
+            frameStats.meshDraws = drawBatcher.drawCount();
+            drawBatcher.upload();
+
+            if (depthPrepassEnabled) {
+                depthPrepass.begin();
+                frameStats.drawCalls +=
+                    drawBatcher.draw(geometry, depthPrepass.drawIdBaseLocation(), true, depthSurfaces);
+                depthPrepass.beginShading();
+                GL_COUNT(glUseProgram(shading->program));
+            }
+            beginSurfaces(depthPrepassEnabled);
+            shadedSamples.begin();
+            frameStats.drawCalls += drawBatcher.draw(geometry, shading->drawIdBase, false, shadingSurfaces);
+            shadedSamples.end();
+            if (depthPrepassEnabled) depthPrepass.end();
+        }
+        shadedSamples.endFrame();
+        profiler.end(drawScope);
+
+        if (temporal) {
+            Profiler::Scope scope(profiler, "temporal resolve");
+            temporalReprojection.apply(sceneTarget, projection * view, BACKGROUND_COLOR);
+        }
+
+        if (screenSpaceSssEnabled) {
+            Profiler::Scope scope(profiler, "sss blur");
+            screenSpaceSss.setMaterial(currentMaterial);
+            screenSpaceSss.apply(sceneTarget, projection[1][1] * 0.5f * sceneTarget.getHeight(), BACKGROUND_COLOR);
+        }
+
+        int resolveScope = profiler.begin("resolve");
+        upscaler.present(sceneTarget, framebufferWidth, framebufferHeight, options.sharpness);
+        profiler.end(resolveScope);
+        resolution.endFrame();
+        frameStats.glCalls = GLCounter::calls;
+        profiler.counter("triangles", double(frameStats.triangles));
+        profiler.counter("mesh draws", double(frameStats.meshDraws));
+        profiler.counter("draw calls", double(frameStats.drawCalls));
+        profiler.counter("clusters culled", double(frameStats.clusters.frustumCulled + frameStats.clusters.backfaceCulled));
+        profiler.counter("render scale", frameStats.renderScale);
+        profiler.counter("texture MB", double(textures.getStats().residentBytes) / (1024.0 * 1024.0));
+    }
+
+    // Moves the visible instances that draw a clustered mesh at LOD 0 out of
+    // visibleInstances, culls their clusters on all cores and queues each
+    // one's surviving index ranges under a single draw ID. Coarser LODs are
+    // small enough to draw whole, as is everything left in visibleInstances,
+    // including instances that no longer fit in the draw data.
+    void addClusterDraws(const Frustum& frustum) {
+        clusterCuller.begin();
+        clusterInstances.clear();
+        size_t kept = 0;
+        for (uint32_t i : visibleInstances) {
+            MeshInstance& instance = instances[i];
+            const Mesh& mesh = meshes[instance.meshIdx];
+            if (mesh.clusters.empty() || selectLod(instance) != 0) {
+                visibleInstances[kept++] = i;
+                continue;
+            }
+            clusterCuller.add(mesh.clusters, MeshClusters::objectSpaceView(frustum, cameraPos, instance.modelMatrix));
+            clusterInstances.push_back(i);
+        }
+        visibleInstances.resize(kept);
+        if (clusterInstances.empty()) return;
+
+        clusterCuller.run();
+        frameStats.clusters = clusterCuller.stats();
+        for (size_t job = 0; job < clusterInstances.size(); ++job) {
+            const MeshInstance& instance = instances[clusterInstances[job]];
+            const Mesh& mesh = meshes[instance.meshIdx];
+            const std::vector<MeshClusters::IndexRange>& ranges = clusterCuller.ranges(job);
+            if (ranges.empty()) continue;
+
+            uint32_t drawId = drawBatcher.addDrawData(mesh, instance.modelMatrix, instance.normalMatrix);
+            if (drawId == DrawBatcher::INVALID_DRAW) {
+                // Out of draw IDs: hand this and every later instance that still
+                // has visible clusters back to the whole-mesh path
+                for (size_t rest = job; rest < clusterInstances.size(); ++rest) {
+                    if (!clusterCuller.ranges(rest).empty()) visibleInstances.push_back(clusterInstances[rest]);
+                }
+                break;
+            }
+            size_t triangles = 0;
+            for (const MeshClusters::IndexRange& range : ranges) {
+                drawBatcher.addRange(mesh, range.firstIndex, range.indexCount, drawId);
+                triangles += range.indexCount / 3;
+            }
+            countModelDraw(instance, triangles);
+        }
+    }
+
+    // Groups visible instances by mesh and LOD and queues one command per
+    // group. A group's draw data is contiguous, so aDrawId (base instance +
+    // instance index) walks its per-instance transforms. Groups are emitted in
+    // order of their nearest member, which keeps most of the front-to-back order.
+    void addInstancedDraws() {
+        instanceGroupLookup.clear();
+        instanceGroupCount = 0;
+        for (uint32_t i : visibleInstances) {
+            MeshInstance& instance = instances[i];
+            int lod = selectLod(instance);
+            uint64_t key = (uint64_t(instance.meshIdx) << 8) | uint64_t(lod);
+            auto inserted = instanceGroupLookup.emplace(key, instanceGroupCount);
+            if (inserted.second) {
+                if (instanceGroupCount == instanceGroups.size()) instanceGroups.emplace_back();
+                InstanceGroup& group = instanceGroups[instanceGroupCount++];
+                group.meshIdx = instance.meshIdx;
+                group.lod = lod;
+                group.members.clear();
+            }
+            instanceGroups[inserted.first->second].members.push_back(i);
+        }
+
+        for (size_t g = 0; g < instanceGroupCount; ++g) {
+            const InstanceGroup& group = instanceGroups[g];
+            const Mesh& mesh = meshes[group.meshIdx];
+            uint32_t firstDrawId = DrawBatcher::INVALID_DRAW;
+            uint32_t count = 0;
+            for (uint32_t i : group.members) {
+                const MeshInstance& instance = instances[i];
+                uint32_t drawId = drawBatcher.addDrawData(mesh, instance.modelMatrix, instance.normalMatrix);
+                if (drawId == DrawBatcher::INVALID_DRAW) break;
+                if (count == 0) firstDrawId = drawId;
+                count++;
+                countModelDraw(instance, mesh.lods[group.lod].indexCount / 3);
+            }
+            if (count > 0) drawBatcher.addCommand(mesh, group.lod, firstDrawId, count);
+        }
+    }
+
+    void countModelDraw(const MeshInstance& instance, size_t triangles) {
+        frameStats.triangles += triangles;
+        ModelDrawCounts& counts = modelDrawCounts[instance.model];
+        counts.meshDraws++;
+        counts.triangles += triangles;
+    }
+
+    // Orders visibleInstances by view depth of their bounds centers so early
+    // depth testing rejects as much as possible, with or without a pre-pass.
+    void sortFrontToBack(const glm::mat4& view) {
+        drawOrder.clear();
+        for (uint32_t i : visibleInstances) {
+            const Aabb& bounds = instances[i].worldBounds;
+            glm::vec4 center = view * glm::vec4(0.5f * (bounds.min + bounds.max), 1.0f);
+            drawOrder.push_back({-center.z, i});
+        }
+        std::sort(drawOrder.begin(), drawOrder.end());
+        for (size_t k = 0; k < drawOrder.size(); ++k) visibleInstances[k] = drawOrder[k].second;
+    }
+
+    // Phase one draws what passed the Hi-Z test last frame, phase two draws
+    // whatever else passes against the depth phase one produced. With the
+    // depth pre-pass on, both phases are depth-only and a single shading pass
+    // follows over the phase one set and the phase two survivors.
+    // Alpha-tested surfaces stay out of depth-only passes; the shading pass
+    // draws them with an ordinary depth test instead
+    bool surfaceMasked(uint32_t index) const {
+        const Surface& surface = surfaces[index];
+        return surface.alphaMap || textures.hasAlpha(surface.albedo);
+    }
+
+    // Starts a shading pass: the next bindSurface() sets everything, and over
+    // a depth pre-pass masked surfaces switch back to writing depth
+    void beginSurfaces(bool overPrepass) {
+        surfaceStateValid = false;
+        surfacesOverPrepass = overPrepass;
+        maskedDepthState = false;
+    }
+
+    bool bindSurface(uint32_t index) {
+        if (surfaceStateValid && index == boundSurface) return true;
+        const Surface& surface = surfaces[index];
+        bool albedo = textures.bind(surface.albedo, TextureStreamer::ALBEDO_UNIT);
+        bool normal = textures.bind(surface.normal, TextureStreamer::NORMAL_UNIT);
+        bool masked = surfaceMasked(index);
+        glm::vec3 color = albedo ? glm::vec3(1.0f) : surface.color;
+        GL_COUNT(glUniform1i(shading->surfaceMaterial, surface.material));
+        GL_COUNT(glUniform3fv(shading->surfaceColor, 1, glm::value_ptr(color)));
+        GL_COUNT(glUniform1i(shading->hasAlbedoMap, albedo));
+        GL_COUNT(glUniform1i(shading->hasNormalMap, normal));
+        GL_COUNT(glUniform1i(shading->alphaMask, albedo && masked));
+        if (surfacesOverPrepass && masked != maskedDepthState) {
+            GL_COUNT(glDepthFunc(masked ? GL_LESS : GL_EQUAL));
+            GL_COUNT(glDepthMask(masked ? GL_TRUE : GL_FALSE));
+            maskedDepthState = masked;
         }
+        boundSurface = index;
+        surfaceStateValid = true;
+        return true;
     }
 
-    void renderSingleModel(int modelIndex) {
-        if (modelIndex >= models.size()) return;
+    void drawWithOcclusion(const glm::mat4& viewProjection) {
+        if (occlusion.readResults(occlusionResults) && occlusionResults.size() == lastCandidateInstances.size()) {
+            occlusionStats = OcclusionStats();
+            occlusionStats.tested = occlusionResults.size();
+            for (size_t k = 0; k < occlusionResults.size(); ++k) {
+                const HiZOcclusion::Result& r = occlusionResults[k];
+                wasVisible[lastCandidateInstances[k]] = uint8_t(r.visible);
+                if (!r.visible) occlusionStats.rejected++;
+                if (r.drawnLate) {
+                    occlusionStats.drawnLate++;
+                    occlusionStats.lateTriangles += r.indexCount / 3;
+                }
+            }
+            occlusionStats.drawnEarly = occlusionStats.tested - occlusionStats.rejected - occlusionStats.drawnLate;
+        }
+
+        // Grouped by surface within each index type, so survivors bind once per surface
+        std::stable_sort(visibleInstances.begin(), visibleInstances.end(), [&](uint32_t a, uint32_t b) {
+            return meshes[instances[a].meshIdx].surface < meshes[instances[b].meshIdx].surface;
+        });
+
+        drawBatcher.begin();
+        occlusionCandidates.clear();
+        candidateInstances.clear();
+        candidateSurfaces.clear();
+        size_t shortIndexCandidates = 0;
+
+        // 16-bit index meshes first so each index type is one contiguous command range
+        for (int pass = 0; pass < 2; ++pass) {
+            for (uint32_t i : visibleInstances) {
+                MeshInstance& instance = instances[i];
+                const Mesh& mesh = meshes[instance.meshIdx];
+                if ((mesh.indexType == GL_UNSIGNED_SHORT) != (pass == 0)) continue;
+
+                int lod = selectLod(instance);
+                uint32_t drawId = drawBatcher.addDrawData(mesh, instance.modelMatrix, instance.normalMatrix);
+                if (drawId == DrawBatcher::INVALID_DRAW) continue;
+
+                bool early = wasVisible[i] != 0;
+                if (early) {
+                    drawBatcher.addCommand(mesh, lod, drawId);
+                    countModelDraw(instance, mesh.lods[lod].indexCount / 3);
+                }
+
+                DrawBatcher::IndirectCommand cmd = DrawBatcher::makeCommand(mesh, lod, drawId);
+                occlusionCandidates.push_back({instance.worldBounds.min, cmd.count, instance.worldBounds.max,
+                                               cmd.firstIndex, cmd.baseVertex, drawId, early ? 1u : 0u, 0u});
+                candidateInstances.push_back(i);
+                candidateSurfaces.push_back(mesh.surface);
+            }
+            if (pass == 0) shortIndexCandidates = occlusionCandidates.size();
+        }
+        candidateRuns.clear();
+        DrawBatcher::appendRuns(GL_UNSIGNED_SHORT, candidateSurfaces.data(), shortIndexCandidates, candidateRuns);
+        DrawBatcher::appendRuns(GL_UNSIGNED_INT, candidateSurfaces.data() + shortIndexCandidates,
+                                candidateSurfaces.size() - shortIndexCandidates, candidateRuns);
+
+        frameStats.meshDraws = drawBatcher.drawCount();
+        drawBatcher.upload();
+        if (depthPrepassEnabled) {
+            depthPrepass.begin();
+            frameStats.drawCalls += drawBatcher.draw(geometry, depthPrepass.drawIdBaseLocation(), true, depthSurfaces);
+            depthPrepass.end();
+        } else {
+            beginSurfaces(false);
+            shadedSamples.begin();
+            frameStats.drawCalls += drawBatcher.draw(geometry, shading->drawIdBase, false, shadingSurfaces);
+            shadedSamples.end();
+        }
+
+        int hizScope = profiler.begin("hi-z test");
+        occlusion.buildPyramid(sceneTarget.getDepthTexture(), sceneTarget.getSamples(), sceneTarget.getWidth(),
+                               sceneTarget.getHeight());
+        occlusion.test(occlusionCandidates, viewProjection);
+        profiler.end(hizScope);
+
+        sceneTarget.bind();
+        if (depthPrepassEnabled) {
+            depthPrepass.begin();
+            frameStats.drawCalls +=
+                occlusion.drawSurvivors(geometry, shortIndexCandidates, candidateRuns, true, depthSurfaces);
+            depthPrepass.beginShading();
+            GL_COUNT(glUseProgram(shading->program));
+            beginSurfaces(true);
+            shadedSamples.begin();
+            frameStats.drawCalls += drawBatcher.draw(geometry, shading->drawIdBase, false, shadingSurfaces);
+            frameStats.drawCalls +=
+                occlusion.drawSurvivors(geometry, shortIndexCandidates, candidateRuns, false, shadingSurfaces);
+            shadedSamples.end();
+            depthPrepass.end();
+        } else {
+            GL_COUNT(glUseProgram(shading->program));
+            beginSurfaces(false);
+            shadedSamples.begin();
+            frameStats.drawCalls +=
+                occlusion.drawSurvivors(geometry, shortIndexCandidates, candidateRuns, false, shadingSurfaces);
+            shadedSamples.end();
+        }
+        lastCandidateInstances.swap(candidateInstances);
+    }
 
-        const ModelInfo& model = models[modelIndex];
+    glm::mat4 singleModelMatrix(const ModelInfo& model) {
         glm::mat4 modelMatrix = glm::mat4(1.0f);
         modelMatrix = glm::translate(modelMatrix, model.idealPosition);
-        modelMatrix = glm::scale(modelMatrix, model.idealScale);
+        return glm::scale(modelMatrix, model.idealScale);
+    }
 
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(modelMatrix));
+    // All-models mode lays the models out on a ring; --scene-copies repeats
+    // that ring on a grid to stress culling.
+    glm::mat4 ringModelMatrix(size_t i, const glm::vec3& copyOffset) {
+        const ModelInfo& model = models[i];
+        glm::mat4 modelMatrix = glm::mat4(1.0f);
 
-        for (size_t meshIdx : model.meshIndices) {
-            if (meshIdx < meshes.size()) {
-                meshes[meshIdx].Draw();
+        float angle = (float(i) / float(models.size())) * 2.0f * PI;
+        glm::vec3 offset = glm::vec3(cos(angle) * 8.0f, 0, sin(angle) * 8.0f);
+
+        modelMatrix = glm::translate(modelMatrix, model.idealPosition + offset + copyOffset);
+        return glm::scale(modelMatrix, model.idealScale * 0.7f);
+    }
+
+    // Rebuilt whenever the set of visible models or their meshes changes
+    void rebuildInstances() {
+        instances.clear();
+        instanceBaseTriangles = 0;
+        std::vector<Aabb> bounds;
+
+        auto addModel = [&](size_t modelIdx, const glm::mat4& modelMatrix) {
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
+            for (size_t meshIdx : models[modelIdx].meshIndices) {
+                if (meshIdx >= meshes.size()) continue;
+                const Mesh& mesh = meshes[meshIdx];
+                Aabb worldBounds = transformAabb(Aabb(mesh.boundsMin, mesh.boundsMax), modelMatrix);
+                instances.push_back({meshIdx, uint32_t(modelIdx), modelMatrix, normalMatrix, worldBounds, 0});
+                bounds.push_back(worldBounds);
+                instanceBaseTriangles += mesh.lods[0].indexCount / 3;
             }
+        };
+
+        if (showAllModels) {
+            int side = int(std::ceil(std::sqrt(float(options.sceneCopies))));
+            for (int copy = 0; copy < options.sceneCopies; ++copy) {
+                glm::vec3 copyOffset = 24.0f * glm::vec3(copy % side, 0, copy / side);
+                for (size_t i = 0; i < models.size(); ++i) {
+                    addModel(i, ringModelMatrix(i, copyOffset));
+                }
+            }
+        } else if (currentModel < int(models.size())) {
+            addModel(size_t(currentModel), singleModelMatrix(models[currentModel]));
         }
+
+        auto start = std::chrono::steady_clock::now();
+        sceneBvh.build(bounds);
+        bvhBuildMs = millisecondsSince(start);
+        wasVisible.assign(instances.size(), 0);
+        lastCandidateInstances.clear();
+        instancesDirty = false;
     }
 
-    void renderAllModels() {
-        for (size_t i = 0; i < models.size(); ++i) {
-            const ModelInfo& model = models[i];
-            glm::mat4 modelMatrix = glm::mat4(1.0f);
+    // Picks the coarsest LOD whose error projects to at most lodPixelError
+    // pixels. Moving to a coarser level than last frame needs the error to be
+    // lodHysteresis below the threshold, so levels don't flicker at the boundary.
+    int selectLod(MeshInstance& instance) {
+        const Mesh& mesh = meshes[instance.meshIdx];
+        const glm::mat4& modelMatrix = instance.modelMatrix;
+        int levels = int(mesh.lods.size());
+        if (!lodEnabled || levels <= 1) return 0;
+
+        int current = instance.lod;
+        float scale = std::sqrt(std::max(glm::dot(modelMatrix[0], modelMatrix[0]),
+                                std::max(glm::dot(modelMatrix[1], modelMatrix[1]), glm::dot(modelMatrix[2], modelMatrix[2]))));
+        glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(mesh.boundsCenter, 1.0f));
+        float distance = std::max(glm::length(cameraPos - center) - mesh.boundsRadius * scale, 0.1f);
+        // Error is measured in pixels of the scaled render target, not the window
+        int viewportHeight = sceneTarget.getHeight() > 0 ? sceneTarget.getHeight() : framebufferHeight;
+        float pixelsPerUnit = currentProjection[1][1] * 0.5f * float(viewportHeight) / distance;
+
+        int chosen = 0;
+        for (int level = levels - 1; level > 0; --level) {
+            float pixels = mesh.lods[level].error * scale * pixelsPerUnit;
+            float limit = level > current ? options.lodPixelError * (1.0f - options.lodHysteresis) : options.lodPixelError;
+            if (pixels <= limit) {
+                chosen = level;
+                break;
+            }
+        }
+        instance.lod = uint8_t(chosen);
+        return chosen;
+    }
 
-            float angle = (float(i) / float(models.size())) * 2.0f * PI;
-            glm::vec3 offset = glm::vec3(cos(angle) * 8.0f, 0, sin(angle) * 8.0f);
+    // Draws the same frame with both shading paths, glFinish-bounded, and
+    // reports median frame time and the difference between the two images.
+    void compareShadingPaths() {
+        const int runs = 5;
+        float time = animationTime;
+        bool wasEnabled = screenSpaceSssEnabled;
+        bool wasAdaptive = resolution.isAdaptive();
+        resolution.setAdaptive(false);
+        std::vector<double> times[2];
+        std::vector<uint8_t> images[2];
+
+        for (int run = 0; run < runs; ++run) {
+            for (int mode = 0; mode < 2; ++mode) {
+                screenSpaceSssEnabled = mode == 1;
+                glFinish();
+                auto start = std::chrono::steady_clock::now();
+                drawFrame(time);
+                glFinish();
+                times[mode].push_back(millisecondsSince(start));
+                if (run == 0) {
+                    images[mode].resize(size_t(framebufferWidth) * framebufferHeight * 4);
+                    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+                    glReadPixels(0, 0, framebufferWidth, framebufferHeight, GL_RGBA, GL_UNSIGNED_BYTE,
+                                 images[mode].data());
+                }
+            }
+        }
+        screenSpaceSssEnabled = wasEnabled;
+        resolution.setAdaptive(wasAdaptive);
+
+        ImageDifference difference;
+        difference.add(images[0], images[1]);
+        std::cout << "🌫️ " << lightCount << " lights | forward SSS " << Benchmarks::median(times[0])
+                  << " ms, screen-space SSS " << Benchmarks::median(times[1]) << " ms (median of " << runs
+                  << ", glFinish-bounded)" << std::endl;
+        std::cout << "   image difference: RMSE " << difference.rmse() << " / 255, PSNR " << difference.psnr()
+                  << " dB, max " << difference.max << std::endl;
+    }
 
-            modelMatrix = glm::translate(modelMatrix, model.idealPosition + offset);
-            modelMatrix = glm::scale(modelMatrix, model.idealScale * 0.7f);
+    // Plays the same short orbit (autoRotate speed, 60 Hz steps) with
+    // full-rate forward shading and in temporal mode, glFinish-bounded, and
+    // compares every fourth frame once the history has had time to settle.
+    void compareTemporalShading() {
+        const int frames = 32;
+        const int settleFrames = 8;
+        const float step = 1.0f / 60.0f;
+        float startTime = animationTime;
+        float startAngle = cameraAngle;
+        bool wasTemporal = temporalEnabled;
+        bool wasScreenSpace = screenSpaceSssEnabled;
+        bool wasAdaptive = resolution.isAdaptive();
+        resolution.setAdaptive(false);
+        screenSpaceSssEnabled = false;
+        std::vector<double> times[2];
+        std::vector<std::vector<uint8_t>> fullRate;
+        std::vector<uint8_t> image(size_t(framebufferWidth) * framebufferHeight * 4);
+        ImageDifference difference;
+
+        for (int mode = 0; mode < 2; ++mode) {
+            temporalEnabled = mode == 1;
+            temporalReprojection.reset();
+            for (int frame = 0; frame < frames; ++frame) {
+                cameraAngle = startAngle + 0.3f * step * frame;
+                glFinish();
+                auto start = std::chrono::steady_clock::now();
+                drawFrame(startTime + step * frame);
+                glFinish();
+                times[mode].push_back(millisecondsSince(start));
+                if (frame < settleFrames || frame % 4 != 3) continue;
+
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+                glReadPixels(0, 0, framebufferWidth, framebufferHeight, GL_RGBA, GL_UNSIGNED_BYTE, image.data());
+                if (mode == 0) {
+                    fullRate.push_back(image);
+                } else {
+                    difference.add(fullRate[(frame - settleFrames) / 4], image);
+                }
+            }
+        }
+        cameraAngle = startAngle;
+        temporalEnabled = wasTemporal;
+        screenSpaceSssEnabled = wasScreenSpace;
+        resolution.setAdaptive(wasAdaptive);
+        temporalReprojection.reset();
+
+        std::cout << "⏳ " << lightCount << " lights | full rate (" << SceneTarget::SAMPLES << "x MSAA) "
+                  << Benchmarks::median(times[0]) << " ms, temporal (1 in " << temporalReprojection.getRate()
+                  << " pixels lit per frame) " << Benchmarks::median(times[1]) << " ms (median of " << frames
+                  << " frames, glFinish-bounded)" << std::endl;
+        std::cout << "   image difference over " << fullRate.size() << " orbit frames: RMSE " << difference.rmse()
+                  << " / 255, PSNR " << difference.psnr() << " dB, max " << difference.max << std::endl;
+    }
 
-            glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(modelMatrix));
+    // Replays FrameBenchmark's camera script over every loaded model with each
+    // material preset and writes per-frame CSV plus percentile JSON. Returns
+    // the process exit code: non-zero on I/O failure or baseline regression.
+    int runBenchmark(const FrameBenchmark::Settings& settings) {
+        while (modelLoader) {
+            uploadLoadedMeshes();
+            if (modelLoader) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        // Transcodes finish before the first timed frame; level streaming
+        // still runs inside the frames, as it would interactively
+        while (textures.getStats().pending > 0) {
+            textures.update();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
 
-            for (size_t meshIdx : model.meshIndices) {
-                if (meshIdx < meshes.size()) {
-                    meshes[meshIdx].Draw();
+        autoRotate = false;
+        showAllModels = false;
+        resolution.setAdaptive(false);
+        std::vector<FrameBenchmark::Shot> shots;
+        for (size_t model = 0; model < models.size(); ++model) {
+            if (models[model].meshIndices.empty()) continue;
+            currentModel = int(model);
+            instancesDirty = true;
+            updateCameraForCurrentModel();
+            float baseDistance = cameraDistance;
+
+            for (int material = 0; material < UniformBlocks::MATERIAL_COUNT; ++material) {
+                currentMaterial = material;
+                FrameBenchmark::Shot shot;
+                shot.name = models[model].name + "/" + materialNames[material];
+
+                FrameBenchmark::GpuTimer gpuTimer;
+                gpuTimer.create(settings.frames);
+                for (int frame = -settings.warmupFrames; frame < settings.frames; ++frame) {
+                    FrameBenchmark::CameraPose pose = FrameBenchmark::poseAt(std::max(frame, 0), settings.frames);
+                    cameraAngle = pose.angle;
+                    cameraDistance = baseDistance * pose.distanceScale;
+
+                    profiler.beginFrame();
+                    auto start = std::chrono::steady_clock::now();
+                    if (frame >= 0) gpuTimer.begin(frame);
+                    drawFrame(pose.time);
+                    if (frame >= 0) {
+                        gpuTimer.end();
+                        shot.cpuMs.push_back(millisecondsSince(start));
+                    }
+                    profiler.endFrame();
                 }
+                gpuTimer.read(shot.gpuMs);
+                shot.cpu = FrameBenchmark::summarize(shot.cpuMs);
+                shot.gpu = FrameBenchmark::summarize(shot.gpuMs);
+                printf("⏱️ %-36s cpu p50 %7.3f p95 %7.3f ms | gpu p50 %7.3f p95 %7.3f ms\n", shot.name.c_str(),
+                       shot.cpu.p50, shot.cpu.p95, shot.gpu.p50, shot.gpu.p95);
+                shots.push_back(std::move(shot));
             }
+            cameraDistance = baseDistance;
+        }
+
+        std::vector<std::string> config = {
+            "\"renderer\": \"" + std::string(reinterpret_cast<const char*>(glGetString(GL_RENDERER))) + "\"",
+            "\"width\": " + std::to_string(sceneTarget.getWidth()),
+            "\"height\": " + std::to_string(sceneTarget.getHeight()),
+            "\"render_scale\": " + std::to_string(resolution.getScale()),
+            "\"frames\": " + std::to_string(settings.frames),
+            "\"warmup\": " + std::to_string(settings.warmupFrames),
+            "\"lights\": " + std::to_string(lightCount),
+            "\"depth_prepass\": " + std::string(depthPrepassEnabled ? "true" : "false"),
+            "\"screen_space_sss\": " + std::string(screenSpaceSssEnabled ? "true" : "false"),
+            "\"material_luts\": " + std::string(materialLutsEnabled ? "true" : "false"),
+            "\"per_vertex_normal_matrix\": " + std::string(options.perVertexNormalMatrix ? "true" : "false"),
+            "\"instancing\": " + std::string(options.instancing ? "true" : "false"),
+            "\"cluster_culling\": " + std::string(clusterCullingEnabled ? "true" : "false"),
+            "\"packed_vertices\": " + std::string(options.vertexFormat == VertexFormat::Packed ? "true" : "false"),
+        };
+        if (profiler.isTracing()) stopTrace();
+        std::string csvPath = settings.outputPrefix + ".csv";
+        std::string jsonPath = settings.outputPrefix + ".json";
+        if (!FrameBenchmark::writeCsv(csvPath, shots) || !FrameBenchmark::writeJson(jsonPath, shots, config)) {
+            std::cerr << "❌ Could not write " << csvPath << " / " << jsonPath << std::endl;
+            return 1;
         }
+        std::cout << "📄 Wrote " << shots.size() << " shots to " << csvPath << " and " << jsonPath << std::endl;
+
+        if (settings.baselinePath.empty()) return 0;
+        int regressions = FrameBenchmark::compareToBaseline(settings.baselinePath, shots, settings.tolerance);
+        if (regressions != 0) {
+            std::cout << (regressions < 0 ? "❌ Baseline unreadable" : "❌ Performance regression detected") << std::endl;
+            return 2;
+        }
+        std::cout << "✅ No regressions against baseline" << std::endl;
+        return 0;
     }
 
     void run() {
         while (!glfwWindowShouldClose(window)) {
+            frameClock.tick();
+            profiler.beginFrame();
+            int uploadScope = profiler.begin("mesh upload");
+            uploadLoadedMeshes();
+            profiler.end(uploadScope);
             processInput();
+            if (compareRequested) {
+                compareRequested = false;
+                compareShadingPaths();
+            }
+            if (temporalCompareRequested) {
+                temporalCompareRequested = false;
+                compareTemporalShading();
+            }
             render();
+            drawOverlay();
 
+            int swapScope = profiler.begin("swap");
             glfwSwapBuffers(window);
+            profiler.end(swapScope);
+            profiler.endFrame();
             glfwPollEvents();
         }
+        if (profiler.isTracing()) stopTrace();
+    }
+
+    void updateProfilerEnabled() {
+        profiler.setEnabled(overlayVisible || profiler.isTracing());
+    }
+
+    void startTrace() {
+        profiler.startTrace();
+        updateProfilerEnabled();
+        std::cout << "🔴 Recording profile trace" << std::endl;
+    }
+
+    void stopTrace() {
+        std::string path = options.tracePath;
+        if (path.empty()) path = "profile_trace_" + std::to_string(++traceCaptures) + ".json";
+        bool written = profiler.stopTrace(path);
+        updateProfilerEnabled();
+        std::cout << (written ? "📄 Profile trace written to " : "❌ Could not write profile trace ") << path
+                  << (written ? " (open in chrome://tracing or ui.perfetto.dev)" : "") << std::endl;
+    }
+
+    // Pass table (CPU/GPU ms with GPU bars) and per-model submission counts,
+    // drawn straight into the default framebuffer after the resolve
+    void drawOverlay() {
+        if (!overlayVisible || !overlayAvailable) return;
+        Profiler::Scope scope(profiler, "overlay");
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - overlayRefresh > std::chrono::milliseconds(250)) {
+            overlayRefresh = now;
+            overlayPasses = profiler.latest();
+            overlayModelCounts = modelDrawCounts;
+        }
+
+        const glm::vec4 white(1.0f), grey(0.65f, 0.65f, 0.7f, 1.0f), barColor(0.95f, 0.55f, 0.2f, 0.9f);
+        const float scale = 2.0f, line = 8.0f * scale, left = 16.0f;
+        char buffer[128];
+
+        overlay.clear();
+        size_t rows = overlayPasses.size() + overlayModelCounts.size() + 6;
+        overlay.box(8.0f, 8.0f, 560.0f, rows * line + 12.0f, glm::vec4(0.0f, 0.0f, 0.0f, 0.6f));
+
+        float y = 16.0f;
+        double frameGpuMs = overlayPasses.empty() ? 0.0 : overlayPasses[0].gpuMs;
+        snprintf(buffer, sizeof(buffer), "%-20s %8s %8s", "PASS", "CPU MS", "GPU MS");
+        overlay.text(left, y, buffer, grey, scale);
+        y += line;
+        for (const Profiler::Pass& pass : overlayPasses) {
+            std::string name = std::string(size_t(pass.depth) * 2, ' ') + pass.name;
+            snprintf(buffer, sizeof(buffer), "%-20.20s %8.2f %8.2f", name.c_str(), pass.cpuMs, pass.gpuMs);
+            float x = overlay.text(left, y, buffer, white, scale);
+            if (frameGpuMs > 0.0) {
+                overlay.box(x + 8.0f, y, float(140.0 * std::min(1.0, pass.gpuMs / frameGpuMs)), 5.0f * scale, barColor);
+            }
+            y += line;
+        }
+
+        y += line;
+        snprintf(buffer, sizeof(buffer), "%-20s %8s %12s", "MODEL", "MESHES", "TRIANGLES");
+        overlay.text(left, y, buffer, grey, scale);
+        y += line;
+        for (size_t i = 0; i < overlayModelCounts.size() && i < models.size(); ++i) {
+            snprintf(buffer, sizeof(buffer), "%-20.20s %8zu %12zu", models[i].name.c_str(),
+                     overlayModelCounts[i].meshDraws, overlayModelCounts[i].triangles);
+            overlay.text(left, y, buffer, overlayModelCounts[i].meshDraws > 0 ? white : grey, scale);
+            y += line;
+        }
+        snprintf(buffer, sizeof(buffer), "%zu DRAW CALLS, %zu GL CALLS", frameStats.drawCalls, frameStats.glCalls);
+        overlay.text(left, y + line * 0.5f, buffer, grey, scale);
+        y += line;
+        snprintf(buffer, sizeof(buffer), "SCALE %.2f %dX%d%s", frameStats.renderScale, sceneTarget.getWidth(),
+                 sceneTarget.getHeight(), resolution.isAdaptive() ? " (ADAPTIVE)" : "");
+        overlay.text(left, y + line * 0.5f, buffer, grey, scale);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, framebufferWidth, framebufferHeight);
+        overlay.draw(framebufferWidth, framebufferHeight);
     }
 };
 
-int main() {
+int main(int argc, char** argv) {
+    DemoOptions options;
+    bool benchConvert = false;
+    bool benchObj = false;
+    bool benchClusters = false;
+    bool meshStats = false;
+    bool benchLights = false;
+    bool benchLuts = false;
+    bool benchmark = false;
+    FrameBenchmark::Settings benchmarkSettings;
+    int benchIterations = 5;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--bench-convert") == 0) {
+            benchConvert = true;
+        } else if (strcmp(argv[i], "--bench-obj") == 0) {
+            benchObj = true;
+        } else if (strcmp(argv[i], "--bench-clusters") == 0) {
+            benchClusters = true;
+        } else if (strcmp(argv[i], "--no-cluster-culling") == 0) {
+            options.clusterCulling = false;
+        } else if (strcmp(argv[i], "--assimp-obj") == 0) {
+            options.nativeObj = false;
+        } else if (strcmp(argv[i], "--mesh-stats") == 0) {
+            meshStats = true;
+        } else if (strcmp(argv[i], "--no-mesh-optimize") == 0) {
+            options.optimizeMeshes = false;
+        } else if (strcmp(argv[i], "--scene-copies") == 0 && i + 1 < argc) {
+            options.sceneCopies = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc) {
+            options.lightCount = std::clamp<size_t>(size_t(std::max(0, atoi(argv[++i]))), 4, MAX_SCENE_LIGHTS);
+        } else if (strcmp(argv[i], "--bench-lights") == 0) {
+            benchLights = true;
+        } else if (strcmp(argv[i], "--benchmark") == 0) {
+            benchmark = true;
+            options.headless = true;
+        } else if (strcmp(argv[i], "--bench-frames") == 0 && i + 1 < argc) {
+            benchmarkSettings.frames = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--bench-warmup") == 0 && i + 1 < argc) {
+            benchmarkSettings.warmupFrames = std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc) {
+            benchmarkSettings.outputPrefix = argv[++i];
+        } else if (strcmp(argv[i], "--bench-baseline") == 0 && i + 1 < argc) {
+            benchmarkSettings.baselinePath = argv[++i];
+        } else if (strcmp(argv[i], "--bench-tolerance") == 0 && i + 1 < argc) {
+            benchmarkSettings.tolerance = std::max(0.0, atof(argv[++i]));
+        } else if (strcmp(argv[i], "--bench-size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &options.windowWidth, &options.windowHeight) != 2) {
+                std::cerr << "--bench-size expects WIDTHxHEIGHT" << std::endl;
+                return -1;
+            }
+            options.windowWidth = std::max(64, options.windowWidth);
+            options.windowHeight = std::max(64, options.windowHeight);
+        } else if (strcmp(argv[i], "--frame-budget-ms") == 0 && i + 1 < argc) {
+            options.frameBudgetMs = std::max(1.0, atof(argv[++i]));
+        } else if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc) {
+            options.renderScale = glm::clamp(float(atof(argv[++i])), ResolutionController::MIN_SCALE,
+                                             ResolutionController::MAX_SCALE);
+        } else if (strcmp(argv[i], "--sharpen") == 0 && i + 1 < argc) {
+            options.sharpness = glm::clamp(float(atof(argv[++i])), 0.0f, 1.0f);
+        } else if (strcmp(argv[i], "--profile-trace") == 0 && i + 1 < argc) {
+            options.tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--bench-luts") == 0) {
+            benchLuts = true;
+        } else if (strcmp(argv[i], "--no-material-luts") == 0) {
+            options.materialLuts = false;
+        } else if (strcmp(argv[i], "--procedural") == 0 && i + 1 < argc) {
+            options.proceduralTriangles = size_t(std::max(0.0, atof(argv[++i])));
+        } else if (strcmp(argv[i], "--no-shader-cache") == 0) {
+            options.shaderCache = false;
+        } else if (strcmp(argv[i], "--no-textures") == 0) {
+            options.textures = false;
+        } else if (strcmp(argv[i], "--texture-budget-mb") == 0 && i + 1 < argc) {
+            options.textureBudgetMb = size_t(std::max(16, atoi(argv[++i])));
+        } else if (strcmp(argv[i], "--per-vertex-normal-matrix") == 0) {
+            options.perVertexNormalMatrix = true;
+        } else if (strcmp(argv[i], "--no-instancing") == 0) {
+            options.instancing = false;
+        } else if (strcmp(argv[i], "--screen-space-sss") == 0) {
+            options.screenSpaceSss = true;
+        } else if (strcmp(argv[i], "--temporal") == 0) {
+            options.temporal = true;
+        } else if (strcmp(argv[i], "--temporal-rate") == 0 && i + 1 < argc) {
+            options.temporalRate = atoi(argv[++i]);
+            if (options.temporalRate != 1 && options.temporalRate != 2 && options.temporalRate != 4) {
+                std::cerr << "--temporal-rate expects 1, 2 or 4" << std::endl;
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--depth-prepass") == 0) {
+            options.depthPrepass = true;
+        } else if (strcmp(argv[i], "--no-lod") == 0) {
+            options.buildLods = false;
+        } else if (strcmp(argv[i], "--lod-pixel-error") == 0 && i + 1 < argc) {
+            options.lodPixelError = float(atof(argv[++i]));
+        } else if (strcmp(argv[i], "--lod-hysteresis") == 0 && i + 1 < argc) {
+            options.lodHysteresis = glm::clamp(float(atof(argv[++i])), 0.0f, 0.9f);
+        } else if (strcmp(argv[i], "--bench-iterations") == 0 && i + 1 < argc) {
+            benchIterations = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--packed-vertices") == 0) {
+            options.vertexFormat = VertexFormat::Packed;
+        } else if (strcmp(argv[i], "--no-mesh-cache") == 0) {
+            options.useMeshCache = false;
+        } else if (strcmp(argv[i], "--upload-budget-ms") == 0 && i + 1 < argc) {
+            options.uploadBudgetMs = atof(argv[++i]);
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            std::cerr << "Usage: sss_demo [--no-mesh-cache] [--no-mesh-optimize] [--upload-budget-ms <ms>] [--packed-vertices]" << std::endl;
+            std::cerr << "                [--no-lod] [--lod-pixel-error <px>] [--lod-hysteresis <0..0.9>] [--scene-copies <n>]" << std::endl;
+            std::cerr << "                [--depth-prepass] [--lights <4..1024>] [--screen-space-sss]" << std::endl;
+            std::cerr << "                [--temporal] [--temporal-rate <1|2|4>]" << std::endl;
+            std::cerr << "                [--no-material-luts] [--profile-trace <json>]" << std::endl;
+            std::cerr << "                [--per-vertex-normal-matrix] [--no-instancing] [--procedural <triangles per shape>]" << std::endl;
+            std::cerr << "                [--no-shader-cache] [--assimp-obj] [--no-cluster-culling]" << std::endl;
+            std::cerr << "                [--frame-budget-ms <ms>] [--render-scale <0.5..1>] [--sharpen <0..1>]" << std::endl;
+            std::cerr << "                [--no-textures] [--texture-budget-mb <MB>]" << std::endl;
+            std::cerr << "       sss_demo --bench-convert [--bench-iterations <n>]" << std::endl;
+            std::cerr << "       sss_demo --bench-obj [--bench-iterations <n>]" << std::endl;
+            std::cerr << "       sss_demo --bench-clusters [--bench-iterations <n>]" << std::endl;
+            std::cerr << "       sss_demo --mesh-stats" << std::endl;
+            std::cerr << "       sss_demo --bench-lights [--bench-iterations <n>]" << std::endl;
+            std::cerr << "       sss_demo --bench-luts [--bench-iterations <n>]" << std::endl;
+            std::cerr << "       sss_demo --benchmark [--bench-frames <n>] [--bench-warmup <n>] [--bench-size <w>x<h>]" << std::endl;
+            std::cerr << "                [--bench-out <prefix>] [--bench-baseline <json>] [--bench-tolerance <fraction>]" << std::endl;
+            return -1;
+        }
+    }
+
+    if (benchConvert) {
+        std::vector<std::string> stanfordModels;
+        for (const ModelSource& source : modelSources) {
+            if (strncmp(source.name, "Stanford", 8) == 0) stanfordModels.push_back(source.path);
+        }
+        return Benchmarks::runConvertBenchmark(stanfordModels, benchIterations);
+    }
+
+    if (benchObj) {
+        std::vector<std::string> objModels;
+        for (const ModelSource& source : modelSources) {
+            if (ObjParser::isObjPath(source.path)) objModels.push_back(source.path);
+        }
+        return Benchmarks::runObjParseBenchmark(objModels, benchIterations);
+    }
+
+    if (benchClusters) {
+        std::vector<Benchmarks::OrbitModel> orbitModels;
+        for (const ModelSource& source : modelSources) {
+            glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), source.position), source.scale);
+            orbitModels.push_back({source.name, source.path, model, source.position, glm::length(source.cameraDistance)});
+        }
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1400.0f / 900.0f, NEAR_PLANE, FAR_PLANE);
+        return Benchmarks::runClusterBenchmark(orbitModels, projection, benchIterations);
+    }
+
+    if (benchLights) {
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 3.0f, 15.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0, 1, 0));
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1400.0f / 900.0f, NEAR_PLANE, FAR_PLANE);
+        return Benchmarks::runLightBenchmark(view, projection, NEAR_PLANE, FAR_PLANE, MAX_SCENE_LIGHTS, benchIterations);
+    }
+
+    if (benchLuts) {
+        return Benchmarks::runMaterialLutComparison(benchIterations);
+    }
+
+    if (meshStats) {
+        Benchmarks::NamedMeshes spheres;
+        spheres.name = "Test Spheres";
+        spheres.meshes.push_back(buildSphereMesh(glm::vec3(0, 0, 0), 1.0f));
+        spheres.meshes.push_back(buildSphereMesh(glm::vec3(-2.5f, 0, 0), 0.8f));
+        spheres.meshes.push_back(buildSphereMesh(glm::vec3(2.5f, 0, 0), 1.2f));
+        spheres.meshes.push_back(buildSphereMesh(glm::vec3(0, 2.0f, 0), 0.6f));
+
+        std::vector<Benchmarks::NamedMeshes> sets;
+        sets.push_back(std::move(spheres));
+        for (const ModelSource& source : modelSources) {
+            Benchmarks::NamedMeshes imported;
+            imported.name = source.name;
+            if (Benchmarks::importMeshes(source.path, imported.meshes)) {
+                sets.push_back(std::move(imported));
+            }
+        }
+        return Benchmarks::runMeshStats(sets);
+    }
+
     SexySSDemo demo;
-    if (!demo.initialize()) {
+    if (!demo.initialize(options)) {
         std::cerr << "❌ Failed to initialize sexy SSS demo" << std::endl;
         return -1;
     }
 
+    if (benchmark) {
+        int status = demo.runBenchmark(benchmarkSettings);
+        glfwTerminate();
+        return status;
+    }
+
     demo.run();
     glfwTerminate();
     return 0;
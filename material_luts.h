@@ -0,0 +1,280 @@
+#pragma once
+
+#include "gl_counter.h"
+#include "parallel.h"
+#include "uniform_blocks.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Per-material lookup tables that replace the per-light material math in the
+// forward shader:
+//   scatter LUT (NdotL x curvature): the enhanced-SSS scattered term, i.e.
+//     wrapped diffuse pre-integrated over a ring of the given curvature with
+//     the material's diffusion profile, already multiplied by scattering
+//     colour, material tint and the exp(-absorption) term. Row 0 (flat) is
+//     exactly the analytic wrapped diffuse.
+//   Schlick LUT (NdotL x NdotV): FL + FV and FL * FV, with F = (1 - x)^5. The
+//     Disney fd/FSS products expand into those two sums, so the shader keeps
+//     only the HdotL-dependent factor. It doesn't depend on the material and
+//     is built once.
+// Tables are built on worker threads and cached in .cache/luts/ per preset.
+namespace MaterialLuts {
+
+const int SCATTER_SIZE = 64;
+const int SCHLICK_SIZE = 64;
+// Curvature (1 / world units) mapped to the scatter LUT's last row
+const float MAX_CURVATURE = 4.0f;
+const int RING_SAMPLES = 256;
+
+const char MAGIC[8] = {'S', 'S', 'S', 'L', 'U', 'T', '\0', '\0'};
+const uint32_t VERSION = 1;
+
+// Mirrors the materialType branch in calculateEnhancedSSS
+struct MaterialTint {
+    glm::vec3 tint;
+    float multiplier;
+};
+
+inline MaterialTint tintFor(const UniformBlocks::Material& material) {
+    float type = material.params.y;
+    if (type < 0.5f) return {glm::vec3(1.0f, 0.8f, 0.6f), 1.0f};
+    if (type < 1.5f) return {glm::vec3(0.95f, 0.95f, 1.0f), 0.7f};
+    if (type < 2.5f) return {glm::vec3(1.0f, 0.9f, 0.7f), 1.2f};
+    return {glm::vec3(0.7f, 1.0f, 0.8f), 0.8f};
+}
+
+inline glm::vec3 absorptionTerm(const UniformBlocks::Material& material) {
+    return glm::exp(-glm::vec3(material.absorption) * material.scattering.w * 2.0f);
+}
+
+// Everything the scattered term multiplies wrapped diffuse by
+inline glm::vec3 scatterColor(const UniformBlocks::Material& material) {
+    return glm::vec3(material.scattering) * tintFor(material).tint * absorptionTerm(material);
+}
+
+// Everything the transmitted term multiplies pow(VdotH, 3) by
+inline glm::vec3 transmissionColor(const UniformBlocks::Material& material) {
+    MaterialTint t = tintFor(material);
+    return glm::vec3(material.internalColor) * t.tint * material.absorption.w * t.multiplier * absorptionTerm(material);
+}
+
+// Per-channel diffusion width: scatteringDistance * scattering / (scattering + absorption)
+inline glm::vec3 diffusionWidths(const UniformBlocks::Material& material) {
+    glm::vec3 scattering = glm::vec3(material.scattering);
+    glm::vec3 absorption = glm::vec3(material.absorption);
+    glm::vec3 d = material.scattering.w * scattering / glm::max(scattering + absorption, glm::vec3(1e-4f));
+    return glm::max(d, glm::vec3(1e-3f));
+}
+
+inline float wrappedDiffuse(float NdotL, float wrap) {
+    return std::max(0.0f, (NdotL + wrap) / (1.0f + wrap));
+}
+
+// Penner-style ring integral: light arriving at angle theta on a circle of
+// radius 1 / curvature, weighted by the distance falloff of Burley's profile
+// (e^(-s/d) + e^(-s/3d)) along the chord s.
+inline glm::vec3 preIntegrate(float NdotL, float curvature, float wrap, const glm::vec3& d) {
+    if (curvature <= 0.0f) return glm::vec3(wrappedDiffuse(NdotL, wrap));
+
+    float theta = std::acos(std::clamp(NdotL, -1.0f, 1.0f));
+    float radius = 1.0f / curvature;
+    glm::vec3 sum(0.0f), weights(0.0f);
+    for (int i = 0; i < RING_SAMPLES; ++i) {
+        float x = -3.14159265f + (i + 0.5f) * (2.0f * 3.14159265f / RING_SAMPLES);
+        float chord = 2.0f * radius * std::abs(std::sin(0.5f * x));
+        glm::vec3 w = glm::exp(-chord / d) + glm::exp(-chord / (3.0f * d));
+        sum += w * wrappedDiffuse(std::cos(theta + x), wrap);
+        weights += w;
+    }
+    return sum / weights;
+}
+
+inline float lutCoordinate(int i, int size) {
+    return float(i) / float(size - 1);
+}
+
+// RGBA32F texels, row-major with NdotL (-1..1) along x and curvature along y
+inline void buildScatterLut(const UniformBlocks::Material& material, std::vector<glm::vec4>& texels,
+                            bool parallel = true) {
+    texels.resize(size_t(SCATTER_SIZE) * SCATTER_SIZE);
+    glm::vec3 color = scatterColor(material);
+    glm::vec3 d = diffusionWidths(material);
+    float wrap = material.scattering.w;
+
+    parallelFor(SCATTER_SIZE, parallel ? 4 : SCATTER_SIZE, [&](size_t begin, size_t end, unsigned) {
+        for (size_t y = begin; y < end; ++y) {
+            float curvature = lutCoordinate(int(y), SCATTER_SIZE) * MAX_CURVATURE;
+            for (int x = 0; x < SCATTER_SIZE; ++x) {
+                float NdotL = lutCoordinate(x, SCATTER_SIZE) * 2.0f - 1.0f;
+                texels[y * SCATTER_SIZE + x] = glm::vec4(color * preIntegrate(NdotL, curvature, wrap, d), 1.0f);
+            }
+        }
+    });
+}
+
+inline void buildSchlickLut(std::vector<glm::vec4>& texels) {
+    texels.resize(size_t(SCHLICK_SIZE) * SCHLICK_SIZE);
+    for (int y = 0; y < SCHLICK_SIZE; ++y) {
+        float fv = std::pow(1.0f - lutCoordinate(y, SCHLICK_SIZE), 5.0f);
+        for (int x = 0; x < SCHLICK_SIZE; ++x) {
+            float fl = std::pow(1.0f - lutCoordinate(x, SCHLICK_SIZE), 5.0f);
+            texels[y * SCHLICK_SIZE + x] = glm::vec4(fl + fv, fl * fv, 0.0f, 1.0f);
+        }
+    }
+}
+
+// Keyed on the preset's values, so editing a preset rebuilds its table
+inline std::string cachePathFor(const UniformBlocks::Material& material) {
+    uint64_t hash = 1469598103934665603ULL;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&material);
+    for (size_t i = 0; i < sizeof(material); ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.ssslut", (unsigned long long)hash);
+    return std::string(".cache/luts/") + name;
+}
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;
+    float maxCurvature;
+    uint32_t ringSamples;
+    UniformBlocks::Material material;
+};
+
+inline bool readScatterLut(const std::string& path, const UniformBlocks::Material& material,
+                           std::vector<glm::vec4>& texels) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+
+    FileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+              header.version == VERSION && header.size == uint32_t(SCATTER_SIZE) &&
+              header.maxCurvature == MAX_CURVATURE && header.ringSamples == uint32_t(RING_SAMPLES) &&
+              memcmp(&header.material, &material, sizeof(material)) == 0;
+    if (ok) {
+        texels.resize(size_t(SCATTER_SIZE) * SCATTER_SIZE);
+        ok = fread(texels.data(), sizeof(glm::vec4), texels.size(), f) == texels.size();
+    }
+    fclose(f);
+    return ok;
+}
+
+// Temporary file plus rename, as for the mesh cache
+inline bool writeScatterLut(const std::string& path, const UniformBlocks::Material& material,
+                            const std::vector<glm::vec4>& texels) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+    std::string tmpPath = path + ".tmp" + std::to_string(getpid());
+    FILE* f = fopen(tmpPath.c_str(), "wb");
+    if (!f) return false;
+
+    FileHeader header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.size = uint32_t(SCATTER_SIZE);
+    header.maxCurvature = MAX_CURVATURE;
+    header.ringSamples = uint32_t(RING_SAMPLES);
+    header.material = material;
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(texels.data(), sizeof(glm::vec4), texels.size(), f) == texels.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Returns true if the table came from the cache
+inline bool loadOrBuildScatterLut(const UniformBlocks::Material& material, std::vector<glm::vec4>& texels,
+                                  bool useCache = true) {
+    std::string path = cachePathFor(material);
+    if (useCache && readScatterLut(path, material, texels)) return true;
+    buildScatterLut(material, texels);
+    if (useCache) writeScatterLut(path, material, texels);
+    return false;
+}
+
+// Bilinear lookup at coordinate t in [0, 1] where texel i holds t = i / (size - 1),
+// i.e. what the shader's lutCoord() + GL_LINEAR return
+inline glm::vec4 sample(const std::vector<glm::vec4>& texels, int size, float u, float v) {
+    float fx = std::clamp(u, 0.0f, 1.0f) * (size - 1);
+    float fy = std::clamp(v, 0.0f, 1.0f) * (size - 1);
+    int x0 = std::min(int(fx), size - 2), y0 = std::min(int(fy), size - 2);
+    float tx = fx - x0, ty = fy - y0;
+    glm::vec4 top = glm::mix(texels[y0 * size + x0], texels[y0 * size + x0 + 1], tx);
+    glm::vec4 bottom = glm::mix(texels[(y0 + 1) * size + x0], texels[(y0 + 1) * size + x0 + 1], tx);
+    return glm::mix(top, bottom, ty);
+}
+
+}
+
+// GL side: the shared Schlick table plus the selected material's scatter
+// table, rebuilt (or read from the cache) whenever the material changes.
+class MaterialLutTextures {
+public:
+    static const GLuint SCATTER_UNIT = 7;
+    static const GLuint SCHLICK_UNIT = 8;
+
+    void create() {
+        glGenTextures(1, &scatterTexture);
+        glGenTextures(1, &schlickTexture);
+        std::vector<glm::vec4> texels;
+        MaterialLuts::buildSchlickLut(texels);
+        upload(schlickTexture, MaterialLuts::SCHLICK_SIZE, texels, SCHLICK_UNIT);
+    }
+
+    // Returns true if the table changed this call
+    bool select(int index) {
+        if (index == selected) return false;
+        selected = index;
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<glm::vec4> texels;
+        bool cached = MaterialLuts::loadOrBuildScatterLut(UniformBlocks::MATERIAL_PRESETS[index], texels);
+        upload(scatterTexture, MaterialLuts::SCATTER_SIZE, texels, SCATTER_UNIT);
+        std::cout << "🧮 Material LUT " << (cached ? "loaded from cache" : "built") << " in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                  << " ms" << std::endl;
+        return true;
+    }
+
+    static void bindSamplers(GLuint program) {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "scatterLut"), SCATTER_UNIT);
+        glUniform1i(glGetUniformLocation(program, "schlickLut"), SCHLICK_UNIT);
+        glUniform1f(glGetUniformLocation(program, "maxCurvature"), MaterialLuts::MAX_CURVATURE);
+    }
+
+private:
+    GLuint scatterTexture = 0;
+    GLuint schlickTexture = 0;
+    int selected = -1;
+
+    static void upload(GLuint texture, int size, const std::vector<glm::vec4>& texels, GLuint unit) {
+        GL_COUNT(glActiveTexture(GL_TEXTURE0 + unit));
+        GL_COUNT(glBindTexture(GL_TEXTURE_2D, texture));
+        GL_COUNT(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, size, size, 0, GL_RGBA, GL_FLOAT, texels.data()));
+        GL_COUNT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        GL_COUNT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        GL_COUNT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL_COUNT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    }
+};
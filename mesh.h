@@ -0,0 +1,106 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+struct Vertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+};
+
+struct ModelInfo {
+    std::string name;
+    std::string sourcePath;
+    std::vector<size_t> meshIndices;
+    glm::vec3 idealScale;
+    glm::vec3 idealPosition;
+    glm::vec3 cameraDistance;
+    std::string description;
+};
+
+enum class VertexFormat {
+    Float,
+    Packed
+};
+
+// 16 bytes: unorm16 position relative to the mesh AABB, octahedral snorm16
+// normal and half-float UVs. Decoded by positionDecode and octDecode().
+struct PackedVertex {
+    uint16_t Position[4];
+    uint32_t Normal;
+    uint32_t TexCoords;
+};
+
+// A surface material as the model file describes it: base colour plus the
+// albedo, alpha mask and normal (or bump) map paths, resolved against the
+// model's directory. Empty paths mean no texture.
+struct MaterialSource {
+    std::string name;
+    glm::vec3 diffuseColor = glm::vec3(0.8f, 0.6f, 0.5f);
+    std::string diffuseMap;
+    std::string alphaMap;
+    std::string normalMap;
+};
+
+// One level of detail: a range of the mesh's index buffer plus the geometric
+// error (object-space distance) introduced by simplifying down to it.
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+};
+
+// A run of at most 124 triangles / 64 vertices of LOD 0, contiguous in the
+// index buffer, with an object-space bounding sphere and a cone containing
+// every triangle's normal. coneCutoff is the sine of the cone's half angle;
+// 1 or more means the cone is too wide to ever cull.
+struct MeshCluster {
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneAxis;
+    float coneCutoff;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+// A mesh's placement in the GeometryPool plus the CPU-side data the renderer
+// needs for LOD selection and culling: bounds, LOD ranges and clusters. The
+// geometry itself only lives on the GPU. Move-only, so a container of meshes
+// never copies it.
+struct Mesh {
+    GLint baseVertex = 0;
+    GLuint firstIndex = 0;
+    GLsizei indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    VertexFormat format = VertexFormat::Float;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    glm::mat4 positionDecode = glm::mat4(1.0f);
+    size_t gpuBytes = 0;
+    std::vector<MeshLod> lods;
+    std::vector<MeshCluster> clusters;
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+    // Index into the renderer's surface table; 0 is the untextured default
+    uint32_t surface = 0;
+
+    Mesh() = default;
+    Mesh(Mesh&&) = default;
+    Mesh& operator=(Mesh&&) = default;
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    // Renderer-side bytes beyond the struct itself
+    size_t cpuBytes() const {
+        return lods.capacity() * sizeof(MeshLod) + clusters.capacity() * sizeof(MeshCluster);
+    }
+
+    size_t indexSize() const {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+    }
+};
@@ -0,0 +1,377 @@
+#pragma once
+
+#include "mesh.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+
+        void* ptr = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (ptr == MAP_FAILED) return false;
+
+        // The advice values are an enumeration, not flags; apply each on its own.
+        madvise(ptr, size_t(st.st_size), MADV_SEQUENTIAL);
+        madvise(ptr, size_t(st.st_size), MADV_WILLNEED);
+        mapped = static_cast<const uint8_t*>(ptr);
+        mappedSize = size_t(st.st_size);
+        return true;
+    }
+
+    void close() {
+        if (mapped) munmap(const_cast<uint8_t*>(mapped), mappedSize);
+        mapped = nullptr;
+        mappedSize = 0;
+    }
+
+    const uint8_t* data() const { return mapped; }
+    size_t size() const { return mappedSize; }
+
+private:
+    const uint8_t* mapped = nullptr;
+    size_t mappedSize = 0;
+};
+
+// On-disk layout: FileHeader, source path bytes, the material table, MeshRecord[meshCount], then
+// 64-byte aligned vertex/index/LOD/cluster blobs referenced by the records. Everything is
+// little-endian and laid out so the blobs can go to glBufferData as mapped. The material
+// table lists the files materials were read from (OBJ mtllibs) with their size and mtime,
+// which must still match, followed by the materials themselves.
+namespace MeshCache {
+
+const char MAGIC[8] = {'S', 'S', 'S', 'M', 'E', 'S', 'H', '\0'};
+const uint32_t VERSION = 6;
+const size_t BLOB_ALIGNMENT = 64;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint64_t importFlags;
+    uint64_t processingFlags;
+    int64_t sourceMtimeNs;
+    uint64_t sourceSize;
+    uint32_t sourcePathLength;
+    uint32_t meshCount;
+    uint32_t dependencyCount;
+    uint32_t materialCount;
+    uint64_t materialTableBytes;
+};
+
+struct MeshRecord {
+    uint64_t vertexOffset;
+    uint64_t vertexCount;
+    uint64_t indexOffset;
+    uint64_t indexCount;
+    uint64_t lodOffset;
+    uint64_t lodCount;
+    uint64_t clusterOffset;
+    uint64_t clusterCount;
+    uint32_t material;
+    uint32_t reserved;
+};
+
+struct SourceKey {
+    std::string path;
+    int64_t mtimeNs = 0;
+    uint64_t size = 0;
+    uint64_t importFlags = 0;
+    uint64_t processingFlags = 0;
+};
+
+struct MeshView {
+    const Vertex* vertices;
+    size_t vertexCount;
+    const unsigned int* indices;
+    size_t indexCount;
+    const MeshLod* lods;
+    size_t lodCount;
+    const MeshCluster* clusters;
+    size_t clusterCount;
+    uint32_t material;
+};
+
+const uint64_t PROCESSING_OPTIMIZED = 1;
+const uint64_t PROCESSING_LODS = 2;
+// Imported by ObjParser rather than Assimp; the two differ in generated normals
+const uint64_t PROCESSING_NATIVE_OBJ = 4;
+const uint64_t PROCESSING_CLUSTERS = 8;
+
+// No material for this mesh
+const uint32_t NO_MATERIAL = 0xffffffffu;
+
+inline bool fileStamp(const std::string& path, int64_t& mtimeNs, uint64_t& size) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    mtimeNs = int64_t(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    size = uint64_t(st.st_size);
+    return true;
+}
+
+inline bool makeSourceKey(const std::string& sourcePath, uint64_t importFlags, uint64_t processingFlags, SourceKey& key) {
+    if (!fileStamp(sourcePath, key.mtimeNs, key.size)) return false;
+    key.path = sourcePath;
+    key.importFlags = importFlags;
+    key.processingFlags = processingFlags;
+    return true;
+}
+
+inline std::string cachePathFor(const std::string& sourcePath) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (unsigned char c : sourcePath) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.sssmesh", (unsigned long long)hash);
+    return std::string(".cache/meshes/") + name;
+}
+
+inline size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+inline void appendBytes(std::vector<uint8_t>& out, const void* data, size_t bytes) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    out.insert(out.end(), p, p + bytes);
+}
+
+inline void appendString(std::vector<uint8_t>& out, const std::string& text) {
+    uint32_t length = uint32_t(text.size());
+    appendBytes(out, &length, sizeof(length));
+    appendBytes(out, text.data(), text.size());
+}
+
+struct TableReader {
+    const uint8_t* cursor;
+    const uint8_t* end;
+
+    bool read(void* out, size_t bytes) {
+        if (size_t(end - cursor) < bytes) return false;
+        memcpy(out, cursor, bytes);
+        cursor += bytes;
+        return true;
+    }
+
+    bool readString(std::string& out) {
+        uint32_t length;
+        if (!read(&length, sizeof(length)) || size_t(end - cursor) < length) return false;
+        out.assign(reinterpret_cast<const char*>(cursor), length);
+        cursor += length;
+        return true;
+    }
+};
+
+inline std::vector<uint8_t> encodeMaterialTable(const std::vector<std::string>& dependencies,
+                                                const std::vector<MaterialSource>& materials) {
+    std::vector<uint8_t> table;
+    for (const std::string& dependency : dependencies) {
+        int64_t mtimeNs = 0;
+        uint64_t size = 0;
+        fileStamp(dependency, mtimeNs, size);
+        appendString(table, dependency);
+        appendBytes(table, &mtimeNs, sizeof(mtimeNs));
+        appendBytes(table, &size, sizeof(size));
+    }
+    for (const MaterialSource& material : materials) {
+        appendBytes(table, &material.diffuseColor, sizeof(material.diffuseColor));
+        appendString(table, material.name);
+        appendString(table, material.diffuseMap);
+        appendString(table, material.alphaMap);
+        appendString(table, material.normalMap);
+    }
+    return table;
+}
+
+// Fails if a dependency changed since the table was written
+inline bool decodeMaterialTable(const FileHeader& header, const uint8_t* data, std::vector<MaterialSource>& materials) {
+    TableReader reader = {data, data + header.materialTableBytes};
+    for (uint32_t i = 0; i < header.dependencyCount; ++i) {
+        std::string path;
+        int64_t mtimeNs, currentMtimeNs;
+        uint64_t size, currentSize;
+        if (!reader.readString(path) || !reader.read(&mtimeNs, sizeof(mtimeNs)) || !reader.read(&size, sizeof(size))) {
+            return false;
+        }
+        if (!fileStamp(path, currentMtimeNs, currentSize) || currentMtimeNs != mtimeNs || currentSize != size) {
+            return false;
+        }
+    }
+    materials.assign(header.materialCount, MaterialSource());
+    for (MaterialSource& material : materials) {
+        if (!reader.read(&material.diffuseColor, sizeof(material.diffuseColor)) || !reader.readString(material.name) ||
+            !reader.readString(material.diffuseMap) || !reader.readString(material.alphaMap) ||
+            !reader.readString(material.normalMap)) {
+            return false;
+        }
+    }
+    return reader.cursor == reader.end;
+}
+
+// Validates the mapped file against the source key and returns views into the
+// mapping. The views are only valid while the MappedFile stays open.
+inline bool readMeshes(const MappedFile& file, const SourceKey& key, std::vector<MeshView>& out,
+                       std::vector<MaterialSource>& materials) {
+    const uint8_t* base = file.data();
+    size_t size = file.size();
+    if (!base || size < sizeof(FileHeader)) return false;
+
+    FileHeader header;
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+    if (header.version != VERSION || header.vertexSize != sizeof(Vertex)) return false;
+    if (header.importFlags != key.importFlags || header.processingFlags != key.processingFlags) return false;
+    if (header.sourceMtimeNs != key.mtimeNs || header.sourceSize != key.size) return false;
+    if (header.sourcePathLength != key.path.size()) return false;
+
+    size_t cursor = sizeof(FileHeader);
+    if (cursor + header.sourcePathLength > size) return false;
+    if (memcmp(base + cursor, key.path.data(), key.path.size()) != 0) return false;
+    cursor += header.sourcePathLength;
+    if (header.materialTableBytes > size - cursor) return false;
+    if (!decodeMaterialTable(header, base + cursor, materials)) return false;
+    cursor = alignUp(cursor + size_t(header.materialTableBytes), alignof(MeshRecord));
+
+    if (cursor + size_t(header.meshCount) * sizeof(MeshRecord) > size) return false;
+    const MeshRecord* records = reinterpret_cast<const MeshRecord*>(base + cursor);
+
+    out.clear();
+    out.reserve(header.meshCount);
+    for (uint32_t i = 0; i < header.meshCount; ++i) {
+        const MeshRecord& r = records[i];
+        if (r.material != NO_MATERIAL && r.material >= header.materialCount) return false;
+        if (r.vertexOffset % alignof(Vertex) != 0 || r.indexOffset % alignof(unsigned int) != 0) return false;
+        if (r.vertexOffset + r.vertexCount * sizeof(Vertex) > size) return false;
+        if (r.indexOffset + r.indexCount * sizeof(unsigned int) > size) return false;
+        if (r.lodOffset % alignof(MeshLod) != 0 || r.lodOffset + r.lodCount * sizeof(MeshLod) > size) return false;
+
+        if (r.clusterOffset % alignof(MeshCluster) != 0 || r.clusterOffset + r.clusterCount * sizeof(MeshCluster) > size) {
+            return false;
+        }
+
+        const MeshLod* lods = reinterpret_cast<const MeshLod*>(base + r.lodOffset);
+        for (uint64_t l = 0; l < r.lodCount; ++l) {
+            if (uint64_t(lods[l].firstIndex) + lods[l].indexCount > r.indexCount) return false;
+        }
+        const MeshCluster* clusters = reinterpret_cast<const MeshCluster*>(base + r.clusterOffset);
+        for (uint64_t c = 0; c < r.clusterCount; ++c) {
+            if (uint64_t(clusters[c].firstIndex) + clusters[c].indexCount > r.indexCount) return false;
+        }
+
+        out.push_back({reinterpret_cast<const Vertex*>(base + r.vertexOffset), size_t(r.vertexCount),
+                       reinterpret_cast<const unsigned int*>(base + r.indexOffset), size_t(r.indexCount),
+                       lods, size_t(r.lodCount), clusters, size_t(r.clusterCount), r.material});
+    }
+    return true;
+}
+
+// Writes to a temporary file and renames it into place so a crashed or
+// concurrent writer never leaves a half-written cache behind. dependencies are
+// the files the materials came from besides the source itself.
+inline bool writeMeshes(const std::string& cachePath, const SourceKey& key, const std::vector<MeshView>& meshList,
+                        const std::vector<MaterialSource>& materials, const std::vector<std::string>& dependencies) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(cachePath).parent_path(), ec);
+
+    std::string tmpPath = cachePath + ".tmp" + std::to_string(getpid());
+    FILE* f = fopen(tmpPath.c_str(), "wb");
+    if (!f) return false;
+
+    FileHeader header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.importFlags = key.importFlags;
+    header.processingFlags = key.processingFlags;
+    header.sourceMtimeNs = key.mtimeNs;
+    header.sourceSize = key.size;
+    header.sourcePathLength = uint32_t(key.path.size());
+    header.meshCount = uint32_t(meshList.size());
+    std::vector<uint8_t> materialTable = encodeMaterialTable(dependencies, materials);
+    header.dependencyCount = uint32_t(dependencies.size());
+    header.materialCount = uint32_t(materials.size());
+    header.materialTableBytes = materialTable.size();
+
+    size_t recordsOffset = alignUp(sizeof(FileHeader) + key.path.size() + materialTable.size(), alignof(MeshRecord));
+    size_t cursor = recordsOffset + meshList.size() * sizeof(MeshRecord);
+
+    std::vector<MeshRecord> records(meshList.size());
+    for (size_t i = 0; i < meshList.size(); ++i) {
+        records[i].material = meshList[i].material;
+        cursor = alignUp(cursor, BLOB_ALIGNMENT);
+        records[i].vertexOffset = cursor;
+        records[i].vertexCount = meshList[i].vertexCount;
+        cursor += meshList[i].vertexCount * sizeof(Vertex);
+
+        cursor = alignUp(cursor, BLOB_ALIGNMENT);
+        records[i].indexOffset = cursor;
+        records[i].indexCount = meshList[i].indexCount;
+        cursor += meshList[i].indexCount * sizeof(unsigned int);
+
+        cursor = alignUp(cursor, BLOB_ALIGNMENT);
+        records[i].lodOffset = cursor;
+        records[i].lodCount = meshList[i].lodCount;
+        cursor += meshList[i].lodCount * sizeof(MeshLod);
+
+        cursor = alignUp(cursor, BLOB_ALIGNMENT);
+        records[i].clusterOffset = cursor;
+        records[i].clusterCount = meshList[i].clusterCount;
+        cursor += meshList[i].clusterCount * sizeof(MeshCluster);
+    }
+
+    static const uint8_t zeros[BLOB_ALIGNMENT] = {};
+    size_t written = 0;
+    auto put = [&](const void* data, size_t bytes) {
+        if (bytes && fwrite(data, 1, bytes, f) != bytes) return false;
+        written += bytes;
+        return true;
+    };
+    auto padTo = [&](size_t offset) { return put(zeros, offset - written); };
+
+    bool ok = put(&header, sizeof(header)) && put(key.path.data(), key.path.size()) &&
+              put(materialTable.data(), materialTable.size()) && padTo(recordsOffset) && put(records.data(), records.size() * sizeof(MeshRecord));
+
+    for (size_t i = 0; ok && i < meshList.size(); ++i) {
+        ok = padTo(records[i].vertexOffset) &&
+             put(meshList[i].vertices, meshList[i].vertexCount * sizeof(Vertex)) &&
+             padTo(records[i].indexOffset) &&
+             put(meshList[i].indices, meshList[i].indexCount * sizeof(unsigned int)) &&
+             padTo(records[i].lodOffset) &&
+             put(meshList[i].lods, meshList[i].lodCount * sizeof(MeshLod)) &&
+             padTo(records[i].clusterOffset) &&
+             put(meshList[i].clusters, meshList[i].clusterCount * sizeof(MeshCluster));
+    }
+
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+}
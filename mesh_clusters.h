@@ -0,0 +1,284 @@
+#pragma once
+
+#include "bvh.h"
+#include "mesh.h"
+#include "parallel.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Splits LOD 0 of the large meshes into small clusters and culls those per
+// instance on the CPU, so a scan that is mostly off screen or facing away
+// only submits the index ranges that can produce pixels. Clusters follow the
+// existing triangle order (Tipsify output when meshes are optimized), so the
+// index buffer and its vertex cache behaviour are unchanged; a cluster just
+// ends where the next triangle would exceed either limit.
+namespace MeshClusters {
+
+const size_t MAX_VERTICES = 64;
+const size_t MAX_TRIANGLES = 124;
+// Smaller meshes are drawn whole; their clusters would cost more to test
+// than they could save
+const size_t MIN_MESH_TRIANGLES = 16384;
+// Below this minimum dot(axis, normal) the cone is too wide to ever cull
+const float MIN_CONE_DOT = 0.1f;
+
+// Unit geometric normal of a triangle, flipped to the side its vertex normals
+// point to, or zero for a degenerate triangle. The renderer never culls by
+// winding, so facing follows the stored normals rather than the index order.
+inline glm::vec3 facingNormal(const Vertex& a, const Vertex& b, const Vertex& c) {
+    glm::vec3 n = glm::cross(b.Position - a.Position, c.Position - a.Position);
+    float length = glm::length(n);
+    if (length <= 0.0f) return glm::vec3(0.0f);
+    n /= length;
+    return glm::dot(n, a.Normal + b.Normal + c.Normal) < 0.0f ? -n : n;
+}
+
+inline void computeBounds(const Vertex* vertices, const unsigned int* indices, MeshCluster& cluster) {
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(-std::numeric_limits<float>::max());
+    glm::vec3 normalSum(0.0f);
+    const unsigned int* tri = indices + cluster.firstIndex;
+    for (uint32_t i = 0; i < cluster.indexCount; i += 3) {
+        glm::vec3 a = vertices[tri[i]].Position;
+        glm::vec3 b = vertices[tri[i + 1]].Position;
+        glm::vec3 c = vertices[tri[i + 2]].Position;
+        lo = glm::min(lo, glm::min(a, glm::min(b, c)));
+        hi = glm::max(hi, glm::max(a, glm::max(b, c)));
+        normalSum += facingNormal(vertices[tri[i]], vertices[tri[i + 1]], vertices[tri[i + 2]]);
+    }
+
+    cluster.center = 0.5f * (lo + hi);
+    float radiusSquared = 0.0f;
+    for (uint32_t i = 0; i < cluster.indexCount; ++i) {
+        glm::vec3 d = vertices[tri[i]].Position - cluster.center;
+        radiusSquared = std::max(radiusSquared, glm::dot(d, d));
+    }
+    cluster.radius = std::sqrt(radiusSquared);
+
+    // Geometric normals bound the faces exactly; vertex normals only orient them
+    float axisLength = glm::length(normalSum);
+    cluster.coneAxis = axisLength > 0.0f ? normalSum / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+    float minDot = axisLength > 0.0f ? 1.0f : -1.0f;
+    for (uint32_t i = 0; i < cluster.indexCount && minDot >= MIN_CONE_DOT; i += 3) {
+        glm::vec3 n = facingNormal(vertices[tri[i]], vertices[tri[i + 1]], vertices[tri[i + 2]]);
+        if (n != glm::vec3(0.0f)) minDot = std::min(minDot, glm::dot(n, cluster.coneAxis));
+    }
+    // The normal cone widened by 90 degrees on each side holds every view
+    // direction that sees all triangles from behind: cos(angle + 90) = -sin(angle)
+    cluster.coneCutoff = minDot < MIN_CONE_DOT ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+}
+
+// Clusters for indices [firstIndex, firstIndex + indexCount), with
+// firstIndex/indexCount relative to the start of indices
+inline void build(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, uint32_t firstIndex,
+                  uint32_t indexCount, std::vector<MeshCluster>& out) {
+    out.clear();
+    if (indexCount / 3 < MIN_MESH_TRIANGLES) return;
+
+    // Boundaries: a per-vertex stamp of the last cluster that used it counts
+    // each cluster's distinct vertices in one pass
+    std::vector<uint32_t> stamp(vertexCount, ~0u);
+    uint32_t clusterId = 0;
+    size_t clusterVertices = 0;
+    MeshCluster current = {};
+    current.firstIndex = firstIndex;
+    for (uint32_t i = firstIndex; i + 2 < firstIndex + indexCount; i += 3) {
+        size_t added = 0;
+        for (int k = 0; k < 3; ++k) added += stamp[indices[i + k]] != clusterId;
+        if (current.indexCount / 3 == MAX_TRIANGLES || clusterVertices + added > MAX_VERTICES) {
+            out.push_back(current);
+            current = {};
+            current.firstIndex = i;
+            clusterId++;
+            clusterVertices = 0;
+            added = 3;
+        }
+        for (int k = 0; k < 3; ++k) stamp[indices[i + k]] = clusterId;
+        clusterVertices += added;
+        current.indexCount += 3;
+    }
+    if (current.indexCount > 0) out.push_back(current);
+
+    parallelFor(out.size(), 1024, [&](size_t begin, size_t end, unsigned) {
+        for (size_t c = begin; c < end; ++c) computeBounds(vertices, indices, out[c]);
+    });
+}
+
+// One instance's frustum and camera in its object space. Both tests are
+// exact there for any transform, so clusters are never transformed.
+struct View {
+    glm::vec4 planes[6];
+    glm::vec3 camera;
+};
+
+inline View objectSpaceView(const Frustum& frustum, const glm::vec3& cameraPos, const glm::mat4& model) {
+    View view;
+    glm::mat4 toObject = glm::transpose(model);
+    for (int i = 0; i < 6; ++i) {
+        glm::vec4 p = toObject * frustum.planes[i];
+        view.planes[i] = p / glm::length(glm::vec3(p));
+    }
+    view.camera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPos, 1.0f));
+    return view;
+}
+
+struct Stats {
+    size_t instances = 0;
+    size_t tested = 0;
+    size_t frustumCulled = 0;
+    size_t backfaceCulled = 0;
+    size_t trianglesTested = 0;
+    size_t trianglesCulled = 0;
+    size_t ranges = 0;
+    double ms = 0.0;
+
+    void add(const Stats& other) {
+        instances += other.instances;
+        tested += other.tested;
+        frustumCulled += other.frustumCulled;
+        backfaceCulled += other.backfaceCulled;
+        trianglesTested += other.trianglesTested;
+        trianglesCulled += other.trianglesCulled;
+        ranges += other.ranges;
+        ms += other.ms;
+    }
+};
+
+enum Result { Visible, OutsideFrustum, Backfacing };
+
+inline Result test(const MeshCluster& cluster, const View& view) {
+    for (const glm::vec4& p : view.planes) {
+        if (glm::dot(glm::vec3(p), cluster.center) + p.w < -cluster.radius) return OutsideFrustum;
+    }
+    if (cluster.coneCutoff < 1.0f) {
+        glm::vec3 toCluster = cluster.center - view.camera;
+        if (glm::dot(toCluster, cluster.coneAxis) >= cluster.coneCutoff * glm::length(toCluster) + cluster.radius) {
+            return Backfacing;
+        }
+    }
+    return Visible;
+}
+
+// A run of visible clusters, merged while they're adjacent in the index buffer
+struct IndexRange {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+// Collects one frame's clustered instances and culls them across all cores.
+// Work is split into fixed-size chunks of clusters so a single large scan
+// still spreads over every worker; chunks are merged back per instance.
+class Culler {
+public:
+    static const size_t CHUNK_CLUSTERS = 2048;
+
+    void begin() {
+        jobs.clear();
+        chunkCount = 0;
+    }
+
+    // Returns the job index for ranges()
+    size_t add(const std::vector<MeshCluster>& clusters, const View& view) {
+        Job job;
+        job.clusters = clusters.data();
+        job.view = view;
+        job.firstChunk = chunkCount;
+        job.chunkCount = (clusters.size() + CHUNK_CLUSTERS - 1) / CHUNK_CLUSTERS;
+        job.clusterCount = clusters.size();
+        chunkCount += job.chunkCount;
+        jobs.push_back(job);
+        return jobs.size() - 1;
+    }
+
+    void run() {
+        auto start = std::chrono::steady_clock::now();
+        if (chunks.size() < chunkCount) chunks.resize(chunkCount);
+        for (size_t j = 0; j < jobs.size(); ++j) {
+            for (size_t c = 0; c < jobs[j].chunkCount; ++c) {
+                Chunk& chunk = chunks[jobs[j].firstChunk + c];
+                chunk.job = j;
+                chunk.begin = c * CHUNK_CLUSTERS;
+                chunk.end = std::min(jobs[j].clusterCount, chunk.begin + CHUNK_CLUSTERS);
+            }
+        }
+        parallelFor(chunkCount, 4, [&](size_t begin, size_t end, unsigned) {
+            for (size_t c = begin; c < end; ++c) cullChunk(chunks[c]);
+        });
+
+        totals = Stats();
+        totals.instances = jobs.size();
+        for (Job& job : jobs) {
+            job.ranges.clear();
+            for (size_t c = 0; c < job.chunkCount; ++c) {
+                const Chunk& chunk = chunks[job.firstChunk + c];
+                totals.add(chunk.stats);
+                for (const IndexRange& range : chunk.ranges) {
+                    if (!job.ranges.empty() &&
+                        job.ranges.back().firstIndex + job.ranges.back().indexCount == range.firstIndex) {
+                        job.ranges.back().indexCount += range.indexCount;
+                    } else {
+                        job.ranges.push_back(range);
+                    }
+                }
+            }
+            totals.ranges += job.ranges.size();
+        }
+        totals.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const std::vector<IndexRange>& ranges(size_t job) const { return jobs[job].ranges; }
+    const Stats& stats() const { return totals; }
+
+private:
+    struct Job {
+        const MeshCluster* clusters = nullptr;
+        size_t clusterCount = 0;
+        View view;
+        size_t firstChunk = 0;
+        size_t chunkCount = 0;
+        std::vector<IndexRange> ranges;
+    };
+
+    struct Chunk {
+        size_t job = 0;
+        size_t begin = 0;
+        size_t end = 0;
+        std::vector<IndexRange> ranges;
+        Stats stats;
+    };
+
+    std::vector<Job> jobs;
+    std::vector<Chunk> chunks;
+    size_t chunkCount = 0;
+    Stats totals;
+
+    void cullChunk(Chunk& chunk) {
+        const Job& job = jobs[chunk.job];
+        chunk.ranges.clear();
+        chunk.stats = Stats();
+        for (size_t i = chunk.begin; i < chunk.end; ++i) {
+            const MeshCluster& cluster = job.clusters[i];
+            chunk.stats.tested++;
+            chunk.stats.trianglesTested += cluster.indexCount / 3;
+            Result result = test(cluster, job.view);
+            if (result != Visible) {
+                (result == OutsideFrustum ? chunk.stats.frustumCulled : chunk.stats.backfaceCulled)++;
+                chunk.stats.trianglesCulled += cluster.indexCount / 3;
+                continue;
+            }
+            if (!chunk.ranges.empty() &&
+                chunk.ranges.back().firstIndex + chunk.ranges.back().indexCount == cluster.firstIndex) {
+                chunk.ranges.back().indexCount += cluster.indexCount;
+            } else {
+                chunk.ranges.push_back({cluster.firstIndex, cluster.indexCount});
+            }
+        }
+    }
+};
+
+}
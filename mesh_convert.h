@@ -0,0 +1,136 @@
+#pragma once
+
+#include "mesh.h"
+#include <assimp/scene.h>
+#include <cstring>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// aiMesh -> Vertex/index conversion. The destination is sized once from
+// mNumVertices/mNumFaces, attribute presence is resolved outside the loop, and
+// the interleave runs four floats at a time where SSE2 is available.
+namespace MeshConvert {
+
+template <bool HasNormals, bool HasUVs>
+inline void interleaveScalar(const aiVector3D* pos, const aiVector3D* nrm, const aiVector3D* uv,
+                             size_t begin, size_t end, Vertex* out) {
+    for (size_t i = begin; i < end; ++i) {
+        out[i].Position = glm::vec3(pos[i].x, pos[i].y, pos[i].z);
+        out[i].Normal = HasNormals ? glm::vec3(nrm[i].x, nrm[i].y, nrm[i].z) : glm::vec3(0.0f, 1.0f, 0.0f);
+        out[i].TexCoords = HasUVs ? glm::vec2(uv[i].x, uv[i].y) : glm::vec2(0.0f);
+    }
+}
+
+template <bool HasNormals, bool HasUVs>
+inline void interleave(const aiVector3D* pos, const aiVector3D* nrm, const aiVector3D* uv, size_t count, Vertex* out) {
+    static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex must stay two float4 wide");
+    static_assert(sizeof(aiVector3D) == 3 * sizeof(float), "expects single-precision Assimp");
+
+    size_t simdEnd = 0;
+#if defined(__SSE2__)
+    // Each unaligned float4 load reads one float past the element, so the last
+    // vertex is left to the scalar tail to stay inside the source arrays.
+    simdEnd = count > 0 ? count - 1 : 0;
+    const __m128 defaultNormal = _mm_setr_ps(0.0f, 1.0f, 0.0f, 0.0f);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (size_t i = 0; i < simdEnd; ++i) {
+        __m128 p = _mm_loadu_ps(&pos[i].x);
+        __m128 n = HasNormals ? _mm_loadu_ps(&nrm[i].x) : defaultNormal;
+        __m128 t = HasUVs ? _mm_loadu_ps(&uv[i].x) : zero;
+
+        __m128 zzxx = _mm_shuffle_ps(p, n, _MM_SHUFFLE(0, 0, 2, 2));
+        __m128 lo = _mm_shuffle_ps(p, zzxx, _MM_SHUFFLE(2, 0, 1, 0));
+        __m128 hi = _mm_shuffle_ps(n, t, _MM_SHUFFLE(1, 0, 2, 1));
+
+        float* dst = reinterpret_cast<float*>(out + i);
+        _mm_storeu_ps(dst, lo);
+        _mm_storeu_ps(dst + 4, hi);
+    }
+#endif
+    interleaveScalar<HasNormals, HasUVs>(pos, nrm, uv, simdEnd, count, out);
+}
+
+inline void convertVertices(const aiMesh* mesh, Vertex* out) {
+    const aiVector3D* pos = mesh->mVertices;
+    const aiVector3D* nrm = mesh->HasNormals() ? mesh->mNormals : nullptr;
+    const aiVector3D* uv = mesh->mTextureCoords[0];
+    size_t count = mesh->mNumVertices;
+
+    if (nrm && uv) interleave<true, true>(pos, nrm, uv, count, out);
+    else if (nrm) interleave<true, false>(pos, nrm, uv, count, out);
+    else if (uv) interleave<false, true>(pos, nrm, uv, count, out);
+    else interleave<false, false>(pos, nrm, uv, count, out);
+}
+
+inline size_t countIndices(const aiMesh* mesh) {
+    if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE) {
+        return size_t(mesh->mNumFaces) * 3;
+    }
+    size_t total = 0;
+    for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
+        total += mesh->mFaces[i].mNumIndices;
+    }
+    return total;
+}
+
+inline void convertIndices(const aiMesh* mesh, unsigned int* out) {
+    const aiFace* faces = mesh->mFaces;
+    if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE) {
+        for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
+            memcpy(out + size_t(i) * 3, faces[i].mIndices, 3 * sizeof(unsigned int));
+        }
+        return;
+    }
+    for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
+        const aiFace& face = faces[i];
+        memcpy(out, face.mIndices, face.mNumIndices * sizeof(unsigned int));
+        out += face.mNumIndices;
+    }
+}
+
+inline void convertMesh(const aiMesh* mesh, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    vertices.resize(mesh->mNumVertices);
+    indices.resize(countIndices(mesh));
+    convertVertices(mesh, vertices.data());
+    convertIndices(mesh, indices.data());
+}
+
+// The original per-element push_back conversion, kept as the benchmark baseline.
+inline void convertMeshReference(const aiMesh* mesh, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+        Vertex vertex;
+
+        vertex.Position.x = mesh->mVertices[i].x;
+        vertex.Position.y = mesh->mVertices[i].y;
+        vertex.Position.z = mesh->mVertices[i].z;
+
+        if (mesh->HasNormals()) {
+            vertex.Normal.x = mesh->mNormals[i].x;
+            vertex.Normal.y = mesh->mNormals[i].y;
+            vertex.Normal.z = mesh->mNormals[i].z;
+        } else {
+            vertex.Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+
+        if (mesh->mTextureCoords[0]) {
+            vertex.TexCoords.x = mesh->mTextureCoords[0][i].x;
+            vertex.TexCoords.y = mesh->mTextureCoords[0][i].y;
+        } else {
+            vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+        }
+
+        vertices.push_back(vertex);
+    }
+
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+        aiFace face = mesh->mFaces[i];
+        for (unsigned int j = 0; j < face.mNumIndices; j++) {
+            indices.push_back(face.mIndices[j]);
+        }
+    }
+}
+
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include "mesh.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+// Load-time index/vertex reordering for the post-transform cache, overdraw and
+// vertex fetch. The cache pass is Tipsify (Sander et al. 2007); its dead-end
+// restarts double as cluster boundaries for the overdraw sort.
+namespace MeshOptimize {
+
+const unsigned int CACHE_SIZE = 16;
+
+struct CacheStats {
+    size_t misses = 0;
+    size_t triangles = 0;
+    size_t vertices = 0;
+    double acmr = 0.0;
+    double atvr = 0.0;
+
+    void add(const CacheStats& other) {
+        misses += other.misses;
+        triangles += other.triangles;
+        vertices += other.vertices;
+        acmr = triangles ? double(misses) / double(triangles) : 0.0;
+        atvr = vertices ? double(misses) / double(vertices) : 0.0;
+    }
+};
+
+inline CacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount,
+                                     unsigned int cacheSize = CACHE_SIZE) {
+    CacheStats stats;
+    if (indexCount < 3 || vertexCount == 0) return stats;
+
+    // FIFO cache: a vertex is resident while fewer than cacheSize misses happened since it was loaded
+    std::vector<size_t> loadedAt(vertexCount, 0);
+    size_t misses = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        unsigned int v = indices[i];
+        if (loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize) {
+            ++misses;
+            loadedAt[v] = misses;
+        }
+    }
+
+    stats.misses = misses;
+    stats.triangles = indexCount / 3;
+    stats.vertices = vertexCount;
+    stats.acmr = double(misses) / double(stats.triangles);
+    stats.atvr = double(misses) / double(vertexCount);
+    return stats;
+}
+
+struct Adjacency {
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> triangles;
+    std::vector<unsigned int> liveCounts;
+};
+
+inline void buildAdjacency(const unsigned int* indices, size_t indexCount, size_t vertexCount, Adjacency& adj) {
+    adj.liveCounts.assign(vertexCount, 0);
+    for (size_t i = 0; i < indexCount; ++i) {
+        adj.liveCounts[indices[i]]++;
+    }
+
+    adj.offsets.resize(vertexCount + 1);
+    adj.offsets[0] = 0;
+    for (size_t v = 0; v < vertexCount; ++v) {
+        adj.offsets[v + 1] = adj.offsets[v] + adj.liveCounts[v];
+    }
+
+    adj.triangles.resize(indexCount);
+    std::vector<unsigned int> cursor(adj.offsets.begin(), adj.offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i) {
+        adj.triangles[cursor[indices[i]]++] = unsigned(i / 3);
+    }
+}
+
+// Returns the reordered triangle list and appends the first triangle of every
+// cluster (hard boundary) to clusterStarts.
+inline void tipsify(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize,
+                    std::vector<unsigned int>& out, std::vector<unsigned int>& clusterStarts) {
+    size_t triangleCount = indexCount / 3;
+    out.clear();
+    out.reserve(indexCount);
+    clusterStarts.clear();
+    if (triangleCount == 0) return;
+
+    Adjacency adj;
+    buildAdjacency(indices, indexCount, vertexCount, adj);
+
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<unsigned int> deadEnd;
+    std::vector<unsigned int> candidates;
+    deadEnd.reserve(indexCount);
+
+    unsigned int timestamp = cacheSize + 1;
+    size_t scan = 0;
+    long fanning = 0;
+
+    auto skipDeadEnd = [&]() -> long {
+        while (!deadEnd.empty()) {
+            unsigned int d = deadEnd.back();
+            deadEnd.pop_back();
+            if (adj.liveCounts[d] > 0) return long(d);
+        }
+        while (scan < vertexCount) {
+            if (adj.liveCounts[scan] > 0) return long(scan);
+            ++scan;
+        }
+        return -1;
+    };
+
+    // Start from a vertex that is actually referenced
+    fanning = skipDeadEnd();
+    clusterStarts.push_back(0);
+
+    while (fanning >= 0) {
+        candidates.clear();
+        for (unsigned int a = adj.offsets[fanning]; a < adj.offsets[fanning + 1]; ++a) {
+            unsigned int t = adj.triangles[a];
+            if (emitted[t]) continue;
+
+            for (int k = 0; k < 3; ++k) {
+                unsigned int v = indices[size_t(t) * 3 + k];
+                out.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                adj.liveCounts[v]--;
+                if (timestamp - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = timestamp++;
+                }
+            }
+            emitted[t] = 1;
+        }
+
+        long next = -1;
+        long bestPriority = -1;
+        for (unsigned int v : candidates) {
+            if (adj.liveCounts[v] == 0) continue;
+            long priority = 0;
+            if (long(timestamp - cacheTime[v]) + 2 * long(adj.liveCounts[v]) <= long(cacheSize)) {
+                priority = long(timestamp - cacheTime[v]);
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = long(v);
+            }
+        }
+
+        if (next < 0) {
+            next = skipDeadEnd();
+            if (next >= 0 && out.size() < indexCount) {
+                clusterStarts.push_back(unsigned(out.size() / 3));
+            }
+        }
+        fanning = next;
+    }
+}
+
+// Sorts clusters so those facing away from the mesh centre draw first, which
+// approximates front-to-back order for most view directions.
+inline void optimizeOverdraw(const Vertex* vertices, std::vector<unsigned int>& indices,
+                             const std::vector<unsigned int>& clusterStarts) {
+    size_t triangleCount = indices.size() / 3;
+    size_t clusterCount = clusterStarts.size();
+    if (clusterCount < 2) return;
+
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    std::vector<glm::vec3> clusterCentroid(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+    std::vector<float> clusterArea(clusterCount, 0.0f);
+
+    for (size_t c = 0; c < clusterCount; ++c) {
+        size_t end = c + 1 < clusterCount ? clusterStarts[c + 1] : triangleCount;
+        for (size_t t = clusterStarts[c]; t < end; ++t) {
+            const glm::vec3& p0 = vertices[indices[t * 3 + 0]].Position;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(n);
+            glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+
+            clusterCentroid[c] += centroid * area;
+            clusterNormal[c] += n;
+            clusterArea[c] += area;
+        }
+        meshCentroid += clusterCentroid[c];
+        meshArea += clusterArea[c];
+    }
+    if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+    std::vector<float> sortKey(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        if (clusterArea[c] <= 0.0f) continue;
+        glm::vec3 centroid = clusterCentroid[c] / clusterArea[c];
+        float normalLength = glm::length(clusterNormal[c]);
+        glm::vec3 normal = normalLength > 0.0f ? clusterNormal[c] / normalLength : glm::vec3(0.0f);
+        sortKey[c] = glm::dot(centroid - meshCentroid, normal);
+    }
+
+    std::vector<unsigned int> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(indices.size());
+    for (unsigned int c : order) {
+        size_t end = c + 1 < clusterCount ? clusterStarts[c + 1] : triangleCount;
+        sorted.insert(sorted.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + end * 3);
+    }
+    indices.swap(sorted);
+}
+
+inline uint64_t hashVertex(const Vertex& v) {
+    uint32_t words[sizeof(Vertex) / 4];
+    memcpy(words, &v, sizeof(Vertex));
+    uint64_t hash = 1469598103934665603ULL;
+    for (uint32_t w : words) {
+        hash = (hash ^ w) * 1099511628211ULL;
+    }
+    return hash ^ (hash >> 29);
+}
+
+// Merges bit-identical vertices. Assimp's OBJ importer emits one vertex per
+// face corner unless JoinIdenticalVertices runs, which leaves nothing for the
+// cache pass to reuse.
+inline void weldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    size_t capacity = 1;
+    while (capacity < vertices.size() * 2) capacity <<= 1;
+    const unsigned int empty = ~0u;
+    std::vector<unsigned int> table(capacity, empty);
+
+    std::vector<unsigned int> remap(vertices.size());
+    std::vector<Vertex> unique;
+    unique.reserve(vertices.size());
+
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        size_t slot = hashVertex(vertices[i]) & (capacity - 1);
+        while (table[slot] != empty && memcmp(&unique[table[slot]], &vertices[i], sizeof(Vertex)) != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (table[slot] == empty) {
+            table[slot] = unsigned(unique.size());
+            unique.push_back(vertices[i]);
+        }
+        remap[i] = table[slot];
+    }
+
+    if (unique.size() == vertices.size()) return;
+    for (unsigned int& index : indices) {
+        index = remap[index];
+    }
+    vertices.swap(unique);
+}
+
+// Renumbers vertices in first-use order so the index stream walks the vertex
+// buffer mostly forwards. Unreferenced vertices are dropped.
+inline void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+
+    for (unsigned int& index : indices) {
+        if (remap[index] == unused) {
+            remap[index] = unsigned(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+// Cache, overdraw and fetch ordering for an already welded mesh
+inline void reorderMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    if (indices.size() < 3 || indices.size() % 3 != 0) return;
+
+    std::vector<unsigned int> reordered;
+    std::vector<unsigned int> clusterStarts;
+    tipsify(indices.data(), indices.size(), vertices.size(), CACHE_SIZE, reordered, clusterStarts);
+    indices.swap(reordered);
+
+    optimizeOverdraw(vertices.data(), indices, clusterStarts);
+    optimizeVertexFetch(vertices, indices);
+}
+
+inline void optimizeMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    if (indices.size() < 3 || indices.size() % 3 != 0) return;
+
+    weldVertices(vertices, indices);
+    reorderMesh(vertices, indices);
+}
+
+}
@@ -0,0 +1,363 @@
+#pragma once
+
+#include "mesh.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Quadric-error edge collapse (Garland & Heckbert 1997) restricted to
+// vertex-to-vertex collapses, so every LOD is an index list over the original
+// vertex buffer. Collapses run in independent batches: each pass picks the
+// cheapest collapse per vertex, sorts them, and applies the non-overlapping
+// ones, which keeps memory linear in the mesh size.
+namespace MeshSimplify {
+
+const double BOUNDARY_WEIGHT = 10.0;
+
+struct Quadric {
+    double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+
+    void addPlane(const glm::dvec3& n, double d, double weight) {
+        a00 += weight * n.x * n.x; a01 += weight * n.x * n.y; a02 += weight * n.x * n.z; a03 += weight * n.x * d;
+        a11 += weight * n.y * n.y; a12 += weight * n.y * n.z; a13 += weight * n.y * d;
+        a22 += weight * n.z * n.z; a23 += weight * n.z * d;
+        a33 += weight * d * d;
+    }
+
+    void add(const Quadric& q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+    }
+
+    double evaluate(const glm::vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double r = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x +
+                   a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y +
+                   a22 * z * z + 2.0 * a23 * z + a33;
+        return r > 0.0 ? r : 0.0;
+    }
+};
+
+struct LodLevel {
+    std::vector<unsigned int> indices;
+    float error = 0.0f;
+};
+
+struct Collapse {
+    float cost;
+    unsigned int from;
+    unsigned int to;
+};
+
+class Simplifier {
+public:
+    Simplifier(const Vertex* vertices, size_t vertexCount, const std::vector<unsigned int>& indices)
+        : vertices(vertices), vertexCount(vertexCount), triangles(indices) {
+        buildPositionIds();
+        buildAdjacency();
+        buildQuadrics();
+    }
+
+    size_t triangleCount() const { return triangles.size() / 3; }
+    const std::vector<unsigned int>& currentIndices() const { return triangles; }
+    float currentError() const { return float(std::sqrt(maxCost)); }
+
+    // Collapses until at most targetTriangles remain or nothing valid is left.
+    // Returns false if no further progress is possible.
+    bool simplifyTo(size_t targetTriangles) {
+        while (triangleCount() > targetTriangles) {
+            if (!runPass(targetTriangles)) return false;
+        }
+        return true;
+    }
+
+private:
+    const Vertex* vertices;
+    size_t vertexCount;
+    std::vector<unsigned int> triangles;
+
+    std::vector<unsigned int> positionOf;
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> wedgeOffsets;
+    std::vector<unsigned int> wedges;
+
+    std::vector<unsigned int> adjOffsets;
+    std::vector<unsigned int> adjTriangles;
+
+    std::vector<Quadric> quadrics;
+    std::vector<double> weights;
+    double maxCost = 0.0;
+
+    static uint64_t hashPosition(const glm::vec3& p) {
+        uint32_t words[3];
+        memcpy(words, &p, sizeof(words));
+        uint64_t h = 1469598103934665603ULL;
+        for (uint32_t w : words) h = (h ^ w) * 1099511628211ULL;
+        return h ^ (h >> 31);
+    }
+
+    // Vertices that share a position (UV/normal seams) collapse together
+    void buildPositionIds() {
+        size_t capacity = 1;
+        while (capacity < vertexCount * 2) capacity <<= 1;
+        const unsigned int empty = ~0u;
+        std::vector<unsigned int> table(capacity, empty);
+
+        positionOf.resize(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v) {
+            const glm::vec3& p = vertices[v].Position;
+            size_t slot = hashPosition(p) & (capacity - 1);
+            while (table[slot] != empty && memcmp(&positions[table[slot]], &p, sizeof(glm::vec3)) != 0) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            if (table[slot] == empty) {
+                table[slot] = unsigned(positions.size());
+                positions.push_back(p);
+            }
+            positionOf[v] = table[slot];
+        }
+
+        wedgeOffsets.assign(positions.size() + 1, 0);
+        for (size_t v = 0; v < vertexCount; ++v) wedgeOffsets[positionOf[v] + 1]++;
+        for (size_t p = 0; p < positions.size(); ++p) wedgeOffsets[p + 1] += wedgeOffsets[p];
+        wedges.resize(vertexCount);
+        std::vector<unsigned int> cursor(wedgeOffsets.begin(), wedgeOffsets.end() - 1);
+        for (size_t v = 0; v < vertexCount; ++v) wedges[cursor[positionOf[v]]++] = unsigned(v);
+    }
+
+    void buildAdjacency() {
+        adjOffsets.assign(positions.size() + 1, 0);
+        for (unsigned int v : triangles) adjOffsets[positionOf[v] + 1]++;
+        for (size_t p = 0; p < positions.size(); ++p) adjOffsets[p + 1] += adjOffsets[p];
+        adjTriangles.resize(triangles.size());
+        std::vector<unsigned int> cursor(adjOffsets.begin(), adjOffsets.end() - 1);
+        for (size_t i = 0; i < triangles.size(); ++i) {
+            adjTriangles[cursor[positionOf[triangles[i]]]++] = unsigned(i / 3);
+        }
+    }
+
+    void buildQuadrics() {
+        quadrics.assign(positions.size(), Quadric{});
+        weights.assign(positions.size(), 0.0);
+
+        for (size_t t = 0; t < triangleCount(); ++t) {
+            unsigned int p[3] = {positionOf[triangles[t * 3]], positionOf[triangles[t * 3 + 1]],
+                                 positionOf[triangles[t * 3 + 2]]};
+            glm::dvec3 p0(positions[p[0]]), p1(positions[p[1]]), p2(positions[p[2]]);
+            glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+            double area = glm::length(n);
+            if (area <= 0.0) continue;
+            n /= area;
+            double d = -glm::dot(n, p0);
+            for (unsigned int corner : p) {
+                quadrics[corner].addPlane(n, d, area);
+                weights[corner] += area;
+            }
+        }
+
+        // Boundary edges get a perpendicular plane so open borders keep their shape
+        for (unsigned int a = 0; a < positions.size(); ++a) {
+            for (unsigned int i = adjOffsets[a]; i < adjOffsets[a + 1]; ++i) {
+                unsigned int t = adjTriangles[i];
+                int k = cornerOf(t, a);
+                unsigned int next = positionOf[triangles[t * 3 + (k + 1) % 3]];
+                if (!hasDirectedEdge(a, next, a)) {
+                    addBoundaryQuadric(t, a, next);
+                }
+            }
+        }
+    }
+
+    int cornerOf(unsigned int t, unsigned int position) const {
+        for (int k = 0; k < 3; ++k) {
+            if (positionOf[triangles[t * 3 + k]] == position) return k;
+        }
+        return 0;
+    }
+
+    // True if a triangle around `around` contains the directed edge to->from
+    bool hasDirectedEdge(unsigned int from, unsigned int to, unsigned int around) const {
+        for (unsigned int i = adjOffsets[around]; i < adjOffsets[around + 1]; ++i) {
+            unsigned int t = adjTriangles[i];
+            for (int k = 0; k < 3; ++k) {
+                if (positionOf[triangles[t * 3 + k]] == to && positionOf[triangles[t * 3 + (k + 1) % 3]] == from) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void addBoundaryQuadric(unsigned int t, unsigned int a, unsigned int b) {
+        glm::dvec3 p0(positions[positionOf[triangles[t * 3]]]);
+        glm::dvec3 p1(positions[positionOf[triangles[t * 3 + 1]]]);
+        glm::dvec3 p2(positions[positionOf[triangles[t * 3 + 2]]]);
+        glm::dvec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+        glm::dvec3 edge = glm::dvec3(positions[b]) - glm::dvec3(positions[a]);
+        glm::dvec3 n = glm::cross(edge, faceNormal);
+        double len = glm::length(n);
+        if (len <= 0.0) return;
+        n /= len;
+        double d = -glm::dot(n, glm::dvec3(positions[a]));
+        double w = glm::dot(edge, edge) * BOUNDARY_WEIGHT;
+        quadrics[a].addPlane(n, d, w);
+        quadrics[b].addPlane(n, d, w);
+        weights[a] += w;
+        weights[b] += w;
+    }
+
+    double collapseCost(unsigned int from, unsigned int to) const {
+        Quadric q = quadrics[from];
+        q.add(quadrics[to]);
+        double w = weights[from] + weights[to];
+        return w > 0.0 ? q.evaluate(positions[to]) / w : 0.0;
+    }
+
+    bool flipsTriangle(unsigned int from, unsigned int to) const {
+        for (unsigned int i = adjOffsets[from]; i < adjOffsets[from + 1]; ++i) {
+            unsigned int t = adjTriangles[i];
+            unsigned int p[3] = {positionOf[triangles[t * 3]], positionOf[triangles[t * 3 + 1]],
+                                 positionOf[triangles[t * 3 + 2]]};
+            if (p[0] == to || p[1] == to || p[2] == to) continue;
+
+            glm::vec3 before = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+            for (unsigned int& corner : p) {
+                if (corner == from) corner = to;
+            }
+            glm::vec3 after = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+            if (glm::dot(before, after) <= 0.0f) return true;
+        }
+        return false;
+    }
+
+    unsigned int matchingWedge(unsigned int wedge, unsigned int toPosition) const {
+        const Vertex& src = vertices[wedge];
+        unsigned int best = wedges[wedgeOffsets[toPosition]];
+        float bestScore = -1e30f;
+        for (unsigned int i = wedgeOffsets[toPosition]; i < wedgeOffsets[toPosition + 1]; ++i) {
+            const Vertex& dst = vertices[wedges[i]];
+            float score = glm::dot(src.Normal, dst.Normal) - glm::length(src.TexCoords - dst.TexCoords);
+            if (score > bestScore) {
+                bestScore = score;
+                best = wedges[i];
+            }
+        }
+        return best;
+    }
+
+    bool runPass(size_t targetTriangles) {
+        std::vector<Collapse> candidates(positions.size(), Collapse{0.0f, ~0u, ~0u});
+
+        parallelFor(positions.size(), 4096, [&](size_t begin, size_t end, unsigned int) {
+            for (size_t a = begin; a < end; ++a) {
+                double bestCost = 1e300;
+                unsigned int bestTarget = ~0u;
+                for (unsigned int i = adjOffsets[a]; i < adjOffsets[a + 1]; ++i) {
+                    unsigned int t = adjTriangles[i];
+                    for (int k = 0; k < 3; ++k) {
+                        unsigned int b = positionOf[triangles[t * 3 + k]];
+                        if (b == a) continue;
+                        double cost = collapseCost(unsigned(a), b);
+                        if (cost < bestCost) {
+                            bestCost = cost;
+                            bestTarget = b;
+                        }
+                    }
+                }
+                candidates[a] = Collapse{float(bestCost), unsigned(a), bestTarget};
+            }
+        });
+
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                        [](const Collapse& c) { return c.to == ~0u; }),
+                         candidates.end());
+        if (candidates.empty()) return false;
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+        // Only the cheaper part of the list is eligible, so expensive collapses
+        // wait for a later pass instead of jumping the queue
+        float passLimit = candidates[std::min(candidates.size() - 1, candidates.size() / 4)].cost;
+
+        std::vector<uint8_t> locked(positions.size(), 0);
+        std::vector<unsigned int> wedgeTarget(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v) wedgeTarget[v] = unsigned(v);
+
+        size_t remaining = triangleCount();
+        size_t collapses = 0;
+        for (const Collapse& c : candidates) {
+            if (remaining <= targetTriangles) break;
+            if (c.cost > passLimit && collapses > 0) break;
+            if (locked[c.from] || locked[c.to]) continue;
+            if (flipsTriangle(c.from, c.to)) continue;
+
+            for (unsigned int i = wedgeOffsets[c.from]; i < wedgeOffsets[c.from + 1]; ++i) {
+                wedgeTarget[wedges[i]] = matchingWedge(wedges[i], c.to);
+            }
+            quadrics[c.to].add(quadrics[c.from]);
+            weights[c.to] += weights[c.from];
+            maxCost = std::max(maxCost, double(c.cost));
+
+            for (unsigned int i = adjOffsets[c.from]; i < adjOffsets[c.from + 1]; ++i) {
+                unsigned int t = adjTriangles[i];
+                bool removed = false;
+                for (int k = 0; k < 3; ++k) {
+                    unsigned int p = positionOf[triangles[t * 3 + k]];
+                    locked[p] = 1;
+                    removed = removed || p == c.to;
+                }
+                if (removed) remaining--;
+            }
+            collapses++;
+        }
+        if (collapses == 0) return false;
+
+        size_t out = 0;
+        for (size_t t = 0; t < triangleCount(); ++t) {
+            unsigned int v0 = wedgeTarget[triangles[t * 3]];
+            unsigned int v1 = wedgeTarget[triangles[t * 3 + 1]];
+            unsigned int v2 = wedgeTarget[triangles[t * 3 + 2]];
+            unsigned int p0 = positionOf[v0], p1 = positionOf[v1], p2 = positionOf[v2];
+            if (p0 == p1 || p1 == p2 || p0 == p2) continue;
+            triangles[out++] = v0;
+            triangles[out++] = v1;
+            triangles[out++] = v2;
+        }
+        triangles.resize(out);
+        buildAdjacency();
+        return true;
+    }
+};
+
+// Builds successively halved LODs down to minTriangles. Level 0 is the input.
+// Each level's error is the largest collapse cost so far, as a distance in the
+// mesh's object space.
+inline std::vector<LodLevel> buildLodChain(const Vertex* vertices, size_t vertexCount,
+                                           const std::vector<unsigned int>& indices,
+                                           int maxLevels = 6, size_t minTriangles = 128) {
+    std::vector<LodLevel> levels;
+    levels.push_back(LodLevel{indices, 0.0f});
+    if (indices.size() / 3 < minTriangles * 2) return levels;
+
+    Simplifier simplifier(vertices, vertexCount, indices);
+    size_t target = simplifier.triangleCount();
+
+    while (int(levels.size()) < maxLevels) {
+        target /= 2;
+        if (target < minTriangles) break;
+
+        bool progressed = simplifier.simplifyTo(target);
+        if (simplifier.triangleCount() >= levels.back().indices.size() / 3) break;
+
+        levels.push_back(LodLevel{simplifier.currentIndices(), simplifier.currentError()});
+        if (!progressed) break;
+    }
+    return levels;
+}
+
+}
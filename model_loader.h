@@ -0,0 +1,428 @@
+#pragma once
+
+#include "mesh.h"
+#include "import_memory.h"
+#include "mesh_cache.h"
+#include "mesh_clusters.h"
+#include "mesh_convert.h"
+#include "vertex_packing.h"
+#include "mesh_optimize.h"
+#include "mesh_simplify.h"
+#include "obj_parser.h"
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// CPU-side geometry waiting for upload. Data either lives in the owned vectors
+// or in a shared cache mapping; the pointer/count pairs always describe it.
+// prepareForUpload() adds the bounds and stages the streams that go to the
+// GPU (packed vertices and 16-bit indices for the packed layout, otherwise the
+// float data itself) in the model's arena. The owned vectors are freed then,
+// so each mesh waits for upload as one copy; cache-mapped float data is used
+// in place. material indexes the result's materials, or is NO_MATERIAL.
+struct LoadedMesh {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::shared_ptr<MappedFile> mapping;
+
+    const Vertex* vertexData = nullptr;
+    size_t vertexCount = 0;
+    const unsigned int* indexData = nullptr;
+    size_t indexCount = 0;
+
+    std::vector<MeshLod> lods;
+    std::vector<MeshCluster> clusters;
+    uint32_t material = MeshCache::NO_MATERIAL;
+
+    VertexFormat format = VertexFormat::Float;
+    const void* gpuVertices = nullptr;
+    const void* gpuIndices = nullptr;
+    GLenum gpuIndexType = GL_UNSIGNED_INT;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+
+    LoadedMesh() = default;
+    LoadedMesh(LoadedMesh&&) = default;
+    LoadedMesh& operator=(LoadedMesh&&) = default;
+    LoadedMesh(const LoadedMesh&) = delete;
+    LoadedMesh& operator=(const LoadedMesh&) = delete;
+
+    void useOwnedData() {
+        vertexData = vertices.data();
+        vertexCount = vertices.size();
+        indexData = indices.data();
+        indexCount = indices.size();
+    }
+
+    void prepareForUpload(VertexFormat targetFormat, ImportMemory::Arena& arena) {
+        VertexPacking::computeBounds(vertexData, vertexCount, boundsMin, boundsMax);
+        format = targetFormat;
+        gpuVertices = vertexData;
+        gpuIndices = indexData;
+        gpuIndexType = GL_UNSIGNED_INT;
+        if (format == VertexFormat::Packed) {
+            PackedVertex* packed = arena.allocate<PackedVertex>(vertexCount);
+            VertexPacking::packVertices(vertexData, vertexCount, boundsMin, boundsMax, packed);
+            gpuVertices = packed;
+            if (VertexPacking::fitsShortIndices(vertexCount)) {
+                uint16_t* narrowed = arena.allocate<uint16_t>(indexCount);
+                VertexPacking::narrowIndices(indexData, indexCount, narrowed);
+                gpuIndices = narrowed;
+                gpuIndexType = GL_UNSIGNED_SHORT;
+            }
+        }
+
+        if (!mapping) {
+            if (gpuVertices == vertexData) gpuVertices = arena.copy(vertexData, vertexCount);
+            if (gpuIndices == indexData) gpuIndices = arena.copy(indexData, indexCount);
+            std::vector<Vertex>().swap(vertices);
+            std::vector<unsigned int>().swap(indices);
+        } else if (gpuVertices != vertexData && gpuIndices != indexData) {
+            mapping.reset();
+        }
+        vertexData = nullptr;
+        indexData = nullptr;
+    }
+};
+
+struct LoadTimings {
+    double cacheMs = 0.0;
+    double importMs = 0.0;
+    double convertMs = 0.0;
+    double optimizeMs = 0.0;
+    double lodMs = 0.0;
+    double clusterMs = 0.0;
+    double cacheWriteMs = 0.0;
+    double packMs = 0.0;
+    double queuedMs = 0.0;
+    double uploadMs = 0.0;
+    int uploadFrames = 0;
+};
+
+struct ModelLoadResult {
+    std::string path;
+    bool success = false;
+    bool fromCache = false;
+    bool nativeImport = false;
+    std::string error;
+    std::vector<LoadedMesh> meshes;
+    std::vector<MaterialSource> materials;
+    // Backs the meshes' staged streams; unmapped with the result once the
+    // last mesh is uploaded
+    std::unique_ptr<ImportMemory::Arena> arena;
+    LoadTimings timings;
+    size_t gpuBytes = 0;
+    size_t floatBytes = 0;
+    std::chrono::steady_clock::time_point finishedAt;
+};
+
+inline double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace |
+                                        aiProcess_GenNormals | aiProcess_PreTransformVertices;
+
+inline void processMesh(const aiMesh* mesh, std::vector<LoadedMesh>& out) {
+    LoadedMesh loaded;
+    MeshConvert::convertMesh(mesh, loaded.vertices, loaded.indices);
+    loaded.useOwnedData();
+    loaded.material = mesh->mMaterialIndex;
+    out.push_back(std::move(loaded));
+}
+
+inline void processNode(const aiNode* node, const aiScene* scene, std::vector<LoadedMesh>& out) {
+    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+        processMesh(scene->mMeshes[node->mMeshes[i]], out);
+    }
+
+    for (unsigned int i = 0; i < node->mNumChildren; i++) {
+        processNode(node->mChildren[i], scene, out);
+    }
+}
+
+// First texture of a type, relative to the model's directory. Embedded
+// textures ("*0") aren't supported.
+inline std::string materialTexture(const aiMaterial* material, aiTextureType type, const std::filesystem::path& directory) {
+    aiString file;
+    if (material->GetTextureCount(type) == 0 || material->GetTexture(type, 0, &file) != AI_SUCCESS) return std::string();
+    std::string path = file.C_Str();
+    if (path.empty() || path[0] == '*') return std::string();
+    std::replace(path.begin(), path.end(), '\\', '/');
+    return (directory / path).lexically_normal().string();
+}
+
+inline void processMaterials(const aiScene* scene, const std::string& modelPath, std::vector<MaterialSource>& out) {
+    std::filesystem::path directory = std::filesystem::path(modelPath).parent_path();
+    for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+        const aiMaterial* material = scene->mMaterials[i];
+        MaterialSource source;
+        aiString name;
+        if (material->Get(AI_MATKEY_NAME, name) == AI_SUCCESS) source.name = name.C_Str();
+        aiColor3D color;
+        if (material->Get(AI_MATKEY_COLOR_DIFFUSE, color) == AI_SUCCESS) source.diffuseColor = glm::vec3(color.r, color.g, color.b);
+        source.diffuseMap = materialTexture(material, aiTextureType_DIFFUSE, directory);
+        source.alphaMap = materialTexture(material, aiTextureType_OPACITY, directory);
+        // Assimp's OBJ importer files map_bump under HEIGHT
+        source.normalMap = materialTexture(material, aiTextureType_NORMALS, directory);
+        if (source.normalMap.empty()) source.normalMap = materialTexture(material, aiTextureType_HEIGHT, directory);
+        out.push_back(std::move(source));
+    }
+}
+
+// Replaces the index list with LOD 0 followed by each simplified level, and
+// records the per-level ranges and errors in mesh.lods.
+inline void buildMeshLods(LoadedMesh& mesh, bool optimizeLevels) {
+    std::vector<MeshSimplify::LodLevel> levels =
+        MeshSimplify::buildLodChain(mesh.vertices.data(), mesh.vertices.size(), mesh.indices);
+
+    std::vector<unsigned int> combined;
+    std::vector<unsigned int> clusterStarts;
+    mesh.lods.clear();
+    for (size_t level = 0; level < levels.size(); ++level) {
+        std::vector<unsigned int>& levelIndices = levels[level].indices;
+        if (optimizeLevels && level > 0) {
+            std::vector<unsigned int> reordered;
+            MeshOptimize::tipsify(levelIndices.data(), levelIndices.size(), mesh.vertices.size(),
+                                  MeshOptimize::CACHE_SIZE, reordered, clusterStarts);
+            levelIndices.swap(reordered);
+        }
+        mesh.lods.push_back(MeshLod{uint32_t(combined.size()), uint32_t(levelIndices.size()), levels[level].error});
+        combined.insert(combined.end(), levelIndices.begin(), levelIndices.end());
+    }
+    mesh.indices.swap(combined);
+    mesh.useOwnedData();
+}
+
+// Clusters LOD 0 (the whole index list without LODs) for per-cluster culling
+inline void buildMeshClusters(LoadedMesh& mesh) {
+    uint32_t firstIndex = mesh.lods.empty() ? 0 : mesh.lods[0].firstIndex;
+    uint32_t indexCount = mesh.lods.empty() ? uint32_t(mesh.indexCount) : mesh.lods[0].indexCount;
+    MeshClusters::build(mesh.vertexData, mesh.vertexCount, mesh.indexData, firstIndex, indexCount, mesh.clusters);
+}
+
+struct LoaderSettings {
+    bool useMeshCache = true;
+    bool optimizeMeshes = true;
+    bool buildLods = true;
+    bool buildClusters = true;
+    // .obj files go through ObjParser; Assimp only if it fails
+    bool nativeObj = true;
+    VertexFormat vertexFormat = VertexFormat::Float;
+};
+
+// Runs cache lookup, import (ObjParser for .obj, otherwise Assimp) and Vertex
+// conversion on one worker thread per model. Finished models are queued for the GL thread to pick up.
+class ModelLoader {
+public:
+    explicit ModelLoader(const LoaderSettings& settings) : settings(settings) {}
+    ModelLoader(const ModelLoader&) = delete;
+    ModelLoader& operator=(const ModelLoader&) = delete;
+
+    ~ModelLoader() {
+        cancelled = true;
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    void enqueue(const std::string& path) {
+        ++outstanding;
+        workers.emplace_back([this, path]() {
+            ModelLoadResult result = loadModel(path);
+            if (result.success && !cancelled) {
+                auto packStart = std::chrono::steady_clock::now();
+                result.arena = std::make_unique<ImportMemory::Arena>();
+                for (LoadedMesh& mesh : result.meshes) {
+                    mesh.prepareForUpload(settings.vertexFormat, *result.arena);
+                }
+                result.timings.packMs = millisecondsSince(packStart);
+            }
+            result.finishedAt = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> lock(queueMutex);
+            finished.push_back(std::move(result));
+        });
+    }
+
+    bool poll(ModelLoadResult& out) {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (finished.empty()) return false;
+        out = std::move(finished.front());
+        finished.pop_front();
+        --outstanding;
+        return true;
+    }
+
+    bool idle() const { return outstanding == 0; }
+
+private:
+    LoaderSettings settings;
+    std::atomic<bool> cancelled{false};
+    std::atomic<int> outstanding{0};
+    std::vector<std::thread> workers;
+    std::mutex queueMutex;
+    std::deque<ModelLoadResult> finished;
+
+    ModelLoadResult loadModel(const std::string& path) {
+        ModelLoadResult result;
+        result.path = path;
+
+        bool nativeObj = settings.nativeObj && ObjParser::isObjPath(path);
+        MeshCache::SourceKey cacheKey;
+        uint64_t processingFlags = (settings.optimizeMeshes ? MeshCache::PROCESSING_OPTIMIZED : 0) |
+                                   (settings.buildLods ? MeshCache::PROCESSING_LODS : 0) |
+                                   (nativeObj ? MeshCache::PROCESSING_NATIVE_OBJ : 0) |
+                                   (settings.buildClusters ? MeshCache::PROCESSING_CLUSTERS : 0);
+        bool cacheable = settings.useMeshCache &&
+                         MeshCache::makeSourceKey(path, MODEL_IMPORT_FLAGS, processingFlags, cacheKey);
+        std::string cachePath = MeshCache::cachePathFor(path);
+
+        if (cacheable) {
+            auto cacheStart = std::chrono::steady_clock::now();
+            bool hit = loadFromCache(cachePath, cacheKey, result);
+            result.timings.cacheMs = millisecondsSince(cacheStart);
+            if (hit) return result;
+        }
+
+        std::string nativeError;
+        std::vector<std::string> materialLibraries;
+        if (nativeObj && importNativeObj(path, result, materialLibraries, nativeError)) {
+            result.nativeImport = true;
+        } else if (!importWithAssimp(path, result)) {
+            return result;
+        }
+        if (!nativeError.empty()) {
+            // The cache key says native, but these meshes came from Assimp
+            cacheable = false;
+            result.error = "native OBJ parser failed (" + nativeError + "), loaded with Assimp";
+        }
+        if (cancelled) return result;
+        result.success = true;
+
+        if (settings.optimizeMeshes && !cancelled) {
+            auto optimizeStart = std::chrono::steady_clock::now();
+            for (LoadedMesh& mesh : result.meshes) {
+                MeshOptimize::optimizeMesh(mesh.vertices, mesh.indices);
+                mesh.useOwnedData();
+            }
+            result.timings.optimizeMs = millisecondsSince(optimizeStart);
+        }
+
+        if (settings.buildLods && !cancelled) {
+            auto lodStart = std::chrono::steady_clock::now();
+            for (LoadedMesh& mesh : result.meshes) {
+                buildMeshLods(mesh, settings.optimizeMeshes);
+            }
+            result.timings.lodMs = millisecondsSince(lodStart);
+        }
+
+        if (settings.buildClusters && !cancelled) {
+            auto clusterStart = std::chrono::steady_clock::now();
+            for (LoadedMesh& mesh : result.meshes) {
+                buildMeshClusters(mesh);
+            }
+            result.timings.clusterMs = millisecondsSince(clusterStart);
+        }
+
+        if (cacheable && !cancelled) {
+            auto writeStart = std::chrono::steady_clock::now();
+            std::vector<MeshCache::MeshView> views;
+            for (const LoadedMesh& mesh : result.meshes) {
+                views.push_back({mesh.vertexData, mesh.vertexCount, mesh.indexData, mesh.indexCount, mesh.lods.data(),
+                                 mesh.lods.size(), mesh.clusters.data(), mesh.clusters.size(), mesh.material});
+            }
+            if (!MeshCache::writeMeshes(cachePath, cacheKey, views, result.materials, materialLibraries)) {
+                result.error = "could not write mesh cache " + cachePath;
+            }
+            result.timings.cacheWriteMs = millisecondsSince(writeStart);
+        }
+        return result;
+    }
+
+    // materialLibraries gets the .mtl files that were read, for the cache
+    bool importNativeObj(const std::string& path, ModelLoadResult& result, std::vector<std::string>& materialLibraries,
+                         std::string& error) {
+        std::vector<ObjParser::MeshData> parsed;
+        ObjParser::Stats stats;
+        std::vector<std::string> libraries;
+        if (!ObjParser::load(path, parsed, error, &stats, &libraries)) return false;
+
+        std::vector<MaterialSource> materials;
+        for (const std::string& library : libraries) {
+            if (ObjParser::loadMaterials(library, materials)) materialLibraries.push_back(library);
+        }
+
+        result.timings.importMs = stats.parseMs;
+        result.timings.convertMs = stats.buildMs;
+        result.meshes.reserve(parsed.size());
+        for (ObjParser::MeshData& data : parsed) {
+            LoadedMesh loaded;
+            loaded.vertices.swap(data.vertices);
+            loaded.indices.swap(data.indices);
+            loaded.useOwnedData();
+            // Later definitions of a name win, as they would in a single library
+            for (size_t m = materials.size(); m-- > 0;) {
+                if (materials[m].name == data.material) {
+                    loaded.material = uint32_t(m);
+                    break;
+                }
+            }
+            result.meshes.push_back(std::move(loaded));
+        }
+        result.materials = std::move(materials);
+        return true;
+    }
+
+    bool importWithAssimp(const std::string& path, ModelLoadResult& result) {
+        auto importStart = std::chrono::steady_clock::now();
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+        result.timings.importMs = millisecondsSince(importStart);
+
+        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+            result.error = importer.GetErrorString();
+            return false;
+        }
+
+        auto convertStart = std::chrono::steady_clock::now();
+        result.meshes.reserve(scene->mNumMeshes);
+        processNode(scene->mRootNode, scene, result.meshes);
+        processMaterials(scene, path, result.materials);
+        result.timings.convertMs = millisecondsSince(convertStart);
+        return true;
+    }
+
+    static bool loadFromCache(const std::string& cachePath, const MeshCache::SourceKey& key, ModelLoadResult& result) {
+        auto file = std::make_shared<MappedFile>();
+        if (!file->open(cachePath)) return false;
+
+        std::vector<MeshCache::MeshView> views;
+        if (!MeshCache::readMeshes(*file, key, views, result.materials)) return false;
+
+        for (const MeshCache::MeshView& view : views) {
+            LoadedMesh mesh;
+            mesh.mapping = file;
+            mesh.vertexData = view.vertices;
+            mesh.vertexCount = view.vertexCount;
+            mesh.indexData = view.indices;
+            mesh.indexCount = view.indexCount;
+            mesh.lods.assign(view.lods, view.lods + view.lodCount);
+            mesh.clusters.assign(view.clusters, view.clusters + view.clusterCount);
+            mesh.material = view.material;
+            result.meshes.push_back(std::move(mesh));
+        }
+        result.success = true;
+        result.fromCache = true;
+        return true;
+    }
+};
@@ -0,0 +1,714 @@
+#pragma once
+
+#include "mesh.h"
+#include "mesh_cache.h"
+#include "parallel.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Native Wavefront OBJ reader for the large scans. The file is memory-mapped
+// and cut into line-aligned slices that are parsed on all cores; numbers go
+// through a hand-rolled parser that converts eight digits at a time with SWAR
+// arithmetic. v/vt/vn tuples are then deduplicated in parallel: corners are
+// partitioned by tuple hash into shards, each shard gets its own open
+// addressing table, and vertices are renumbered in first-use order. Output is
+// one Vertex/index mesh per material, matching what Assimp produces with
+// aiProcess_PreTransformVertices, with UVs flipped like aiProcess_FlipUVs.
+// Positions without a vn get area-weighted smooth normals. mtllib files are
+// read by loadMaterials() for the colours and texture maps of each usemtl.
+namespace ObjParser {
+
+struct Stats {
+    size_t bytes = 0;
+    size_t slices = 0;
+    size_t positions = 0;
+    size_t texcoords = 0;
+    size_t normals = 0;
+    size_t triangles = 0;
+    size_t vertices = 0;
+    // Slice parsing and merging of the attribute arrays
+    double parseMs = 0.0;
+    // Grouping by material, deduplication and vertex assembly
+    double buildMs = 0.0;
+};
+
+struct MeshData {
+    std::string material;
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+};
+
+// Slices below this size aren't worth a thread
+const size_t MIN_SLICE_BYTES = size_t(1) << 20;
+const uint32_t NONE = 0xffffffffu;
+const size_t SHARDS = 256;
+
+inline bool isObjPath(const std::string& path) {
+    if (path.size() < 4) return false;
+    std::string ext = path.substr(path.size() - 4);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+    return ext == ".obj";
+}
+
+inline bool isDigit(char c) { return unsigned(c - '0') < 10u; }
+
+// Eight ASCII digits at p, first digit most significant (fast_float's check
+// and conversion; little-endian only, which is all this demo targets)
+inline bool eightDigits(const char* p, uint64_t& value) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    if (((v & 0xF0F0F0F0F0F0F0F0ULL) | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) !=
+        0x3333333333333333ULL) {
+        return false;
+    }
+    v = (v & 0x0F0F0F0F0F0F0F0FULL) * 2561 >> 8;
+    v = (v & 0x00FF00FF00FF00FFULL) * 6553601 >> 16;
+    value = (v & 0x0000FFFF0000FFFFULL) * 42949672960001ULL >> 32;
+    return true;
+}
+
+// Decimal float with optional sign, fraction and exponent. Up to 19
+// significant digits are kept; more only shift the exponent.
+inline bool parseFloat(const char*& p, const char* end, float& out) {
+    static const double POW10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char* s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')) negative = *s++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    auto digitRun = [&](bool fraction) {
+        uint64_t eight;
+        while (digits + 8 <= 19 && s + 8 <= end && eightDigits(s, eight)) {
+            mantissa = mantissa * 100000000ULL + eight;
+            digits += 8;
+            if (fraction) exponent -= 8;
+            s += 8;
+            any = true;
+        }
+        while (s < end && isDigit(*s)) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + uint64_t(*s - '0');
+                digits++;
+                if (fraction) exponent--;
+            } else if (!fraction) {
+                exponent++;
+            }
+            s++;
+            any = true;
+        }
+    };
+
+    digitRun(false);
+    if (s < end && *s == '.') {
+        s++;
+        digitRun(true);
+    }
+    if (!any) return false;
+
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char* e = s + 1;
+        bool negativeExp = false;
+        if (e < end && (*e == '-' || *e == '+')) negativeExp = *e++ == '-';
+        if (e < end && isDigit(*e)) {
+            int value = 0;
+            while (e < end && isDigit(*e)) {
+                if (value < 10000) value = value * 10 + (*e - '0');
+                e++;
+            }
+            exponent += negativeExp ? -value : value;
+            s = e;
+        }
+    }
+
+    double value = double(mantissa);
+    if (exponent < 0) {
+        value = -exponent <= 22 ? value / POW10[-exponent] : value * std::pow(10.0, exponent);
+    } else if (exponent > 0) {
+        value = exponent <= 22 ? value * POW10[exponent] : value * std::pow(10.0, exponent);
+    }
+    out = float(negative ? -value : value);
+    p = s;
+    return true;
+}
+
+inline bool parseInt(const char*& p, const char* end, int64_t& out) {
+    const char* s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')) negative = *s++ == '-';
+    if (s >= end || !isDigit(*s)) return false;
+    int64_t value = 0;
+    while (s < end && isDigit(*s)) {
+        if (value < (int64_t(1) << 40)) value = value * 10 + (*s - '0');
+        s++;
+    }
+    out = negative ? -value : value;
+    p = s;
+    return true;
+}
+
+inline void skipBlanks(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+}
+
+inline bool atLineEnd(const char* p, const char* end) {
+    return p >= end || *p == '\n' || *p == '\r' || *p == '#';
+}
+
+// Zero-based attribute indices of one face corner; NONE where absent
+struct Corner {
+    uint32_t v;
+    uint32_t vt;
+    uint32_t vn;
+};
+
+// Everything one slice produced. Negative (relative) indices can reach into
+// earlier slices, so they're stored as fixups and resolved after the merge.
+struct Slice {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+    std::vector<Corner> corners;
+
+    struct Fixup {
+        size_t corner;
+        int attribute;
+        int64_t local;
+    };
+    std::vector<Fixup> fixups;
+
+    struct MaterialRun {
+        size_t firstCorner;
+        std::string name;
+    };
+    std::vector<MaterialRun> materials;
+    std::vector<std::string> libraries;
+
+    size_t base[3] = {};
+    std::string error;
+};
+
+// Relative index of one polygon corner, waiting for the triangle corners
+struct PendingFixup {
+    size_t polygonCorner;
+    int attribute;
+    int64_t local;
+};
+
+// Rest of the line without surrounding blanks, for names and file paths
+inline std::string restOfLine(const char* p, const char* end) {
+    skipBlanks(p, end);
+    const char* nameEnd = p;
+    while (nameEnd < end && *nameEnd != '\n' && *nameEnd != '\r') nameEnd++;
+    while (nameEnd > p && (nameEnd[-1] == ' ' || nameEnd[-1] == '\t')) nameEnd--;
+    return std::string(p, nameEnd);
+}
+
+inline bool startsWithKeyword(const char* p, const char* end, const char* keyword) {
+    size_t length = strlen(keyword);
+    return size_t(end - p) > length && memcmp(p, keyword, length) == 0 && (p[length] == ' ' || p[length] == '\t');
+}
+
+// Parses an f line (v, v/vt, v//vn or v/vt/vn corners) and fan-triangulates
+// it into slice.corners. A line with no corners is ignored.
+inline bool parseFace(const char*& p, const char* end, Slice& slice, std::vector<Corner>& polygon,
+                      std::vector<PendingFixup>& relative) {
+    polygon.clear();
+    relative.clear();
+    const size_t counts[3] = {slice.positions.size(), slice.texcoords.size(), slice.normals.size()};
+    while (true) {
+        skipBlanks(p, end);
+        if (atLineEnd(p, end)) break;
+
+        Corner corner = {NONE, NONE, NONE};
+        uint32_t* fields[3] = {&corner.v, &corner.vt, &corner.vn};
+        for (int attribute = 0; attribute < 3; ++attribute) {
+            if (attribute > 0) {
+                if (p >= end || *p != '/') break;
+                p++;
+                if (attribute == 1 && p < end && *p == '/') continue;
+            }
+            int64_t index = 0;
+            if (!parseInt(p, end, index) || index == 0) return false;
+            if (index > 0) {
+                if (index > int64_t(NONE)) return false;
+                *fields[attribute] = uint32_t(index - 1);
+            } else {
+                // Relative to this slice's count so far; the slice base is added after the merge
+                relative.push_back({polygon.size(), attribute, int64_t(counts[attribute]) + index});
+            }
+        }
+        if (!atLineEnd(p, end) && *p != ' ' && *p != '\t') return false;
+        polygon.push_back(corner);
+    }
+    if (polygon.size() < 3) return polygon.empty();
+
+    for (size_t i = 1; i + 1 < polygon.size(); ++i) {
+        const size_t picks[3] = {0, i, i + 1};
+        for (size_t pick : picks) {
+            for (const PendingFixup& fixup : relative) {
+                if (fixup.polygonCorner == pick) {
+                    slice.fixups.push_back({slice.corners.size(), fixup.attribute, fixup.local});
+                }
+            }
+            slice.corners.push_back(polygon[pick]);
+        }
+    }
+    return true;
+}
+
+inline void parseSlice(Slice& slice) {
+    const char* p = slice.begin;
+    const char* end = slice.end;
+    std::vector<Corner> polygon;
+    std::vector<PendingFixup> relative;
+
+    while (p < end) {
+        skipBlanks(p, end);
+        const char* line = p;
+        bool ok = true;
+        if (p + 1 < end && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            p += 1;
+            glm::vec3 v;
+            for (int i = 0; i < 3 && ok; ++i) {
+                skipBlanks(p, end);
+                ok = parseFloat(p, end, v[i]);
+            }
+            slice.positions.push_back(v);
+        } else if (p + 2 < end && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) {
+            p += 2;
+            glm::vec2 t(0.0f);
+            skipBlanks(p, end);
+            ok = parseFloat(p, end, t.x);
+            skipBlanks(p, end);
+            if (ok && !atLineEnd(p, end)) ok = parseFloat(p, end, t.y);
+            slice.texcoords.push_back(t);
+        } else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {
+            p += 2;
+            glm::vec3 n;
+            for (int i = 0; i < 3 && ok; ++i) {
+                skipBlanks(p, end);
+                ok = parseFloat(p, end, n[i]);
+            }
+            slice.normals.push_back(n);
+        } else if (p + 1 < end && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            p += 1;
+            ok = parseFace(p, end, slice, polygon, relative);
+        } else if (startsWithKeyword(p, end, "usemtl")) {
+            slice.materials.push_back({slice.corners.size(), restOfLine(p + 6, end)});
+        } else if (startsWithKeyword(p, end, "mtllib")) {
+            slice.libraries.push_back(restOfLine(p + 6, end));
+        }
+        if (!ok) {
+            const char* lineEnd = static_cast<const char*>(memchr(line, '\n', size_t(end - line)));
+            slice.error = "malformed line: " + std::string(line, lineEnd ? lineEnd : end);
+            return;
+        }
+
+        const char* next = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+        p = next ? next + 1 : end;
+    }
+}
+
+inline uint64_t hashCorner(const Corner& c) {
+    uint64_t h = (uint64_t(c.v) * 0x9E3779B97F4A7C15ULL) ^ (uint64_t(c.vt) * 0xC2B2AE3D27D4EB4FULL) ^
+                 (uint64_t(c.vn) * 0x165667B19E3779F9ULL);
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    return h ^ (h >> 32);
+}
+
+inline bool sameCorner(const Corner& a, const Corner& b) {
+    return a.v == b.v && a.vt == b.vt && a.vn == b.vn;
+}
+
+// A mesh's corners as a list of ranges inside the slices, so grouping by
+// material never copies the corner arrays
+struct CornerSpans {
+    std::vector<const Corner*> starts;
+    std::vector<size_t> offsets{0};
+
+    void add(const Corner* first, size_t count) {
+        if (count == 0) return;
+        starts.push_back(first);
+        offsets.push_back(offsets.back() + count);
+    }
+
+    size_t size() const { return offsets.back(); }
+
+    // Calls fn(cornerIndex, corner) for corners [begin, end)
+    template <typename Fn>
+    void forEach(size_t begin, size_t end, Fn fn) const {
+        size_t span = size_t(std::upper_bound(offsets.begin(), offsets.end(), begin) - offsets.begin()) - 1;
+        for (size_t i = begin; i < end; ++span) {
+            size_t spanEnd = std::min(end, offsets[span + 1]);
+            const Corner* corners = starts[span] - offsets[span];
+            for (; i < spanEnd; ++i) fn(i, corners[i]);
+        }
+    }
+};
+
+// Deduplicates one mesh's corners and assembles its vertices
+inline bool buildMesh(const CornerSpans& spans, const std::vector<glm::vec3>& positions,
+                      const std::vector<glm::vec2>& texcoords, const std::vector<glm::vec3>& normals,
+                      const std::vector<glm::vec3>& smoothNormals, MeshData& mesh, std::string& error) {
+    const size_t count = spans.size();
+    if (count >= size_t(NONE)) {
+        error = "mesh has more than 2^32 corners";
+        return false;
+    }
+
+    // Partition corners by shard, keeping corner order inside each shard.
+    // parallelFor splits [0, count) the same way both times it's called.
+    const size_t minChunk = 1 << 16;
+    const size_t workers = std::max<size_t>(1, std::min<size_t>(workerCount(), (count + minChunk - 1) / minChunk));
+    std::vector<size_t> shardCounts(workers * SHARDS, 0);
+    std::vector<uint8_t> invalid(workers, 0);
+    parallelFor(count, minChunk, [&](size_t begin, size_t end, unsigned worker) {
+        size_t* counts = &shardCounts[worker * SHARDS];
+        spans.forEach(begin, end, [&](size_t, const Corner& c) {
+            if (c.v >= positions.size() || (c.vt != NONE && c.vt >= texcoords.size()) ||
+                (c.vn != NONE && c.vn >= normals.size())) {
+                invalid[worker] = 1;
+            }
+            counts[hashCorner(c) % SHARDS]++;
+        });
+    });
+    if (std::find(invalid.begin(), invalid.end(), uint8_t(1)) != invalid.end()) {
+        error = "face index out of range";
+        return false;
+    }
+
+    std::vector<size_t> shardStart(SHARDS + 1, 0);
+    std::vector<size_t> cursor(workers * SHARDS);
+    size_t running = 0;
+    for (size_t s = 0; s < SHARDS; ++s) {
+        shardStart[s] = running;
+        for (size_t w = 0; w < workers; ++w) {
+            cursor[w * SHARDS + s] = running;
+            running += shardCounts[w * SHARDS + s];
+        }
+    }
+    shardStart[SHARDS] = running;
+
+    std::vector<uint32_t> order(count);
+    parallelFor(count, minChunk, [&](size_t begin, size_t end, unsigned worker) {
+        size_t* next = &cursor[worker * SHARDS];
+        spans.forEach(begin, end, [&](size_t i, const Corner& c) { order[next[hashCorner(c) % SHARDS]++] = uint32_t(i); });
+    });
+
+    // Per shard: first corner of each distinct tuple, and every corner's
+    // shard-local vertex ID
+    auto cornerAt = [&](uint32_t i) -> const Corner& {
+        size_t span = size_t(std::upper_bound(spans.offsets.begin(), spans.offsets.end(), size_t(i)) -
+                             spans.offsets.begin()) - 1;
+        return spans.starts[span][i - spans.offsets[span]];
+    };
+    std::vector<uint32_t> cornerVertex(count);
+    std::vector<std::vector<uint32_t>> shardUnique(SHARDS);
+    parallelFor(SHARDS, 1, [&](size_t begin, size_t end, unsigned) {
+        std::vector<uint32_t> table;
+        for (size_t s = begin; s < end; ++s) {
+            size_t n = shardStart[s + 1] - shardStart[s];
+            size_t capacity = 16;
+            while (capacity < n * 2) capacity <<= 1;
+            table.assign(capacity, NONE);
+            std::vector<uint32_t>& unique = shardUnique[s];
+            for (size_t k = shardStart[s]; k < shardStart[s + 1]; ++k) {
+                uint32_t i = order[k];
+                const Corner& c = cornerAt(i);
+                size_t slot = (hashCorner(c) / SHARDS) & (capacity - 1);
+                while (table[slot] != NONE && !sameCorner(cornerAt(unique[table[slot]]), c)) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                if (table[slot] == NONE) {
+                    table[slot] = uint32_t(unique.size());
+                    unique.push_back(i);
+                }
+                cornerVertex[i] = table[slot];
+            }
+        }
+    });
+    std::vector<uint32_t>().swap(order);
+
+    std::vector<uint32_t> shardBase(SHARDS + 1, 0);
+    for (size_t s = 0; s < SHARDS; ++s) shardBase[s + 1] = shardBase[s] + uint32_t(shardUnique[s].size());
+    const size_t vertexCount = shardBase[SHARDS];
+
+    // Renumber in first-use order so the vertex stream follows the index stream
+    std::vector<uint32_t> remap(vertexCount, NONE);
+    mesh.indices.resize(count);
+    uint32_t nextVertex = 0;
+    spans.forEach(0, count, [&](size_t i, const Corner& c) {
+        uint32_t shardVertex = shardBase[hashCorner(c) % SHARDS] + cornerVertex[i];
+        if (remap[shardVertex] == NONE) remap[shardVertex] = nextVertex++;
+        mesh.indices[i] = remap[shardVertex];
+    });
+    std::vector<uint32_t>().swap(cornerVertex);
+
+    mesh.vertices.resize(vertexCount);
+    parallelFor(SHARDS, 1, [&](size_t begin, size_t end, unsigned) {
+        for (size_t s = begin; s < end; ++s) {
+            for (size_t u = 0; u < shardUnique[s].size(); ++u) {
+                const Corner& c = cornerAt(shardUnique[s][u]);
+                Vertex& v = mesh.vertices[remap[shardBase[s] + u]];
+                v.Position = positions[c.v];
+                v.Normal = c.vn != NONE ? normals[c.vn] : smoothNormals[c.v];
+                v.TexCoords = c.vt != NONE ? glm::vec2(texcoords[c.vt].x, 1.0f - texcoords[c.vt].y) : glm::vec2(0.0f);
+            }
+        }
+    });
+    return true;
+}
+
+// materialLibraries receives the mtllib paths, resolved against the OBJ's
+// directory
+inline bool load(const std::string& path, std::vector<MeshData>& meshes, std::string& error, Stats* stats = nullptr,
+                 std::vector<std::string>* materialLibraries = nullptr) {
+    auto start = std::chrono::steady_clock::now();
+    auto elapsedMs = [](std::chrono::steady_clock::time_point from) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - from).count();
+    };
+
+    MappedFile file;
+    if (!file.open(path)) {
+        error = "could not map " + path;
+        return false;
+    }
+    const char* text = reinterpret_cast<const char*>(file.data());
+    const size_t size = file.size();
+
+    size_t sliceCount = std::max<size_t>(1, std::min<size_t>(workerCount(), size / MIN_SLICE_BYTES));
+    std::vector<Slice> slices(sliceCount);
+    for (size_t i = 0; i < sliceCount; ++i) {
+        const char* begin = text + size * i / sliceCount;
+        if (i > 0) {
+            const char* newline = static_cast<const char*>(memchr(begin, '\n', size_t(text + size - begin)));
+            begin = newline ? newline + 1 : text + size;
+        }
+        slices[i].begin = begin;
+        if (i > 0) slices[i - 1].end = begin;
+    }
+    slices.back().end = text + size;
+
+    parallelFor(sliceCount, 1, [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i) {
+            if (slices[i].begin < slices[i].end) parseSlice(slices[i]);
+        }
+    });
+    for (const Slice& slice : slices) {
+        if (!slice.error.empty()) {
+            error = slice.error;
+            return false;
+        }
+    }
+
+    // Merge attributes, then point relative indices at their global entries
+    size_t totals[3] = {};
+    for (Slice& slice : slices) {
+        slice.base[0] = totals[0];
+        slice.base[1] = totals[1];
+        slice.base[2] = totals[2];
+        totals[0] += slice.positions.size();
+        totals[1] += slice.texcoords.size();
+        totals[2] += slice.normals.size();
+    }
+    std::vector<glm::vec3> positions(totals[0]);
+    std::vector<glm::vec2> texcoords(totals[1]);
+    std::vector<glm::vec3> normals(totals[2]);
+    std::vector<uint8_t> badFixup(sliceCount, 0);
+    parallelFor(sliceCount, 1, [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i) {
+            Slice& slice = slices[i];
+            std::copy(slice.positions.begin(), slice.positions.end(), positions.begin() + slice.base[0]);
+            std::copy(slice.texcoords.begin(), slice.texcoords.end(), texcoords.begin() + slice.base[1]);
+            std::copy(slice.normals.begin(), slice.normals.end(), normals.begin() + slice.base[2]);
+            std::vector<glm::vec3>().swap(slice.positions);
+            std::vector<glm::vec2>().swap(slice.texcoords);
+            std::vector<glm::vec3>().swap(slice.normals);
+            for (const Slice::Fixup& fixup : slice.fixups) {
+                int64_t global = int64_t(slice.base[fixup.attribute]) + fixup.local;
+                if (global < 0 || global >= int64_t(totals[fixup.attribute])) {
+                    badFixup[i] = 1;
+                    continue;
+                }
+                Corner& c = slice.corners[fixup.corner];
+                (fixup.attribute == 0 ? c.v : fixup.attribute == 1 ? c.vt : c.vn) = uint32_t(global);
+            }
+        }
+    });
+    if (std::find(badFixup.begin(), badFixup.end(), uint8_t(1)) != badFixup.end()) {
+        error = "relative face index out of range";
+        return false;
+    }
+    if (materialLibraries) {
+        materialLibraries->clear();
+        std::filesystem::path directory = std::filesystem::path(path).parent_path();
+        for (const Slice& slice : slices) {
+            for (const std::string& library : slice.libraries) {
+                materialLibraries->push_back((directory / library).lexically_normal().string());
+            }
+        }
+    }
+    if (stats) {
+        stats->bytes = size;
+        stats->slices = sliceCount;
+        stats->positions = totals[0];
+        stats->texcoords = totals[1];
+        stats->normals = totals[2];
+        stats->parseMs = elapsedMs(start);
+    }
+    auto buildStart = std::chrono::steady_clock::now();
+
+    // Group triangles by material in order of first use; faces before any
+    // usemtl belong to an unnamed material
+    std::unordered_map<std::string, size_t> materialIds;
+    std::vector<CornerSpans> groups;
+    std::vector<std::string> groupNames;
+    size_t current = 0;
+    bool haveCurrent = false;
+    auto select = [&](const std::string& name) {
+        auto inserted = materialIds.emplace(name, groups.size());
+        if (inserted.second) {
+            groups.emplace_back();
+            groupNames.push_back(name);
+        }
+        current = inserted.first->second;
+        haveCurrent = true;
+    };
+    for (const Slice& slice : slices) {
+        size_t runStart = 0;
+        for (const Slice::MaterialRun& run : slice.materials) {
+            if (run.firstCorner > runStart) {
+                if (!haveCurrent) select("");
+                groups[current].add(slice.corners.data() + runStart, run.firstCorner - runStart);
+            }
+            select(run.name);
+            runStart = run.firstCorner;
+        }
+        if (slice.corners.size() > runStart) {
+            if (!haveCurrent) select("");
+            groups[current].add(slice.corners.data() + runStart, slice.corners.size() - runStart);
+        }
+    }
+
+    // Smooth normals for positions referenced without a vn. Accumulation is
+    // serial (scattered writes); the cross products are area weights.
+    std::vector<glm::vec3> smoothNormals;
+    for (const Slice& slice : slices) {
+        bool missing = false;
+        for (const Corner& c : slice.corners) {
+            if (c.vn == NONE) {
+                missing = true;
+                break;
+            }
+        }
+        if (!missing) continue;
+        if (smoothNormals.empty()) smoothNormals.assign(positions.size(), glm::vec3(0.0f));
+        for (size_t t = 0; t + 2 < slice.corners.size(); t += 3) {
+            const Corner* tri = &slice.corners[t];
+            if (tri[0].v >= positions.size() || tri[1].v >= positions.size() || tri[2].v >= positions.size()) continue;
+            glm::vec3 n = glm::cross(positions[tri[1].v] - positions[tri[0].v], positions[tri[2].v] - positions[tri[0].v]);
+            for (int k = 0; k < 3; ++k) smoothNormals[tri[k].v] += n;
+        }
+    }
+    parallelFor(smoothNormals.size(), 1 << 16, [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i) {
+            float length = glm::length(smoothNormals[i]);
+            smoothNormals[i] = length > 0.0f ? smoothNormals[i] / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+    });
+
+    meshes.clear();
+    meshes.reserve(groups.size());
+    size_t triangles = 0, vertices = 0;
+    for (size_t g = 0; g < groups.size(); ++g) {
+        MeshData mesh;
+        mesh.material = groupNames[g];
+        if (!buildMesh(groups[g], positions, texcoords, normals, smoothNormals, mesh, error)) return false;
+        triangles += mesh.indices.size() / 3;
+        vertices += mesh.vertices.size();
+        meshes.push_back(std::move(mesh));
+    }
+    if (meshes.empty()) {
+        error = "no faces in " + path;
+        return false;
+    }
+    if (stats) {
+        stats->triangles = triangles;
+        stats->vertices = vertices;
+        stats->buildMs = elapsedMs(buildStart);
+    }
+    return true;
+}
+
+// Texture path of a map_* statement. Options like "-bm 1.0" come before the
+// file name, so with options present the last token is the file; exporters
+// on Windows write backslashes.
+inline std::string mapPath(const std::string& statement, const std::filesystem::path& directory) {
+    std::string file = statement;
+    if (!file.empty() && file[0] == '-') {
+        size_t lastBlank = file.find_last_of(" \t");
+        file = lastBlank == std::string::npos ? std::string() : file.substr(lastBlank + 1);
+    }
+    if (file.empty()) return file;
+    std::replace(file.begin(), file.end(), '\\', '/');
+    return (directory / file).lexically_normal().string();
+}
+
+// Reads newmtl, Kd, map_Kd, map_d and map_bump/bump/norm from an .mtl file.
+// Returns false only if the file can't be read.
+inline bool loadMaterials(const std::string& path, std::vector<MaterialSource>& materials) {
+    MappedFile file;
+    if (!file.open(path)) return false;
+    const char* p = reinterpret_cast<const char*>(file.data());
+    const char* end = p + file.size();
+    std::filesystem::path directory = std::filesystem::path(path).parent_path();
+
+    MaterialSource* current = nullptr;
+    while (p < end) {
+        skipBlanks(p, end);
+        if (startsWithKeyword(p, end, "newmtl")) {
+            materials.emplace_back();
+            current = &materials.back();
+            current->name = restOfLine(p + 6, end);
+        } else if (current && startsWithKeyword(p, end, "Kd")) {
+            const char* q = p + 2;
+            glm::vec3 color;
+            bool ok = true;
+            for (int i = 0; i < 3 && ok; ++i) {
+                skipBlanks(q, end);
+                ok = parseFloat(q, end, color[i]);
+            }
+            if (ok) current->diffuseColor = color;
+        } else if (current && startsWithKeyword(p, end, "map_Kd")) {
+            current->diffuseMap = mapPath(restOfLine(p + 6, end), directory);
+        } else if (current && startsWithKeyword(p, end, "map_d")) {
+            current->alphaMap = mapPath(restOfLine(p + 5, end), directory);
+        } else if (current && (startsWithKeyword(p, end, "map_bump") || startsWithKeyword(p, end, "map_Bump"))) {
+            current->normalMap = mapPath(restOfLine(p + 8, end), directory);
+        } else if (current && current->normalMap.empty() &&
+                   (startsWithKeyword(p, end, "bump") || startsWithKeyword(p, end, "norm"))) {
+            current->normalMap = mapPath(restOfLine(p + 4, end), directory);
+        }
+        const char* next = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+        p = next ? next + 1 : end;
+    }
+    return true;
+}
+
+}
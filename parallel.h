@@ -0,0 +1,35 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+inline unsigned int workerCount() {
+    unsigned int count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+// Splits [0, count) into contiguous ranges and runs fn(begin, end, worker) on
+// each from its own thread. Small ranges run inline on the caller.
+template <typename Fn>
+void parallelFor(size_t count, size_t minChunk, Fn fn) {
+    size_t workers = std::min<size_t>(workerCount(), (count + minChunk - 1) / std::max<size_t>(minChunk, 1));
+    if (workers <= 1) {
+        fn(size_t(0), count, 0u);
+        return;
+    }
+
+    size_t chunk = (count + workers - 1) / workers;
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (size_t w = 1; w < workers; ++w) {
+        size_t begin = std::min(count, w * chunk);
+        size_t end = std::min(count, begin + chunk);
+        threads.emplace_back([=]() { fn(begin, end, unsigned(w)); });
+    }
+    fn(size_t(0), std::min(count, chunk), 0u);
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
@@ -0,0 +1,325 @@
+#pragma once
+
+#include "mesh.h"
+#include "parallel.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Procedural test geometry for SSS stress tests: UV spheres, icospheres, tori,
+// noise-displaced spheres and thin slabs. Every shape is sized from a triangle
+// budget, its vertex and index arrays are allocated once up front and rows (or
+// icosahedron faces) are filled in parallel. Trig is tabulated per row and
+// column instead of evaluated per vertex.
+namespace Procedural {
+
+const float PI = 3.14159265359f;
+// 32-bit indices and a few GB of CPU memory are the practical ceiling
+const size_t MAX_TRIANGLES = size_t(64) << 20;
+// Rows per worker below which a grid is filled on the calling thread
+const size_t MIN_ROWS_PER_WORKER = 16;
+
+struct Geometry {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+
+    size_t triangleCount() const { return indices.size() / 3; }
+};
+
+enum class Shape {
+    UvSphere,
+    Icosphere,
+    Torus,
+    NoiseSphere,
+    Slab
+};
+
+inline const char* shapeName(Shape shape) {
+    switch (shape) {
+        case Shape::UvSphere: return "UV sphere";
+        case Shape::Icosphere: return "icosphere";
+        case Shape::Torus: return "torus";
+        case Shape::NoiseSphere: return "noise sphere";
+        case Shape::Slab: return "slab";
+    }
+    return "shape";
+}
+
+// Appends a (rows + 1) x (cols + 1) vertex grid and its 2 * rows * cols
+// triangles. eval(row, col, vertex) fills one vertex and is called from
+// worker threads, so it must only read shared state. Triangles are
+// counter-clockwise when the col direction crossed with the row direction
+// points along the surface normal, like the imported scans.
+template <typename Eval>
+void appendGrid(Geometry& out, uint32_t rows, uint32_t cols, Eval eval) {
+    size_t baseVertex = out.vertices.size();
+    size_t baseIndex = out.indices.size();
+    size_t stride = size_t(cols) + 1;
+    out.vertices.resize(baseVertex + (size_t(rows) + 1) * stride);
+    out.indices.resize(baseIndex + size_t(rows) * cols * 6);
+
+    Vertex* vertices = out.vertices.data() + baseVertex;
+    unsigned int* indices = out.indices.data() + baseIndex;
+    parallelFor(size_t(rows) + 1, MIN_ROWS_PER_WORKER, [&](size_t begin, size_t end, unsigned) {
+        for (size_t row = begin; row < end; ++row) {
+            for (size_t col = 0; col <= cols; ++col) {
+                eval(uint32_t(row), uint32_t(col), vertices[row * stride + col]);
+            }
+            if (row == rows) continue;
+            unsigned int* quad = indices + row * cols * 6;
+            for (size_t col = 0; col < cols; ++col, quad += 6) {
+                unsigned int current = unsigned(baseVertex + row * stride + col);
+                unsigned int next = current + unsigned(stride);
+                quad[0] = current;
+                quad[1] = current + 1;
+                quad[2] = next;
+                quad[3] = current + 1;
+                quad[4] = next + 1;
+                quad[5] = next;
+            }
+        }
+    });
+}
+
+// sin/cos of count + 1 evenly spaced angles from 0 to range
+struct AngleTable {
+    std::vector<float> sines;
+    std::vector<float> cosines;
+
+    AngleTable(uint32_t count, float range) : sines(size_t(count) + 1), cosines(size_t(count) + 1) {
+        for (uint32_t i = 0; i <= count; ++i) {
+            float angle = range * float(i) / float(count);
+            sines[i] = std::sin(angle);
+            cosines[i] = std::cos(angle);
+        }
+    }
+};
+
+inline uint32_t gridSide(size_t triangles, size_t trianglesPerSquaredSide, uint32_t minimum) {
+    triangles = std::min(triangles, MAX_TRIANGLES);
+    return std::max(minimum, uint32_t(std::sqrt(double(triangles) / double(trianglesPerSquaredSide))));
+}
+
+// Latitude/longitude sphere; 2 * latSegments * lonSegments triangles
+inline void appendUvSphere(Geometry& out, glm::vec3 center, float radius, uint32_t latSegments, uint32_t lonSegments) {
+    AngleTable lat(latSegments, PI);
+    AngleTable lon(lonSegments, 2.0f * PI);
+    appendGrid(out, latSegments, lonSegments, [&](uint32_t row, uint32_t col, Vertex& v) {
+        glm::vec3 dir(lat.sines[row] * lon.cosines[col], lat.cosines[row], lat.sines[row] * lon.sines[col]);
+        v.Position = center + radius * dir;
+        v.Normal = glm::normalize(v.Position - center);
+        v.TexCoords = glm::vec2(float(col) / float(lonSegments), float(row) / float(latSegments));
+    });
+}
+
+inline void appendUvSphere(Geometry& out, glm::vec3 center, float radius, size_t triangles) {
+    uint32_t lat = gridSide(triangles, 4, 4);
+    appendUvSphere(out, center, radius, lat, lat * 2);
+}
+
+// Geodesic sphere: each icosahedron face is split into frequency^2 triangles
+// and projected onto the sphere, so triangles stay close to equal area. Faces
+// don't share vertices, but points on a shared edge are summed in corner order
+// and come out bit-identical, which keeps position welding in the LOD builder
+// and the rasterizer crack-free.
+inline void appendIcosphere(Geometry& out, glm::vec3 center, float radius, uint32_t frequency) {
+    const float t = (1.0f + std::sqrt(5.0f)) * 0.5f;
+    const glm::vec3 corners[12] = {
+        {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0}, {0, -1, t}, {0, 1, t},
+        {0, -1, -t}, {0, 1, -t}, {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1},
+    };
+    const uint8_t faces[20][3] = {
+        {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11}, {1, 5, 9}, {5, 11, 4},
+        {11, 10, 2}, {10, 7, 6}, {7, 1, 8}, {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8},
+        {3, 8, 9}, {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1},
+    };
+
+    const size_t n = frequency;
+    const size_t faceVertices = (n + 1) * (n + 2) / 2;
+    const size_t faceIndices = n * n * 3;
+    size_t baseVertex = out.vertices.size();
+    size_t baseIndex = out.indices.size();
+    out.vertices.resize(baseVertex + 20 * faceVertices);
+    out.indices.resize(baseIndex + 20 * faceIndices);
+
+    // Row r of a face holds n - r + 1 vertices, starting at rowStart(r)
+    auto rowStart = [n](size_t r) { return r * (n + 1) - r * (r - 1) / 2; };
+
+    parallelFor(20, 1, [&](size_t begin, size_t end, unsigned) {
+        for (size_t f = begin; f < end; ++f) {
+            // Corners sorted by index so shared edges are summed in the same order
+            struct Weighted {
+                uint8_t corner;
+                int slot;
+            } order[3] = {{faces[f][0], 0}, {faces[f][1], 1}, {faces[f][2], 2}};
+            std::sort(order, order + 3, [](const Weighted& a, const Weighted& b) { return a.corner < b.corner; });
+
+            Vertex* vertices = out.vertices.data() + baseVertex + f * faceVertices;
+            for (size_t r = 0; r <= n; ++r) {
+                for (size_t c = 0; c + r <= n; ++c) {
+                    // Steps towards corners 1 and 2; the rest goes to corner 0
+                    float weights[3] = {float(n - r - c), float(c), float(r)};
+                    glm::vec3 p = corners[order[0].corner] * weights[order[0].slot];
+                    p += corners[order[1].corner] * weights[order[1].slot];
+                    p += corners[order[2].corner] * weights[order[2].slot];
+                    glm::vec3 dir = glm::normalize(p);
+
+                    Vertex& v = vertices[rowStart(r) + c];
+                    v.Position = center + radius * dir;
+                    v.Normal = dir;
+                    v.TexCoords = glm::vec2(0.5f + std::atan2(dir.z, dir.x) / (2.0f * PI), std::acos(dir.y) / PI);
+                }
+            }
+
+            unsigned int* tri = out.indices.data() + baseIndex + f * faceIndices;
+            unsigned int faceBase = unsigned(baseVertex + f * faceVertices);
+            for (size_t r = 0; r < n; ++r) {
+                unsigned int row = faceBase + unsigned(rowStart(r));
+                unsigned int above = faceBase + unsigned(rowStart(r + 1));
+                for (size_t c = 0; c + r < n; ++c) {
+                    *tri++ = row + unsigned(c);
+                    *tri++ = row + unsigned(c) + 1;
+                    *tri++ = above + unsigned(c);
+                    if (c + r + 1 < n) {
+                        *tri++ = row + unsigned(c) + 1;
+                        *tri++ = above + unsigned(c) + 1;
+                        *tri++ = above + unsigned(c);
+                    }
+                }
+            }
+        }
+    });
+}
+
+inline void appendIcosphere(Geometry& out, glm::vec3 center, float radius, size_t triangles) {
+    appendIcosphere(out, center, radius, gridSide(triangles, 20, 1));
+}
+
+// Ring in the XZ plane; 2 * rings * sides triangles
+inline void appendTorus(Geometry& out, glm::vec3 center, float majorRadius, float minorRadius, uint32_t rings,
+                        uint32_t sides) {
+    AngleTable ring(rings, 2.0f * PI);
+    AngleTable side(sides, 2.0f * PI);
+    appendGrid(out, rings, sides, [&](uint32_t row, uint32_t col, Vertex& v) {
+        glm::vec3 around(ring.cosines[row], 0.0f, ring.sines[row]);
+        glm::vec3 normal = side.cosines[col] * around + glm::vec3(0.0f, side.sines[col], 0.0f);
+        v.Position = center + majorRadius * around + minorRadius * normal;
+        v.Normal = normal;
+        v.TexCoords = glm::vec2(float(row) / float(rings), float(col) / float(sides));
+    });
+}
+
+inline void appendTorus(Geometry& out, glm::vec3 center, float majorRadius, float minorRadius, size_t triangles) {
+    uint32_t sides = gridSide(triangles, 4, 3);
+    appendTorus(out, center, majorRadius, minorRadius, sides * 2, sides);
+}
+
+// Value noise on the integer lattice with smoothstep blending, plus fBm.
+// Deterministic, so repeated runs produce identical meshes.
+inline float latticeValue(int x, int y, int z) {
+    uint32_t h = uint32_t(x) * 0x8da6b343u ^ uint32_t(y) * 0xd8163841u ^ uint32_t(z) * 0xcb1ab31fu;
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return float(h & 0xffffff) / float(0xffffff) * 2.0f - 1.0f;
+}
+
+inline float valueNoise(glm::vec3 p) {
+    glm::vec3 cell = glm::floor(p);
+    glm::vec3 f = p - cell;
+    glm::vec3 s = f * f * (3.0f - 2.0f * f);
+    int x = int(cell.x), y = int(cell.y), z = int(cell.z);
+    auto lerp = [](float a, float b, float t) { return a + (b - a) * t; };
+    float x00 = lerp(latticeValue(x, y, z), latticeValue(x + 1, y, z), s.x);
+    float x10 = lerp(latticeValue(x, y + 1, z), latticeValue(x + 1, y + 1, z), s.x);
+    float x01 = lerp(latticeValue(x, y, z + 1), latticeValue(x + 1, y, z + 1), s.x);
+    float x11 = lerp(latticeValue(x, y + 1, z + 1), latticeValue(x + 1, y + 1, z + 1), s.x);
+    return lerp(lerp(x00, x10, s.y), lerp(x01, x11, s.y), s.z);
+}
+
+inline float fbm(glm::vec3 p, int octaves) {
+    float sum = 0.0f, amplitude = 0.5f;
+    for (int i = 0; i < octaves; ++i) {
+        sum += amplitude * valueNoise(p);
+        p *= 2.03f;
+        amplitude *= 0.5f;
+    }
+    return sum;
+}
+
+// UV sphere pushed in and out along its normal by fBm: a rough, pitted
+// surface with lots of curvature variation for the SSS terms. Normals come
+// from central differences of the displaced surface, so every vertex is
+// independent of its neighbours and rows can be filled in any order.
+inline void appendNoiseSphere(Geometry& out, glm::vec3 center, float radius, float amplitude, float frequency,
+                              uint32_t latSegments, uint32_t lonSegments) {
+    auto surface = [=](float theta, float phi) {
+        glm::vec3 dir(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+        return dir * (radius * (1.0f + amplitude * fbm(dir * frequency, 5)));
+    };
+    const float step = PI / float(latSegments) * 0.5f;
+    appendGrid(out, latSegments, lonSegments, [&](uint32_t row, uint32_t col, Vertex& v) {
+        float theta = PI * float(row) / float(latSegments);
+        float phi = 2.0f * PI * float(col) / float(lonSegments);
+        glm::vec3 p = surface(theta, phi);
+        glm::vec3 dTheta = surface(theta + step, phi) - surface(theta - step, phi);
+        glm::vec3 dPhi = surface(theta, phi + step) - surface(theta, phi - step);
+        glm::vec3 normal = glm::cross(dPhi, dTheta);
+        float length = glm::length(normal);
+        // At the poles dPhi vanishes; fall back to the radial direction
+        normal = length > 1e-8f * radius * radius ? normal / length : glm::normalize(p);
+        if (glm::dot(normal, p) < 0.0f) normal = -normal;
+
+        v.Position = center + p;
+        v.Normal = normal;
+        v.TexCoords = glm::vec2(float(col) / float(lonSegments), float(row) / float(latSegments));
+    });
+}
+
+inline void appendNoiseSphere(Geometry& out, glm::vec3 center, float radius, size_t triangles) {
+    uint32_t lat = gridSide(triangles, 4, 4);
+    appendNoiseSphere(out, center, radius, 0.18f, 2.5f, lat, lat * 2);
+}
+
+// Thin box centred on center with its large faces along +-Z: size.z is the
+// thickness that light has to pass through in transmission tests. The large
+// faces get segments^2 quads each, the rims one quad across.
+inline void appendSlab(Geometry& out, glm::vec3 center, glm::vec3 size, uint32_t segments) {
+    glm::vec3 half = size * 0.5f;
+    struct Face {
+        glm::vec3 normal;
+        glm::vec3 u;
+        glm::vec3 v;
+        uint32_t rows;
+        uint32_t cols;
+    };
+    const Face faces[6] = {
+        {{0, 0, 1}, {1, 0, 0}, {0, 1, 0}, segments, segments},
+        {{0, 0, -1}, {-1, 0, 0}, {0, 1, 0}, segments, segments},
+        {{1, 0, 0}, {0, 0, -1}, {0, 1, 0}, segments, 1},
+        {{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}, segments, 1},
+        {{0, 1, 0}, {1, 0, 0}, {0, 0, -1}, 1, segments},
+        {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}, 1, segments},
+    };
+    for (const Face& face : faces) {
+        glm::vec3 origin = center + face.normal * glm::abs(glm::dot(face.normal, half)) -
+                           face.u * glm::abs(glm::dot(face.u, half)) - face.v * glm::abs(glm::dot(face.v, half));
+        glm::vec3 uSpan = face.u * 2.0f * glm::abs(glm::dot(face.u, half));
+        glm::vec3 vSpan = face.v * 2.0f * glm::abs(glm::dot(face.v, half));
+        appendGrid(out, face.rows, face.cols, [&](uint32_t row, uint32_t col, Vertex& vertex) {
+            glm::vec2 uv(float(col) / float(face.cols), float(row) / float(face.rows));
+            vertex.Position = origin + uSpan * uv.x + vSpan * uv.y;
+            vertex.Normal = face.normal;
+            vertex.TexCoords = uv;
+        });
+    }
+}
+
+inline void appendSlab(Geometry& out, glm::vec3 center, glm::vec3 size, size_t triangles) {
+    appendSlab(out, center, size, gridSide(triangles, 4, 1));
+}
+
+}
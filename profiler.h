@@ -0,0 +1,215 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Nested CPU + GPU timing scopes around the phases of a frame. GPU times come
+// from a GL_TIMESTAMP query at each end of a scope; timestamps nest where
+// GL_TIME_ELAPSED queries can't, so a pass can later be split into sub-scopes
+// (culling, LOD selection) without restructuring. Two query sets alternate
+// between frames and a set is read back when it comes round again, so the
+// CPU never waits on the GPU; a frame whose queries aren't done by then is
+// dropped. Disabled, a scope is a branch on a bool.
+class Profiler {
+public:
+    static const int MAX_SCOPES = 48;
+    static const int FRAMES = 2;
+
+    // Times in ms; starts are relative to the frame scope's start
+    struct Pass {
+        const char* name;
+        int depth;
+        double cpuStartMs;
+        double cpuMs;
+        double gpuStartMs;
+        double gpuMs;
+    };
+
+    class Scope {
+    public:
+        Scope(Profiler& profiler, const char* name) : profiler(profiler), index(profiler.begin(name)) {}
+        ~Scope() { profiler.end(index); }
+
+    private:
+        Profiler& profiler;
+        int index;
+    };
+
+    void create() {
+        glGenQueries(FRAMES * MAX_SCOPES * 2, &queries[0][0]);
+    }
+
+    void setEnabled(bool on) {
+        enabled = on;
+        if (!on) {
+            for (FrameRecord& frame : frames) frame.issued = false;
+        }
+    }
+
+    bool isEnabled() const { return enabled; }
+
+    void beginFrame() {
+        if (!enabled) return;
+        slot = int(frameCounter % FRAMES);
+        collect(frames[slot], slot);
+
+        FrameRecord& frame = frames[slot];
+        frame.passes.clear();
+        frame.counters.clear();
+        frame.cpuStart = Clock::now();
+        depth = 0;
+        active = true;
+        frameScope = begin("frame");
+    }
+
+    void endFrame() {
+        if (!active) return;
+        end(frameScope);
+        active = false;
+        frames[slot].issued = true;
+        frameCounter++;
+    }
+
+    int begin(const char* name) {
+        if (!active) return -1;
+        FrameRecord& frame = frames[slot];
+        if (frame.passes.size() >= size_t(MAX_SCOPES)) return -1;
+
+        int index = int(frame.passes.size());
+        frame.passes.push_back({name, depth++, millisecondsFrom(frame.cpuStart), 0.0, 0.0, 0.0});
+        glQueryCounter(queries[slot][index * 2], GL_TIMESTAMP);
+        return index;
+    }
+
+    void end(int index) {
+        if (index < 0) return;
+        FrameRecord& frame = frames[slot];
+        Pass& pass = frame.passes[size_t(index)];
+        pass.cpuMs = millisecondsFrom(frame.cpuStart) - pass.cpuStartMs;
+        depth--;
+        glQueryCounter(queries[slot][index * 2 + 1], GL_TIMESTAMP);
+    }
+
+    // Per-frame value shown as a counter track in the trace (triangles, draws)
+    void counter(const char* name, double value) {
+        if (active) frames[slot].counters.push_back({name, value});
+    }
+
+    // Most recent frame whose GPU results have arrived; empty until then
+    const std::vector<Pass>& latest() const { return latestPasses; }
+
+    void startTrace() {
+        traceEvents.clear();
+        traceStart = Clock::now();
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        traceGpuStart = uint64_t(gpuNow);
+        tracing = true;
+    }
+
+    bool isTracing() const { return tracing; }
+
+    // Chrome trace-event format (chrome://tracing, Perfetto): CPU and GPU
+    // scopes as complete events on two tracks, counters as counter events
+    bool stopTrace(const std::string& path) {
+        tracing = false;
+        std::ofstream out(path);
+        if (!out) return false;
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n";
+        out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"GPU\"}}";
+        for (const TraceEvent& e : traceEvents) {
+            out << ",\n{\"name\": \"" << e.name << "\", \"ph\": \"" << e.phase << "\", \"pid\": 1, \"tid\": " << e.track
+                << ", \"ts\": " << e.startUs;
+            if (e.phase == 'X') {
+                out << ", \"dur\": " << e.durationUs << "}";
+            } else {
+                out << ", \"args\": {\"value\": " << e.durationUs << "}}";
+            }
+        }
+        out << "\n]}\n";
+        traceEvents.clear();
+        return bool(out);
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Counter {
+        const char* name;
+        double value;
+    };
+
+    struct FrameRecord {
+        std::vector<Pass> passes;
+        std::vector<Counter> counters;
+        Clock::time_point cpuStart;
+        bool issued = false;
+    };
+
+    // phase 'X' is a scope, 'C' a counter whose value rides in durationUs
+    struct TraceEvent {
+        const char* name;
+        char phase;
+        int track;
+        double startUs;
+        double durationUs;
+    };
+
+    bool enabled = false;
+    bool active = false;
+    int slot = 0;
+    int depth = 0;
+    int frameScope = -1;
+    uint64_t frameCounter = 0;
+    GLuint queries[FRAMES][MAX_SCOPES * 2] = {};
+    FrameRecord frames[FRAMES];
+    std::vector<Pass> latestPasses;
+
+    bool tracing = false;
+    Clock::time_point traceStart;
+    uint64_t traceGpuStart = 0;
+    std::vector<TraceEvent> traceEvents;
+
+    static double millisecondsFrom(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    void collect(FrameRecord& frame, int set) {
+        if (!frame.issued) return;
+        frame.issued = false;
+
+        // The frame scope's end is the last query issued for the set
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries[set][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return;
+
+        std::vector<uint64_t> stamps(frame.passes.size() * 2);
+        for (size_t i = 0; i < stamps.size(); ++i) {
+            GLuint64 value = 0;
+            glGetQueryObjectui64v(queries[set][i], GL_QUERY_RESULT, &value);
+            stamps[i] = value;
+        }
+        for (size_t i = 0; i < frame.passes.size(); ++i) {
+            frame.passes[i].gpuStartMs = double(int64_t(stamps[i * 2] - stamps[0])) * 1e-6;
+            frame.passes[i].gpuMs = double(int64_t(stamps[i * 2 + 1] - stamps[i * 2])) * 1e-6;
+        }
+        latestPasses = frame.passes;
+
+        if (!tracing) return;
+        double frameUs = std::chrono::duration<double, std::micro>(frame.cpuStart - traceStart).count();
+        for (size_t i = 0; i < frame.passes.size(); ++i) {
+            const Pass& pass = frame.passes[i];
+            traceEvents.push_back({pass.name, 'X', 1, frameUs + pass.cpuStartMs * 1000.0, pass.cpuMs * 1000.0});
+            double gpuUs = double(int64_t(stamps[i * 2] - traceGpuStart)) * 1e-3;
+            traceEvents.push_back({pass.name, 'X', 2, gpuUs, pass.gpuMs * 1000.0});
+        }
+        for (const Counter& c : frame.counters) {
+            traceEvents.push_back({c.name, 'C', 1, frameUs, c.value});
+        }
+    }
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "gl_counter.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <iostream>
+
+// Offscreen multisampled scene buffer. The frame renders here and is resolved
+// to the window at the end. Depth is a texture, multisampled like the rest,
+// so passes can read every sample mid-frame. On request it also
+// carries up to three HDR attachments for passes that split their output.
+// Multisampling can be turned off for passes that antialias temporally.
+class SceneTarget {
+public:
+    static const int SAMPLES = 4;
+    static const int MAX_SPLIT_OUTPUTS = 3;
+
+    // Reallocates attachments when the size changes; cheap to call every frame
+    bool resize(int newWidth, int newHeight) {
+        if (newWidth == width && newHeight == height && fbo) return true;
+        if (newWidth <= 0 || newHeight <= 0) return false;
+        release();
+        width = newWidth;
+        height = newHeight;
+
+        glGenRenderbuffers(1, &colorBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+        glGenTextures(1, &depthTexture);
+        if (samples > 0) {
+            // Fixed sample locations, as required next to renderbuffer attachments
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, depthTexture);
+            glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples, GL_DEPTH_COMPONENT32F, width, height, GL_TRUE);
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+        } else {
+            glBindTexture(GL_TEXTURE_2D, depthTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, getDepthTarget(), depthTexture, 0);
+        if (splitCount > 0) {
+            glGenRenderbuffers(splitCount, splitBuffers);
+            for (int i = 0; i < splitCount; ++i) {
+                glBindRenderbuffer(GL_RENDERBUFFER, splitBuffers[i]);
+                glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA16F, width, height);
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1 + i, GL_RENDERBUFFER, splitBuffers[i]);
+            }
+        }
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete) {
+            std::cerr << "❌ Scene render target incomplete at " << width << "x" << height << std::endl;
+        }
+        return complete;
+    }
+
+    // Allocates the first count HDR attachments (RGBA16F, from attachment 1)
+    // on the next resize()
+    void requestSplitOutputs(int count = 2) {
+        count = std::min(count, MAX_SPLIT_OUTPUTS);
+        if (count <= splitCount) return;
+        splitCount = count;
+        width = height = 0;
+    }
+
+    // SAMPLES per pixel, or one; takes effect on the next resize()
+    void setMultisample(bool enabled) {
+        int wanted = enabled ? SAMPLES : 0;
+        if (wanted == samples) return;
+        samples = wanted;
+        width = height = 0;
+    }
+
+    int getSamples() const { return std::max(samples, 1); }
+
+    // The depth attachment: GL_TEXTURE_2D_MULTISAMPLE with getSamples() samples
+    // per pixel, or GL_TEXTURE_2D when multisampling is off. Only read it while
+    // another framebuffer is bound for drawing.
+    GLuint getDepthTexture() const { return depthTexture; }
+    GLenum getDepthTarget() const { return samples > 0 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D; }
+
+    void bind() {
+        GL_COUNT(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+        GL_COUNT(glViewport(0, 0, width, height));
+    }
+
+    // Routes fragment outputs 0..outputs-1 to the HDR attachments, or with 0
+    // output 0 to the regular color attachment. The scene framebuffer must be bound.
+    void selectOutputs(int outputs) {
+        static const GLenum colorOnly[] = {GL_COLOR_ATTACHMENT0};
+        static const GLenum splitTargets[] = {GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3};
+        if (outputs > 0 && outputs <= splitCount && splitBuffers[outputs - 1]) {
+            GL_COUNT(glDrawBuffers(outputs, splitTargets));
+        } else {
+            GL_COUNT(glDrawBuffers(1, colorOnly));
+        }
+    }
+
+    // Resolves split attachment index (from 0) into a single-sample framebuffer
+    void resolveSplit(int index, GLuint destinationFbo) {
+        GL_COUNT(glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo));
+        GL_COUNT(glReadBuffer(GL_COLOR_ATTACHMENT1 + index));
+        GL_COUNT(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, destinationFbo));
+        GL_COUNT(glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST));
+        GL_COUNT(glReadBuffer(GL_COLOR_ATTACHMENT0));
+    }
+
+    // Resolves the color attachment into a single-sample framebuffer of the same size
+    void resolveColor(GLuint destinationFbo) {
+        GL_COUNT(glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo));
+        GL_COUNT(glReadBuffer(GL_COLOR_ATTACHMENT0));
+        GL_COUNT(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, destinationFbo));
+        GL_COUNT(glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST));
+    }
+
+    // Copies a same-size color attachment of another framebuffer into the
+    // color attachment, which must be single-sample, and leaves the scene
+    // framebuffer bound with output 0 selected
+    void copyColorFrom(GLuint sourceFbo, GLenum attachment) {
+        GL_COUNT(glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFbo));
+        GL_COUNT(glReadBuffer(attachment));
+        GL_COUNT(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo));
+        selectOutputs(0);
+        GL_COUNT(glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST));
+        GL_COUNT(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
+    }
+
+    void resolveToScreen() {
+        GL_COUNT(glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo));
+        GL_COUNT(glReadBuffer(GL_COLOR_ATTACHMENT0));
+        GL_COUNT(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0));
+        GL_COUNT(glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST));
+        GL_COUNT(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+private:
+    int width = 0;
+    int height = 0;
+    GLuint fbo = 0;
+    GLuint colorBuffer = 0;
+    GLuint depthTexture = 0;
+    GLuint splitBuffers[MAX_SPLIT_OUTPUTS] = {0, 0, 0};
+    int splitCount = 0;
+    int samples = SAMPLES;
+
+    void release() {
+        if (fbo) glDeleteFramebuffers(1, &fbo);
+        if (colorBuffer) glDeleteRenderbuffers(1, &colorBuffer);
+        if (depthTexture) glDeleteTextures(1, &depthTexture);
+        for (GLuint& buffer : splitBuffers) {
+            if (buffer) glDeleteRenderbuffers(1, &buffer);
+            buffer = 0;
+        }
+        fbo = colorBuffer = depthTexture = 0;
+    }
+};
@@ -0,0 +1,274 @@
+#pragma once
+
+#include "shader_utils.h"
+#include <GL/glew.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Builds every GL program in the demo. A program is keyed by its sources after
+// #define injection plus its transform feedback varyings, so each permutation
+// is its own entry. Linked binaries are kept in .cache/shaders/ through
+// glGetProgramBinary and tagged with a hash of the driver's vendor, renderer
+// and version strings: a driver update or a shader edit misses the cache and
+// compiles from source. request() only issues work and resolve() waits for
+// it, so programs requested together compile concurrently on drivers with
+// KHR_parallel_shader_compile.
+class ShaderCache {
+public:
+    using Handle = size_t;
+
+    static constexpr char MAGIC[8] = "SSSPRG";
+    static const uint32_t VERSION = 1;
+
+    struct Stats {
+        size_t programs = 0;
+        size_t binaryHits = 0;
+        size_t binaryRejected = 0;
+        size_t compiled = 0;
+        size_t failed = 0;
+        // Time the caller spent blocked in request() and resolve()
+        double ms = 0.0;
+    };
+
+    static ShaderCache& global() {
+        static ShaderCache cache;
+        return cache;
+    }
+
+    // Needs a current context. With useDisk off every program compiles from
+    // source and the cache directory is never read or written.
+    void create(bool useDisk = true, const std::string& cacheDirectory = ".cache/shaders") {
+        directory = cacheDirectory;
+        GLint formats = 0;
+        if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        }
+        binaries = useDisk && formats > 0;
+
+#ifdef GL_KHR_parallel_shader_compile
+        if (GLEW_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xffffffffu);
+            parallelCompile = true;
+        }
+#endif
+#ifdef GL_ARB_parallel_shader_compile
+        if (!parallelCompile && GLEW_ARB_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsARB(0xffffffffu);
+            parallelCompile = true;
+        }
+#endif
+
+        driverHash = FNV_OFFSET;
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            const char* value = reinterpret_cast<const char*>(glGetString(name));
+            driverHash = hashBytes(driverHash, value ? value : "", value ? strlen(value) + 1 : 1);
+        }
+    }
+
+    bool hasBinaries() const { return binaries; }
+    bool hasParallelCompile() const { return parallelCompile; }
+    const Stats& stats() const { return counters; }
+
+    // Starts building a program, or finds one already requested with the same
+    // key. fragmentSource may be null for transform feedback programs.
+    Handle request(const char* vertexSource, const char* fragmentSource,
+                   const std::vector<const char*>& feedbackVaryings = {},
+                   const std::vector<std::string>& defines = {}) {
+        auto start = Clock::now();
+        Entry entry;
+        entry.vertex = shaderVariant(vertexSource, defines);
+        entry.hasFragment = fragmentSource != nullptr;
+        if (fragmentSource) entry.fragment = shaderVariant(fragmentSource, defines);
+        entry.varyings.assign(feedbackVaryings.begin(), feedbackVaryings.end());
+        entry.key = keyFor(entry);
+
+        for (Handle h = 0; h < entries.size(); ++h) {
+            if (entries[h].key == entry.key) return h;
+        }
+
+        entry.fromBinary = binaries && loadBinary(entry);
+        if (!entry.fromBinary) startCompile(entry);
+        entries.push_back(std::move(entry));
+        counters.programs++;
+        counters.ms += millisecondsSince(start);
+        return entries.size() - 1;
+    }
+
+    // Waits for a requested program; 0 if it failed to build
+    GLuint resolve(Handle handle) {
+        Entry& entry = entries[handle];
+        if (entry.resolved) return entry.program;
+        auto start = Clock::now();
+
+        if (entry.fromBinary) {
+            GLint linked = 0;
+            glGetProgramiv(entry.program, GL_LINK_STATUS, &linked);
+            if (linked) {
+                counters.binaryHits++;
+            } else {
+                // The driver may refuse a binary it wrote itself (e.g. after a state change)
+                glDeleteProgram(entry.program);
+                counters.binaryRejected++;
+                entry.fromBinary = false;
+                startCompile(entry);
+            }
+        }
+        if (!entry.fromBinary) {
+            entry.program = finishLink(entry.program);
+            if (entry.program) {
+                counters.compiled++;
+                if (binaries) saveBinary(entry);
+            } else {
+                counters.failed++;
+            }
+        }
+
+        entry.resolved = true;
+        entry.vertex.clear();
+        entry.fragment.clear();
+        counters.ms += millisecondsSince(start);
+        return entry.program;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static const uint64_t FNV_OFFSET = 1469598103934665603ULL;
+
+    struct Entry {
+        std::string vertex;
+        std::string fragment;
+        bool hasFragment = false;
+        std::vector<std::string> varyings;
+        uint64_t key = 0;
+        GLuint program = 0;
+        bool fromBinary = false;
+        bool resolved = false;
+    };
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t format;
+        uint64_t key;
+        uint64_t driverHash;
+        uint64_t length;
+    };
+
+    std::vector<Entry> entries;
+    std::string directory = ".cache/shaders";
+    bool binaries = false;
+    bool parallelCompile = false;
+    uint64_t driverHash = FNV_OFFSET;
+    Stats counters;
+
+    static double millisecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Sources are hashed with their terminators so "a" + "bc" != "ab" + "c"
+    static uint64_t keyFor(const Entry& entry) {
+        uint64_t hash = hashBytes(FNV_OFFSET, entry.vertex.c_str(), entry.vertex.size() + 1);
+        hash = hashBytes(hash, &entry.hasFragment, sizeof(entry.hasFragment));
+        hash = hashBytes(hash, entry.fragment.c_str(), entry.fragment.size() + 1);
+        for (const std::string& varying : entry.varyings) {
+            hash = hashBytes(hash, varying.c_str(), varying.size() + 1);
+        }
+        return hash;
+    }
+
+    std::string pathFor(uint64_t key) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.glprog", (unsigned long long)key);
+        return directory + "/" + name;
+    }
+
+    void startCompile(Entry& entry) {
+        std::vector<const char*> varyings;
+        for (const std::string& varying : entry.varyings) varyings.push_back(varying.c_str());
+        entry.program = startLink(entry.vertex.c_str(), entry.hasFragment ? entry.fragment.c_str() : nullptr,
+                                  varyings, binaries);
+    }
+
+    bool loadBinary(Entry& entry) {
+        FILE* f = fopen(pathFor(entry.key).c_str(), "rb");
+        if (!f) return false;
+
+        FileHeader header;
+        std::vector<uint8_t> data;
+        bool ok = fread(&header, sizeof(header), 1, f) == 1 && memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                  header.version == VERSION && header.key == entry.key && header.driverHash == driverHash &&
+                  header.length > 0 && header.length < (uint64_t(1) << 31);
+        if (ok) {
+            data.resize(size_t(header.length));
+            ok = fread(data.data(), 1, data.size(), f) == data.size();
+        }
+        fclose(f);
+        if (!ok) return false;
+
+        entry.program = glCreateProgram();
+        glProgramBinary(entry.program, GLenum(header.format), data.data(), GLsizei(data.size()));
+        return true;
+    }
+
+    bool saveBinary(const Entry& entry) {
+        GLint length = 0;
+        glGetProgramiv(entry.program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return false;
+
+        std::vector<uint8_t> data(static_cast<size_t>(length));
+        GLenum format = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(entry.program, length, &written, &format, data.data());
+        if (written <= 0) return false;
+
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        std::string path = pathFor(entry.key);
+        std::string tmpPath = path + ".tmp" + std::to_string(getpid());
+        FILE* f = fopen(tmpPath.c_str(), "wb");
+        if (!f) return false;
+
+        FileHeader header = {};
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.format = uint32_t(format);
+        header.key = entry.key;
+        header.driverHash = driverHash;
+        header.length = uint64_t(written);
+
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                  fwrite(data.data(), 1, size_t(written), f) == size_t(written);
+        ok = (fclose(f) == 0) && ok;
+        if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+            remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+};
+
+// Builds (or loads from the cache) a program and waits for it: the
+// synchronous path for passes that create their program on the spot
+inline GLuint linkProgram(const char* vertexSource, const char* fragmentSource,
+                          const std::vector<const char*>& feedbackVaryings = {},
+                          const std::vector<std::string>& defines = {}) {
+    ShaderCache& cache = ShaderCache::global();
+    return cache.resolve(cache.request(vertexSource, fragmentSource, feedbackVaryings, defines));
+}
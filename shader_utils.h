@@ -0,0 +1,102 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// One triangle covering the viewport, drawn with glDrawArrays(GL_TRIANGLES, 0, 3)
+// and an empty VAO. Fragment shaders address texels through gl_FragCoord.
+const char* const fullscreenTriangleVertex = R"(
+#version 330 core
+void main() {
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// Builds a variant of a shader by inserting "#define NAME" lines right after
+// its #version line, so one source can carry several code paths.
+inline std::string shaderVariant(const char* source, const std::vector<std::string>& defines) {
+    std::string text(source);
+    if (defines.empty()) return text;
+    size_t version = text.find("#version");
+    size_t insertAt = version == std::string::npos ? 0 : text.find('\n', version);
+    insertAt = insertAt == std::string::npos ? text.size() : insertAt + 1;
+    std::string block;
+    for (const std::string& name : defines) block += "#define " + name + "\n";
+    return text.insert(insertAt, block);
+}
+
+// Full info log of a shader or program; logs can run well past a few hundred
+// bytes when one error cascades
+inline std::string shaderInfoLog(GLuint object, bool isProgram) {
+    GLint length = 0;
+    if (isProgram) {
+        glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+    } else {
+        glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+    }
+    std::string log(size_t(std::max(length, 1)), '\0');
+    if (isProgram) {
+        glGetProgramInfoLog(object, GLsizei(log.size()), nullptr, &log[0]);
+    } else {
+        glGetShaderInfoLog(object, GLsizei(log.size()), nullptr, &log[0]);
+    }
+    log.resize(strlen(log.c_str()));
+    return log;
+}
+
+// Issues the compile without reading its status, so drivers with
+// KHR_parallel_shader_compile can work on it in the background
+inline GLuint compileShader(const char* source, GLenum shaderType) {
+    GLuint shader = glCreateShader(shaderType);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    return shader;
+}
+
+// Compiles and links a vertex/fragment pair (fragment may be null for
+// transform feedback programs) without waiting for the result. The shader
+// objects are flagged for deletion and go away with the program.
+inline GLuint startLink(const char* vertexSource, const char* fragmentSource,
+                        const std::vector<const char*>& feedbackVaryings = {}, bool retrievable = false) {
+    GLuint program = glCreateProgram();
+    GLuint shaders[2] = {compileShader(vertexSource, GL_VERTEX_SHADER),
+                         fragmentSource ? compileShader(fragmentSource, GL_FRAGMENT_SHADER) : 0};
+    for (GLuint shader : shaders) {
+        if (shader) glAttachShader(program, shader);
+    }
+    if (!feedbackVaryings.empty()) {
+        glTransformFeedbackVaryings(program, GLsizei(feedbackVaryings.size()), feedbackVaryings.data(),
+                                    GL_INTERLEAVED_ATTRIBS);
+    }
+    if (retrievable) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+    for (GLuint shader : shaders) {
+        if (shader) glDeleteShader(shader);
+    }
+    return program;
+}
+
+// Waits for a startLink() program. On failure prints the compile logs of
+// its shaders and the link log, deletes the program and returns 0.
+inline GLuint finishLink(GLuint program) {
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (success) return program;
+
+    GLuint shaders[2] = {};
+    GLsizei count = 0;
+    glGetAttachedShaders(program, 2, &count, shaders);
+    for (GLsizei i = 0; i < count; ++i) {
+        GLint compiled = 0;
+        glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &compiled);
+        if (!compiled) std::cerr << "Shader compilation failed: " << shaderInfoLog(shaders[i], false) << std::endl;
+    }
+    std::cerr << "Shader linking failed: " << shaderInfoLog(program, true) << std::endl;
+    glDeleteProgram(program);
+    return 0;
+}
@@ -0,0 +1,352 @@
+#pragma once
+
+#include "gl_counter.h"
+#include "material_luts.h"
+#include "render_target.h"
+#include "shader_cache.h"
+#include "uniform_blocks.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace SssShaders {
+
+// Scene pass for the screen-space path: no per-light scattering terms, just
+// Lambert irradiance (plus the forward shader's ambient) into output 0 with
+// view depth in alpha, and the surface-only rim term into output 1.
+const char* const irradianceFragment = R"(
+#version 330 core
+layout (location = 0) out vec4 Irradiance;
+layout (location = 1) out vec4 Specular;
+
+in vec3 WorldPos;
+in vec3 Normal;
+in vec2 TexCoord;
+in vec3 ViewPos;
+
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 camPosTime;
+    vec4 clusterScale;
+    vec4 clusterDims;
+    mat4 previousViewProjection;
+    vec4 temporal;
+};
+
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterLights;
+
+// Alpha test and normal map of the surface material; albedo is left to the
+// composite's material colour
+uniform bool hasAlbedoMap;
+uniform bool hasNormalMap;
+uniform bool alphaMask;
+uniform sampler2D albedoMap;
+uniform sampler2D normalMap;
+
+// Same as the forward shader's
+vec3 perturbNormal(vec3 N, vec3 P, vec2 uv) {
+    vec3 dp1 = dFdx(P);
+    vec3 dp2 = dFdy(P);
+    vec2 duv1 = dFdx(uv);
+    vec2 duv2 = dFdy(uv);
+    vec3 dp2perp = cross(dp2, N);
+    vec3 dp1perp = cross(N, dp1);
+    vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+    float scale = inversesqrt(max(max(dot(T, T), dot(B, B)), 1e-20));
+    vec2 xy = texture(normalMap, uv).rg * 2.0 - 1.0;
+    vec3 n = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+    return normalize(mat3(T * scale, -B * scale, N) * n);
+}
+
+vec3 calculateSceneGI(vec3 normal) {
+    vec3 ambient = vec3(0.08, 0.08, 0.12);
+    vec3 sky = vec3(0.4, 0.6, 1.0) * max(0.0, normal.y) * 0.2;
+    vec3 ground = vec3(0.8, 0.6, 0.4) * max(0.0, -normal.y) * 0.05;
+    return ambient + sky + ground;
+}
+
+void main() {
+    if (alphaMask && hasAlbedoMap && texture(albedoMap, TexCoord).a < 0.5) discard;
+    vec3 N = normalize(Normal);
+    if (hasNormalMap) N = perturbNormal(N, WorldPos, TexCoord);
+    vec3 V = normalize(camPosTime.xyz - WorldPos);
+
+    ivec3 dims = ivec3(clusterDims.xyz);
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy * clusterScale.xy),
+                          int(floor(log(max(-ViewPos.z, 1e-4)) * clusterScale.z + clusterScale.w)));
+    cluster = clamp(cluster, ivec3(0), dims - 1);
+    uvec2 range = texelFetch(clusterRanges, (cluster.z * dims.y + cluster.y) * dims.x + cluster.x).xy;
+
+    vec3 irradiance = vec3(0.0);
+    vec3 rim = vec3(0.0);
+    float rimFactor = pow(1.0 - max(0.0, dot(N, V)), 2.0) * 0.5;
+    for (uint k = 0u; k < range.y; ++k) {
+        int light = int(texelFetch(clusterLights, int(range.x + k)).r);
+        vec4 positionRadius = texelFetch(lightData, light * 2);
+        vec3 lightColor = texelFetch(lightData, light * 2 + 1).xyz;
+
+        vec3 toLight = positionRadius.xyz - WorldPos;
+        float distance = length(toLight);
+        float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+        vec3 radiance = lightColor * window * window / (distance * distance + 1.0);
+
+        irradiance += radiance * max(dot(N, toLight / distance), 0.0);
+        rim += radiance * rimFactor;
+    }
+
+    Irradiance = vec4(calculateSceneGI(N) * 0.2 + irradiance, -ViewPos.z);
+    Specular = vec4(rim * 0.3 * vec3(0.8, 0.9, 1.0), 1.0);
+}
+)";
+
+// One direction of the separable diffusion blur. kernel[i].rgb is the
+// per-channel weight, kernel[i].a the world-space offset; the step in
+// texels follows the surface's view depth. Samples across a depth edge fall
+// back to the centre colour so light doesn't bleed between objects.
+const char* const blurFragment = R"(
+#version 330 core
+uniform sampler2D source;
+uniform vec2 direction;
+uniform float pixelsPerUnit;
+uniform float kernelRange;
+uniform vec4 kernel[17];
+out vec4 blurred;
+
+void main() {
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+    vec2 uv = gl_FragCoord.xy * texel;
+    vec4 center = texture(source, uv);
+    if (center.a <= 0.0) {
+        blurred = center;
+        return;
+    }
+
+    vec2 step = direction * texel * pixelsPerUnit / center.a;
+    vec3 sum = center.rgb * kernel[0].rgb;
+    for (int i = 1; i < 17; ++i) {
+        vec4 s = texture(source, uv + kernel[i].a * step);
+        float edge = s.a <= 0.0 ? 1.0 : clamp(abs(s.a - center.a) / kernelRange, 0.0, 1.0);
+        sum += kernel[i].rgb * mix(s.rgb, center.rgb, edge);
+    }
+    blurred = vec4(sum, center.a);
+}
+)";
+
+// Diffuse albedo is the forward shader's scattering colour times its
+// absorption term; then the same exposure, ACES, tint and gamma.
+const char* const compositeFragment = R"(
+#version 330 core
+struct Material {
+    vec4 scattering;
+    vec4 absorption;
+    vec4 internalColor;
+    vec4 params;
+};
+
+layout (std140) uniform Materials {
+    Material materials[4];
+};
+
+uniform int materialIndex;
+uniform sampler2D diffuse;
+uniform sampler2D specular;
+uniform vec3 background;
+out vec4 FragColor;
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec4 irradiance = texelFetch(diffuse, p, 0);
+    if (irradiance.a <= 0.0) {
+        FragColor = vec4(background, 1.0);
+        return;
+    }
+
+    Material m = materials[materialIndex];
+    vec3 albedo = m.scattering.xyz * exp(-m.absorption.xyz * m.scattering.w * 2.0);
+    vec3 color = irradiance.rgb * albedo + texelFetch(specular, p, 0).rgb;
+
+    color *= 1.2;
+    color = (color * (2.51 * color + 0.03)) / (color * (2.43 * color + 0.59) + 0.14);
+    color *= vec3(1.05, 1.0, 0.95);
+    FragColor = vec4(pow(color, vec3(1.0 / 2.2)), 1.0);
+}
+)";
+
+}
+
+// Jimenez-style screen-space subsurface scattering: the scene pass writes
+// irradiance and specular to separate HDR targets, a horizontal and a
+// vertical blur with a per-material diffusion profile spread the irradiance,
+// and a composite applies albedo and tonemaps. The blur's cost per pixel is
+// fixed by the kernel size, whatever the light count.
+class ScreenSpaceSss {
+public:
+    static const int KERNEL_SIZE = 17;
+    static const GLuint SOURCE_UNIT = 5;
+    static const GLuint SPECULAR_UNIT = 6;
+
+    bool create() {
+        blurProgram = linkProgram(fullscreenTriangleVertex, SssShaders::blurFragment);
+        compositeProgram = linkProgram(fullscreenTriangleVertex, SssShaders::compositeFragment);
+        if (!blurProgram || !compositeProgram) return false;
+
+        blurDirection = glGetUniformLocation(blurProgram, "direction");
+        blurPixelsPerUnit = glGetUniformLocation(blurProgram, "pixelsPerUnit");
+        blurKernelRange = glGetUniformLocation(blurProgram, "kernelRange");
+        blurKernel = glGetUniformLocation(blurProgram, "kernel");
+        compositeMaterial = glGetUniformLocation(compositeProgram, "materialIndex");
+        compositeBackground = glGetUniformLocation(compositeProgram, "background");
+
+        glUseProgram(blurProgram);
+        glUniform1i(glGetUniformLocation(blurProgram, "source"), SOURCE_UNIT);
+        glUseProgram(compositeProgram);
+        glUniform1i(glGetUniformLocation(compositeProgram, "diffuse"), SOURCE_UNIT);
+        glUniform1i(glGetUniformLocation(compositeProgram, "specular"), SPECULAR_UNIT);
+        UniformBlocks::bindBlock(compositeProgram, "Materials", UniformBlocks::MATERIAL_BINDING);
+        glUseProgram(0);
+
+        glGenVertexArrays(1, &emptyVao);
+        return true;
+    }
+
+    // Rebuilds the blur kernel when the material changes
+    void setMaterial(int index) {
+        if (index == materialIndex) return;
+        materialIndex = index;
+
+        std::vector<glm::vec4> kernel;
+        kernelRange = buildKernel(UniformBlocks::MATERIAL_PRESETS[index], kernel);
+        glUseProgram(blurProgram);
+        glUniform4fv(blurKernel, KERNEL_SIZE, glm::value_ptr(kernel[0]));
+        glUniform1f(blurKernelRange, kernelRange);
+        glUseProgram(compositeProgram);
+        glUniform1i(compositeMaterial, index);
+    }
+
+    // Resolves, blurs and composites into the scene target's regular color
+    // attachment. Leaves the scene framebuffer bound with depth testing on.
+    void apply(SceneTarget& target, float pixelsPerUnit, const glm::vec3& background) {
+        allocate(target.getWidth(), target.getHeight());
+        target.resolveSplit(0, fbos[0]);
+        target.resolveSplit(1, specularFbo);
+
+        GL_COUNT(glDisable(GL_DEPTH_TEST));
+        GL_COUNT(glBindVertexArray(emptyVao));
+        GL_COUNT(glUseProgram(blurProgram));
+        GL_COUNT(glUniform1f(blurPixelsPerUnit, pixelsPerUnit));
+        GL_COUNT(glViewport(0, 0, width, height));
+        GL_COUNT(glActiveTexture(GL_TEXTURE0 + SOURCE_UNIT));
+        for (int pass = 0; pass < 2; ++pass) {
+            GL_COUNT(glBindFramebuffer(GL_FRAMEBUFFER, fbos[1 - pass]));
+            GL_COUNT(glBindTexture(GL_TEXTURE_2D, textures[pass]));
+            GL_COUNT(glUniform2f(blurDirection, pass == 0 ? 1.0f : 0.0f, pass == 0 ? 0.0f : 1.0f));
+            GL_COUNT(glDrawArrays(GL_TRIANGLES, 0, 3));
+        }
+
+        target.bind();
+        target.selectOutputs(0);
+        GL_COUNT(glUseProgram(compositeProgram));
+        GL_COUNT(glUniform3f(compositeBackground, background.x, background.y, background.z));
+        GL_COUNT(glBindTexture(GL_TEXTURE_2D, textures[0]));
+        GL_COUNT(glActiveTexture(GL_TEXTURE0 + SPECULAR_UNIT));
+        GL_COUNT(glBindTexture(GL_TEXTURE_2D, specularTexture));
+        GL_COUNT(glDrawArrays(GL_TRIANGLES, 0, 3));
+        GL_COUNT(glBindVertexArray(0));
+        GL_COUNT(glEnable(GL_DEPTH_TEST));
+    }
+
+    // Burley's normalized diffusion R(r) = (e^(-r/d) + e^(-r/3d)) / (8 pi d r)
+    // with a per-channel d of scatteringDistance * albedo, where albedo is
+    // scattering / (scattering + absorption). Offsets are spread over
+    // +-3 d_max, denser near the centre; each sample's weight is the profile
+    // times the interval it stands for, normalized per channel. Entry 0 is
+    // the centre sample. Returns the kernel's world-space reach.
+    static float buildKernel(const UniformBlocks::Material& material, std::vector<glm::vec4>& kernel) {
+        glm::vec3 d = MaterialLuts::diffusionWidths(material);
+        float range = 3.0f * std::max(d.x, std::max(d.y, d.z));
+
+        std::vector<float> offsets(KERNEL_SIZE);
+        for (int i = 0; i < KERNEL_SIZE; ++i) {
+            float t = 2.0f * i / (KERNEL_SIZE - 1) - 1.0f;
+            offsets[i] = range * t * std::abs(t);
+        }
+
+        kernel.assign(KERNEL_SIZE, glm::vec4(0.0f));
+        glm::vec3 total(0.0f);
+        for (int i = 0; i < KERNEL_SIZE; ++i) {
+            float lo = i > 0 ? 0.5f * (offsets[i - 1] + offsets[i]) : offsets[i];
+            float hi = i + 1 < KERNEL_SIZE ? 0.5f * (offsets[i] + offsets[i + 1]) : offsets[i];
+            float r = std::max(std::abs(offsets[i]), 0.25f * (hi - lo));
+            glm::vec3 profile = (glm::exp(-r / d) + glm::exp(-r / (3.0f * d))) / (8.0f * 3.14159265f * d * r);
+            glm::vec3 weight = profile * (hi - lo);
+            kernel[i] = glm::vec4(weight, offsets[i]);
+            total += weight;
+        }
+        for (glm::vec4& k : kernel) {
+            k = glm::vec4(glm::vec3(k) / total, k.w);
+        }
+
+        std::swap(kernel[0], kernel[KERNEL_SIZE / 2]);
+        return range;
+    }
+
+private:
+    GLuint blurProgram = 0;
+    GLuint compositeProgram = 0;
+    GLint blurDirection = -1;
+    GLint blurPixelsPerUnit = -1;
+    GLint blurKernelRange = -1;
+    GLint blurKernel = -1;
+    GLint compositeMaterial = -1;
+    GLint compositeBackground = -1;
+    GLuint emptyVao = 0;
+    int materialIndex = -1;
+    float kernelRange = 1.0f;
+
+    int width = 0;
+    int height = 0;
+    // 0: resolved and fully blurred irradiance, 1: after the horizontal pass
+    GLuint textures[2] = {0, 0};
+    GLuint fbos[2] = {0, 0};
+    GLuint specularTexture = 0;
+    GLuint specularFbo = 0;
+
+    static GLuint createTarget(int w, int h, GLenum filter, GLuint& fbo) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        return texture;
+    }
+
+    void allocate(int w, int h) {
+        if (w == width && h == height && textures[0]) return;
+        if (textures[0]) {
+            glDeleteTextures(2, textures);
+            glDeleteFramebuffers(2, fbos);
+            glDeleteTextures(1, &specularTexture);
+            glDeleteFramebuffers(1, &specularFbo);
+        }
+        width = w;
+        height = h;
+        // Blur taps land between texels, so the irradiance targets filter
+        for (int i = 0; i < 2; ++i) textures[i] = createTarget(w, h, GL_LINEAR, fbos[i]);
+        specularTexture = createTarget(w, h, GL_NEAREST, specularFbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
@@ -0,0 +1,322 @@
+#pragma once
+
+#include "gl_counter.h"
+#include "render_target.h"
+#include "shader_cache.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+
+namespace TemporalShaders {
+
+// Reprojects last frame's light loop and colour through the scene pass's
+// motion vectors. The light loop only ran on some screen tiles this frame:
+// their pixels blend their fresh value into the history, the rest keep the
+// history, both clamped to fresh samples on the same surface. A shaded pixel
+// looks at its 3x3 neighbourhood; a skipped one has no fresh neighbours inside
+// its tile, so it looks at the same 3x3 pattern spaced a tile apart, which
+// always reaches a shaded tile. History from a different surface (view depth
+// doesn't match where the point was last frame) or from off screen is dropped,
+// and skipped pixels then take those fresh samples' average. The displayed
+// colour is accumulated the same way over the jittered frames, clamped to the
+// current neighbourhood, which antialiases edges in place of MSAA.
+const char* const resolveFragment = R"(
+#version 330 core
+layout (location = 0) out vec4 LightingHistory;
+layout (location = 1) out vec4 ColorHistory;
+
+uniform sampler2D ambient;
+uniform sampler2D lighting;
+uniform sampler2D motion;
+uniform sampler2D lightingHistory;
+uniform sampler2D colorHistory;
+uniform bool historyValid;
+uniform float lightingBlend;
+uniform float colorBlend;
+uniform vec3 background;
+
+// The forward shader's exposure, ACES, tint and gamma
+vec3 display(vec3 color) {
+    color *= 1.2;
+    color = (color * (2.51 * color + 0.03)) / (color * (2.43 * color + 0.59) + 0.14);
+    color *= vec3(1.05, 1.0, 0.95);
+    return pow(color, vec3(1.0 / 2.2));
+}
+
+bool onScreen(vec2 uv) {
+    return historyValid && all(greaterThanEqual(uv, vec2(0.0))) && all(lessThanEqual(uv, vec2(1.0)));
+}
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    ivec2 size = textureSize(ambient, 0);
+    vec2 uv = (vec2(p) + 0.5) / vec2(size);
+    vec4 center = texelFetch(ambient, p, 0);
+    vec4 own = texelFetch(lighting, p, 0);
+    int spacing = own.a > 0.0 ? 1 : TILE_SIZE;
+
+    // The nearest surface's pixel, whose motion the colour follows so edges
+    // move with the foreground
+    float nearest = 1e9;
+    ivec2 nearestPixel = p;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            ivec2 q = clamp(p + ivec2(x, y), ivec2(0), size - 1);
+            float depth = texelFetch(ambient, q, 0).a;
+            if (depth > 0.0 && depth < nearest) {
+                nearest = depth;
+                nearestPixel = q;
+            }
+        }
+    }
+
+    // Fresh light-loop samples on this surface
+    vec3 lightMin = vec3(1e9);
+    vec3 lightMax = vec3(-1e9);
+    vec3 lightSum = vec3(0.0);
+    float fresh = 0.0;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            ivec2 q = clamp(p + ivec2(x, y) * spacing, ivec2(0), size - 1);
+            float depth = texelFetch(ambient, q, 0).a;
+            vec4 l = texelFetch(lighting, q, 0);
+            if (depth > 0.0 && l.a > 0.0 && abs(depth - center.a) < 0.05 * center.a) {
+                lightMin = min(lightMin, l.rgb);
+                lightMax = max(lightMax, l.rgb);
+                lightSum += l.rgb;
+                fresh += 1.0;
+            }
+        }
+    }
+
+    vec3 lit = vec3(0.0);
+    if (center.a > 0.0) {
+        vec4 ownMotion = texelFetch(motion, p, 0);
+        vec2 previousUv = uv - ownMotion.xy;
+        vec4 previous = texture(lightingHistory, previousUv);
+        bool reused = onScreen(previousUv) && previous.a > 0.0 && abs(previous.a - ownMotion.z) < 0.05 * ownMotion.z;
+        vec3 history = fresh > 0.0 ? clamp(previous.rgb, lightMin, lightMax) : previous.rgb;
+        if (own.a > 0.0) {
+            lit = reused ? mix(history, own.rgb, lightingBlend) : own.rgb;
+        } else if (reused) {
+            lit = history;
+        } else if (fresh > 0.0) {
+            lit = lightSum / fresh;
+        }
+    }
+    LightingHistory = vec4(lit, center.a);
+
+    // Neighbours that skipped the light loop borrow this pixel's result
+    vec3 color = center.a > 0.0 ? display(center.rgb + lit) : background;
+    vec3 colorMin = color;
+    vec3 colorMax = color;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            ivec2 q = clamp(p + ivec2(x, y), ivec2(0), size - 1);
+            vec4 a = texelFetch(ambient, q, 0);
+            vec3 c = background;
+            if (a.a > 0.0) {
+                vec4 l = texelFetch(lighting, q, 0);
+                c = display(a.rgb + (l.a > 0.0 ? l.rgb : lit));
+            }
+            colorMin = min(colorMin, c);
+            colorMax = max(colorMax, c);
+        }
+    }
+
+    vec2 colorUv = uv - texelFetch(motion, nearestPixel, 0).xy;
+    if (onScreen(colorUv)) {
+        vec3 history = clamp(texture(colorHistory, colorUv).rgb, colorMin, colorMax);
+        color = mix(history, color, colorBlend);
+    }
+    ColorHistory = vec4(color, 1.0);
+}
+)";
+
+}
+
+// Temporal mode for the forward shading path. The scene pass renders one
+// sample per pixel with a sub-pixel jitter and writes the ambient term, the
+// light loop and motion vectors to separate targets, running the light loop on
+// only one TILE_SIZE x TILE_SIZE screen tile in rate per frame. This pass
+// reprojects the accumulated light loop and colour from the previous frame and
+// writes the result to the scene target's colour attachment.
+class TemporalReprojection {
+public:
+    static const GLuint AMBIENT_UNIT = 12;
+    static const GLuint LIGHTING_UNIT = 13;
+    static const GLuint MOTION_UNIT = 14;
+    static const GLuint LIGHTING_HISTORY_UNIT = 15;
+    static const GLuint COLOR_HISTORY_UNIT = 16;
+    // Side of the screen tiles that run or skip the light loop together.
+    // Masking single pixels saves nothing on SIMT hardware, where a quad or
+    // warp with any shaded lane pays for the whole loop; 8x8 tiles are
+    // quad-aligned and fill a 64-wide wave.
+    static const int TILE_SIZE = 8;
+    // Halton (2, 3) jitter sequence length
+    static const int JITTER_PHASES = 8;
+    static constexpr float LIGHTING_BLEND = 0.5f;
+    static constexpr float COLOR_BLEND = 0.1f;
+
+    bool create() {
+        program = linkProgram(fullscreenTriangleVertex, TemporalShaders::resolveFragment, {},
+                              {"TILE_SIZE " + std::to_string(TILE_SIZE)});
+        if (!program) return false;
+
+        historyValidLocation = glGetUniformLocation(program, "historyValid");
+        backgroundLocation = glGetUniformLocation(program, "background");
+
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "ambient"), AMBIENT_UNIT);
+        glUniform1i(glGetUniformLocation(program, "lighting"), LIGHTING_UNIT);
+        glUniform1i(glGetUniformLocation(program, "motion"), MOTION_UNIT);
+        glUniform1i(glGetUniformLocation(program, "lightingHistory"), LIGHTING_HISTORY_UNIT);
+        glUniform1i(glGetUniformLocation(program, "colorHistory"), COLOR_HISTORY_UNIT);
+        glUniform1f(glGetUniformLocation(program, "lightingBlend"), LIGHTING_BLEND);
+        glUniform1f(glGetUniformLocation(program, "colorBlend"), COLOR_BLEND);
+        glUseProgram(0);
+
+        glGenVertexArrays(1, &emptyVao);
+        return true;
+    }
+
+    // One in every rate 8x8 tiles runs the light loop each frame: 1 (every
+    // tile), 2 (a checkerboard of tiles) or 4 (one tile of each 2x2 block)
+    void setRate(int tilesPerShadedTile) {
+        rate = tilesPerShadedTile >= 4 ? 4 : tilesPerShadedTile >= 2 ? 2 : 1;
+        reset();
+    }
+
+    int getRate() const { return rate; }
+
+    // Drops the history; the next frame starts from its own samples only
+    void reset() { historyValid = false; }
+
+    // Sub-pixel offset for this frame's projection, in NDC
+    glm::vec2 jitter(int targetWidth, int targetHeight) const {
+        int index = int(frame % JITTER_PHASES) + 1;
+        return glm::vec2((halton(index, 2) - 0.5f) * 2.0f / float(targetWidth),
+                         (halton(index, 3) - 0.5f) * 2.0f / float(targetHeight));
+    }
+
+    // FrameData::temporal for this frame
+    glm::vec4 frameParams(const glm::vec2& frameJitter) const {
+        return glm::vec4(frameJitter, float(frame % 4), float(rate));
+    }
+
+    // Last frame's unjittered viewProjection, or the current one when there
+    // is no history to reproject into
+    glm::mat4 previousViewProjection(const glm::mat4& current) const {
+        return historyValid ? previous : current;
+    }
+
+    // Resolves the split scene outputs, reprojects and writes the displayed
+    // colour into the scene target, which must be single-sample. Leaves the
+    // scene framebuffer bound with depth testing on.
+    void apply(SceneTarget& target, const glm::mat4& viewProjection, const glm::vec3& background) {
+        allocate(target.getWidth(), target.getHeight());
+        for (int i = 0; i < 3; ++i) target.resolveSplit(i, inputFbos[i]);
+        int read = int(frame & 1);
+        int write = 1 - read;
+
+        GL_COUNT(glDisable(GL_DEPTH_TEST));
+        GL_COUNT(glBindFramebuffer(GL_FRAMEBUFFER, historyFbos[write]));
+        GL_COUNT(glViewport(0, 0, width, height));
+        GL_COUNT(glUseProgram(program));
+        GL_COUNT(glUniform1i(historyValidLocation, historyValid));
+        GL_COUNT(glUniform3f(backgroundLocation, background.x, background.y, background.z));
+        const GLuint units[5] = {AMBIENT_UNIT, LIGHTING_UNIT, MOTION_UNIT, LIGHTING_HISTORY_UNIT, COLOR_HISTORY_UNIT};
+        const GLuint sources[5] = {inputs[0], inputs[1], inputs[2], lightingHistory[read], colorHistory[read]};
+        for (int i = 0; i < 5; ++i) {
+            GL_COUNT(glActiveTexture(GL_TEXTURE0 + units[i]));
+            GL_COUNT(glBindTexture(GL_TEXTURE_2D, sources[i]));
+        }
+        GL_COUNT(glBindVertexArray(emptyVao));
+        GL_COUNT(glDrawArrays(GL_TRIANGLES, 0, 3));
+        GL_COUNT(glBindVertexArray(0));
+
+        target.copyColorFrom(historyFbos[write], GL_COLOR_ATTACHMENT1);
+        GL_COUNT(glEnable(GL_DEPTH_TEST));
+
+        previous = viewProjection;
+        historyValid = true;
+        frame++;
+    }
+
+private:
+    GLuint program = 0;
+    GLint historyValidLocation = -1;
+    GLint backgroundLocation = -1;
+    GLuint emptyVao = 0;
+    int rate = 2;
+    bool historyValid = false;
+    uint64_t frame = 0;
+    glm::mat4 previous = glm::mat4(1.0f);
+
+    int width = 0;
+    int height = 0;
+    // Resolved scene outputs: ambient, light loop, motion
+    GLuint inputs[3] = {0, 0, 0};
+    GLuint inputFbos[3] = {0, 0, 0};
+    // Ping-pong pairs, each framebuffer writing both histories
+    GLuint lightingHistory[2] = {0, 0};
+    GLuint colorHistory[2] = {0, 0};
+    GLuint historyFbos[2] = {0, 0};
+
+    static float halton(int index, int base) {
+        float result = 0.0f;
+        float fraction = 1.0f;
+        while (index > 0) {
+            fraction /= float(base);
+            result += fraction * float(index % base);
+            index /= base;
+        }
+        return result;
+    }
+
+    static GLuint createTexture(int w, int h, GLenum filter) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    void allocate(int w, int h) {
+        if (w == width && h == height && inputs[0]) return;
+        if (inputs[0]) {
+            glDeleteTextures(3, inputs);
+            glDeleteFramebuffers(3, inputFbos);
+            glDeleteTextures(2, lightingHistory);
+            glDeleteTextures(2, colorHistory);
+            glDeleteFramebuffers(2, historyFbos);
+        }
+        width = w;
+        height = h;
+        historyValid = false;
+
+        glGenFramebuffers(3, inputFbos);
+        for (int i = 0; i < 3; ++i) {
+            inputs[i] = createTexture(w, h, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, inputFbos[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, inputs[i], 0);
+        }
+        // History is read at reprojected positions between texels
+        static const GLenum historyTargets[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glGenFramebuffers(2, historyFbos);
+        for (int i = 0; i < 2; ++i) {
+            lightingHistory[i] = createTexture(w, h, GL_LINEAR);
+            colorHistory[i] = createTexture(w, h, GL_LINEAR);
+            glBindFramebuffer(GL_FRAMEBUFFER, historyFbos[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, lightingHistory[i], 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, colorHistory[i], 0);
+            glDrawBuffers(2, historyTargets);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "shader_cache.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace TextOverlayShaders {
+
+const char* const vertex = R"(
+#version 330 core
+layout (location = 0) in vec4 aRect;
+layout (location = 1) in uint aGlyph;
+layout (location = 2) in vec4 aColor;
+
+uniform vec2 viewport;
+
+out vec2 cellUv;
+flat out uint glyph;
+out vec4 color;
+
+void main() {
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    vec2 pixel = aRect.xy + corner * aRect.zw;
+    cellUv = corner;
+    glyph = aGlyph;
+    color = aColor;
+    gl_Position = vec4(pixel / viewport * vec2(2.0, -2.0) + vec2(-1.0, 1.0), 0.0, 1.0);
+}
+)";
+
+// 3x5 bitmap, bit 14 is the top-left pixel, rows top to bottom
+const char* const fragment = R"(
+#version 330 core
+in vec2 cellUv;
+flat in uint glyph;
+in vec4 color;
+
+out vec4 FragColor;
+
+void main() {
+    ivec2 cell = min(ivec2(cellUv * vec2(3.0, 5.0)), ivec2(2, 4));
+    uint bit = 14u - uint(cell.y * 3 + cell.x);
+    if (((glyph >> bit) & 1u) == 0u) discard;
+    FragColor = color;
+}
+)";
+
+}
+
+// Minimal screen-space text and box drawing for debug overlays: a built-in
+// 3x5 font for ASCII 32..95 (lower case is drawn as upper case), one
+// instanced quad per character or box, positions in pixels from the top left.
+class TextOverlay {
+public:
+    static const uint16_t SOLID = 0x7fff;
+    static const int GLYPH_WIDTH = 3;
+    static const int GLYPH_HEIGHT = 5;
+
+    bool create() {
+        program = linkProgram(TextOverlayShaders::vertex, TextOverlayShaders::fragment);
+        if (!program) return false;
+        viewportLocation = glGetUniformLocation(program, "viewport");
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &instanceBuffer);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Quad), (void*)offsetof(Quad, rect));
+        glVertexAttribDivisor(0, 1);
+        glEnableVertexAttribArray(1);
+        glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(Quad), (void*)offsetof(Quad, glyph));
+        glVertexAttribDivisor(1, 1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Quad), (void*)offsetof(Quad, color));
+        glVertexAttribDivisor(2, 1);
+        glBindVertexArray(0);
+        return true;
+    }
+
+    void clear() { quads.clear(); }
+
+    // Returns the x just past the last character
+    float text(float x, float y, const std::string& str, const glm::vec4& color, float scale = 2.0f) {
+        uint32_t packed = packColor(color);
+        for (char c : str) {
+            uint16_t glyph = glyphFor(c);
+            if (glyph != 0) {
+                quads.push_back({glm::vec4(x, y, GLYPH_WIDTH * scale, GLYPH_HEIGHT * scale), glyph, packed});
+            }
+            x += (GLYPH_WIDTH + 1) * scale;
+        }
+        return x;
+    }
+
+    void box(float x, float y, float width, float height, const glm::vec4& color) {
+        quads.push_back({glm::vec4(x, y, width, height), SOLID, packColor(color)});
+    }
+
+    static float textWidth(size_t characters, float scale = 2.0f) {
+        return characters * (GLYPH_WIDTH + 1) * scale;
+    }
+
+    // Draws into the currently bound framebuffer; restores depth test and blending
+    void draw(int width, int height) {
+        if (quads.empty() || !program) return;
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, quads.size() * sizeof(Quad), quads.data(), GL_STREAM_DRAW);
+
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glUseProgram(program);
+        glUniform2f(viewportLocation, float(width), float(height));
+        glBindVertexArray(vao);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(quads.size()));
+        glBindVertexArray(0);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+private:
+    struct Quad {
+        glm::vec4 rect;
+        uint32_t glyph;
+        uint32_t color;
+    };
+
+    GLuint program = 0;
+    GLint viewportLocation = -1;
+    GLuint vao = 0;
+    GLuint instanceBuffer = 0;
+    std::vector<Quad> quads;
+
+    static uint32_t packColor(const glm::vec4& color) {
+        glm::vec4 c = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+        return uint32_t(c.r) | (uint32_t(c.g) << 8) | (uint32_t(c.b) << 16) | (uint32_t(c.a) << 24);
+    }
+
+    static uint16_t glyphFor(char c) {
+        static const uint16_t GLYPHS[64] = {
+            0x0000, 0x2482, 0x5a00, 0x5f7d, 0x3c9e, 0x52a5, 0x2aab, 0x2400,
+            0x2922, 0x224a, 0x55d5, 0x05d0, 0x0014, 0x01c0, 0x0002, 0x12a4,
+            0x7b6f, 0x2c97, 0x73e7, 0x73cf, 0x5bc9, 0x79cf, 0x79ef, 0x7249,
+            0x7bef, 0x7bcf, 0x0410, 0x0414, 0x1511, 0x0e38, 0x4454, 0x7282,
+            0x7be3, 0x2bed, 0x6bae, 0x3923, 0x6b6e, 0x79a7, 0x79a4, 0x396b,
+            0x5bed, 0x7497, 0x126a, 0x5bad, 0x4927, 0x5fed, 0x6b6d, 0x2b6a,
+            0x6ba4, 0x2b73, 0x6bad, 0x388e, 0x7492, 0x5b6f, 0x5b6a, 0x5bfd,
+            0x5aad, 0x5a92, 0x72a7, 0x6926, 0x4889, 0x324b, 0x2a00, 0x0007,
+        };
+        int code = std::toupper(static_cast<unsigned char>(c));
+        if (code < 32 || code > 95) code = '?';
+        return GLYPHS[code - 32];
+    }
+};
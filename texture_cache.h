@@ -0,0 +1,335 @@
+#pragma once
+
+#include "image_decode.h"
+#include "mesh_cache.h"
+#include "texture_compress.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// On-disk cache of transcoded textures, one KTX2 file per source image (plus
+// alpha mask). Files follow the KTX2 layout: header, level index, a basic data
+// format descriptor, key/value data and the mip levels stored smallest first,
+// so streaming from the coarsest level reads the file front to back. A
+// "SSSsource" key records the source files' size and mtime and the encoder
+// version; a mismatch means the texture is transcoded again.
+namespace TextureCache {
+
+const uint8_t IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+// Bump when the encoders' output changes
+const uint32_t ENCODER_VERSION = 1;
+
+// Vulkan format numbers KTX2 identifies formats by
+const uint32_t VK_FORMAT_BC1_RGB_SRGB_BLOCK = 132;
+const uint32_t VK_FORMAT_BC5_UNORM_BLOCK = 141;
+const uint32_t VK_FORMAT_BC7_SRGB_BLOCK = 146;
+
+struct Header {
+    uint8_t identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+static_assert(sizeof(Header) == 80, "KTX2 header is 80 bytes");
+
+struct LevelIndex {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+// What a cached texture was built from: a colour or normal map, and for
+// colour maps an optional separate alpha mask (OBJ map_d)
+struct Source {
+    std::string path;
+    std::string maskPath;
+    TextureCompress::Kind kind = TextureCompress::Kind::Color;
+};
+
+// A validated cache file. Level data points into the mapping.
+struct Texture {
+    std::shared_ptr<MappedFile> file;
+    TextureCompress::Format format = TextureCompress::Format::BC1_SRGB;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    struct Level {
+        const uint8_t* data;
+        size_t bytes;
+        uint32_t width;
+        uint32_t height;
+    };
+    std::vector<Level> levels;
+};
+
+inline uint32_t vkFormatFor(TextureCompress::Format format) {
+    switch (format) {
+    case TextureCompress::Format::BC1_SRGB: return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+    case TextureCompress::Format::BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+    case TextureCompress::Format::BC7_SRGB: return VK_FORMAT_BC7_SRGB_BLOCK;
+    }
+    return 0;
+}
+
+inline bool formatFor(uint32_t vkFormat, TextureCompress::Format& format) {
+    switch (vkFormat) {
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK: format = TextureCompress::Format::BC1_SRGB; return true;
+    case VK_FORMAT_BC5_UNORM_BLOCK: format = TextureCompress::Format::BC5; return true;
+    case VK_FORMAT_BC7_SRGB_BLOCK: format = TextureCompress::Format::BC7_SRGB; return true;
+    }
+    return false;
+}
+
+inline std::string fileStamp(const std::string& path) {
+    struct stat st;
+    if (path.empty() || stat(path.c_str(), &st) != 0) return "-";
+    long long mtimeNs = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return std::to_string((long long)st.st_size) + "@" + std::to_string(mtimeNs);
+}
+
+// Value of the SSSsource key; empty if the source image is missing
+inline std::string sourceKey(const Source& source) {
+    struct stat st;
+    if (stat(source.path.c_str(), &st) != 0) return std::string();
+    return "v" + std::to_string(ENCODER_VERSION) + " kind " + std::to_string(uint32_t(source.kind)) + " " +
+           source.path + " " + fileStamp(source.path) + " mask " + source.maskPath + " " + fileStamp(source.maskPath);
+}
+
+inline std::string cachePathFor(const Source& source) {
+    uint64_t hash = 1469598103934665603ULL;
+    std::string identity = source.path + '\n' + source.maskPath + '\n' + std::to_string(uint32_t(source.kind));
+    for (unsigned char c : identity) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.ktx2", (unsigned long long)hash);
+    return std::string(".cache/textures/") + name;
+}
+
+// Basic descriptor block for the three block formats: colour model, transfer
+// function and one sample per stored channel
+inline std::vector<uint32_t> dataFormatDescriptor(TextureCompress::Format format) {
+    const uint32_t MODEL_BC1A = 128, MODEL_BC5 = 132, MODEL_BC7 = 134;
+    const uint32_t PRIMARIES_BT709 = 1, TRANSFER_LINEAR = 1, TRANSFER_SRGB = 2;
+    bool bc5 = format == TextureCompress::Format::BC5;
+    uint32_t model = bc5 ? MODEL_BC5 : format == TextureCompress::Format::BC7_SRGB ? MODEL_BC7 : MODEL_BC1A;
+    uint32_t transfer = bc5 ? TRANSFER_LINEAR : TRANSFER_SRGB;
+    uint32_t blockBits = uint32_t(TextureCompress::blockBytes(format) * 8);
+    uint32_t samples = bc5 ? 2 : 1;
+    uint32_t blockSize = 24 + 16 * samples;
+
+    std::vector<uint32_t> words;
+    words.push_back(4 + blockSize);
+    words.push_back(0);                               // vendor 0 (Khronos), descriptor type 0 (basic)
+    words.push_back(2u | (blockSize << 16));          // version 2
+    words.push_back(model | (PRIMARIES_BT709 << 8) | (transfer << 16));
+    words.push_back(3u | (3u << 8));                  // 4x4 texel blocks
+    words.push_back(blockBits / 8);                   // bytes in plane 0
+    words.push_back(0);
+    for (uint32_t s = 0; s < samples; ++s) {
+        uint32_t sampleBits = blockBits / samples;
+        words.push_back((s * sampleBits) | ((sampleBits - 1) << 16) | (s << 24));
+        words.push_back(0);                           // sample position
+        words.push_back(0);                           // lower
+        words.push_back(0xFFFFFFFFu);                 // upper
+    }
+    return words;
+}
+
+inline void appendKeyValue(std::vector<uint8_t>& kvd, const std::string& key, const std::string& value) {
+    uint32_t length = uint32_t(key.size() + 1 + value.size() + 1);
+    const uint8_t* lengthBytes = reinterpret_cast<const uint8_t*>(&length);
+    kvd.insert(kvd.end(), lengthBytes, lengthBytes + 4);
+    kvd.insert(kvd.end(), key.begin(), key.end());
+    kvd.push_back(0);
+    kvd.insert(kvd.end(), value.begin(), value.end());
+    kvd.push_back(0);
+    while (kvd.size() % 4) kvd.push_back(0);
+}
+
+inline bool findKeyValue(const uint8_t* kvd, size_t length, const std::string& key, std::string& value) {
+    size_t cursor = 0;
+    while (cursor + 4 <= length) {
+        uint32_t entry;
+        memcpy(&entry, kvd + cursor, 4);
+        if (entry > length - cursor - 4) return false;
+        const char* text = reinterpret_cast<const char*>(kvd + cursor + 4);
+        size_t keyLength = strnlen(text, entry);
+        if (keyLength < entry && key == std::string(text, keyLength)) {
+            const char* v = text + keyLength + 1;
+            value.assign(v, strnlen(v, entry - keyLength - 1));
+            return true;
+        }
+        cursor += 4 + ((size_t(entry) + 3) & ~size_t(3));
+    }
+    return false;
+}
+
+inline bool write(const std::string& path, const std::string& key, TextureCompress::Format format,
+                  const std::vector<TextureCompress::Level>& levels) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+    std::vector<uint32_t> dfd = dataFormatDescriptor(format);
+    std::vector<uint8_t> kvd;
+    appendKeyValue(kvd, "KTXorientation", "rd");
+    appendKeyValue(kvd, "KTXwriter", "sss_demo texture cache");
+    appendKeyValue(kvd, "SSSsource", key);
+
+    Header header = {};
+    memcpy(header.identifier, IDENTIFIER, sizeof(IDENTIFIER));
+    header.vkFormat = vkFormatFor(format);
+    header.typeSize = 1;
+    header.pixelWidth = levels[0].width;
+    header.pixelHeight = levels[0].height;
+    header.faceCount = 1;
+    header.levelCount = uint32_t(levels.size());
+    header.dfdByteOffset = uint32_t(sizeof(Header) + levels.size() * sizeof(LevelIndex));
+    header.dfdByteLength = uint32_t(dfd.size() * 4);
+    header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+    header.kvdByteLength = uint32_t(kvd.size());
+
+    // Level data smallest first, each aligned to the block size
+    size_t alignment = TextureCompress::blockBytes(format);
+    size_t cursor = header.kvdByteOffset + header.kvdByteLength;
+    std::vector<LevelIndex> index(levels.size());
+    for (size_t l = levels.size(); l-- > 0;) {
+        cursor = MeshCache::alignUp(cursor, alignment);
+        index[l] = {cursor, levels[l].data.size(), levels[l].data.size()};
+        cursor += levels[l].data.size();
+    }
+
+    std::string tmpPath = path + ".tmp" + std::to_string(getpid());
+    FILE* f = fopen(tmpPath.c_str(), "wb");
+    if (!f) return false;
+    static const uint8_t zeros[16] = {};
+    size_t written = 0;
+    auto put = [&](const void* data, size_t bytes) {
+        if (bytes && fwrite(data, 1, bytes, f) != bytes) return false;
+        written += bytes;
+        return true;
+    };
+    bool ok = put(&header, sizeof(header)) && put(index.data(), index.size() * sizeof(LevelIndex)) &&
+              put(dfd.data(), dfd.size() * 4) && put(kvd.data(), kvd.size());
+    for (size_t l = levels.size(); ok && l-- > 0;) {
+        ok = put(zeros, size_t(index[l].byteOffset) - written) && put(levels[l].data.data(), levels[l].data.size());
+    }
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Maps a cache file and checks it against the expected key and its own
+// level layout
+inline bool open(const std::string& path, const std::string& key, Texture& out) {
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(path)) return false;
+    const uint8_t* base = file->data();
+    size_t size = file->size();
+    if (!base || size < sizeof(Header)) return false;
+
+    Header header;
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.identifier, IDENTIFIER, sizeof(IDENTIFIER)) != 0) return false;
+    if (!formatFor(header.vkFormat, out.format) || header.supercompressionScheme != 0) return false;
+    if (header.levelCount == 0 || header.levelCount > 32 || header.pixelWidth == 0 || header.pixelHeight == 0) return false;
+    if (sizeof(Header) + header.levelCount * sizeof(LevelIndex) > size) return false;
+    if (uint64_t(header.kvdByteOffset) + header.kvdByteLength > size) return false;
+
+    std::string stored;
+    if (!findKeyValue(base + header.kvdByteOffset, header.kvdByteLength, "SSSsource", stored) || stored != key) {
+        return false;
+    }
+
+    std::vector<LevelIndex> index(header.levelCount);
+    memcpy(index.data(), base + sizeof(Header), index.size() * sizeof(LevelIndex));
+    out.width = header.pixelWidth;
+    out.height = header.pixelHeight;
+    out.levels.clear();
+    for (uint32_t l = 0; l < header.levelCount; ++l) {
+        uint32_t w = std::max(1u, header.pixelWidth >> l);
+        uint32_t h = std::max(1u, header.pixelHeight >> l);
+        size_t expected = TextureCompress::levelBytes(out.format, w, h);
+        if (index[l].byteLength != expected || index[l].byteOffset + index[l].byteLength > size) return false;
+        out.levels.push_back({base + index[l].byteOffset, expected, w, h});
+    }
+    out.file = std::move(file);
+    return true;
+}
+
+struct TranscodeStats {
+    bool cached = false;
+    double decodeMs = 0.0;
+    double compressMs = 0.0;
+};
+
+// Returns the cached texture for source, transcoding it first if the cache
+// is missing or stale
+inline bool load(const Source& source, Texture& out, std::string& error, TranscodeStats* stats = nullptr) {
+    std::string key = sourceKey(source);
+    if (key.empty()) {
+        error = "missing texture " + source.path;
+        return false;
+    }
+    std::string path = cachePathFor(source);
+    if (open(path, key, out)) {
+        if (stats) stats->cached = true;
+        return true;
+    }
+
+    auto decodeStart = std::chrono::steady_clock::now();
+    ImageDecode::Image image;
+    if (!ImageDecode::load(source.path, image, error)) {
+        error = source.path + ": " + error;
+        return false;
+    }
+    if (!source.maskPath.empty()) {
+        ImageDecode::Image mask;
+        std::string maskError;
+        if (ImageDecode::load(source.maskPath, mask, maskError) && mask.width == image.width &&
+            mask.height == image.height) {
+            for (size_t i = 0; i < size_t(image.width) * image.height; ++i) {
+                image.rgba[i * 4 + 3] = mask.rgba[i * 4];
+            }
+            image.channels = 4;
+        }
+    }
+    auto compressStart = std::chrono::steady_clock::now();
+
+    std::vector<TextureCompress::Level> levels;
+    TextureCompress::Format format = TextureCompress::compressMipChain(image, source.kind, levels);
+    if (stats) {
+        stats->decodeMs = std::chrono::duration<double, std::milli>(compressStart - decodeStart).count();
+        stats->compressMs =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compressStart).count();
+    }
+    if (!write(path, key, format, levels) || !open(path, key, out)) {
+        error = "could not write texture cache " + path;
+        return false;
+    }
+    return true;
+}
+
+}
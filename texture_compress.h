@@ -0,0 +1,468 @@
+#pragma once
+
+#include "image_decode.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Block compression and mip generation for the texture cache. Colour maps
+// become BC1 (opaque) or BC7 (with alpha), both sRGB; normal maps become BC5
+// holding X and Y, with Z rebuilt in the shader. Grayscale bump maps are
+// turned into normal maps first. The encoders are single-pass range fits
+// along each block's principal axis, chosen for transcode speed; every mip
+// level is split into block rows that are encoded on all cores.
+namespace TextureCompress {
+
+enum class Kind : uint32_t {
+    Color = 0,
+    Normal = 1
+};
+
+enum class Format : uint32_t {
+    BC1_SRGB = 0,
+    BC5 = 1,
+    BC7_SRGB = 2
+};
+
+inline size_t blockBytes(Format format) {
+    return format == Format::BC1_SRGB ? 8 : 16;
+}
+
+inline size_t levelBytes(Format format, uint32_t width, uint32_t height) {
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+struct Level {
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> data;
+};
+
+// Bump maps are stored as heights; this is how steep a full 0..1 step
+// between neighbouring texels becomes
+const float BUMP_STRENGTH = 4.0f;
+
+// Alpha-tested coverage at this reference survives down the mip chain
+const float ALPHA_REFERENCE = 0.5f;
+
+inline const float* srgbToLinearTable() {
+    static float table[256];
+    static bool init = [] {
+        for (int i = 0; i < 256; ++i) {
+            float c = i / 255.0f;
+            table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return true;
+    }();
+    (void)init;
+    return table;
+}
+
+inline uint8_t linearToSrgb(float c) {
+    c = std::min(std::max(c, 0.0f), 1.0f);
+    float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    return uint8_t(s * 255.0f + 0.5f);
+}
+
+inline bool hasTranslucency(const ImageDecode::Image& image) {
+    for (size_t i = 3; i < image.rgba.size(); i += 4) {
+        if (image.rgba[i] < 250) return true;
+    }
+    return false;
+}
+
+// Bump maps saved as RGB carry the same value in every channel
+inline bool isGrayscale(const ImageDecode::Image& image) {
+    for (size_t i = 0; i < image.rgba.size(); i += 4) {
+        if (image.rgba[i] != image.rgba[i + 1] || image.rgba[i] != image.rgba[i + 2]) return false;
+    }
+    return true;
+}
+
+// Heights from the red channel to a tangent-space normal map in the OpenGL
+// convention authored maps use: X to the right, Y up the image
+inline void heightToNormals(ImageDecode::Image& image) {
+    uint32_t w = image.width, h = image.height;
+    std::vector<float> height(size_t(w) * h);
+    for (size_t i = 0; i < height.size(); ++i) height[i] = image.rgba[i * 4] / 255.0f;
+    auto at = [&](int x, int y) {
+        x = (x % int(w) + int(w)) % int(w);
+        y = (y % int(h) + int(h)) % int(h);
+        return height[size_t(y) * w + size_t(x)];
+    };
+    parallelFor(h, 64, [&](size_t begin, size_t end, unsigned) {
+        for (size_t y = begin; y < end; ++y) {
+            for (uint32_t x = 0; x < w; ++x) {
+                int ix = int(x), iy = int(y);
+                float dx = (at(ix + 1, iy - 1) + 2.0f * at(ix + 1, iy) + at(ix + 1, iy + 1) -
+                            at(ix - 1, iy - 1) - 2.0f * at(ix - 1, iy) - at(ix - 1, iy + 1)) / 8.0f;
+                float dy = (at(ix - 1, iy + 1) + 2.0f * at(ix, iy + 1) + at(ix + 1, iy + 1) -
+                            at(ix - 1, iy - 1) - 2.0f * at(ix, iy - 1) - at(ix + 1, iy - 1)) / 8.0f;
+                float nx = -dx * BUMP_STRENGTH, ny = dy * BUMP_STRENGTH;
+                float inv = 1.0f / std::sqrt(nx * nx + ny * ny + 1.0f);
+                uint8_t* d = &image.rgba[(y * w + x) * 4];
+                d[0] = uint8_t((nx * inv * 0.5f + 0.5f) * 255.0f + 0.5f);
+                d[1] = uint8_t((ny * inv * 0.5f + 0.5f) * 255.0f + 0.5f);
+                d[2] = uint8_t((inv * 0.5f + 0.5f) * 255.0f + 0.5f);
+                d[3] = 255;
+            }
+        }
+    });
+    image.channels = 3;
+}
+
+// Fraction of texels that pass an alpha test at ALPHA_REFERENCE / scale
+inline float alphaCoverage(const std::vector<uint8_t>& rgba, float scale) {
+    size_t passed = 0, count = rgba.size() / 4;
+    for (size_t i = 0; i < count; ++i) {
+        if (rgba[i * 4 + 3] / 255.0f * scale >= ALPHA_REFERENCE) passed++;
+    }
+    return count ? float(passed) / float(count) : 0.0f;
+}
+
+// Scales alpha so the level passes the alpha test as often as level 0 did;
+// plain averaging would make foliage thin out with distance
+inline void preserveCoverage(std::vector<uint8_t>& rgba, float target) {
+    float lo = 0.0f, hi = 4.0f;
+    for (int i = 0; i < 10; ++i) {
+        float mid = 0.5f * (lo + hi);
+        (alphaCoverage(rgba, mid) < target ? lo : hi) = mid;
+    }
+    for (size_t i = 3; i < rgba.size(); i += 4) {
+        rgba[i] = uint8_t(std::min(255.0f, rgba[i] * hi + 0.5f));
+    }
+}
+
+// Box-filters one level into the next. Colour is averaged in linear space;
+// normals are averaged as vectors and renormalized.
+inline void downsample(const std::vector<uint8_t>& src, uint32_t w, uint32_t h, Kind kind, std::vector<uint8_t>& dst,
+                       uint32_t& outW, uint32_t& outH) {
+    outW = std::max(1u, w / 2);
+    outH = std::max(1u, h / 2);
+    dst.resize(size_t(outW) * outH * 4);
+    const float* toLinear = srgbToLinearTable();
+    parallelFor(outH, 32, [&](size_t begin, size_t end, unsigned) {
+        for (size_t y = begin; y < end; ++y) {
+            for (uint32_t x = 0; x < outW; ++x) {
+                float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                for (uint32_t dy = 0; dy < 2; ++dy) {
+                    for (uint32_t dx = 0; dx < 2; ++dx) {
+                        uint32_t sx = std::min(w - 1, uint32_t(x) * 2 + dx);
+                        uint32_t sy = std::min(h - 1, uint32_t(y) * 2 + dy);
+                        const uint8_t* s = &src[(size_t(sy) * w + sx) * 4];
+                        for (int c = 0; c < 3; ++c) {
+                            sum[c] += kind == Kind::Color ? toLinear[s[c]] : s[c] / 127.5f - 1.0f;
+                        }
+                        sum[3] += s[3];
+                    }
+                }
+                uint8_t* d = &dst[(y * outW + x) * 4];
+                if (kind == Kind::Color) {
+                    for (int c = 0; c < 3; ++c) d[c] = linearToSrgb(sum[c] * 0.25f);
+                } else {
+                    float len = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                    float inv = len > 0.0f ? 1.0f / len : 0.0f;
+                    for (int c = 0; c < 3; ++c) d[c] = uint8_t((sum[c] * inv * 0.5f + 0.5f) * 255.0f + 0.5f);
+                }
+                d[3] = uint8_t(sum[3] * 0.25f + 0.5f);
+            }
+        }
+    });
+}
+
+inline void loadBlock(const std::vector<uint8_t>& rgba, uint32_t w, uint32_t h, uint32_t bx, uint32_t by,
+                      uint8_t block[16][4]) {
+    for (uint32_t y = 0; y < 4; ++y) {
+        for (uint32_t x = 0; x < 4; ++x) {
+            uint32_t sx = std::min(w - 1, bx * 4 + x);
+            uint32_t sy = std::min(h - 1, by * 4 + y);
+            memcpy(block[y * 4 + x], &rgba[(size_t(sy) * w + sx) * 4], 4);
+        }
+    }
+}
+
+// Principal axis of the block's first `channels` channels by power iteration,
+// returned with the mean
+inline void principalAxis(const uint8_t block[16][4], int channels, float mean[4], float axis[4]) {
+    for (int c = 0; c < 4; ++c) mean[c] = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < channels; ++c) mean[c] += block[i][c];
+    }
+    for (int c = 0; c < channels; ++c) mean[c] /= 16.0f;
+
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; ++i) {
+        float d[4];
+        for (int c = 0; c < channels; ++c) d[c] = block[i][c] - mean[c];
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) cov[a][b] += d[a] * d[b];
+        }
+    }
+
+    // Start from the largest-variance channel so flat blocks converge at once
+    for (int c = 0; c < 4; ++c) axis[c] = 0.0f;
+    int start = 0;
+    for (int c = 1; c < channels; ++c) {
+        if (cov[c][c] > cov[start][start]) start = c;
+    }
+    axis[start] = 1.0f;
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = {};
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) next[a] += cov[a][b] * axis[b];
+        }
+        float len = 0.0f;
+        for (int c = 0; c < channels; ++c) len += next[c] * next[c];
+        if (len <= 1e-12f) break;
+        len = 1.0f / std::sqrt(len);
+        for (int c = 0; c < channels; ++c) axis[c] = next[c] * len;
+    }
+}
+
+inline uint16_t to565(const float c[3]) {
+    auto q = [](float v, int bits) {
+        int maxValue = (1 << bits) - 1;
+        return std::min(maxValue, std::max(0, int(v / 255.0f * maxValue + 0.5f)));
+    };
+    return uint16_t((q(c[0], 5) << 11) | (q(c[1], 6) << 5) | q(c[2], 5));
+}
+
+inline void from565(uint16_t v, int out[3]) {
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+inline void encodeBC1(const uint8_t block[16][4], uint8_t* out) {
+    float mean[4], axis[4];
+    principalAxis(block, 3, mean, axis);
+    float lo = 0.0f, hi = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.0f;
+        for (int c = 0; c < 3; ++c) t += (block[i][c] - mean[c]) * axis[c];
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+    }
+    // Inset the range a little: the extremes are rarely worth a full endpoint
+    float inset = (hi - lo) / 32.0f;
+    float e0[3], e1[3];
+    for (int c = 0; c < 3; ++c) {
+        e0[c] = mean[c] + axis[c] * (hi - inset);
+        e1[c] = mean[c] + axis[c] * (lo + inset);
+    }
+    uint16_t c0 = to565(e0), c1 = to565(e1);
+    if (c0 < c1) std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int p0[3], p1[3];
+        from565(c0, p0);
+        from565(c1, p1);
+        int palette[4][3];
+        for (int c = 0; c < 3; ++c) {
+            palette[0][c] = p0[c];
+            palette[1][c] = p1[c];
+            palette[2][c] = (2 * p0[c] + p1[c]) / 3;
+            palette[3][c] = (p0[c] + 2 * p1[c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestError = 1 << 30;
+            for (int k = 0; k < 4; ++k) {
+                int error = 0;
+                for (int c = 0; c < 3; ++c) {
+                    int d = block[i][c] - palette[k][c];
+                    error += d * d;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    best = k;
+                }
+            }
+            indices |= uint32_t(best) << (i * 2);
+        }
+    }
+    out[0] = uint8_t(c0);
+    out[1] = uint8_t(c0 >> 8);
+    out[2] = uint8_t(c1);
+    out[3] = uint8_t(c1 >> 8);
+    memcpy(out + 4, &indices, 4);
+}
+
+// One BC4 block from channel `channel` (8-value mode)
+inline void encodeBC4(const uint8_t block[16][4], int channel, uint8_t* out) {
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; ++i) {
+        lo = std::min(lo, int(block[i][channel]));
+        hi = std::max(hi, int(block[i][channel]));
+    }
+    out[0] = uint8_t(hi);
+    out[1] = uint8_t(lo);
+    uint64_t bits = 0;
+    if (hi > lo) {
+        for (int i = 0; i < 16; ++i) {
+            // Steps from the low endpoint: 0 is e1 (code 1), 7 is e0 (code 0)
+            int step = (int(block[i][channel] - lo) * 14 + (hi - lo)) / (2 * (hi - lo));
+            uint64_t code = step == 7 ? 0 : step == 0 ? 1 : uint64_t(8 - step);
+            bits |= code << (i * 3);
+        }
+    }
+    for (int b = 0; b < 6; ++b) out[2 + b] = uint8_t(bits >> (b * 8));
+}
+
+inline void encodeBC5(const uint8_t block[16][4], uint8_t* out) {
+    encodeBC4(block, 0, out);
+    encodeBC4(block, 1, out + 8);
+}
+
+// Little-endian bit writer for BC7's 128-bit blocks
+struct BlockBits {
+    uint8_t* out;
+    int position = 0;
+
+    void put(uint32_t value, int count) {
+        for (int i = 0; i < count; ++i, ++position) {
+            if (value & (1u << i)) out[position >> 3] |= uint8_t(1u << (position & 7));
+        }
+    }
+};
+
+// BC7 mode 6: one subset, RGBA endpoints of 7 bits plus a per-endpoint
+// p-bit, 4-bit indices. Good for smooth colour with alpha, which is what the
+// alpha-tested model textures are.
+inline void encodeBC7(const uint8_t block[16][4], uint8_t* out) {
+    static const int WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    float mean[4], axis[4];
+    principalAxis(block, 4, mean, axis);
+    float lo = 0.0f, hi = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.0f;
+        for (int c = 0; c < 4; ++c) t += (block[i][c] - mean[c]) * axis[c];
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+    }
+
+    int q[2][4], p[2];
+    for (int e = 0; e < 2; ++e) {
+        float value[4];
+        for (int c = 0; c < 4; ++c) {
+            value[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * (e == 0 ? lo : hi)));
+        }
+        int bestError = 1 << 30;
+        for (int pbit = 0; pbit < 2; ++pbit) {
+            int candidate[4], error = 0;
+            for (int c = 0; c < 4; ++c) {
+                candidate[c] = std::min(127, std::max(0, int((value[c] - pbit) / 2.0f + 0.5f)));
+                int d = ((candidate[c] << 1) | pbit) - int(value[c] + 0.5f);
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                p[e] = pbit;
+                memcpy(q[e], candidate, sizeof(candidate));
+            }
+        }
+    }
+
+    int endpoint[2][4];
+    for (int e = 0; e < 2; ++e) {
+        for (int c = 0; c < 4; ++c) endpoint[e][c] = (q[e][c] << 1) | p[e];
+    }
+    int palette[16][4];
+    for (int k = 0; k < 16; ++k) {
+        for (int c = 0; c < 4; ++c) {
+            palette[k][c] = ((64 - WEIGHTS[k]) * endpoint[0][c] + WEIGHTS[k] * endpoint[1][c] + 32) >> 6;
+        }
+    }
+    int indices[16];
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, bestError = 1 << 30;
+        for (int k = 0; k < 16; ++k) {
+            int error = 0;
+            for (int c = 0; c < 4; ++c) {
+                int d = block[i][c] - palette[k][c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                best = k;
+            }
+        }
+        indices[i] = best;
+    }
+
+    // The first index is stored without its top bit, so it must be below 8
+    if (indices[0] >= 8) {
+        std::swap(q[0], q[1]);
+        std::swap(p[0], p[1]);
+        for (int i = 0; i < 16; ++i) indices[i] = 15 - indices[i];
+    }
+
+    memset(out, 0, 16);
+    BlockBits bits{out};
+    bits.put(1u << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        bits.put(uint32_t(q[0][c]), 7);
+        bits.put(uint32_t(q[1][c]), 7);
+    }
+    bits.put(uint32_t(p[0]), 1);
+    bits.put(uint32_t(p[1]), 1);
+    bits.put(uint32_t(indices[0]), 3);
+    for (int i = 1; i < 16; ++i) bits.put(uint32_t(indices[i]), 4);
+}
+
+inline void compressLevel(const std::vector<uint8_t>& rgba, uint32_t w, uint32_t h, Format format,
+                          std::vector<uint8_t>& out) {
+    uint32_t blocksX = (w + 3) / 4, blocksY = (h + 3) / 4;
+    size_t bytes = blockBytes(format);
+    out.resize(size_t(blocksX) * blocksY * bytes);
+    parallelFor(blocksY, 16, [&](size_t begin, size_t end, unsigned) {
+        uint8_t block[16][4];
+        for (size_t by = begin; by < end; ++by) {
+            for (uint32_t bx = 0; bx < blocksX; ++bx) {
+                loadBlock(rgba, w, h, bx, uint32_t(by), block);
+                uint8_t* dst = &out[(by * blocksX + bx) * bytes];
+                switch (format) {
+                case Format::BC1_SRGB: encodeBC1(block, dst); break;
+                case Format::BC5: encodeBC5(block, dst); break;
+                case Format::BC7_SRGB: encodeBC7(block, dst); break;
+                }
+            }
+        }
+    });
+}
+
+// Picks the format, then builds and compresses the full mip chain down to 1x1
+inline Format compressMipChain(ImageDecode::Image& image, Kind kind, std::vector<Level>& levels) {
+    if (kind == Kind::Normal && (image.channels <= 2 || isGrayscale(image))) heightToNormals(image);
+    bool alpha = kind == Kind::Color && hasTranslucency(image);
+    Format format = kind == Kind::Normal ? Format::BC5 : alpha ? Format::BC7_SRGB : Format::BC1_SRGB;
+    float coverage = alpha ? alphaCoverage(image.rgba, 1.0f) : 0.0f;
+
+    levels.clear();
+    std::vector<uint8_t> current = std::move(image.rgba);
+    std::vector<uint8_t> next;
+    uint32_t w = image.width, h = image.height;
+    while (true) {
+        Level level;
+        level.width = w;
+        level.height = h;
+        compressLevel(current, w, h, format, level.data);
+        levels.push_back(std::move(level));
+        if (w == 1 && h == 1) break;
+
+        uint32_t nextW, nextH;
+        downsample(current, w, h, kind, next, nextW, nextH);
+        if (alpha) preserveCoverage(next, coverage);
+        current.swap(next);
+        w = nextW;
+        h = nextH;
+    }
+    return format;
+}
+
+}
@@ -0,0 +1,385 @@
+#pragma once
+
+#include "gl_counter.h"
+#include "texture_cache.h"
+#include "texture_compress.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Material textures: transcoded to BC1/BC5/BC7 through the on-disk cache on a
+// background thread, then made resident coarsest level first. A new texture
+// starts with its small tail levels and streams finer levels in through a ring
+// of pixel buffer objects, smallest pending level across all textures first.
+// When resident levels exceed the budget, the finest level of textures that
+// haven't been drawn for a while is dropped again.
+class TextureStreamer {
+public:
+    static const GLuint ALBEDO_UNIT = 9;
+    static const GLuint NORMAL_UNIT = 10;
+    // Scratch unit for uploads so the draw bindings stay untouched
+    static const GLuint UPLOAD_UNIT = 11;
+    static const uint32_t NO_TEXTURE = 0;
+    static const int STAGING_BUFFERS = 3;
+    static const size_t STAGING_BYTES = size_t(4) << 20;
+    // Levels this size and below go up with the texture itself
+    static const uint32_t TAIL_SIZE = 64;
+    // Frames without a bind() after which a texture's fine levels may be evicted
+    static const uint64_t IDLE_FRAMES = 120;
+
+    struct Stats {
+        size_t textures = 0;
+        size_t pending = 0;
+        size_t failed = 0;
+        size_t residentBytes = 0;
+        size_t fullBytes = 0;
+        size_t levelsStreamed = 0;
+        size_t levelsEvicted = 0;
+        size_t transcoded = 0;
+        size_t cached = 0;
+        double transcodeMs = 0.0;
+    };
+
+    TextureStreamer() = default;
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    ~TextureStreamer() {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        if (worker.joinable()) worker.join();
+    }
+
+    bool create(size_t budgetMegabytes) {
+        bool s3tc = GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+        bool bptc = GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+        if (!s3tc || !bptc) {
+            std::cout << "⚠️ Material textures need EXT_texture_compression_s3tc, EXT_texture_sRGB and BPTC"
+                         " (GL 4.2 or ARB_texture_compression_bptc); drawing material colours only" << std::endl;
+            return false;
+        }
+        budgetBytes = budgetMegabytes << 20;
+        if (GLEW_EXT_texture_filter_anisotropic) {
+            glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+            maxAnisotropy = std::min(maxAnisotropy, 8.0f);
+        }
+        glGenBuffers(STAGING_BUFFERS, staging);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        for (GLuint buffer : staging) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, STAGING_BYTES, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        worker = std::thread([this]() { transcodeLoop(); });
+        available = true;
+        std::cout << "🖼️ Textures: BC1/BC5/BC7 with streamed mips, " << budgetMegabytes << " MB budget" << std::endl;
+        return true;
+    }
+
+    bool isAvailable() const { return available; }
+
+    // Queues a source image for transcoding; the same source always maps to
+    // the same handle. Returns NO_TEXTURE for an empty path or when textures
+    // are unavailable.
+    uint32_t request(const std::string& path, const std::string& maskPath, TextureCompress::Kind kind) {
+        if (!available || path.empty()) return NO_TEXTURE;
+        std::string key = path + '\n' + maskPath + '\n' + std::to_string(uint32_t(kind));
+        auto found = handles.find(key);
+        if (found != handles.end()) return found->second;
+
+        uint32_t handle = uint32_t(entries.size()) + 1;
+        entries.emplace_back();
+        handles.emplace(key, handle);
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            jobs.push_back({handle, {path, maskPath, kind}});
+        }
+        jobReady.notify_one();
+        stats.pending++;
+        return handle;
+    }
+
+    // Once per frame on the GL thread: creates textures whose transcode has
+    // finished, evicts one idle fine level if over budget and streams levels in
+    void update() {
+        frame++;
+        if (!available) return;
+        createFinished();
+        evictIdle();
+        streamLevels();
+    }
+
+    // Returns false if the texture has no levels resident yet
+    bool bind(uint32_t handle, GLuint unit) {
+        if (handle == NO_TEXTURE) return false;
+        Entry& entry = entries[handle - 1];
+        if (!entry.texture) return false;
+        entry.lastUsed = frame;
+        GL_COUNT(glActiveTexture(GL_TEXTURE0 + unit));
+        GL_COUNT(glBindTexture(GL_TEXTURE_2D, entry.texture));
+        return true;
+    }
+
+    // BC7 colour maps carry alpha, so they are drawn alpha-tested
+    bool hasAlpha(uint32_t handle) const {
+        if (handle == NO_TEXTURE) return false;
+        const Entry& entry = entries[handle - 1];
+        return entry.texture && entry.data.format == TextureCompress::Format::BC7_SRGB;
+    }
+
+    const Stats& getStats() const { return stats; }
+
+    static void bindSamplers(GLuint program) {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "albedoMap"), ALBEDO_UNIT);
+        glUniform1i(glGetUniformLocation(program, "normalMap"), NORMAL_UNIT);
+    }
+
+private:
+    struct Job {
+        uint32_t handle;
+        TextureCache::Source source;
+    };
+
+    struct Finished {
+        uint32_t handle;
+        bool ok;
+        std::string error;
+        TextureCache::Texture data;
+        TextureCache::TranscodeStats transcode;
+    };
+
+    struct Entry {
+        TextureCache::Texture data;
+        GLuint texture = 0;
+        // Finest resident level, and the coarsest level that is always kept
+        int baseLevel = 0;
+        int tailLevel = 0;
+        size_t residentBytes = 0;
+        uint64_t lastUsed = 0;
+    };
+
+    bool available = false;
+    size_t budgetBytes = 0;
+    float maxAnisotropy = 1.0f;
+    uint64_t frame = 0;
+    std::deque<Entry> entries;
+    std::unordered_map<std::string, uint32_t> handles;
+    Stats stats;
+
+    GLuint staging[STAGING_BUFFERS] = {};
+    GLsync stagingFences[STAGING_BUFFERS] = {};
+    int nextStaging = 0;
+
+    std::thread worker;
+    std::mutex jobMutex;
+    std::condition_variable jobReady;
+    std::deque<Job> jobs;
+    bool stopping = false;
+    std::mutex finishedMutex;
+    std::deque<Finished> finished;
+
+    // One image at a time; each transcode already spreads its blocks over
+    // every core
+    void transcodeLoop() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(jobMutex);
+                jobReady.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            Finished result;
+            result.handle = job.handle;
+            result.ok = TextureCache::load(job.source, result.data, result.error, &result.transcode);
+            std::lock_guard<std::mutex> lock(finishedMutex);
+            finished.push_back(std::move(result));
+        }
+    }
+
+    static GLenum internalFormat(TextureCompress::Format format) {
+        switch (format) {
+        case TextureCompress::Format::BC1_SRGB: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        case TextureCompress::Format::BC5: return GL_COMPRESSED_RG_RGTC2;
+        case TextureCompress::Format::BC7_SRGB: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB;
+        }
+        return 0;
+    }
+
+    // Defines levels [first, levelCount) of a new texture object straight
+    // from the cache mapping, replacing the entry's previous texture
+    void buildTexture(Entry& entry, int first) {
+        if (entry.texture) glDeleteTextures(1, &entry.texture);
+        glGenTextures(1, &entry.texture);
+        glActiveTexture(GL_TEXTURE0 + UPLOAD_UNIT);
+        glBindTexture(GL_TEXTURE_2D, entry.texture);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        GLenum format = internalFormat(entry.data.format);
+        entry.residentBytes = 0;
+        for (int l = first; l < int(entry.data.levels.size()); ++l) {
+            const TextureCache::Texture::Level& level = entry.data.levels[l];
+            glCompressedTexImage2D(GL_TEXTURE_2D, l, format, GLsizei(level.width), GLsizei(level.height), 0,
+                                   GLsizei(level.bytes), level.data);
+            entry.residentBytes += level.bytes;
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, first);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(entry.data.levels.size()) - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        if (maxAnisotropy > 1.0f) glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy);
+        entry.baseLevel = first;
+    }
+
+    void createFinished() {
+        std::deque<Finished> ready;
+        {
+            std::lock_guard<std::mutex> lock(finishedMutex);
+            ready.swap(finished);
+        }
+        for (Finished& result : ready) {
+            stats.pending--;
+            if (!result.ok) {
+                stats.failed++;
+                std::cout << "⚠️ Texture skipped: " << result.error << std::endl;
+                continue;
+            }
+            (result.transcode.cached ? stats.cached : stats.transcoded)++;
+            stats.transcodeMs += result.transcode.decodeMs + result.transcode.compressMs;
+
+            Entry& entry = entries[result.handle - 1];
+            entry.data = std::move(result.data);
+            int tail = int(entry.data.levels.size()) - 1;
+            while (tail > 0 && std::max(entry.data.levels[tail - 1].width, entry.data.levels[tail - 1].height) <= TAIL_SIZE) {
+                tail--;
+            }
+            entry.tailLevel = tail;
+            entry.lastUsed = frame;
+            buildTexture(entry, tail);
+            stats.textures++;
+            stats.residentBytes += entry.residentBytes;
+            for (const TextureCache::Texture::Level& level : entry.data.levels) stats.fullBytes += level.bytes;
+
+            if (stats.pending == 0) {
+                std::cout << "🖼️ " << stats.textures << " textures ready (" << stats.transcoded << " transcoded, "
+                          << stats.cached << " from cache, " << stats.transcodeMs << " ms), "
+                          << stats.fullBytes / (1024 * 1024) << " MB with full mip chains" << std::endl;
+            }
+        }
+    }
+
+    // Over budget, the largest idle finest level is dropped. Dropping one means
+    // rebuilding the texture with synchronous uploads of its other levels, so
+    // at most one level goes per frame and a large overshoot drains over
+    // several frames instead of stalling one.
+    void evictIdle() {
+        if (stats.residentBytes <= budgetBytes) return;
+        Entry* victim = nullptr;
+        for (Entry& entry : entries) {
+            if (!entry.texture || entry.baseLevel >= entry.tailLevel || frame - entry.lastUsed <= IDLE_FRAMES) continue;
+            if (!victim || entry.data.levels[entry.baseLevel].bytes > victim->data.levels[victim->baseLevel].bytes) {
+                victim = &entry;
+            }
+        }
+        if (!victim) return;
+        stats.residentBytes -= victim->residentBytes;
+        buildTexture(*victim, victim->baseLevel + 1);
+        stats.residentBytes += victim->residentBytes;
+        stats.levelsEvicted++;
+    }
+
+    // Next finer level of every recently drawn texture, smallest first, as
+    // long as staging buffers are free and the budget allows
+    void streamLevels() {
+        std::vector<std::pair<size_t, Entry*>> wanted;
+        for (Entry& entry : entries) {
+            if (!entry.texture || entry.baseLevel == 0 || frame - entry.lastUsed > IDLE_FRAMES) continue;
+            wanted.push_back({entry.data.levels[entry.baseLevel - 1].bytes, &entry});
+        }
+        if (wanted.empty()) return;
+        std::sort(wanted.begin(), wanted.end(),
+                  [](const std::pair<size_t, Entry*>& a, const std::pair<size_t, Entry*>& b) { return a.first < b.first; });
+
+        GL_COUNT(glActiveTexture(GL_TEXTURE0 + UPLOAD_UNIT));
+        size_t projected = stats.residentBytes;
+        size_t next = 0;
+        for (int attempt = 0; attempt < STAGING_BUFFERS && next < wanted.size(); ++attempt) {
+            int slot = nextStaging;
+            if (stagingFences[slot]) {
+                GLenum status = GL_COUNT(glClientWaitSync(stagingFences[slot], 0, 0));
+                if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+                GL_COUNT(glDeleteSync(stagingFences[slot]));
+                stagingFences[slot] = nullptr;
+            }
+
+            // Levels bigger than a staging buffer go up from the mapping, one per frame
+            if (wanted[next].first > STAGING_BYTES) {
+                if (attempt == 0 && projected + wanted[next].first <= budgetBytes) {
+                    GL_COUNT(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+                    uploadLevel(*wanted[next].second, nullptr);
+                }
+                break;
+            }
+
+            GL_COUNT(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging[slot]));
+            uint8_t* mapped = static_cast<uint8_t*>(GL_COUNT(glMapBufferRange(
+                GL_PIXEL_UNPACK_BUFFER, 0, STAGING_BYTES, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT)));
+            if (!mapped) break;
+            size_t offset = 0;
+            std::vector<std::pair<Entry*, size_t>> placed;
+            while (next < wanted.size()) {
+                size_t bytes = wanted[next].first;
+                size_t aligned = (offset + 15) & ~size_t(15);
+                if (bytes > STAGING_BYTES || aligned + bytes > STAGING_BYTES) break;
+                if (projected + bytes > budgetBytes) {
+                    next = wanted.size();
+                    break;
+                }
+                Entry& entry = *wanted[next].second;
+                memcpy(mapped + aligned, entry.data.levels[entry.baseLevel - 1].data, bytes);
+                placed.push_back({&entry, aligned});
+                projected += bytes;
+                offset = aligned + bytes;
+                next++;
+            }
+            GL_COUNT(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+            for (const std::pair<Entry*, size_t>& p : placed) {
+                uploadLevel(*p.first, reinterpret_cast<const void*>(p.second));
+            }
+            if (placed.empty()) break;
+            stagingFences[slot] = GL_COUNT(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+            nextStaging = (nextStaging + 1) % STAGING_BUFFERS;
+        }
+        GL_COUNT(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+    }
+
+    // Defines the level above the entry's base from source (a PBO offset, or
+    // null to read the mapping directly) and makes it the new base
+    void uploadLevel(Entry& entry, const void* source) {
+        int l = entry.baseLevel - 1;
+        const TextureCache::Texture::Level& level = entry.data.levels[l];
+        GL_COUNT(glBindTexture(GL_TEXTURE_2D, entry.texture));
+        GL_COUNT(glCompressedTexImage2D(GL_TEXTURE_2D, l, internalFormat(entry.data.format), GLsizei(level.width),
+                                        GLsizei(level.height), 0, GLsizei(level.bytes), source ? source : level.data));
+        GL_COUNT(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, l));
+        entry.baseLevel = l;
+        entry.residentBytes += level.bytes;
+        stats.residentBytes += level.bytes;
+        stats.levelsStreamed++;
+    }
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "gl_counter.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <iostream>
+
+// CPU mirrors of the shader's std140 uniform blocks. Everything is vec4/mat4 so
+// the C++ layout matches std140 without manual padding; scalars ride in .w.
+namespace UniformBlocks {
+
+const GLuint FRAME_BINDING = 0;
+const GLuint MATERIAL_BINDING = 1;
+const int MATERIAL_COUNT = 4;
+
+// Lights themselves live in texture buffers (see light_clusters.h)
+struct FrameData {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;              // projection * view, once per frame
+    glm::vec4 camPosTime;                  // xyz camera position, w time
+    glm::vec4 clusterScale;                // xy tiles per pixel, zw log-depth to slice
+    glm::vec4 clusterDims;                 // xyz cluster grid size
+    glm::mat4 previousViewProjection;      // last frame's, unjittered (temporal mode)
+    glm::vec4 temporal;                    // xy projection jitter in NDC, z pattern phase, w pixels per shaded sample
+};
+static_assert(sizeof(FrameData) == 4 * 64 + 4 * 16, "FrameData must match std140");
+
+struct Material {
+    glm::vec4 scattering;                  // xyz scatteringCoeff, w scatteringDistance
+    glm::vec4 absorption;                  // xyz absorptionCoeff, w thickness
+    glm::vec4 internalColor;               // xyz internalColor, w roughness
+    glm::vec4 params;                      // x subsurfaceMix, y materialType
+};
+static_assert(sizeof(Material) == 64, "Material must match std140");
+
+// Skin, Marble, Wax, Jade
+const Material MATERIAL_PRESETS[MATERIAL_COUNT] = {
+    {glm::vec4(0.9f, 0.7f, 0.5f, 0.4f), glm::vec4(0.1f, 0.3f, 0.6f, 0.5f),
+     glm::vec4(1.0f, 0.6f, 0.4f, 0.4f), glm::vec4(0.9f, 0.0f, 0.0f, 0.0f)},
+    {glm::vec4(0.8f, 0.8f, 0.9f, 0.6f), glm::vec4(0.05f, 0.05f, 0.1f, 0.3f),
+     glm::vec4(0.9f, 0.9f, 1.0f, 0.2f), glm::vec4(0.7f, 1.0f, 0.0f, 0.0f)},
+    {glm::vec4(1.0f, 0.9f, 0.7f, 0.8f), glm::vec4(0.2f, 0.4f, 0.8f, 0.7f),
+     glm::vec4(1.0f, 0.8f, 0.6f, 0.6f), glm::vec4(0.95f, 2.0f, 0.0f, 0.0f)},
+    {glm::vec4(0.6f, 0.9f, 0.7f, 0.3f), glm::vec4(0.3f, 0.1f, 0.2f, 0.4f),
+     glm::vec4(0.7f, 1.0f, 0.8f, 0.3f), glm::vec4(0.8f, 3.0f, 0.0f, 0.0f)},
+};
+
+class UniformBuffer {
+public:
+    void create(GLuint binding, size_t bytes, const void* data, GLenum usage) {
+        size = bytes;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, bytes, data, usage);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // Orphans the previous contents so the driver doesn't stall on a buffer
+    // the GPU may still be reading from last frame.
+    void update(const void* data) {
+        GL_COUNT(glBindBuffer(GL_UNIFORM_BUFFER, buffer));
+        GL_COUNT(glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_STREAM_DRAW));
+        GL_COUNT(glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data));
+    }
+
+    void destroy() {
+        if (buffer) glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+private:
+    GLuint buffer = 0;
+    size_t size = 0;
+};
+
+inline bool bindBlock(GLuint program, const char* name, GLuint binding) {
+    GLuint index = glGetUniformBlockIndex(program, name);
+    if (index == GL_INVALID_INDEX) {
+        std::cerr << "❌ Uniform block " << name << " not found in shader" << std::endl;
+        return false;
+    }
+    glUniformBlockBinding(program, index, binding);
+    return true;
+}
+
+}
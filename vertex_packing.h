@@ -0,0 +1,79 @@
+#pragma once
+
+#include "mesh.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace VertexPacking {
+
+inline void computeBounds(const Vertex* vertices, size_t count, glm::vec3& boundsMin, glm::vec3& boundsMax) {
+    if (count == 0) {
+        boundsMin = boundsMax = glm::vec3(0.0f);
+        return;
+    }
+    boundsMin = boundsMax = vertices[0].Position;
+    for (size_t i = 1; i < count; ++i) {
+        boundsMin = glm::min(boundsMin, vertices[i].Position);
+        boundsMax = glm::max(boundsMax, vertices[i].Position);
+    }
+}
+
+// Flat axes get a unit extent so quantization never divides by zero
+inline glm::vec3 quantizationExtent(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    glm::vec3 extent = boundsMax - boundsMin;
+    for (int i = 0; i < 3; ++i) {
+        if (extent[i] <= 0.0f) extent[i] = 1.0f;
+    }
+    return extent;
+}
+
+// Maps normalized unorm16 attributes in [0,1] back to object space
+inline glm::mat4 decodeMatrix(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    glm::mat4 decode = glm::translate(glm::mat4(1.0f), boundsMin);
+    return glm::scale(decode, quantizationExtent(boundsMin, boundsMax));
+}
+
+inline glm::vec2 octEncode(glm::vec3 n) {
+    n /= (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f) {
+        e = glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                      (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+    }
+    return e;
+}
+
+inline void packVertices(const Vertex* vertices, size_t count, const glm::vec3& boundsMin,
+                         const glm::vec3& boundsMax, PackedVertex* out) {
+    glm::vec3 scale = 65535.0f / quantizationExtent(boundsMin, boundsMax);
+
+    for (size_t i = 0; i < count; ++i) {
+        const Vertex& v = vertices[i];
+        glm::vec3 q = glm::clamp((v.Position - boundsMin) * scale + 0.5f, 0.0f, 65535.0f);
+        out[i].Position[0] = uint16_t(q.x);
+        out[i].Position[1] = uint16_t(q.y);
+        out[i].Position[2] = uint16_t(q.z);
+        out[i].Position[3] = 0;
+
+        float len = glm::length(v.Normal);
+        glm::vec3 n = len > 0.0f ? v.Normal / len : glm::vec3(0.0f, 1.0f, 0.0f);
+        out[i].Normal = glm::packSnorm2x16(octEncode(n));
+        out[i].TexCoords = glm::packHalf2x16(v.TexCoords);
+    }
+}
+
+inline bool fitsShortIndices(size_t vertexCount) {
+    return vertexCount <= 65536;
+}
+
+// out must hold count indices; only valid when fitsShortIndices(vertexCount)
+inline void narrowIndices(const unsigned int* indices, size_t count, uint16_t* out) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = uint16_t(indices[i]);
+    }
+}
+
+}